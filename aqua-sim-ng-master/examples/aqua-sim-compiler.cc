@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/aqua-sim-ng-module.h"
+
+#include <iostream>
+
+/*
+ * Compile the text inputs Aqua-Sim can memory map or stream into their
+ * binary form:
+ *
+ *   --kind=route    static routing table (node:dst:nexthop per line), set
+ *                   ns3::AquaSimStaticRouting::RouteFile to the output
+ *   --kind=trace    channel trace (time temperature salinity noise per
+ *                   line), pass the output to AquaSimTraceReader::ReadFile
+ *   --kind=current  gridded current file, set
+ *                   ns3::AquaSimMobilityDrift::FieldFile to the output
+ *
+ *   ./waf --run "AquaSimCompiler --kind=route --input=routes.txt --output=routes.bin"
+ */
+
+using namespace ns3;
+
+int
+main (int argc, char *argv[])
+{
+  std::string kind;
+  std::string input;
+  std::string output;
+
+  CommandLine cmd;
+  cmd.AddValue ("kind", "Input kind: route, trace or current", kind);
+  cmd.AddValue ("input", "Text file to compile", input);
+  cmd.AddValue ("output", "Binary file to write", output);
+  cmd.Parse(argc,argv);
+
+  if (input.empty() || output.empty())
+    {
+      std::cerr << "Usage: AquaSimCompiler --kind=<route|trace|current> --input=<text file> --output=<binary file>\n";
+      return 1;
+    }
+
+  bool ok = false;
+  if (kind == "route")
+    ok = AquaSimStaticRouteFile::Compile(input, output);
+  else if (kind == "trace")
+    ok = AquaSimTraceReader::Compile(input, output);
+  else if (kind == "current")
+    ok = AquaSimCurrentField::Compile(input, output);
+  else
+    {
+      std::cerr << "Unknown kind '" << kind << "', expected route, trace or current\n";
+      return 1;
+    }
+
+  if (!ok)
+    {
+      std::cerr << "Failed to compile " << input << " into " << output << "\n";
+      return 1;
+    }
+
+  std::cout << "Wrote " << output;
+  if (kind == "route")
+    {
+      Ptr<AquaSimStaticRouteFile> file = AquaSimStaticRouteFile::Load(output);
+      uint32_t len;
+      file->Row(0, len);
+      std::cout << " (" << len << " destinations per node)";
+    }
+  std::cout << "\n";
+  return 0;
+}
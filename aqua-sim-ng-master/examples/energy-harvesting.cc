@@ -0,0 +1,226 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/aqua-sim-ng-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/log.h"
+#include "ns3/callback.h"
+
+#include <limits>
+#include <vector>
+
+/*
+ * EnergyHarvesting
+ *
+ * String topology, every node reports to the sink:
+ * N ---->  N  -----> N -----> N -----> S
+ *
+ * Compare network lifetime (first node running out of energy) and
+ * delivered bits per joule with and without tidal harvesting and the
+ * energy-aware duty cycle/power controller:
+ *
+ *   ./waf --run "EnergyHarvesting --harvest=0 --control=0"
+ *   ./waf --run "EnergyHarvesting --harvest=1 --control=1"
+ */
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("EnergyHarvesting");
+
+class EnergyExperiment
+{
+public:
+  EnergyExperiment();
+  void Run();
+  void RecvPacket(Ptr<Socket> socket);
+
+  double simStop; //seconds
+  int nodes;
+  double initialEnergy;
+  double peakHarvest;
+  bool harvest;
+  bool control;
+  uint32_t m_dataRate;
+  uint32_t m_packetSize;
+  uint64_t m_bytesTotal;
+};
+
+EnergyExperiment::EnergyExperiment() :
+  simStop(3*86400), nodes(4), initialEnergy(500), peakHarvest(0.02),
+  harvest(true), control(true), m_dataRate(8), m_packetSize(40),
+  m_bytesTotal(0)
+{
+}
+
+void
+EnergyExperiment::RecvPacket(Ptr<Socket> socket)
+{
+  Ptr<Packet> packet;
+  while ((packet = socket->Recv ()))
+    m_bytesTotal += packet->GetSize ();
+}
+
+void
+EnergyExperiment::Run()
+{
+  std::cout << "-----------Initializing simulation-----------\n";
+
+  NodeContainer nodesCon;
+  NodeContainer sinksCon;
+  nodesCon.Create(nodes);
+  sinksCon.Create(1);
+
+  PacketSocketHelper socketHelper;
+  socketHelper.Install(nodesCon);
+  socketHelper.Install(sinksCon);
+
+  AquaSimChannelHelper channel = AquaSimChannelHelper::Default();
+  AquaSimHelper asHelper = AquaSimHelper::Default();
+  asHelper.SetChannel(channel.Create());
+  asHelper.SetMac("ns3::AquaSimBroadcastMac");
+  asHelper.SetRouting("ns3::AquaSimRoutingDummy");
+  asHelper.SetEnergyModel("ns3::AquaSimEnergyModel",
+                          "InitialEnergy", DoubleValue(initialEnergy));
+
+  MobilityHelper mobility;
+  NetDeviceContainer devices;
+  Ptr<ListPositionAllocator> position = CreateObject<ListPositionAllocator> ();
+  Vector boundry = Vector(0,0,0);
+
+  std::vector<Ptr<AquaSimNetDevice> > asDevices;
+  for (int i = 0; i <= nodes; i++)
+    {
+      Ptr<Node> node = (i < nodes) ? nodesCon.Get(i) : sinksCon.Get(0);
+      Ptr<AquaSimNetDevice> newDevice = CreateObject<AquaSimNetDevice>();
+      position->Add(boundry);
+      devices.Add(asHelper.Create(node, newDevice));
+      asDevices.push_back(newDevice);
+      boundry.x += 100;
+    }
+
+  mobility.SetPositionAllocator(position);
+  mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+  mobility.Install(nodesCon);
+  mobility.Install(sinksCon);
+
+  /*
+   * Harvesting source and controller on every sensor node, the sink is
+   * assumed to be cabled.
+   */
+  std::vector<Ptr<AquaSimEnergyHarvester> > harvesters;
+  std::vector<Ptr<AquaSimEnergyController> > controllers;
+  std::vector<double> levels;
+  levels.push_back(0.330);
+  levels.push_back(0.660);
+  for (int i = 0; i < nodes; i++)
+    {
+      Ptr<AquaSimEnergyHarvester> harvester = 0;
+      if (harvest)
+        {
+          harvester = CreateObject<AquaSimEnergyHarvester>();
+          harvester->SetAttribute("PeakPower", DoubleValue(peakHarvest));
+          harvester->SetEnergyModel(asDevices[i]->EnergyModel());
+          Simulator::Schedule(Seconds(0), &AquaSimEnergyHarvester::Start, harvester);
+        }
+      if (control)
+        {
+          Ptr<AquaSimPhyCmn> phy = DynamicCast<AquaSimPhyCmn>(asDevices[i]->GetPhy());
+          if (phy != 0)
+            {
+              phy->SetPowerLevels(levels);
+              phy->SetPtLevel(levels.size() - 1);
+            }
+          Ptr<AquaSimEnergyController> controller = CreateObject<AquaSimEnergyController>();
+          controller->SetDevice(asDevices[i]);
+          controller->SetHarvester(harvester);
+          Simulator::Schedule(Seconds(1), &AquaSimEnergyController::Start, controller);
+          controllers.push_back(controller);
+        }
+      if (harvester != 0)
+        harvesters.push_back(harvester);
+    }
+
+  PacketSocketAddress socket;
+  socket.SetAllDevices();
+  socket.SetPhysicalAddress (devices.Get(nodes)->GetAddress());
+  socket.SetProtocol (0);
+
+  OnOffHelper app ("ns3::PacketSocketFactory", Address (socket));
+  app.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
+  app.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+  app.SetAttribute ("DataRate", DataRateValue (m_dataRate));
+  app.SetAttribute ("PacketSize", UintegerValue (m_packetSize));
+
+  ApplicationContainer apps = app.Install (nodesCon);
+  apps.Start (Seconds (0.5));
+  apps.Stop (Seconds (simStop));
+
+  TypeId psfid = TypeId::LookupByName ("ns3::PacketSocketFactory");
+  Ptr<Socket> sinkSocket = Socket::CreateSocket (sinksCon.Get(0), psfid);
+  sinkSocket->Bind (socket);
+  sinkSocket->SetRecvCallback (MakeCallback (&EnergyExperiment::RecvPacket, this));
+
+  std::cout << "-----------Running Simulation-----------\n";
+  Simulator::Stop(Seconds(simStop));
+  Simulator::Run();
+
+  std::cout << "-----------Printing Simulation Results-----------\n";
+  double lifetime = std::numeric_limits<double>::infinity();
+  double consumed = 0;
+  double harvested = 0;
+  for (int i = 0; i < nodes; i++)
+    {
+      Ptr<AquaSimEnergyModel> em = asDevices[i]->EnergyModel();
+      lifetime = std::min(lifetime, em->GetFirstDepletionTime());
+      consumed += em->GetTotalEnergyConsumption();
+      harvested += em->GetTotalEnergyHarvested();
+      std::cout << "Node " << i << ": left " << em->GetEnergy() << "J, consumed " <<
+        em->GetTotalEnergyConsumption() << "J, harvested " << em->GetTotalEnergyHarvested() << "J\n";
+    }
+  if (lifetime == std::numeric_limits<double>::infinity())
+    std::cout << "Network lifetime: > " << simStop << "s\n";
+  else
+    std::cout << "Network lifetime: " << lifetime << "s\n";
+  std::cout << "Delivered: " << m_bytesTotal*8 << " bits, consumed " << consumed <<
+    "J, harvested " << harvested << "J\n";
+  std::cout << "Delivered bits per joule: " << (consumed > 0 ? m_bytesTotal*8/consumed : 0) << "\n";
+
+  Simulator::Destroy();
+  std::cout << "End.\n";
+}
+
+int
+main (int argc, char *argv[])
+{
+  EnergyExperiment experiment;
+
+  CommandLine cmd;
+  cmd.AddValue ("simStop", "Length of simulation", experiment.simStop);
+  cmd.AddValue ("nodes", "Amount of regular underwater nodes", experiment.nodes);
+  cmd.AddValue ("initialEnergy", "Battery of every node (J)", experiment.initialEnergy);
+  cmd.AddValue ("peakHarvest", "Peak tidal harvest power (W)", experiment.peakHarvest);
+  cmd.AddValue ("harvest", "Harvest tidal energy", experiment.harvest);
+  cmd.AddValue ("control", "Energy-aware duty cycle and power control", experiment.control);
+  cmd.Parse(argc,argv);
+
+  experiment.Run();
+  return 0;
+}
@@ -0,0 +1,63 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/aqua-sim-ng-module.h"
+
+#include <iostream>
+
+/*
+ * Convert a binary event log written by AquaSimHelper::EnableBinary:
+ *
+ *   ./waf --run "EventLogDecoder --input=events.bin --output=events.csv"
+ *   ./waf --run "EventLogDecoder --input=events.bin --output=events --format=columnar"
+ *
+ * The columnar format writes one raw array per field (events.time,
+ * events.uid, ...) and their types to events.schema.
+ */
+
+using namespace ns3;
+
+int
+main (int argc, char *argv[])
+{
+  std::string input;
+  std::string output;
+  std::string format = "csv";
+
+  CommandLine cmd;
+  cmd.AddValue ("input", "Binary event log", input);
+  cmd.AddValue ("output", "CSV file or column file prefix to write", output);
+  cmd.AddValue ("format", "csv or columnar", format);
+  cmd.Parse(argc,argv);
+
+  if (input.empty() || output.empty() || (format != "csv" && format != "columnar"))
+    {
+      std::cerr << "Usage: EventLogDecoder --input=<event log> --output=<file> [--format=csv|columnar]\n";
+      return 1;
+    }
+
+  if (!AquaSimEventLog::Decode(input, output, format == "columnar"))
+    {
+      std::cerr << "Failed to decode " << input << " into " << output << "\n";
+      return 1;
+    }
+
+  std::cout << "Wrote " << output << "\n";
+  return 0;
+}
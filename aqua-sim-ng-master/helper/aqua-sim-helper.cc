@@ -50,6 +50,16 @@ static void AsciiPhyTxEvent (std::ostream *os, std::string context, Ptr<Packet>
   *os << "t " << Simulator::Now().GetSeconds() << " " << context << " " << *pkt << std::endl;
 }
 
+static void BinaryPhyRxEvent (Ptr<AquaSimEventLog> log, uint32_t nodeid, uint32_t deviceid, Ptr<Packet> pkt, double noise)
+{
+  log->Log(nodeid, deviceid, EL_PHY, EL_RX, pkt->GetUid(), pkt->GetSize(), noise);
+}
+
+static void BinaryPhyTxEvent (Ptr<AquaSimEventLog> log, uint32_t nodeid, uint32_t deviceid, Ptr<Packet> pkt, double noise)
+{
+  log->Log(nodeid, deviceid, EL_PHY, EL_TX, pkt->GetUid(), pkt->GetSize(), noise);
+}
+
 
 AquaSimChannelHelper::AquaSimChannelHelper()
 {
@@ -499,6 +509,59 @@ AquaSimHelper::EnableAsciiAll (std::ostream &os)
   EnableAscii(os, NodeContainer::GetGlobal());
 }
 
+void
+AquaSimHelper::EnableBinary (Ptr<AquaSimEventLog> log, uint32_t nodeid, uint32_t deviceid)
+{
+  std::ostringstream oss;
+
+  oss << "/NodeList/" << nodeid << "/DeviceList/" << deviceid << "/$ns3::AquaSimNetDevice/Phy/Rx";
+  Config::ConnectWithoutContext(oss.str(), MakeBoundCallback (&BinaryPhyRxEvent, log, nodeid, deviceid));
+
+  oss.str("");
+
+  oss << "/NodeList/" << nodeid << "/DeviceList/" << deviceid << "/$ns3::AquaSimNetDevice/Phy/Tx";
+  Config::ConnectWithoutContext(oss.str(), MakeBoundCallback (&BinaryPhyTxEvent, log, nodeid, deviceid));
+}
+
+void
+AquaSimHelper::EnableBinary (Ptr<AquaSimEventLog> log, NetDeviceContainer c)
+{
+  for (NetDeviceContainer::Iterator i = c.Begin(); i != c.End(); ++i) {
+    EnableBinary(log, (*i)->GetNode()->GetId(), (*i)->GetIfIndex());
+  }
+}
+
+void
+AquaSimHelper::EnableBinary (Ptr<AquaSimEventLog> log, NodeContainer n)
+{
+  NetDeviceContainer devs;
+  for (NodeContainer::Iterator i = n.Begin(); i != n.End(); ++i) {
+    Ptr<Node> node = *i;
+    for (uint32_t j =0; j < node->GetNDevices(); ++j) {
+      devs.Add (node->GetDevice(j));
+    }
+  }
+  EnableBinary(log,devs);
+}
+
+/*
+ * The returned log is closed (flushed) by Simulator::Destroy.
+ */
+Ptr<AquaSimEventLog>
+AquaSimHelper::EnableBinary (std::string filename, NodeContainer n)
+{
+  Ptr<AquaSimEventLog> log = Create<AquaSimEventLog>(filename);
+  EnableBinary(log, n);
+  Simulator::ScheduleDestroy(&AquaSimEventLog::Close, log);
+  return log;
+}
+
+Ptr<AquaSimEventLog>
+AquaSimHelper::EnableBinaryAll (std::string filename)
+{
+  return EnableBinary(filename, NodeContainer::GetGlobal());
+}
+
 uint64_t AssignStreams (NetDeviceContainer c, int64_t stream)
 {
   int64_t currentStream = stream;
@@ -24,6 +24,7 @@
 #include "ns3/attribute.h"
 #include "ns3/object-factory.h"
 #include "ns3/aqua-sim-channel.h"
+#include "ns3/aqua-sim-event-log.h"
 #include "ns3/net-device-container.h"
 #include "ns3/node-container.h"
 
@@ -160,6 +161,13 @@ public:
     static void EnableAscii (std::ostream &os, NodeContainer n);
     static void EnableAsciiAll (std::ostream &os);
 
+    /* binary phy event log, see AquaSimEventLog; much cheaper than ascii */
+    static void EnableBinary (Ptr<AquaSimEventLog> log, uint32_t nodeid, uint32_t deviceid);
+    static void EnableBinary (Ptr<AquaSimEventLog> log, NetDeviceContainer c);
+    static void EnableBinary (Ptr<AquaSimEventLog> log, NodeContainer n);
+    static Ptr<AquaSimEventLog> EnableBinary (std::string filename, NodeContainer n);
+    static Ptr<AquaSimEventLog> EnableBinaryAll (std::string filename);
+
     uint64_t AssignStreams (NetDeviceContainer c, int64_t stream);
 
 private:
@@ -0,0 +1,330 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AQUA_SIM_DUP_TABLE_H
+#define AQUA_SIM_DUP_TABLE_H
+
+#include "aqua-sim-address.h"
+#include "aqua-sim-datastructure.h"
+
+#include "ns3/node-list.h"
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Fixed capacity duplicate suppression table keyed by (source, sequence number)
+ *
+ * Records live inline in an open addressing (linear probing) array, so a
+ * lookup or insert never allocates once the table is set up. Every source
+ * keeps a sliding window of the last WindowSize sequence numbers as a
+ * bitmap; a record leaves the table when its sequence number falls out of
+ * the window, and sequence numbers behind the window count as duplicates.
+ * Sequence numbers must grow by one per packet of a source, a global
+ * counter such as the packet uid spreads every source over the whole
+ * window. When more than MaxSources sources are active the least recently
+ * heard one is forgotten; MaxSources 0 (the default) sizes the table for
+ * every node of the simulation. Storage is allocated on the first insert,
+ * unused tables cost nothing.
+ */
+template <class T>
+class AquaSimDupTable
+{
+public:
+  AquaSimDupTable(uint32_t maxSources = 0, uint32_t windowSize = WINDOW_SIZE)
+    : m_maxSources(maxSources), m_windowSize(windowSize), m_clock(0), m_size(0), m_nSources(0)
+  {
+    if (m_windowSize > 64) m_windowSize = 64;
+    if (m_windowSize == 0) m_windowSize = 1;
+  }
+
+  /* only takes effect on an empty table */
+  void SetCapacity(uint32_t maxSources, uint32_t windowSize)
+  {
+    Reset();
+    m_slots.clear();
+    m_sources.clear();
+    m_maxSources = maxSources;
+    m_windowSize = windowSize > 64 ? 64 : (windowSize == 0 ? 1 : windowSize);
+  }
+
+  T* Get(AquaSimAddress src, uint32_t seq)
+  {
+    if (m_slots.empty()) return NULL;
+    int i = FindSlot(src, seq);
+    return i < 0 ? NULL : &m_slots[i].value;
+  }
+
+  /*
+   * Returns the record of (src, seq), creating a value initialised one if
+   * needed. NULL if seq is already behind the source's window.
+   */
+  T* Insert(AquaSimAddress src, uint32_t seq, bool &isNew)
+  {
+    isNew = false;
+    if (m_slots.empty()) Allocate();
+
+    int s = FindSource(src);
+    if (s < 0) s = AddSource(src, seq);
+    SourceWindow &w = m_sources[s];
+    w.lastUse = ++m_clock;
+
+    if (seq > w.highest)
+      Slide(s, seq);
+    else if (w.highest - seq >= m_windowSize)
+      return NULL;
+
+    uint64_t bit = (uint64_t)1 << (w.highest - seq);
+    if (w.bitmap & bit)
+      return &m_slots[FindSlot(src, seq)].value;
+
+    uint32_t i = Home(src, seq);
+    while (m_slots[i].used)
+      i = (i + 1) & m_slotMask;
+    m_slots[i].used = true;
+    m_slots[i].src = src;
+    m_slots[i].seq = seq;
+    m_slots[i].value = T();
+    w.bitmap |= bit;
+    m_size++;
+    isNew = true;
+    return &m_slots[i].value;
+  }
+
+  /* stored, or too old to be told apart from a duplicate */
+  bool IsDuplicate(AquaSimAddress src, uint32_t seq)
+  {
+    if (m_slots.empty()) return false;
+    int s = FindSource(src);
+    if (s < 0) return false;
+    const SourceWindow &w = m_sources[s];
+    if (seq > w.highest) return false;
+    if (w.highest - seq >= m_windowSize) return true;
+    return (w.bitmap >> (w.highest - seq)) & 1;
+  }
+
+  void Erase(AquaSimAddress src, uint32_t seq)
+  {
+    if (m_slots.empty()) return;
+    int s = FindSource(src);
+    if (s < 0 || seq > m_sources[s].highest || m_sources[s].highest - seq >= m_windowSize)
+      return;
+    uint64_t bit = (uint64_t)1 << (m_sources[s].highest - seq);
+    if (!(m_sources[s].bitmap & bit)) return;
+    m_sources[s].bitmap &= ~bit;
+    EraseSlot(FindSlot(src, seq));
+  }
+
+  void Reset()
+  {
+    for (uint32_t i = 0; i < m_slots.size(); i++) {
+      m_slots[i].used = false;
+      m_slots[i].value = T();
+    }
+    for (uint32_t i = 0; i < m_sources.size(); i++)
+      m_sources[i].used = false;
+    m_size = 0;
+    m_nSources = 0;
+  }
+
+  uint32_t GetSize() const { return m_size; }
+
+private:
+  struct Slot {
+    bool used;
+    AquaSimAddress src;
+    uint32_t seq;
+    T value;
+    Slot() : used(false), seq(0), value() {}
+  };
+  struct SourceWindow {
+    bool used;
+    AquaSimAddress src;
+    uint32_t highest;
+    uint64_t bitmap;   //bit i: record of seq highest-i is stored
+    uint64_t lastUse;
+    SourceWindow() : used(false), highest(0), bitmap(0), lastUse(0) {}
+  };
+
+  static uint32_t Mix(uint32_t h)
+  {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+  }
+  uint32_t Home(AquaSimAddress src, uint32_t seq) const
+  {
+    return Mix(((uint32_t)src.GetAsInt() << 16) ^ seq ^ (seq >> 16) * 0x9e3779b1) & m_slotMask;
+  }
+  uint32_t SourceHome(AquaSimAddress src) const
+  {
+    return Mix(src.GetAsInt()) & m_sourceMask;
+  }
+
+  static uint32_t PowerOfTwo(uint32_t n)
+  {
+    uint32_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+  }
+
+  /* load factor at most 1/2 for both arrays */
+  void Allocate()
+  {
+    if (m_maxSources == 0)
+      m_maxSources = NodeList::GetNNodes() > 8 ? NodeList::GetNNodes() : 8;
+    m_slots.resize(PowerOfTwo(2 * m_maxSources * m_windowSize));
+    m_slotMask = m_slots.size() - 1;
+    m_sources.resize(PowerOfTwo(2 * m_maxSources));
+    m_sourceMask = m_sources.size() - 1;
+  }
+
+  int FindSlot(AquaSimAddress src, uint32_t seq) const
+  {
+    for (uint32_t i = Home(src, seq); m_slots[i].used; i = (i + 1) & m_slotMask) {
+      if (m_slots[i].seq == seq && m_slots[i].src == src)
+        return i;
+    }
+    return -1;
+  }
+
+  int FindSource(AquaSimAddress src) const
+  {
+    for (uint32_t i = SourceHome(src); m_sources[i].used; i = (i + 1) & m_sourceMask) {
+      if (m_sources[i].src == src)
+        return i;
+    }
+    return -1;
+  }
+
+  int AddSource(AquaSimAddress src, uint32_t seq)
+  {
+    if (m_nSources >= m_maxSources)
+      EvictSource();
+    uint32_t i = SourceHome(src);
+    while (m_sources[i].used)
+      i = (i + 1) & m_sourceMask;
+    m_sources[i].used = true;
+    m_sources[i].src = src;
+    m_sources[i].highest = seq;
+    m_sources[i].bitmap = 0;
+    m_nSources++;
+    return i;
+  }
+
+  /* rare: only when a new source shows up and the table is full */
+  void EvictSource()
+  {
+    int victim = -1;
+    for (uint32_t i = 0; i < m_sources.size(); i++) {
+      if (m_sources[i].used && (victim < 0 || m_sources[i].lastUse < m_sources[victim].lastUse))
+        victim = i;
+    }
+    if (victim < 0) return;
+    DropRecords(victim, m_sources[victim].bitmap);
+    EraseSource(victim);
+  }
+
+  void DropRecords(int s, uint64_t bits)
+  {
+    SourceWindow &w = m_sources[s];
+    for (uint32_t k = 0; bits != 0 && k < 64; k++, bits >>= 1) {
+      if (bits & 1)
+        EraseSlot(FindSlot(w.src, w.highest - k));
+    }
+  }
+
+  /* move the window up to seq, dropping the records that fall out of it */
+  void Slide(int s, uint32_t seq)
+  {
+    SourceWindow &w = m_sources[s];
+    uint32_t shift = seq - w.highest;
+    uint64_t keep = shift >= m_windowSize ? 0 :
+        (m_windowSize - shift >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << (m_windowSize - shift)) - 1));
+    DropRecords(s, w.bitmap & ~keep);
+    w.bitmap = shift >= 64 ? 0 : (w.bitmap & keep) << shift;
+    w.highest = seq;
+  }
+
+  /* backward shift deletion keeps probe chains intact without tombstones */
+  template <class E, class H>
+  static void ShiftDelete(std::vector<E> &v, uint32_t mask, uint32_t i, H home)
+  {
+    uint32_t j = i;
+    while (true) {
+      v[i].used = false;
+      while (true) {
+        j = (j + 1) & mask;
+        if (!v[j].used)
+          return;
+        uint32_t k = home(v[j]);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+          continue;
+        break;
+      }
+      v[i] = v[j];
+      i = j;
+    }
+  }
+
+  struct SlotHome {
+    const AquaSimDupTable *t;
+    uint32_t operator()(const Slot &e) const { return t->Home(e.src, e.seq); }
+  };
+  struct SourceSlotHome {
+    const AquaSimDupTable *t;
+    uint32_t operator()(const SourceWindow &e) const { return t->SourceHome(e.src); }
+  };
+
+  void EraseSlot(int i)
+  {
+    if (i < 0) return;
+    SlotHome h = {this};
+    ShiftDelete(m_slots, m_slotMask, i, h);
+    m_size--;
+  }
+
+  void EraseSource(int i)
+  {
+    SourceSlotHome h = {this};
+    ShiftDelete(m_sources, m_sourceMask, i, h);
+    m_nSources--;
+  }
+
+  std::vector<Slot> m_slots;
+  std::vector<SourceWindow> m_sources;
+  uint32_t m_slotMask;
+  uint32_t m_sourceMask;
+  uint32_t m_maxSources;
+  uint32_t m_windowSize;
+  uint64_t m_clock;
+  uint32_t m_size;
+  uint32_t m_nSources;
+};  // class AquaSimDupTable
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_DUP_TABLE_H */
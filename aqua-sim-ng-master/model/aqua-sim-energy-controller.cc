@@ -0,0 +1,188 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "aqua-sim-energy-controller.h"
+#include "aqua-sim-energy-harvester.h"
+#include "aqua-sim-net-device.h"
+#include "aqua-sim-phy-cmn.h"
+
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AquaSimEnergyController");
+NS_OBJECT_ENSURE_REGISTERED(AquaSimEnergyController);
+
+AquaSimEnergyController::AquaSimEnergyController() :
+  m_interval(Seconds(3600)), m_horizon(Seconds(86400)), m_cyclePeriod(Seconds(60)),
+  m_minDutyCycle(0.1), m_reserve(0.1), m_lastAwakeTime(0), m_lastAwakeEnergy(0),
+  m_dutyCycle(1), m_ptLevel(0)
+{
+}
+
+TypeId
+AquaSimEnergyController::GetTypeId(void)
+{
+  static TypeId tid = TypeId("ns3::AquaSimEnergyController")
+    .SetParent<Object>()
+    .AddConstructor<AquaSimEnergyController>()
+    .AddAttribute ("Interval", "Time between two budget plans.",
+      TimeValue (Seconds (3600)),
+      MakeTimeAccessor (&AquaSimEnergyController::m_interval),
+      MakeTimeChecker ())
+    .AddAttribute ("Horizon", "The energy budget has to last this long.",
+      TimeValue (Seconds (86400)),
+      MakeTimeAccessor (&AquaSimEnergyController::m_horizon),
+      MakeTimeChecker ())
+    .AddAttribute ("CyclePeriod", "Length of one sleep/wake cycle of the MAC.",
+      TimeValue (Seconds (60)),
+      MakeTimeAccessor (&AquaSimEnergyController::m_cyclePeriod),
+      MakeTimeChecker ())
+    .AddAttribute ("MinDutyCycle", "The MAC is never awake for less than this share of a cycle.",
+      DoubleValue (0.1),
+      MakeDoubleAccessor (&AquaSimEnergyController::m_minDutyCycle),
+      MakeDoubleChecker<double> (0, 1))
+    .AddAttribute ("Reserve", "Share of the initial energy kept out of the budget.",
+      DoubleValue (0.1),
+      MakeDoubleAccessor (&AquaSimEnergyController::m_reserve),
+      MakeDoubleChecker<double> (0, 1))
+    .AddTraceSource ("DutyCycle", "Share of each cycle the MAC is awake.",
+      MakeTraceSourceAccessor (&AquaSimEnergyController::m_dutyCycle),
+      "ns3::TracedValueCallback::Double")
+    .AddTraceSource ("PtLevel", "Transmission power level picked for the PHY.",
+      MakeTraceSourceAccessor (&AquaSimEnergyController::m_ptLevel),
+      "ns3::TracedValueCallback::Uint32")
+    ;
+  return tid;
+}
+
+void
+AquaSimEnergyController::SetDevice(Ptr<AquaSimNetDevice> device)
+{
+  m_device = device;
+}
+
+void
+AquaSimEnergyController::SetHarvester(Ptr<AquaSimEnergyHarvester> harvester)
+{
+  m_harvester = harvester;
+}
+
+void
+AquaSimEnergyController::Start()
+{
+  NS_LOG_FUNCTION(this);
+  NS_ASSERT(m_device != 0);
+  Plan();
+  CycleStart();
+}
+
+/*
+ * Pick the duty cycle the energy budget over the horizon sustains:
+ *   (d*awake + (1-d)*sleep) * horizon = budget
+ */
+void
+AquaSimEnergyController::Plan()
+{
+  Ptr<AquaSimEnergyModel> em = m_device->EnergyModel();
+  if (em == 0)
+    return;
+
+  double now = Simulator::Now().GetSeconds();
+  double horizon = m_horizon.GetSeconds();
+
+  double awakeTime = em->GetStateTime(NIDLE) + em->GetStateTime(SEND) + em->GetStateTime(RECV);
+  double awakeEnergy = em->GetStateEnergy(NIDLE) + em->GetStateEnergy(SEND) + em->GetStateEnergy(RECV);
+  double awakeP = em->GetIdlePower();
+  if (awakeTime > m_lastAwakeTime)
+    awakeP = (awakeEnergy - m_lastAwakeEnergy) / (awakeTime - m_lastAwakeTime);
+  m_lastAwakeTime = awakeTime;
+  m_lastAwakeEnergy = awakeEnergy;
+
+  double budget = em->GetEnergy() - m_reserve * em->GetInitialEnergy();
+  if (m_harvester != 0)
+    budget += m_harvester->GetEnergy(now, now + horizon);
+
+  double sleepP = em->GetSleepPower();
+  double duty = 1;
+  if (awakeP > sleepP && horizon > 0)
+    duty = (budget / horizon - sleepP) / (awakeP - sleepP);
+  m_dutyCycle = std::min(1.0, std::max(m_minDutyCycle, duty));
+
+  Ptr<AquaSimPhyCmn> phy = DynamicCast<AquaSimPhyCmn>(m_device->GetPhy());
+  if (phy != 0 && phy->GetPowerLevelCount() > 1)
+    {
+      uint32_t level = (uint32_t)std::floor(m_dutyCycle * (phy->GetPowerLevelCount() - 1) + 0.5);
+      if (level != phy->GetPtLevel())
+        phy->SetPtLevel(level);
+      m_ptLevel = level;
+    }
+
+  NS_LOG_INFO("Node " << m_device->GetNode()->GetId() << " budget " << budget <<
+      "J awake power " << awakeP << "W duty cycle " << m_dutyCycle <<
+      " power level " << m_ptLevel);
+
+  m_planEvent = Simulator::Schedule(m_interval, &AquaSimEnergyController::Plan, this);
+}
+
+void
+AquaSimEnergyController::CycleStart()
+{
+  Simulator::Cancel(m_sleepEvent);
+  if (!m_device->GetPhy()->IsPoweredOn())
+    m_device->GetMac()->PowerOn();
+
+  if (m_dutyCycle < 1)
+    m_sleepEvent = Simulator::Schedule(Seconds(m_dutyCycle * m_cyclePeriod.GetSeconds()),
+                                       &AquaSimEnergyController::CycleSleep, this);
+  m_cycleEvent = Simulator::Schedule(m_cyclePeriod, &AquaSimEnergyController::CycleStart, this);
+}
+
+/*
+ * End of the awake share: do not cut a frame in the air, retry shortly.
+ */
+void
+AquaSimEnergyController::CycleSleep()
+{
+  TransStatus status = m_device->GetTransmissionStatus();
+  if (status == SEND || status == RECV)
+    {
+      m_sleepEvent = Simulator::Schedule(Seconds(0.01 * m_cyclePeriod.GetSeconds()),
+                                         &AquaSimEnergyController::CycleSleep, this);
+      return;
+    }
+  if (m_device->GetPhy()->IsPoweredOn())
+    m_device->GetMac()->PowerOff();
+}
+
+void
+AquaSimEnergyController::DoDispose()
+{
+  Simulator::Cancel(m_planEvent);
+  Simulator::Cancel(m_cycleEvent);
+  Simulator::Cancel(m_sleepEvent);
+  m_device = 0;
+  m_harvester = 0;
+  Object::DoDispose();
+}
@@ -0,0 +1,84 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AQUA_SIM_ENERGY_CONTROLLER_H
+#define AQUA_SIM_ENERGY_CONTROLLER_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/traced-value.h"
+
+namespace ns3 {
+
+class AquaSimNetDevice;
+class AquaSimEnergyHarvester;
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Energy-aware duty cycling and transmission power control.
+ *
+ * Every Interval the controller predicts the energy it may spend over
+ * Horizon (stored energy above Reserve plus what the harvester will
+ * deliver) and the awake power measured by the energy model since the
+ * last plan. From these it picks the duty cycle the budget sustains; the
+ * MAC is powered on for that share of every CyclePeriod. The PHY power
+ * level follows the duty cycle, full power only with a full budget.
+ */
+class AquaSimEnergyController : public Object {
+public:
+  static TypeId GetTypeId(void);
+  AquaSimEnergyController();
+
+  void SetDevice(Ptr<AquaSimNetDevice> device);
+  void SetHarvester(Ptr<AquaSimEnergyHarvester> harvester);
+  void Start();
+
+  double GetDutyCycle() { return m_dutyCycle; }
+
+protected:
+  virtual void DoDispose();
+
+private:
+  void Plan();
+  void CycleStart();
+  void CycleSleep();
+
+  Ptr<AquaSimNetDevice> m_device;
+  Ptr<AquaSimEnergyHarvester> m_harvester;
+
+  Time m_interval;
+  Time m_horizon;
+  Time m_cyclePeriod;
+  double m_minDutyCycle;
+  double m_reserve;
+
+  double m_lastAwakeTime;  //awake residency at the last plan
+  double m_lastAwakeEnergy;
+  EventId m_planEvent;
+  EventId m_cycleEvent;
+  EventId m_sleepEvent;
+
+  TracedValue<double> m_dutyCycle;
+  TracedValue<uint32_t> m_ptLevel;
+};  // class AquaSimEnergyController
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_ENERGY_CONTROLLER_H */
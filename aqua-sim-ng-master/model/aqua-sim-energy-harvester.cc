@@ -0,0 +1,186 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "aqua-sim-energy-harvester.h"
+#include "aqua-sim-energy-model.h"
+
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include "ns3/enum.h"
+#include "ns3/string.h"
+#include "ns3/simulator.h"
+
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AquaSimEnergyHarvester");
+NS_OBJECT_ENSURE_REGISTERED(AquaSimEnergyHarvester);
+
+AquaSimEnergyHarvester::AquaSimEnergyHarvester() :
+  m_profile(TIDAL), m_peakPower(0.01), m_period(Seconds(44712)),
+  m_step(Seconds(600))
+{
+}
+
+TypeId
+AquaSimEnergyHarvester::GetTypeId(void)
+{
+  static TypeId tid = TypeId("ns3::AquaSimEnergyHarvester")
+    .SetParent<Object>()
+    .AddConstructor<AquaSimEnergyHarvester>()
+    .AddAttribute ("Profile", "Shape of the harvested power.",
+      EnumValue (TIDAL),
+      MakeEnumAccessor (&AquaSimEnergyHarvester::m_profile),
+      MakeEnumChecker (TIDAL, "Tidal",
+                       SOLAR, "Solar",
+                       TRACE, "Trace"))
+    .AddAttribute ("PeakPower", "Peak harvested power of the tidal/solar profile (W).",
+      DoubleValue (0.01),
+      MakeDoubleAccessor (&AquaSimEnergyHarvester::m_peakPower),
+      MakeDoubleChecker<double> (0))
+    .AddAttribute ("Period", "Period of the profile, 12.42h (M2 tide) by default, 24h for solar.",
+      TimeValue (Seconds (44712)),
+      MakeTimeAccessor (&AquaSimEnergyHarvester::m_period),
+      MakeTimeChecker (Seconds (1)))
+    .AddAttribute ("Step", "Time the tidal/solar power is held constant, at least 1s.",
+      TimeValue (Seconds (600)),
+      MakeTimeAccessor (&AquaSimEnergyHarvester::m_step),
+      MakeTimeChecker (Seconds (1)))
+    .AddAttribute ("TraceFile", "Harvest trace, one \"time power\" entry per line (Trace profile).",
+      StringValue (""),
+      MakeStringAccessor (&AquaSimEnergyHarvester::SetTraceFile,
+                          &AquaSimEnergyHarvester::GetTraceFile),
+      MakeStringChecker ())
+    ;
+  return tid;
+}
+
+void
+AquaSimEnergyHarvester::SetEnergyModel(Ptr<AquaSimEnergyModel> model)
+{
+  m_model = model;
+}
+
+void
+AquaSimEnergyHarvester::Start()
+{
+  NS_LOG_FUNCTION(this);
+  Simulator::Cancel(m_update);
+  Update();
+}
+
+void
+AquaSimEnergyHarvester::SetTraceFile(std::string filename)
+{
+  m_traceFile = filename;
+  m_trace.clear();
+  if (filename.empty())
+    return;
+
+  FILE* stream = fopen(filename.c_str(), "r");
+  if (stream == NULL)
+    NS_FATAL_ERROR("Cannot read harvest trace " << filename);
+  double t, p;
+  while (fscanf(stream, "%lf %lf", &t, &p) == 2)
+    m_trace.push_back(std::make_pair(t, p));
+  fclose(stream);
+  std::sort(m_trace.begin(), m_trace.end());
+  NS_LOG_INFO("Harvest trace " << filename << ": " << m_trace.size() << " entries");
+}
+
+std::string
+AquaSimEnergyHarvester::GetTraceFile() const
+{
+  return m_traceFile;
+}
+
+double
+AquaSimEnergyHarvester::GetPower(double t)
+{
+  if (m_profile == TRACE)
+    {
+      std::vector<std::pair<double,double> >::const_iterator it =
+        std::upper_bound(m_trace.begin(), m_trace.end(),
+                         std::make_pair(t, std::numeric_limits<double>::infinity()));
+      return (it == m_trace.begin()) ? 0 : (it-1)->second;
+    }
+
+  double step = m_step.GetSeconds();
+  double mid = (std::floor(t / step) + 0.5) * step;
+  double phase = 2 * M_PI * mid / m_period.GetSeconds();
+  if (m_profile == SOLAR)
+    return m_peakPower * std::max(0.0, std::sin(phase));
+  return m_peakPower * std::pow(std::fabs(std::sin(phase)), 3);
+}
+
+/**
+* next time after t the harvest power may change, infinite if never
+*/
+double
+AquaSimEnergyHarvester::NextChange(double t)
+{
+  if (m_profile == TRACE)
+    {
+      std::vector<std::pair<double,double> >::const_iterator it =
+        std::upper_bound(m_trace.begin(), m_trace.end(),
+                         std::make_pair(t, std::numeric_limits<double>::infinity()));
+      return (it == m_trace.end()) ? std::numeric_limits<double>::infinity() : it->first;
+    }
+  double step = m_step.GetSeconds();
+  if (m_peakPower == 0)
+    return std::numeric_limits<double>::infinity();
+  return (std::floor(t / step) + 1) * step;
+}
+
+double
+AquaSimEnergyHarvester::GetEnergy(double t0, double t1)
+{
+  double energy = 0;
+  for (double t = t0; t < t1; )
+    {
+      double next = std::min(NextChange(t + 1e-6), t1);
+      energy += GetPower(t + 1e-6) * (next - t);
+      t = next;
+    }
+  return energy;
+}
+
+void
+AquaSimEnergyHarvester::Update()
+{
+  //event times are rounded to ns, do not land just before the change
+  double now = Simulator::Now().GetSeconds();
+  if (m_model != 0)
+    m_model->SetHarvestPower(GetPower(now + 1e-6));
+
+  double next = NextChange(now + 1e-6);
+  if (next != std::numeric_limits<double>::infinity())
+    m_update = Simulator::Schedule(Seconds(std::max(0.0, next - now)), &AquaSimEnergyHarvester::Update, this);
+}
+
+void
+AquaSimEnergyHarvester::DoDispose()
+{
+  Simulator::Cancel(m_update);
+  m_model = 0;
+  Object::DoDispose();
+}
@@ -0,0 +1,83 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AQUA_SIM_ENERGY_HARVESTER_H
+#define AQUA_SIM_ENERGY_HARVESTER_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace ns3 {
+
+class AquaSimEnergyModel;
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Energy harvesting source feeding an AquaSimEnergyModel.
+ *
+ * The harvested power is piecewise constant: tidal and solar profiles are
+ * held for Step at the value of the middle of the step, a trace holds
+ * each "time power" entry until the next one. The energy model is only
+ * told when the power changes.
+ */
+class AquaSimEnergyHarvester : public Object {
+public:
+  enum Profile {
+    TIDAL,	// stream power, |sin|^3 of the tidal flow
+    SOLAR,	// daylight, positive half of a sine
+    TRACE
+  };
+
+  static TypeId GetTypeId(void);
+  AquaSimEnergyHarvester();
+
+  void SetEnergyModel(Ptr<AquaSimEnergyModel> model);
+  void Start();
+
+  double GetPower(double t);  //harvest power at time t (W)
+  double GetEnergy(double t0, double t1);  //energy harvested over [t0, t1)
+
+  void SetTraceFile(std::string filename);
+  std::string GetTraceFile() const;
+
+protected:
+  virtual void DoDispose();
+
+private:
+  void Update();
+  double NextChange(double t);
+
+  Ptr<AquaSimEnergyModel> m_model;
+  Profile m_profile;
+  double m_peakPower;
+  Time m_period;
+  Time m_step;
+  std::string m_traceFile;
+  std::vector<std::pair<double,double> > m_trace;  //(time, power), by time
+  EventId m_update;
+};  // class AquaSimEnergyHarvester
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_ENERGY_HARVESTER_H */
@@ -22,11 +22,16 @@
 #include "ns3/log.h"
 #include "ns3/pointer.h"
 #include "ns3/double.h"
+#include "ns3/simulator.h"
 
 #include "aqua-sim-energy-model.h"
 #include "aqua-sim-net-device.h"
 #include "aqua-sim-phy.h"
 
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
 // Aqua Sim Energy Model
 
 using namespace ns3;
@@ -46,11 +51,11 @@ AquaSimEnergyModel::GetTypeId()
       MakePointerChecker<AquaSimNetDevice>())
     .AddAttribute ("RxPower", "Rx power: power consumption for reception (W). Default is 0.395 (1.2W).",
       DoubleValue (0.395),
-      MakeDoubleAccessor (&AquaSimEnergyModel::m_rxP),
+      MakeDoubleAccessor (&AquaSimEnergyModel::SetRxPower),
       MakeDoubleChecker<double>())
     .AddAttribute ("TxPower", "Tx power: power consumption for transmission (W). Default is 0.660 (1.6W).",
       DoubleValue (0.660),
-      MakeDoubleAccessor (&AquaSimEnergyModel::m_txP),
+      MakeDoubleAccessor (&AquaSimEnergyModel::SetTxPower),
       MakeDoubleChecker<double>())
     .AddAttribute ("InitialEnergy", "Starting energy",
       DoubleValue (10000.0),
@@ -58,7 +63,11 @@ AquaSimEnergyModel::GetTypeId()
       MakeDoubleChecker<double>())
     .AddAttribute ("IdlePower", "Idle power: idle power consumption (W). Default is 0.0 (0.008W)",
       DoubleValue (0.008),
-      MakeDoubleAccessor (&AquaSimEnergyModel::m_idleP),
+      MakeDoubleAccessor (&AquaSimEnergyModel::SetIdlePower),
+      MakeDoubleChecker<double>())
+    .AddAttribute ("SleepPower", "Sleep power: power consumption while the radio is off (W). Default is 0.0",
+      DoubleValue (0.0),
+      MakeDoubleAccessor (&AquaSimEnergyModel::SetSleepPower),
       MakeDoubleChecker<double>())
     ;
   return tid;
@@ -70,9 +79,20 @@ AquaSimEnergyModel::AquaSimEnergyModel() :
     m_rxP(0.75),
     m_txP(2.0),
     m_idleP(0.008),
-    m_totalEnergyConsumption(0.0)
+    m_sleepP(0.0),
+    m_harvestP(0.0),
+    m_totalEnergyHarvested(0.0),
+    m_totalEnergyConsumption(0.0),
+    m_deliveredPkts(0),
+    m_baseState(NIDLE),
+    m_depleted(false),
+    m_depletionTime(std::numeric_limits<double>::infinity()),
+    m_firstDepletion(std::numeric_limits<double>::infinity())
 {
   //m_source = 0;
+  m_lastUpdate = Simulator::Now().GetSeconds();
+  for (int i = 0; i < AQUA_SIM_ENERGY_STATES; i++)
+    m_stateTime[i] = m_stateEnergy[i] = 0;
 }
 
 AquaSimEnergyModel::~AquaSimEnergyModel()
@@ -91,10 +111,202 @@ AquaSimEnergyModel::GetDevice() const
   return m_device;
 }
 
+/*
+ * Switch the state the radio rests in (NIDLE or SLEEP). Announced
+ * receptions and transmissions are cut short.
+ */
 void
 AquaSimEnergyModel::ChangeState(int newState)
 {
   NS_LOG_FUNCTION(this << newState);
+  NS_ASSERT(newState >= 0 && newState < AQUA_SIM_ENERGY_STATES);
+
+  Integrate(Simulator::Now().GetSeconds());
+  m_timeline.clear();
+  m_baseState = newState;
+  ScheduleDepletion();
+}
+
+/*
+ * The radio is in state for the next duration seconds. A transmission
+ * preempts whatever was announced (half duplex); a reception only extends
+ * the busy period past what is already announced.
+ */
+void
+AquaSimEnergyModel::SetStateFor(int state, double duration)
+{
+  NS_LOG_FUNCTION(this << state << duration);
+  NS_ASSERT(state >= 0 && state < AQUA_SIM_ENERGY_STATES);
+
+  double now = Simulator::Now().GetSeconds();
+  double end = now + duration;
+  Integrate(now);
+  if (state == RECV)
+    {
+      if (!m_timeline.empty() && m_timeline.back().first >= end)
+        return;
+    }
+  else
+    m_timeline.clear();
+  m_timeline.push_back(std::make_pair(end, state));
+  ScheduleDepletion();
+}
+
+double
+AquaSimEnergyModel::StatePower(int state) const
+{
+  switch (state) {
+    case SEND: return m_txP;
+    case RECV: return m_rxP;
+    case SLEEP: return m_sleepP;
+    default: return m_idleP;
+  }
+}
+
+/*
+ * Charge the timeline up to time t and keep the per state residency.
+ * Net power is constant along each piece, so clamping the stored energy
+ * to [0, capacity] at the end of a piece is exact.
+ */
+void
+AquaSimEnergyModel::Integrate(double t)
+{
+  while (m_lastUpdate < t)
+    {
+      int state = m_baseState;
+      double end = t;
+      if (!m_timeline.empty())
+        {
+          state = m_timeline.front().second;
+          end = std::min(t, m_timeline.front().first);
+        }
+      double dt = std::max(0.0, end - m_lastUpdate);
+      double harvested = dt * m_harvestP;
+      double dEng = std::min(dt * StatePower(state), m_energy + harvested);
+      double energy = std::min(m_energy + harvested - dEng, m_initialEnergy);
+      m_totalEnergyHarvested += energy - m_energy + dEng;
+      m_energy = energy;
+      m_totalEnergyConsumption += dEng;
+      m_stateTime[state] += dt;
+      m_stateEnergy[state] += dEng;
+      m_lastUpdate = std::max(m_lastUpdate, end);
+      if (!m_timeline.empty() && m_timeline.front().first <= m_lastUpdate)
+        m_timeline.pop_front();
+    }
+}
+
+/*
+ * Predict when the energy runs out along the timeline, infinite if never.
+ */
+double
+AquaSimEnergyModel::PredictDepletion()
+{
+  double t = Simulator::Now().GetSeconds();
+  double energy = m_energy;
+  double depletion = std::numeric_limits<double>::infinity();
+  std::deque<std::pair<double,int> >::const_iterator it = m_timeline.begin();
+  for (; it != m_timeline.end(); it++)
+    {
+      double dt = it->first - t;
+      if (dt <= 0)
+        continue;
+      double p = StatePower(it->second) - m_harvestP;
+      if (p > 0 && p * dt >= energy)
+        {
+          depletion = t + energy / p;
+          break;
+        }
+      energy = std::min(energy - p * dt, m_initialEnergy);
+      t = it->first;
+    }
+  if (it == m_timeline.end() && StatePower(m_baseState) > m_harvestP)
+    depletion = t + energy / (StatePower(m_baseState) - m_harvestP);
+  return depletion;
+}
+
+/*
+ * Keep one event at or before the predicted depletion. The prediction
+ * changes on every state change, but only one that moves it earlier needs
+ * a new event; a later one is picked up when the pending event fires.
+ */
+void
+AquaSimEnergyModel::ScheduleDepletion()
+{
+  if (m_depleted)
+    {
+      Simulator::Remove(m_depletionEvent);
+      return;
+    }
+
+  m_depletionTime = PredictDepletion();
+  if (m_depletionTime == std::numeric_limits<double>::infinity())
+    return;
+
+  Time delay = Seconds(std::max(0.0, m_depletionTime - Simulator::Now().GetSeconds()));
+  if (m_depletionEvent.IsRunning())
+    {
+      if (Simulator::GetDelayLeft(m_depletionEvent) <= delay)
+        return;
+      Simulator::Remove(m_depletionEvent);
+    }
+  m_depletionEvent = Simulator::Schedule(delay, &AquaSimEnergyModel::CheckDepletion, this);
+}
+
+/*
+ * The depletion event fired: deplete if the energy really runs out now,
+ * otherwise the prediction moved later and the event is set again.
+ */
+void
+AquaSimEnergyModel::CheckDepletion()
+{
+  Integrate(Simulator::Now().GetSeconds());
+  if (PredictDepletion() <= Simulator::Now().GetSeconds() + 1e-9)
+    Deplete();
+  else
+    ScheduleDepletion();
+}
+
+/*
+ * Harvest power changed: settle the old rate, revive a depleted node that
+ * gained energy and predict depletion with the new rate.
+ */
+void
+AquaSimEnergyModel::SetHarvestPower(double harvestP)
+{
+  NS_LOG_FUNCTION(this << harvestP);
+
+  Integrate(Simulator::Now().GetSeconds());
+  m_harvestP = std::max(0.0, harvestP);
+  if (m_depleted && m_energy > 0)
+    {
+      m_depleted = false;
+      HandleEnergyRecharged();
+    }
+  ScheduleDepletion();
+}
+
+double
+AquaSimEnergyModel::GetHarvestPower()
+{
+  return m_harvestP;
+}
+
+double
+AquaSimEnergyModel::GetTotalEnergyHarvested()
+{
+  Integrate(Simulator::Now().GetSeconds());
+  return m_totalEnergyHarvested;
+}
+
+void
+AquaSimEnergyModel::Deplete()
+{
+  Integrate(Simulator::Now().GetSeconds());
+  m_energy = 0.0;
+  m_depleted = true;
+  m_depletionTime = Simulator::Now().GetSeconds();
+  m_firstDepletion = std::min(m_firstDepletion, m_depletionTime);
+  HandleEnergyDepletion();
 }
 
 double
@@ -111,13 +323,15 @@ AquaSimEnergyModel::HandleEnergyDepletion(void)
   NS_LOG_DEBUG(this << "Energy is depleted on device " << m_device
 	  << ", calling AquaSimPhy::EnergyDeplete");
 
-  m_device->GetPhy()->EnergyDeplete();
+  if (m_device != 0)
+    m_device->GetPhy()->EnergyDeplete();
 }
 
 void
 AquaSimEnergyModel::HandleEnergyRecharged(void)
 {
-  //Not currently used.
+  NS_LOG_FUNCTION(this);
+  NS_LOG_DEBUG(this << "Energy is recharged on device " << m_device);
 }
 
 
@@ -132,6 +346,7 @@ AquaSimEnergyModel::GetCurrentA(void) const
 double
 AquaSimEnergyModel::GetTotalEnergyConsumption(void) const
 {
+  const_cast<AquaSimEnergyModel*>(this)->Integrate(Simulator::Now().GetSeconds());
   return m_totalEnergyConsumption;
 }
 
@@ -148,24 +363,44 @@ AquaSimEnergyModel::SetEnergySource(Ptr<EnergySource> source)
 void
 AquaSimEnergyModel::SetRxPower(double rxP)
 {
+  Integrate(Simulator::Now().GetSeconds());
   m_rxP = rxP;
+  ScheduleDepletion();
 }
 void
 AquaSimEnergyModel::SetTxPower(double txP)
 {
+  Integrate(Simulator::Now().GetSeconds());
   m_txP = txP;
+  ScheduleDepletion();
 }
 void
 AquaSimEnergyModel::SetIdlePower(double idleP)
 {
+  Integrate(Simulator::Now().GetSeconds());
   m_idleP = idleP;
+  ScheduleDepletion();
+}
+void
+AquaSimEnergyModel::SetSleepPower(double sleepP)
+{
+  Integrate(Simulator::Now().GetSeconds());
+  m_sleepP = sleepP;
+  ScheduleDepletion();
 }
 void
 AquaSimEnergyModel::SetEnergy(double energy)
 {
   NS_LOG_FUNCTION(this << energy);
 
-  m_energy = energy;
+  Integrate(Simulator::Now().GetSeconds());
+  m_energy = std::max(0.0, energy);
+  if (m_depleted && m_energy > 0)
+    {
+      m_depleted = false;
+      HandleEnergyRecharged();
+    }
+  ScheduleDepletion();
 }
 void
 AquaSimEnergyModel::SetInitialEnergy(double initialEnergy)
@@ -190,8 +425,14 @@ AquaSimEnergyModel::GetIdlePower()
   return m_idleP;
 }
 double
+AquaSimEnergyModel::GetSleepPower()
+{
+  return m_sleepP;
+}
+double
 AquaSimEnergyModel::GetEnergy()
 {
+  Integrate(Simulator::Now().GetSeconds());
   return m_energy;
 }
 double
@@ -200,74 +441,129 @@ AquaSimEnergyModel::GetInitialEnergy()
   return m_initialEnergy;
 }
 
+double
+AquaSimEnergyModel::GetStateTime(int state)
+{
+  NS_ASSERT(state >= 0 && state < AQUA_SIM_ENERGY_STATES);
+  Integrate(Simulator::Now().GetSeconds());
+  return m_stateTime[state];
+}
+
+double
+AquaSimEnergyModel::GetStateEnergy(int state)
+{
+  NS_ASSERT(state >= 0 && state < AQUA_SIM_ENERGY_STATES);
+  Integrate(Simulator::Now().GetSeconds());
+  return m_stateEnergy[state];
+}
+
+double
+AquaSimEnergyModel::GetDepletionTime()
+{
+  return m_depletionTime;
+}
+
+/*
+ * One line per device: seconds and joules spent in each state.
+ */
 void
-AquaSimEnergyModel::DecrIdleEnergy(double t)
+AquaSimEnergyModel::LogResidency()
 {
-  NS_LOG_FUNCTION(this << m_energy);
+  static const char *names[AQUA_SIM_ENERGY_STATES] = {"sleep", "idle", "tx", "rx"};
+
+  Integrate(Simulator::Now().GetSeconds());
+  std::ostringstream os;
+  for (int i = 0; i < AQUA_SIM_ENERGY_STATES; i++)
+    os << " " << names[i] << "=" << m_stateTime[i] << "s/" << m_stateEnergy[i] << "J";
+  NS_LOG_INFO("Energy residency" << os.str() << " left=" << m_energy << "J harvested=" <<
+      m_totalEnergyHarvested << "J" <<
+      (m_depleted ? " depleted@" : " depletes@") << m_depletionTime);
+}
 
-  double dEng = t * m_idleP;
-  if (m_energy <= dEng) {
+/*
+ * Lump charge of power over t seconds, booked to state (-1 for none).
+ */
+void
+AquaSimEnergyModel::Draw(int state, double t, double power)
+{
+  Integrate(Simulator::Now().GetSeconds());
+  double dEng = t * power;
+  if (m_energy <= dEng)
 	  m_energy = 0.0;
-	  HandleEnergyDepletion();
-  }
   else
 	  m_energy -= dEng;
 
   m_totalEnergyConsumption += dEng;
+  if (state >= 0)
+    {
+      m_stateTime[state] += t;
+      m_stateEnergy[state] += dEng;
+    }
+
+  if (m_energy <= 0.0 && !m_depleted)
+    {
+      Simulator::Remove(m_depletionEvent);
+      Deplete();
+    }
+  else
+    ScheduleDepletion();
+}
+
+void
+AquaSimEnergyModel::DecrIdleEnergy(double t)
+{
+  NS_LOG_FUNCTION(this << m_energy);
+  Draw(NIDLE, t, m_idleP);
 }
 
 void
 AquaSimEnergyModel::DecrRcvEnergy(double t)
 {
   NS_LOG_FUNCTION(this);
-
-  double dEng = t * m_rxP;
-  if (m_energy <= dEng) {
-	  m_energy = 0.0;
-	  HandleEnergyDepletion();
-  }
-  else
-	  m_energy -= dEng;
-
-  m_totalEnergyConsumption += dEng;
+  Draw(RECV, t, m_rxP);
 }
 
 void
 AquaSimEnergyModel::DecrTxEnergy(double t)
 {
   NS_LOG_FUNCTION(this);
-
-  double dEng = t * m_txP;
-  if (m_energy <= dEng) {
-	  m_energy = 0.0;
-	  HandleEnergyDepletion();
-  }
-  else
-	  m_energy -= dEng;
-
-  m_totalEnergyConsumption += dEng;
+  Draw(SEND, t, m_txP);
 }
 
 void
 AquaSimEnergyModel::DecrEnergy(double t, double decrEnergy)
 {
   NS_LOG_FUNCTION(this);
+  Draw(-1, t, decrEnergy);
+}
 
-  double dEng = t * decrEnergy;
-  if (m_energy <= dEng) {
-	  m_energy = 0.0;
-	  HandleEnergyDepletion();
-  }
-  else
-	  m_energy -= dEng;
+void
+AquaSimEnergyModel::NotifyPktDelivered()
+{
+  m_deliveredPkts++;
+}
 
-  m_totalEnergyConsumption += dEng;
+uint32_t
+AquaSimEnergyModel::GetDeliveredPkts()
+{
+  return m_deliveredPkts;
+}
+
+double
+AquaSimEnergyModel::GetEnergyPerDeliveredPkt()
+{
+  if (m_deliveredPkts == 0)
+    return 0.0;
+  return GetTotalEnergyConsumption() / m_deliveredPkts;
 }
 
 void
 AquaSimEnergyModel::DoDispose()
 {
   NS_LOG_FUNCTION(this);
+  LogResidency();
+  Simulator::Cancel(m_depletionEvent);
+  m_timeline.clear();
   m_device=0;
   m_source=0;
 }
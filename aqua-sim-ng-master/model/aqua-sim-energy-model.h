@@ -22,8 +22,12 @@
 #define AQUA_SIM_ENERGY_MODEL_H
 
 #include "ns3/device-energy-model.h"
+#include "ns3/event-id.h"
 //#include "aqua-sim-net-device.h"
 
+#include <deque>
+#include <utility>
+
 /*
 Aqua Sim Energy model
 Inherited from DeviceEnergyModel
@@ -33,6 +37,10 @@ This should be overloaded to match necessity.
 Base case is very similar to UAN's AcousticModemEnergyModel.
 */
 
+// radio states tracked by the energy timeline, indexed by TransStatus
+// (SLEEP, NIDLE, SEND, RECV)
+#define AQUA_SIM_ENERGY_STATES 4
+
 namespace ns3 {
 
 class AquaSimNetDevice;
@@ -41,6 +49,14 @@ class AquaSimNetDevice;
  * \ingroup aqua-sim-ng
  *
  * \brief Energy model class to assist in recording and keeping state of node's energy.
+ *
+ * The radio state is kept as a timeline: a base state (idle or sleep) and
+ * the receptions/transmissions the PHY has announced ahead of time. Power
+ * times residency is integrated only when the energy is asked for or the
+ * timeline changes, and the depletion instant is predicted from the
+ * timeline so that a single event fires exactly when energy runs out.
+ * A harvesting source feeds a piecewise constant harvest power, stored
+ * energy never exceeds the initial energy (battery capacity).
  */
 class AquaSimEnergyModel : public DeviceEnergyModel
 {
@@ -62,38 +78,77 @@ public:
   double GetTotalEnergyConsumption(void) const;
   void SetEnergySource(Ptr<EnergySource> source); //only called by DeviceEnergyModel helper...
 
+  ///State timeline, states are TransStatus values
+  void SetStateFor(int state, double duration);  //rx/tx for duration, then back to the base state
+  double GetStateTime(int state);
+  double GetStateEnergy(int state);
+  double GetDepletionTime(void);  //actual or predicted, infinite if never
+  bool IsDepleted(void) const { return m_depleted; }
+  double GetFirstDepletionTime(void) { return m_firstDepletion; }  //node lifetime, even if recharged later
+  ///Harvesting, power (W) holds until the next call
+  void SetHarvestPower(double harvestP);
+  double GetHarvestPower(void);
+  double GetTotalEnergyHarvested(void);
+  void LogResidency(void);
+
 
   //include callback if energy is <= 0.0 during decreasing... to call energy depleted on Phy using device...
   ///Initial energy setters or for resetting
   void SetRxPower(double rxP);
   void SetTxPower(double txP);
   void SetIdlePower(double idleP);
+  void SetSleepPower(double sleepP);
   void SetEnergy(double energy);
   void SetInitialEnergy(double initialEnergy);
   ///Energy getters
   double GetRxPower(void);
   double GetTxPower(void);
   double GetIdlePower(void);
+  double GetSleepPower(void);
   double GetEnergy(void);
   double GetInitialEnergy(void);
-  ///To be called after an event occurs
+  ///Lump charges outside the timeline
   void DecrIdleEnergy(double t);
   void DecrRcvEnergy(double t);
   void DecrTxEnergy(double t);
   void DecrEnergy(double t, double decrEnergy);  //allow user to specify energy decr value
-
-  /* TODO : Future work needs to incorporate total times in each state */
+  ///Delivery accounting, to be called by the MAC for every data packet handed up
+  void NotifyPktDelivered(void);
+  uint32_t GetDeliveredPkts(void);
+  double GetEnergyPerDeliveredPkt(void);  //J per delivered packet, 0 if none delivered
 
 protected:
   void DoDispose();
 
 private:
+  void Integrate(double t);
+  void Draw(int state, double t, double power);
+  double StatePower(int state) const;
+  double PredictDepletion(void);
+  void ScheduleDepletion(void);
+  void CheckDepletion(void);
+  void Deplete(void);
+
   double m_energy;
   double m_initialEnergy;
   double m_rxP,   // power consumption for reception (W)
          m_txP,   // power consumption for transmission (W)
-         m_idleP; // idle power consumption (W)
+         m_idleP, // idle power consumption (W)
+         m_sleepP,  // power consumption while the radio is off (W)
+         m_harvestP;  // power currently harvested (W)
+  double m_totalEnergyHarvested;
   double m_totalEnergyConsumption;	//if energy recharging where incorporated
+  uint32_t m_deliveredPkts;
+
+  double m_lastUpdate;  //energy is integrated up to this time
+  int m_baseState;
+  std::deque<std::pair<double,int> > m_timeline;  //(end, state) after m_lastUpdate
+  double m_stateTime[AQUA_SIM_ENERGY_STATES];
+  double m_stateEnergy[AQUA_SIM_ENERGY_STATES];
+  bool m_depleted;
+  double m_depletionTime;
+  double m_firstDepletion;
+  EventId m_depletionEvent;
 
   Ptr<AquaSimNetDevice> m_device;
   Ptr<EnergySource> m_source;
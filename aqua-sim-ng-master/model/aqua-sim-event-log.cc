@@ -0,0 +1,286 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "aqua-sim-event-log.h"
+
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("AquaSimEventLog");
+
+// last log and buffer used by this thread, saves the lookup per record
+static thread_local uint64_t t_serial = 0;
+static thread_local std::vector<AquaSimEventRecord> *t_buffer = NULL;
+
+static uint64_t s_nextSerial = 1;
+
+AquaSimEventLog::AquaSimEventLog(const std::string &filename, uint32_t bufferRecords) :
+  m_bufferRecords(bufferRecords > 0 ? bufferRecords : 1), m_serial(s_nextSerial++),
+  m_stop(false)
+{
+  m_file = fopen(filename.c_str(), "wb");
+  if (m_file == NULL)
+    NS_FATAL_ERROR("Cannot open event log " << filename);
+
+  FileHeader hdr;
+  hdr.magic = EL_FILE_MAGIC;
+  hdr.version = EL_FILE_VERSION;
+  hdr.recordSize = sizeof(AquaSimEventRecord);
+  hdr.reserved = 0;
+  fwrite(&hdr, sizeof(hdr), 1, m_file);
+
+  m_writer = Create<SystemThread> (MakeCallback (&AquaSimEventLog::Write, this));
+  m_writer->Start();
+}
+
+AquaSimEventLog::~AquaSimEventLog()
+{
+  Close();
+  std::map<SystemThread::ThreadId, RecordBuffer*>::iterator it = m_buffers.begin();
+  for (; it != m_buffers.end(); it++)
+    delete it->second;
+  if (t_serial == m_serial)
+    t_serial = 0;
+}
+
+AquaSimEventLog::RecordBuffer*
+AquaSimEventLog::ThreadBuffer()
+{
+  if (t_serial == m_serial)
+    return t_buffer;
+
+  CriticalSection cs(m_mutex);
+  RecordBuffer *&buf = m_buffers[SystemThread::Self()];
+  if (buf == NULL)
+    {
+      buf = new RecordBuffer();
+      buf->reserve(m_bufferRecords);
+    }
+  t_serial = m_serial;
+  t_buffer = buf;
+  return buf;
+}
+
+void
+AquaSimEventLog::Log(uint32_t node, uint16_t device, uint8_t layer, uint8_t event,
+                     uint64_t uid, uint32_t size, float value)
+{
+  RecordBuffer *buf = ThreadBuffer();
+  AquaSimEventRecord rec;
+  rec.time = Simulator::Now().GetNanoSeconds();
+  rec.uid = uid;
+  rec.node = node;
+  rec.size = size;
+  rec.layer = layer;
+  rec.event = event;
+  rec.device = device;
+  rec.value = value;
+  buf->push_back(rec);
+  if (buf->size() >= m_bufferRecords)
+    Submit(*buf);
+}
+
+/*
+ * Queue buf for the writer and give the caller an empty (recycled) one.
+ */
+void
+AquaSimEventLog::Submit(RecordBuffer &buf)
+{
+  if (buf.empty())
+    return;
+  {
+    CriticalSection cs(m_mutex);
+    m_queue.push_back(RecordBuffer());
+    m_queue.back().swap(buf);
+    if (!m_free.empty())
+      {
+        buf.swap(m_free.back());
+        m_free.pop_back();
+      }
+  }
+  if (buf.capacity() < m_bufferRecords)
+    buf.reserve(m_bufferRecords);
+  m_notEmpty.SetCondition(true);
+  m_notEmpty.Signal();
+}
+
+void
+AquaSimEventLog::Flush()
+{
+  std::vector<RecordBuffer*> buffers;
+  {
+    CriticalSection cs(m_mutex);
+    std::map<SystemThread::ThreadId, RecordBuffer*>::iterator it = m_buffers.begin();
+    for (; it != m_buffers.end(); it++)
+      buffers.push_back(it->second);
+  }
+  for (size_t i = 0; i < buffers.size(); i++)
+    Submit(*buffers[i]);
+}
+
+void
+AquaSimEventLog::Close()
+{
+  if (m_writer == 0)
+    return;
+  Flush();
+  {
+    CriticalSection cs(m_mutex);
+    m_stop = true;
+  }
+  m_notEmpty.SetCondition(true);
+  m_notEmpty.Signal();
+  m_writer->Join();
+  m_writer = 0;
+  fclose(m_file);
+  m_file = NULL;
+}
+
+/*
+ * Writer thread: appends queued buffers until closed and drained.
+ * Never touches the simulator.
+ */
+void
+AquaSimEventLog::Write()
+{
+  while (true)
+    {
+      RecordBuffer buf;
+      {
+        CriticalSection cs(m_mutex);
+        if (!m_queue.empty())
+          {
+            buf.swap(m_queue.front());
+            m_queue.pop_front();
+          }
+        else if (m_stop)
+          return;
+        else
+          m_notEmpty.SetCondition(false);  //set again by Submit/Close once queued
+      }
+      if (buf.empty())
+        {
+          m_notEmpty.TimedWait(1000000);
+          continue;
+        }
+      if (fwrite(&buf[0], sizeof(AquaSimEventRecord), buf.size(), m_file) != buf.size())
+        NS_LOG_WARN("Short write to event log");
+      buf.clear();
+      CriticalSection cs(m_mutex);
+      m_free.push_back(RecordBuffer());
+      m_free.back().swap(buf);
+    }
+}
+
+static const char*
+LayerName(uint8_t layer)
+{
+  static const char *names[] = {"phy", "mac", "routing", "app"};
+  return (layer < 4) ? names[layer] : "?";
+}
+
+static const char*
+EventName(uint8_t event)
+{
+  static const char *names[] = {"tx", "rx", "drop"};
+  return (event < 3) ? names[event] : "?";
+}
+
+/*
+ * Offline decoder: CSV to output, or with columnar one raw little endian
+ * array per field in output.<field> plus a schema in output.schema.
+ */
+bool
+AquaSimEventLog::Decode(const std::string &logFile, const std::string &output, bool columnar)
+{
+  FILE *in = fopen(logFile.c_str(), "rb");
+  if (in == NULL)
+    return false;
+  FileHeader hdr;
+  if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != EL_FILE_MAGIC ||
+      hdr.version != EL_FILE_VERSION || hdr.recordSize != sizeof(AquaSimEventRecord))
+    {
+      fclose(in);
+      return false;
+    }
+
+  static const char *fields[] = {"time", "uid", "node", "size", "layer", "event", "device", "value"};
+  static const char *types[] = {"int64", "uint64", "uint32", "uint32", "uint8", "uint8", "uint16", "float32"};
+  const int nFields = 8;
+  std::vector<FILE*> out;
+  bool ok = true;
+  if (columnar)
+    {
+      for (int i = 0; i < nFields && ok; i++)
+        {
+          out.push_back(fopen((output + "." + fields[i]).c_str(), "wb"));
+          ok = out.back() != NULL;
+        }
+      FILE *schema = ok ? fopen((output + ".schema").c_str(), "w") : NULL;
+      if (schema != NULL)
+        {
+          for (int i = 0; i < nFields; i++)
+            fprintf(schema, "%s %s\n", fields[i], types[i]);
+          fclose(schema);
+        }
+      else
+        ok = false;
+    }
+  else
+    {
+      out.push_back(fopen(output.c_str(), "w"));
+      ok = out.back() != NULL;
+      if (ok)
+        fprintf(out[0], "time,node,device,layer,event,uid,size,value\n");
+    }
+
+  std::vector<AquaSimEventRecord> recs(4096);
+  size_t n;
+  while (ok && (n = fread(&recs[0], sizeof(AquaSimEventRecord), recs.size(), in)) > 0)
+    {
+      for (size_t i = 0; i < n; i++)
+        {
+          const AquaSimEventRecord &r = recs[i];
+          if (!columnar)
+            {
+              fprintf(out[0], "%.9f,%u,%u,%s,%s,%llu,%u,%g\n", r.time / 1e9, r.node,
+                      (unsigned)r.device, LayerName(r.layer), EventName(r.event),
+                      (unsigned long long)r.uid, r.size, r.value);
+              continue;
+            }
+          fwrite(&r.time, sizeof(r.time), 1, out[0]);
+          fwrite(&r.uid, sizeof(r.uid), 1, out[1]);
+          fwrite(&r.node, sizeof(r.node), 1, out[2]);
+          fwrite(&r.size, sizeof(r.size), 1, out[3]);
+          fwrite(&r.layer, sizeof(r.layer), 1, out[4]);
+          fwrite(&r.event, sizeof(r.event), 1, out[5]);
+          fwrite(&r.device, sizeof(r.device), 1, out[6]);
+          fwrite(&r.value, sizeof(r.value), 1, out[7]);
+        }
+    }
+
+  fclose(in);
+  for (size_t i = 0; i < out.size(); i++)
+    if (out[i] != NULL && fclose(out[i]) != 0)
+      ok = false;
+  return ok;
+}
+
+}  // namespace ns3
@@ -0,0 +1,109 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AQUA_SIM_EVENT_LOG_H
+#define AQUA_SIM_EVENT_LOG_H
+
+#include "ns3/simple-ref-count.h"
+#include "ns3/ptr.h"
+#include "ns3/system-thread.h"
+#include "ns3/system-mutex.h"
+#include "ns3/system-condition.h"
+
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/*binary event log: header followed by AquaSimEventRecord entries*/
+#define EL_FILE_MAGIC 0x4C455341	// "ASEL"
+#define EL_FILE_VERSION 1
+
+enum AquaSimEventLayer { EL_PHY, EL_MAC, EL_ROUTING, EL_APP };
+enum AquaSimEventType { EL_TX, EL_RX, EL_DROP };
+
+/**
+ * \brief One logged event, 32 bytes.
+ */
+struct AquaSimEventRecord {
+  int64_t time;		// ns
+  uint64_t uid;		// packet uid
+  uint32_t node;
+  uint32_t size;	// bytes
+  uint8_t layer;
+  uint8_t event;
+  uint16_t device;
+  float value;		// event specific, noise for phy events
+};
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Binary per packet event log.
+ *
+ * Every thread fills its own buffer of fixed size records without
+ * locking; full buffers are handed to a writer thread that appends them
+ * to the file, so the simulation never waits on I/O or formats text.
+ * Records of different threads may interleave out of time order. Decode()
+ * turns a log into CSV or into one raw file per column.
+ */
+class AquaSimEventLog : public SimpleRefCount<AquaSimEventLog> {
+public:
+  AquaSimEventLog(const std::string &filename, uint32_t bufferRecords = 4096);
+  ~AquaSimEventLog();
+
+  void Log(uint32_t node, uint16_t device, uint8_t layer, uint8_t event,
+           uint64_t uid, uint32_t size, float value = 0);
+  void Flush();	// hand every buffer to the writer, call when no thread logs
+  void Close();
+
+  static bool Decode(const std::string &logFile, const std::string &output, bool columnar);
+
+private:
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+  };
+  typedef std::vector<AquaSimEventRecord> RecordBuffer;
+
+  RecordBuffer* ThreadBuffer();
+  void Submit(RecordBuffer &buf);
+  void Write();
+
+  FILE *m_file;
+  uint32_t m_bufferRecords;
+  uint64_t m_serial;	// tells logs apart in the per thread cache
+
+  // shared with the writer thread
+  std::map<SystemThread::ThreadId, RecordBuffer*> m_buffers;
+  std::deque<RecordBuffer> m_queue;
+  std::vector<RecordBuffer> m_free;
+  bool m_stop;
+  SystemMutex m_mutex;
+  SystemCondition m_notEmpty;
+  Ptr<SystemThread> m_writer;
+};  // class AquaSimEventLog
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_EVENT_LOG_H */
@@ -24,6 +24,7 @@
 
 #include "ns3/log.h"
 #include "ns3/buffer.h"
+#include "ns3/packet.h"
 
 using namespace ns3;
 
@@ -63,6 +64,17 @@ MacHeader::GetSerializedSize(void) const
   return (5);
 }
 
+uint8_t
+MacHeader::PeekDemuxPType(Ptr<const Packet> p, uint32_t offset)
+{
+  uint8_t buf[64];
+  uint32_t end = offset + 5;  //the type follows SA and DA
+  if (end > sizeof(buf) || end > p->GetSize())
+    return UWPTYPE_OTHER;
+  p->CopyData(buf, end);
+  return buf[end - 1];
+}
+
 void
 MacHeader::Serialize(Buffer::Iterator start) const
 {
@@ -627,7 +639,8 @@ CopeHeader::GetInstanceTypeId(void) const
 /*
  * SFamaHeader
  */
-SFamaHeader::SFamaHeader()
+SFamaHeader::SFamaHeader() :
+  m_pType(0), m_slotNum(0), m_pktNum(1)
 {
 }
 
@@ -653,6 +666,7 @@ SFamaHeader::GetSize(enum PacketType pType)
   if( pType == SFAMA_RTS || pType == SFAMA_CTS ) {
     pkt_size += sizeof(uint16_t)+1; //size of packet_type and slotnum
   }
+  pkt_size += 1; //size of pktnum
 
   return pkt_size;
 }
@@ -666,6 +680,11 @@ SFamaHeader::SetSlotNum(uint16_t slotNum)
 {
   m_slotNum = slotNum;
 }
+void
+SFamaHeader::SetPktNum(uint8_t pktNum)
+{
+  m_pktNum = pktNum;
+}
 uint8_t
 SFamaHeader::GetPType()
 {
@@ -676,17 +695,23 @@ SFamaHeader::GetSlotNum()
 {
   return m_slotNum;
 }
+uint8_t
+SFamaHeader::GetPktNum()
+{
+  return m_pktNum;
+}
 
 uint32_t
 SFamaHeader::GetSerializedSize(void) const
 {
-  return 1+2;
+  return 1+2+1;
 }
 void
 SFamaHeader::Serialize (Buffer::Iterator start) const
 {
   start.WriteU8 (m_pType);
   start.WriteU16 (m_slotNum);
+  start.WriteU8 (m_pktNum);
 }
 uint32_t
 SFamaHeader::Deserialize (Buffer::Iterator start)
@@ -694,6 +719,7 @@ SFamaHeader::Deserialize (Buffer::Iterator start)
   Buffer::Iterator i = start;
   m_pType = i.ReadU8();
   m_slotNum = i.ReadU16();
+  m_pktNum = i.ReadU8();
 
   return GetSerializedSize();
 }
@@ -708,7 +734,7 @@ SFamaHeader::Print (std::ostream &os) const
     case SFAMA_ACK: os << "SFAMA_ACK"; break;
     default: break;
   }
-  os << ", SlotNum=" << m_slotNum << "\n";
+  os << ", SlotNum=" << m_slotNum << ", PktNum=" << (int)m_pktNum << "\n";
 }
 TypeId
 SFamaHeader::GetInstanceTypeId(void) const
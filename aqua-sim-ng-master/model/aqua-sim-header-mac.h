@@ -27,6 +27,7 @@
 #include "ns3/header.h"
 //#include "ns3/nstime.h"
 #include "ns3/vector.h"
+#include "ns3/ptr.h"
 
 #include "aqua-sim-address.h"
 //#include "aqua-sim-routing-buffer.h"
@@ -34,6 +35,8 @@
 
 namespace ns3 {
 
+class Packet;
+
 /**
  * \ingroup aqua-sim-ng
  *
@@ -59,6 +62,12 @@ public:
   AquaSimAddress GetDA();
   uint8_t GetDemuxPType();
 
+  /*
+   * Read the demux type in place; offset is the size of the headers in
+   * front of the MacHeader. UWPTYPE_OTHER if p is too short.
+   */
+  static uint8_t PeekDemuxPType(Ptr<const Packet> p, uint32_t offset = 0);
+
   //inherited methods
   virtual uint32_t GetSerializedSize(void) const;
   virtual void Serialize (Buffer::Iterator start) const;
@@ -279,8 +288,10 @@ public:
 
   void SetPType(uint8_t pType);
   void SetSlotNum(uint16_t slotNum);
+  void SetPktNum(uint8_t pktNum);
   uint8_t GetPType();	//Remove Set/Get pType and go directly to public variable??
   uint16_t GetSlotNum();
+  uint8_t GetPktNum();
 
   //inherited methods
   virtual uint32_t GetSerializedSize(void) const;
@@ -293,6 +304,7 @@ private:
   //AquaSimAddress DA;
   uint8_t m_pType;
   uint16_t	m_slotNum;  //the number of slots required for transmitting the DATA packet
+  uint8_t m_pktNum;  //RTS: packets queued for the receiver, CTS: packets granted, ACK: packets received
 
 };  // class SFamaHeader
 
@@ -23,6 +23,9 @@
 #include "ns3/log.h"
 #include "ns3/buffer.h"
 
+#include <algorithm>
+#include <cmath>
+
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("DRoutingHeader");
@@ -658,3 +661,410 @@ DDOSHeader::SetRowIndex(uint32_t index)
 {
   m_index = index;
 }
+
+NS_OBJECT_ENSURE_REGISTERED(DDBRHeader);
+
+DDBRHeader::DDBRHeader() :
+  m_depth(0), m_hopCount(0), m_numCandidates(0)
+{
+}
+
+DDBRHeader::~DDBRHeader()
+{
+}
+
+TypeId
+DDBRHeader::GetTypeId()
+{
+  static TypeId tid = TypeId("ns3::DDBRHeader")
+    .SetParent<Header>()
+    .AddConstructor<DDBRHeader>()
+  ;
+  return tid;
+}
+
+uint32_t
+DDBRHeader::Deserialize(Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  m_prevHop = (AquaSimAddress) i.ReadU16();
+  m_depth = ((double) i.ReadU32()) / 1000.0;
+  m_hopCount = i.ReadU8();
+  m_numCandidates = std::min(i.ReadU8(), (uint8_t)DDBR_MAX_CANDIDATES);
+  for (uint8_t c = 0; c < m_numCandidates; c++)
+    m_candidates[c] = (AquaSimAddress) i.ReadU16();
+  return GetSerializedSize();
+}
+
+uint32_t
+DDBRHeader::GetSerializedSize(void) const
+{
+  return (2+4+1+1+2*m_numCandidates);
+}
+
+void
+DDBRHeader::Serialize(Buffer::Iterator start) const
+{
+  Buffer::Iterator i = start;
+  i.WriteU16(m_prevHop.GetAsInt());
+  i.WriteU32((uint32_t)(m_depth*1000.0 + 0.5));
+  i.WriteU8(m_hopCount);
+  i.WriteU8(m_numCandidates);
+  for (uint8_t c = 0; c < m_numCandidates; c++)
+    i.WriteU16(m_candidates[c].GetAsInt());
+}
+
+void
+DDBRHeader::Print(std::ostream &os) const
+{
+  os << "DDBR Header is: prevHopAddr=" << m_prevHop << " depth=" << m_depth <<
+    " hopCount=" << (int)m_hopCount << " candidates=";
+  for (uint8_t c = 0; c < m_numCandidates; c++)
+    os << m_candidates[c] << (c + 1 < m_numCandidates ? "," : "");
+  os << "\n";
+}
+
+TypeId
+DDBRHeader::GetInstanceTypeId(void) const
+{
+  return GetTypeId();
+}
+
+void
+DDBRHeader::SetPrevHop(AquaSimAddress prevHop)
+{
+  m_prevHop = prevHop;
+}
+
+void
+DDBRHeader::SetDepth(double depth)
+{
+  m_depth = depth;
+}
+
+void
+DDBRHeader::SetHopCount(uint8_t hopCount)
+{
+  m_hopCount = hopCount;
+}
+
+void
+DDBRHeader::ClearCandidates()
+{
+  m_numCandidates = 0;
+}
+
+bool
+DDBRHeader::AddCandidate(AquaSimAddress candidate)
+{
+  if (m_numCandidates == DDBR_MAX_CANDIDATES)
+    return false;
+  m_candidates[m_numCandidates++] = candidate;
+  return true;
+}
+
+AquaSimAddress
+DDBRHeader::GetPrevHop()
+{
+  return m_prevHop;
+}
+
+double
+DDBRHeader::GetDepth()
+{
+  return m_depth;
+}
+
+uint8_t
+DDBRHeader::GetHopCount()
+{
+  return m_hopCount;
+}
+
+uint8_t
+DDBRHeader::GetNumCandidates()
+{
+  return m_numCandidates;
+}
+
+AquaSimAddress
+DDBRHeader::GetCandidate(uint8_t i)
+{
+  return m_candidates[i];
+}
+
+int
+DDBRHeader::GetPriority(AquaSimAddress addr)
+{
+  for (uint8_t c = 0; c < m_numCandidates; c++)
+    if (m_candidates[c] == addr)
+      return c;
+  return -1;
+}
+
+NS_OBJECT_ENSURE_REGISTERED(GeoHeader);
+
+/*
+ * Coordinates go on the wire in millimetres as signed 32 bit integers,
+ * depths are negative.
+ */
+static void
+WriteGeoPosition(Buffer::Iterator &i, const Vector &v)
+{
+  i.WriteU32((uint32_t)(int32_t)std::floor(v.x*1000.0 + 0.5));
+  i.WriteU32((uint32_t)(int32_t)std::floor(v.y*1000.0 + 0.5));
+  i.WriteU32((uint32_t)(int32_t)std::floor(v.z*1000.0 + 0.5));
+}
+
+static Vector
+ReadGeoPosition(Buffer::Iterator &i)
+{
+  Vector v;
+  v.x = ((int32_t) i.ReadU32()) / 1000.0;
+  v.y = ((int32_t) i.ReadU32()) / 1000.0;
+  v.z = ((int32_t) i.ReadU32()) / 1000.0;
+  return v;
+}
+
+GeoHeader::GeoHeader() :
+  m_messType(GEOH_DATA), m_mode(GEOH_GREEDY), m_hopCount(0), m_pkNum(0)
+{
+}
+
+GeoHeader::~GeoHeader()
+{
+}
+
+TypeId
+GeoHeader::GetTypeId()
+{
+  static TypeId tid = TypeId("ns3::GeoHeader")
+    .SetParent<Header>()
+    .AddConstructor<GeoHeader>()
+  ;
+  return tid;
+}
+
+uint32_t
+GeoHeader::Deserialize(Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  m_messType = i.ReadU8();
+  m_prevHop = (AquaSimAddress) i.ReadU16();
+  m_prevPos = ReadGeoPosition(i);
+  if (m_messType == GEOH_BEACON)
+    return GetSerializedSize();
+
+  m_mode = i.ReadU8();
+  m_hopCount = i.ReadU8();
+  m_pkNum = i.ReadU32();
+  m_source = (AquaSimAddress) i.ReadU16();
+  m_target = (AquaSimAddress) i.ReadU16();
+  m_targetPos = ReadGeoPosition(i);
+  m_entryPos = ReadGeoPosition(i);
+  m_facePos = ReadGeoPosition(i);
+  m_e0From = (AquaSimAddress) i.ReadU16();
+  m_e0To = (AquaSimAddress) i.ReadU16();
+  return GetSerializedSize();
+}
+
+uint32_t
+GeoHeader::GetSerializedSize(void) const
+{
+  if (m_messType == GEOH_BEACON)
+    return (1+2+12);
+  return (1+2+12+1+1+4+2+2+36+2+2);
+}
+
+void
+GeoHeader::Serialize(Buffer::Iterator start) const
+{
+  Buffer::Iterator i = start;
+  i.WriteU8(m_messType);
+  i.WriteU16(m_prevHop.GetAsInt());
+  WriteGeoPosition(i, m_prevPos);
+  if (m_messType == GEOH_BEACON)
+    return;
+
+  i.WriteU8(m_mode);
+  i.WriteU8(m_hopCount);
+  i.WriteU32(m_pkNum);
+  i.WriteU16(m_source.GetAsInt());
+  i.WriteU16(m_target.GetAsInt());
+  WriteGeoPosition(i, m_targetPos);
+  WriteGeoPosition(i, m_entryPos);
+  WriteGeoPosition(i, m_facePos);
+  i.WriteU16(m_e0From.GetAsInt());
+  i.WriteU16(m_e0To.GetAsInt());
+}
+
+void
+GeoHeader::Print(std::ostream &os) const
+{
+  os << "Geo Header is: messType=" << (m_messType == GEOH_BEACON ? "BEACON" : "DATA") <<
+    " prevHop=" << m_prevHop << " prevPos=" << m_prevPos;
+  if (m_messType != GEOH_BEACON)
+    os << " mode=" << (m_mode == GEOH_FACE ? "FACE" : "GREEDY") <<
+      " hopCount=" << (int)m_hopCount << " pkNum=" << m_pkNum <<
+      " source=" << m_source << " target=" << m_target <<
+      " targetPos=" << m_targetPos << " Lp=" << m_entryPos << " Lf=" << m_facePos <<
+      " e0=" << m_e0From << "->" << m_e0To;
+  os << "\n";
+}
+
+TypeId
+GeoHeader::GetInstanceTypeId(void) const
+{
+  return GetTypeId();
+}
+
+void
+GeoHeader::SetMessType(uint8_t messType)
+{
+  m_messType = messType;
+}
+
+void
+GeoHeader::SetMode(uint8_t mode)
+{
+  m_mode = mode;
+}
+
+void
+GeoHeader::SetHopCount(uint8_t hopCount)
+{
+  m_hopCount = hopCount;
+}
+
+void
+GeoHeader::SetPkNum(uint32_t pkNum)
+{
+  m_pkNum = pkNum;
+}
+
+void
+GeoHeader::SetSource(AquaSimAddress source)
+{
+  m_source = source;
+}
+
+void
+GeoHeader::SetTarget(AquaSimAddress target)
+{
+  m_target = target;
+}
+
+void
+GeoHeader::SetPrevHop(AquaSimAddress prevHop)
+{
+  m_prevHop = prevHop;
+}
+
+void
+GeoHeader::SetPrevPosition(Vector position)
+{
+  m_prevPos = position;
+}
+
+void
+GeoHeader::SetTargetPosition(Vector position)
+{
+  m_targetPos = position;
+}
+
+void
+GeoHeader::SetEntryPosition(Vector position)
+{
+  m_entryPos = position;
+}
+
+void
+GeoHeader::SetFacePosition(Vector position)
+{
+  m_facePos = position;
+}
+
+void
+GeoHeader::SetFirstEdge(AquaSimAddress from, AquaSimAddress to)
+{
+  m_e0From = from;
+  m_e0To = to;
+}
+
+uint8_t
+GeoHeader::GetMessType()
+{
+  return m_messType;
+}
+
+uint8_t
+GeoHeader::GetMode()
+{
+  return m_mode;
+}
+
+uint8_t
+GeoHeader::GetHopCount()
+{
+  return m_hopCount;
+}
+
+uint32_t
+GeoHeader::GetPkNum()
+{
+  return m_pkNum;
+}
+
+AquaSimAddress
+GeoHeader::GetSource()
+{
+  return m_source;
+}
+
+AquaSimAddress
+GeoHeader::GetTarget()
+{
+  return m_target;
+}
+
+AquaSimAddress
+GeoHeader::GetPrevHop()
+{
+  return m_prevHop;
+}
+
+Vector
+GeoHeader::GetPrevPosition()
+{
+  return m_prevPos;
+}
+
+Vector
+GeoHeader::GetTargetPosition()
+{
+  return m_targetPos;
+}
+
+Vector
+GeoHeader::GetEntryPosition()
+{
+  return m_entryPos;
+}
+
+Vector
+GeoHeader::GetFacePosition()
+{
+  return m_facePos;
+}
+
+AquaSimAddress
+GeoHeader::GetFirstEdgeFrom()
+{
+  return m_e0From;
+}
+
+AquaSimAddress
+GeoHeader::GetFirstEdgeTo()
+{
+  return m_e0To;
+}
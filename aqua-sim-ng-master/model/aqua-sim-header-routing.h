@@ -36,6 +36,14 @@
 #define	DBRH_DATA_RECOVER	1
 #define	DBRH_BEACON	    	2
 
+#define DDBR_MAX_CANDIDATES	4
+
+#define	GEOH_DATA	0
+#define	GEOH_BEACON	1
+
+#define	GEOH_GREEDY	0
+#define	GEOH_FACE	1
+
 namespace ns3 {
 
  /**
@@ -224,6 +232,118 @@ private:
 
 };  // class DDOSHeader
 
+ /**
+  * \brief DDBR opportunistic forwarding header
+  *
+  * Carries the depth of the last hop and the forwarding candidates it chose,
+  * highest priority first.
+  */
+class DDBRHeader : public Header
+{
+public:
+  DDBRHeader();
+  virtual ~DDBRHeader();
+  static TypeId GetTypeId();
+
+  //Setters
+  void SetPrevHop(AquaSimAddress prevHop);
+  void SetDepth(double depth);
+  void SetHopCount(uint8_t hopCount);
+  void ClearCandidates();
+  bool AddCandidate(AquaSimAddress candidate);
+
+  //Getters
+  AquaSimAddress GetPrevHop();
+  double GetDepth();
+  uint8_t GetHopCount();
+  uint8_t GetNumCandidates();
+  AquaSimAddress GetCandidate(uint8_t i);
+  // priority of addr in the candidate list, -1 if it is not a candidate
+  int GetPriority(AquaSimAddress addr);
+
+  //inherited methods
+  virtual uint32_t GetSerializedSize(void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+  virtual TypeId GetInstanceTypeId(void) const;
+
+private:
+  AquaSimAddress m_prevHop;	// the sender
+  double m_depth;		// the depth of last hop
+  uint8_t m_hopCount;
+  uint8_t m_numCandidates;
+  AquaSimAddress m_candidates[DDBR_MAX_CANDIDATES];
+};  // class DDBRHeader
+
+ /**
+  * \brief Geographic routing header
+  *
+  * Every packet piggybacks the position of the node that sent it. Data
+  * packets also carry the destination position and, while routed around a
+  * void, the face routing state: where recovery started (Lp), the closest
+  * point to the destination found on the current face (Lf) and the first
+  * edge taken on that face. Beacons only carry the sender and its position.
+  */
+class GeoHeader : public Header
+{
+public:
+  GeoHeader();
+  virtual ~GeoHeader();
+  static TypeId GetTypeId();
+
+  //Setters
+  void SetMessType(uint8_t messType);
+  void SetMode(uint8_t mode);
+  void SetHopCount(uint8_t hopCount);
+  void SetPkNum(uint32_t pkNum);
+  void SetSource(AquaSimAddress source);
+  void SetTarget(AquaSimAddress target);
+  void SetPrevHop(AquaSimAddress prevHop);
+  void SetPrevPosition(Vector position);
+  void SetTargetPosition(Vector position);
+  void SetEntryPosition(Vector position);
+  void SetFacePosition(Vector position);
+  void SetFirstEdge(AquaSimAddress from, AquaSimAddress to);
+
+  //Getters
+  uint8_t GetMessType();
+  uint8_t GetMode();
+  uint8_t GetHopCount();
+  uint32_t GetPkNum();
+  AquaSimAddress GetSource();
+  AquaSimAddress GetTarget();
+  AquaSimAddress GetPrevHop();
+  Vector GetPrevPosition();
+  Vector GetTargetPosition();
+  Vector GetEntryPosition();
+  Vector GetFacePosition();
+  AquaSimAddress GetFirstEdgeFrom();
+  AquaSimAddress GetFirstEdgeTo();
+
+  //inherited methods
+  virtual uint32_t GetSerializedSize(void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+  virtual TypeId GetInstanceTypeId(void) const;
+
+private:
+  uint8_t m_messType;
+  uint8_t m_mode;		// greedy or face
+  uint8_t m_hopCount;
+  uint32_t m_pkNum;		// per source sequence number
+  AquaSimAddress m_source;
+  AquaSimAddress m_target;
+  AquaSimAddress m_prevHop;
+  Vector m_prevPos;
+  Vector m_targetPos;
+  Vector m_entryPos;		// Lp
+  Vector m_facePos;		// Lf
+  AquaSimAddress m_e0From;	// first edge on the current face
+  AquaSimAddress m_e0To;
+};  // class GeoHeader
+
 }  // namespace ns3
 
 #endif /* AQUA_SIM_HEADER_ROUTING_H */
@@ -24,6 +24,7 @@
 #include "ns3/buffer.h"
 #include "ns3/log.h"
 #include "ns3/address-utils.h"
+#include "ns3/packet.h"
 
 #include <iostream>
 #include <bitset>
@@ -38,8 +39,17 @@ using namespace ns3;
 NS_LOG_COMPONENT_DEFINE("AquaSimHeader");
 NS_OBJECT_ENSURE_REGISTERED(AquaSimHeader);
 
+/*
+ * Wire format: one flags byte (direction in bits 0-1, error flag in bit 2)
+ * followed by LEB128 varints for size, forwards, next hop, source,
+ * destination, uid, tx time (ms) and timestamp (ms). Small values, the
+ * common case, take a single byte each.
+ */
+#define ASH_DIRECTION_MASK 0x03
+#define ASH_ERROR_FLAG 0x04
+
 AquaSimHeader::AquaSimHeader(void) :
-    m_txTime(0), m_direction(DOWN),
+    m_serializedSize(0), m_txTime(0), m_direction(DOWN),
     m_numForwards(0), m_errorFlag(0), m_uId(-1),
     m_size(0), m_timestamp(0)
 {
@@ -73,51 +83,117 @@ AquaSimHeader::GetInstanceTypeId(void) const
   return GetTypeId();
 }
 
+uint32_t
+AquaSimHeader::VarIntSize(uint32_t v)
+{
+  uint32_t n = 1;
+  while (v >= 0x80)
+    {
+      v >>= 7;
+      n++;
+    }
+  return n;
+}
+
+void
+AquaSimHeader::WriteVarInt(Buffer::Iterator &i, uint32_t v)
+{
+  while (v >= 0x80)
+    {
+      i.WriteU8((uint8_t)(v | 0x80));
+      v >>= 7;
+    }
+  i.WriteU8((uint8_t)v);
+}
+
+uint32_t
+AquaSimHeader::ReadVarInt(Buffer::Iterator &i)
+{
+  uint32_t v = 0;
+  uint8_t byte;
+  int shift = 0;
+  do
+    {
+      byte = i.ReadU8();
+      if (shift < 32)
+        v |= (uint32_t)(byte & 0x7f) << shift;
+      shift += 7;
+    }
+  while (byte & 0x80);
+  return v;
+}
+
 uint32_t
 AquaSimHeader::Deserialize(Buffer::Iterator start)
 {
   Buffer::Iterator i = start;
-  m_txTime = Seconds ( ( (double) i.ReadU32 ()) / 1000.0 );
-  m_size = i.ReadU16();
-  m_direction = i.ReadU8();
-  m_numForwards = i.ReadU16();
-  m_nextHop = (AquaSimAddress) i.ReadU16();
-  m_src.addr = (AquaSimAddress) i.ReadU16();
-  m_dst.addr = (AquaSimAddress) i.ReadU16();
-  m_errorFlag = i.ReadU8();	//wasted space due to only needing 1 bit
-  m_uId = i.ReadU16();
-  m_timestamp = Seconds ( ( (double) i.ReadU32 ()) / 1000.0 );
-
-  return GetSerializedSize();
+  uint8_t flags = i.ReadU8();
+  m_direction = flags & ASH_DIRECTION_MASK;
+  m_errorFlag = (flags & ASH_ERROR_FLAG) ? 1 : 0;
+  m_size = ReadVarInt(i);
+  m_numForwards = ReadVarInt(i);
+  m_nextHop = (AquaSimAddress) (uint16_t) ReadVarInt(i);
+  m_src.addr = (AquaSimAddress) (uint16_t) ReadVarInt(i);
+  m_dst.addr = (AquaSimAddress) (uint16_t) ReadVarInt(i);
+  m_uId = ReadVarInt(i);
+  m_txTime = Seconds ( ( (double) ReadVarInt(i)) / 1000.0 );
+  m_timestamp = Seconds ( ( (double) ReadVarInt(i)) / 1000.0 );
+
+  m_serializedSize = i.GetDistanceFrom(start);
+  return m_serializedSize;
 }
 
 uint32_t
 AquaSimHeader::GetSerializedSize(void) const
 {
-  /*Currently can be of arbitrary size
-  (say 2 bytes for static header fields + 4 bytes for data)
-  this can/SHOULD be changed dependent on protocol constrains.
-  example can be seen @ main-packet-header.cc*/
-
-  //reserved bytes for header
-  return (4+2+1+2+1+2+2+2+2+4);
+  if (m_serializedSize == 0)
+    m_serializedSize = 1 + VarIntSize(m_size) + VarIntSize(m_numForwards) +
+      VarIntSize(m_nextHop.GetAsInt()) + VarIntSize(m_src.addr.GetAsInt()) +
+      VarIntSize(m_dst.addr.GetAsInt()) + VarIntSize(m_uId) +
+      VarIntSize((uint32_t)(m_txTime.GetSeconds() * 1000.0)) +
+      VarIntSize((uint32_t)(m_timestamp.GetSeconds()*1000.0 + 0.5));
+  return m_serializedSize;
 }
 
 void
 AquaSimHeader::Serialize(Buffer::Iterator start) const
 {
   Buffer::Iterator i = start;
-  i.WriteU32((uint32_t)(m_txTime.GetSeconds() * 1000.0));
-  i.WriteU16(m_size);
-  i.WriteU8(m_direction);
-  i.WriteU16(m_numForwards);
-  i.WriteU16(m_nextHop.GetAsInt());
-  i.WriteU16(m_src.addr.GetAsInt());
-  i.WriteU16(m_dst.addr.GetAsInt());
-  i.WriteU8(m_errorFlag);
-  i.WriteU16(m_uId);
+  i.WriteU8((m_direction & ASH_DIRECTION_MASK) | (m_errorFlag ? ASH_ERROR_FLAG : 0));
+  WriteVarInt(i, m_size);
+  WriteVarInt(i, m_numForwards);
+  WriteVarInt(i, m_nextHop.GetAsInt());
+  WriteVarInt(i, m_src.addr.GetAsInt());
+  WriteVarInt(i, m_dst.addr.GetAsInt());
+  WriteVarInt(i, m_uId);
   //src/dst port
-  i.WriteU32((uint32_t)(m_timestamp.GetSeconds()*1000.0 + 0.5));
+  WriteVarInt(i, (uint32_t)(m_txTime.GetSeconds() * 1000.0));
+  WriteVarInt(i, (uint32_t)(m_timestamp.GetSeconds()*1000.0 + 0.5));
+}
+
+uint8_t
+AquaSimHeader::PeekFlags(Ptr<const Packet> p, uint32_t offset)
+{
+  uint8_t buf[64];
+  if (offset >= sizeof(buf) || offset >= p->GetSize())
+    {
+      NS_LOG_WARN("No flags byte at offset " << offset << " of a " << p->GetSize() << " byte packet");
+      return NONE;  //direction none, no error
+    }
+  p->CopyData(buf, offset + 1);
+  return buf[offset];
+}
+
+uint8_t
+AquaSimHeader::PeekDirection(Ptr<const Packet> p, uint32_t offset)
+{
+  return PeekFlags(p, offset) & ASH_DIRECTION_MASK;
+}
+
+bool
+AquaSimHeader::PeekErrorFlag(Ptr<const Packet> p, uint32_t offset)
+{
+  return (PeekFlags(p, offset) & ASH_ERROR_FLAG) != 0;
 }
 
 void
@@ -216,12 +292,14 @@ void
 AquaSimHeader::SetTxTime(Time time)
 {
   m_txTime = time;
+  m_serializedSize = 0;
 }
 
 void
 AquaSimHeader::SetSize(uint16_t size)
 {
   m_size = size;
+  m_serializedSize = 0;
 }
 
 void
@@ -234,24 +312,28 @@ void
 AquaSimHeader::SetNextHop(AquaSimAddress nextHop)
 {
   m_nextHop = nextHop;
+  m_serializedSize = 0;
 }
 
 void
 AquaSimHeader::SetNumForwards(uint16_t numForwards)
 {
   m_numForwards = numForwards;
+  m_serializedSize = 0;
 }
 
 void
 AquaSimHeader::SetSAddr(AquaSimAddress sAddr)
 {
   m_src.addr = sAddr;
+  m_serializedSize = 0;
 }
 
 void
 AquaSimHeader::SetDAddr(AquaSimAddress dAddr)
 {
   m_dst.addr = dAddr;
+  m_serializedSize = 0;
 }
 
 void
@@ -277,12 +359,14 @@ AquaSimHeader::SetUId(uint16_t uId)
 {
   NS_LOG_FUNCTION(this << "this is not unique and must be removed/implemented");
   m_uId = uId;
+  m_serializedSize = 0;
 }
 
 void
 AquaSimHeader::SetTimeStamp(Time timestamp)
 {
   m_timestamp = timestamp;
+  m_serializedSize = 0;
 }
 
 
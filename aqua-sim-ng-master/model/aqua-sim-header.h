@@ -27,6 +27,7 @@
 #include "ns3/address.h"
 #include "ns3/header.h"
 #include "ns3/nstime.h"
+#include "ns3/ptr.h"
 
 #include "aqua-sim-address.h"
 
@@ -89,6 +90,13 @@ public:
   void SetUId(uint16_t uId);
   void SetTimeStamp(Time timestamp);
 
+  /*
+   * Fast path: read the flags byte in place, without deserializing or
+   * removing anything. offset is the size of the headers in front of it.
+   */
+  static uint8_t PeekDirection(Ptr<const Packet> p, uint32_t offset = 0);
+  static bool PeekErrorFlag(Ptr<const Packet> p, uint32_t offset = 0);
+
   //inherited by Header class
   virtual TypeId GetInstanceTypeId(void) const;
   virtual void Print(std::ostream &os) const;
@@ -97,6 +105,12 @@ public:
   virtual uint32_t GetSerializedSize(void) const;
 
 private:
+  static uint8_t PeekFlags(Ptr<const Packet> p, uint32_t offset);
+  static uint32_t VarIntSize(uint32_t v);
+  static void WriteVarInt(Buffer::Iterator &i, uint32_t v);
+  static uint32_t ReadVarInt(Buffer::Iterator &i);
+
+  mutable uint32_t m_serializedSize;  // 0 until computed, reset by setters
   //uint32_t m_data;
   Time m_txTime;
   uint8_t m_direction;  // direction: 0=down, 1=none, 2=up
@@ -30,8 +30,10 @@
 #include "ns3/boolean.h"
 #include "ns3/double.h"
 #include "ns3/integer.h"
+#include "ns3/uinteger.h"
 
 #include "math.h"
+#include <algorithm>
 
 
 using namespace ns3;
@@ -76,7 +78,7 @@ AquaSimLocalization::SetPr(double pr)
   m_pr = pr;
 }
 
-std::list<LocalizationStructure>
+const std::vector<LocalizationStructure>&
 AquaSimLocalization::GetLocalizationList()
 {
   return m_localizationList;
@@ -86,6 +88,46 @@ void
 AquaSimLocalization::ClearLocalizationList()
 {
   m_localizationList.clear();
+  m_localizationIndex.clear();
+}
+
+void
+AquaSimLocalization::AddMeasurement(const LocalizationStructure &ls)
+{
+  std::map<int, uint32_t>::iterator it = m_localizationIndex.find(ls.m_nodeID);
+  if (it != m_localizationIndex.end())
+    {
+      m_localizationList[it->second] = ls;
+      return;
+    }
+  m_localizationIndex[ls.m_nodeID] = m_localizationList.size();
+  m_localizationList.push_back(ls);
+}
+
+/*
+ * Drop measurements received more than lifetime ago, swapping the last
+ * slot into the hole so the store stays dense.
+ */
+void
+AquaSimLocalization::ExpireMeasurements(Time lifetime)
+{
+  Time oldest = Simulator::Now() - lifetime;
+  uint32_t i = 0;
+  while (i < m_localizationList.size())
+    {
+      if (m_localizationList[i].m_ToA >= oldest)
+        {
+          i++;
+          continue;
+        }
+      m_localizationIndex.erase(m_localizationList[i].m_nodeID);
+      if (i != m_localizationList.size() - 1)
+        {
+          m_localizationList[i] = m_localizationList.back();
+          m_localizationIndex[m_localizationList[i].m_nodeID] = i;
+        }
+      m_localizationList.pop_back();
+    }
 }
 
 double
@@ -103,7 +145,7 @@ AquaSimLocalization::EuclideanDistance3D(Vector s, Vector r)
 double
 AquaSimLocalization::LocationError(Vector s, Vector r, double estRange)
 {
-  return std::abs (EuclideanDistance3D(s,r) - pow(estRange,2));
+  return std::abs (EuclideanDistance3D(s,r) - estRange);
 }
 
 void
@@ -121,7 +163,8 @@ AquaSimLocalization::DoDispose()
 NS_OBJECT_ENSURE_REGISTERED(AquaSimRBLocalization);
 
 AquaSimRBLocalization::AquaSimRBLocalization() :
-  m_localizationThreshold(4)
+  m_confidence(0), m_localizationThreshold(4), m_maxIterations(10),
+  m_tolerance(0.01), m_lifetime(Hours(10)), m_hasEstimate(false)
 {
 }
 
@@ -143,6 +186,18 @@ AquaSimRBLocalization::GetTypeId(void)
     IntegerValue (4),
     MakeIntegerAccessor (&AquaSimRBLocalization::m_localizationThreshold),
     MakeIntegerChecker<int> ())
+  .AddAttribute ("MaxIterations", "Maximum Levenberg-Marquardt steps per localization",
+    UintegerValue (10),
+    MakeUintegerAccessor (&AquaSimRBLocalization::m_maxIterations),
+    MakeUintegerChecker<uint32_t> (1))
+  .AddAttribute ("Tolerance", "Solver stops once a step is shorter than this (m)",
+    DoubleValue (0.01),
+    MakeDoubleAccessor (&AquaSimRBLocalization::m_tolerance),
+    MakeDoubleChecker<double> (0))
+  .AddAttribute ("MeasurementLifetime", "Ranges older than this are not used",
+    TimeValue (Hours(10)),
+    MakeTimeAccessor (&AquaSimRBLocalization::m_lifetime),
+    MakeTimeChecker ())
   ;
   return tid;
 }
@@ -171,7 +226,7 @@ AquaSimRBLocalization::Recv(Ptr<Packet> p)
   ls.m_nodeID = ash.GetSAddr().GetAsInt();
   ls.m_nodeConfidence = loch.GetConfidence();
 
-  m_localizationList.push_back(ls);
+  AddMeasurement(ls);
 
   if(m_localizationList.size() >= (unsigned)m_localizationThreshold) {
     Lateration();
@@ -195,7 +250,7 @@ AquaSimRBLocalization::SendLoc()
   ash.SetTimeStamp(Simulator::Now());
 
   mach.SetDemuxPType(MacHeader::UWPTYPE_LOC);
-  loch.SetNodePosition(m_nodePosition);
+  loch.SetNodePosition(GetEstimatedPosition());
   loch.SetConfidence(m_confidence);
 
   p->AddHeader(loch);
@@ -226,32 +281,152 @@ AquaSimRBLocalization::SetLocalizationThreshold(double locThreshold)
   m_localizationThreshold = locThreshold;
 }
 
+Vector
+AquaSimRBLocalization::GetEstimatedPosition()
+{
+  return m_hasEstimate ? m_estimate : m_nodePosition;
+}
+
+double
+AquaSimRBLocalization::Range(const LocalizationStructure &ls)
+{
+  return (ls.m_ToA - ls.m_TDoA).GetSeconds() * 1500;
+}
+
+/*
+ * Configured reference nodes may advertise no confidence at all, keep
+ * them in the fit.
+ */
+double
+AquaSimRBLocalization::Weight(const LocalizationStructure &ls)
+{
+  return std::min(1.0, std::max(0.01, ls.m_nodeConfidence));
+}
+
+/*
+ * Levenberg-Marquardt on r_i = |x - a_i| - d_i, weighted by the anchor's
+ * confidence. Normal equations are 3x3 and solved in place; x holds the
+ * start point and returns the estimate.
+ */
+bool
+AquaSimRBLocalization::SolveMultilateration(Vector &x)
+{
+  uint32_t n = m_localizationList.size();
+  double lambda = 1e-3;
+  double cost = 0;
+  for (uint32_t k = 0; k < n; k++)
+    {
+      const LocalizationStructure &ls = m_localizationList[k];
+      double r = EuclideanDistance3D(x, ls.m_knownLocation) - Range(ls);
+      cost += Weight(ls) * r * r;
+    }
+
+  for (uint32_t iter = 0; iter < m_maxIterations; iter++)
+    {
+      double A[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
+      double g[3] = {0,0,0};
+      for (uint32_t k = 0; k < n; k++)
+        {
+          const LocalizationStructure &ls = m_localizationList[k];
+          double d[3] = {x.x - ls.m_knownLocation.x, x.y - ls.m_knownLocation.y,
+                         x.z - ls.m_knownLocation.z};
+          double dist = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+          if (dist < 1e-9)
+            continue;
+          double w = Weight(ls);
+          double r = dist - Range(ls);
+          for (int a = 0; a < 3; a++)
+            {
+              double ja = d[a] / dist;
+              g[a] += w * ja * r;
+              for (int b = 0; b < 3; b++)
+                A[a][b] += w * ja * d[b] / dist;
+            }
+        }
+
+      // (A + lambda*diag(A)) step = -g, by Cramer's rule
+      double M[3][3];
+      for (int a = 0; a < 3; a++)
+        for (int b = 0; b < 3; b++)
+          M[a][b] = A[a][b] + ((a == b) ? lambda * (A[a][a] + 1e-9) : 0);
+      double det = M[0][0]*(M[1][1]*M[2][2] - M[1][2]*M[2][1])
+                 - M[0][1]*(M[1][0]*M[2][2] - M[1][2]*M[2][0])
+                 + M[0][2]*(M[1][0]*M[2][1] - M[1][1]*M[2][0]);
+      if (std::abs(det) < 1e-12)
+        return false;
+      double step[3];
+      for (int c = 0; c < 3; c++)
+        {
+          double C[3][3];
+          for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+              C[a][b] = (b == c) ? -g[a] : M[a][b];
+          step[c] = (C[0][0]*(C[1][1]*C[2][2] - C[1][2]*C[2][1])
+                   - C[0][1]*(C[1][0]*C[2][2] - C[1][2]*C[2][0])
+                   + C[0][2]*(C[1][0]*C[2][1] - C[1][1]*C[2][0])) / det;
+        }
+
+      Vector next(x.x + step[0], x.y + step[1], x.z + step[2]);
+      double nextCost = 0;
+      for (uint32_t k = 0; k < n; k++)
+        {
+          const LocalizationStructure &ls = m_localizationList[k];
+          double r = EuclideanDistance3D(next, ls.m_knownLocation) - Range(ls);
+          nextCost += Weight(ls) * r * r;
+        }
+
+      double stepLength = sqrt(step[0]*step[0] + step[1]*step[1] + step[2]*step[2]);
+      if (nextCost < cost)
+        {
+          x = next;
+          cost = nextCost;
+          lambda *= 0.1;
+        }
+      else
+        lambda *= 10;
+      if (stepLength < m_tolerance)
+        break;
+    }
+  return true;
+}
+
 void
 AquaSimRBLocalization::Lateration()
 {
   NS_LOG_FUNCTION(this);
   if (m_referenceNode) return;
 
-  double errorTotal=0;
-  double estRange=0;
-  double locationTotal=0;
+  ExpireMeasurements(m_lifetime);
+  if (m_localizationList.size() < (unsigned)m_localizationThreshold)
+    return;
 
-  std::list<LocalizationStructure>::iterator it=m_localizationList.begin();
-  for (; it != m_localizationList.end(); ++it)
-  {
-    estRange = ((*it).m_ToA.GetMilliSeconds()  - (*it).m_TDoA.GetMilliSeconds()) * 1500;
-    errorTotal += LocationError((*it).m_knownLocation, m_nodePosition, estRange);
-    locationTotal += EuclideanDistance3D((*it).m_knownLocation, m_nodePosition);
-    estRange=0;
-  }
+  // warm start, the first solve starts from the last known position
+  Vector x = m_hasEstimate ? m_estimate : m_nodePosition;
+
+  if (!SolveMultilateration(x))
+    {
+      NS_LOG_DEBUG("Localization: reference nodes are degenerate");
+      return;
+    }
+  m_estimate = x;
+  m_hasEstimate = true;
 
-  m_confidence = 1 - errorTotal / locationTotal;
+  double errorTotal=0;
+  double locationTotal=0;
+  for (uint32_t k = 0; k < m_localizationList.size(); k++)
+    {
+      const LocalizationStructure &ls = m_localizationList[k];
+      double estRange = Range(ls);
+      errorTotal += LocationError(ls.m_knownLocation, m_estimate, estRange);
+      locationTotal += estRange;
+    }
+
+  m_confidence = (locationTotal > 0) ? 1 - errorTotal / locationTotal : 0;
+  NS_LOG_DEBUG("Localization: estimate " << m_estimate << " confidence " << m_confidence);
   if (m_confidence > m_confidenceThreshold)
   {
     m_referenceNode = 1;
   }
-
-  ClearLocalizationList();
 }
 
 Vector
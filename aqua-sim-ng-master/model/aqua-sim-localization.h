@@ -25,7 +25,8 @@
 #include "ns3/object.h"
 #include "ns3/nstime.h"
 #include "aqua-sim-net-device.h"
-#include <list>
+#include <map>
+#include <vector>
 
 namespace ns3 {
 
@@ -57,8 +58,10 @@ public:
   virtual void SendLoc() = 0;
 
 protected:
-  std::list<LocalizationStructure> GetLocalizationList();
+  const std::vector<LocalizationStructure>& GetLocalizationList();
   void ClearLocalizationList();
+  void AddMeasurement(const LocalizationStructure &ls);  //replaces older ones of the same node
+  void ExpireMeasurements(Time lifetime);
   virtual void Lateration() = 0;
   virtual Vector GetAngleOfArrival(Ptr<Packet> p) = 0;
   double EuclideanDistance2D(Vector2D s, Vector2D r);
@@ -69,7 +72,8 @@ protected:
   Time m_localizationRefreshRate;
   Vector m_nodePosition;  //last known position, may vary due to mobility
   double m_pr;
-  std::list<LocalizationStructure> m_localizationList;
+  std::vector<LocalizationStructure> m_localizationList;
+  std::map<int, uint32_t> m_localizationIndex;  //node id -> slot in m_localizationList
   Ptr<AquaSimNetDevice> m_device;
 
 }; // class AquaSimLocalization
@@ -80,6 +84,10 @@ protected:
  * Z. Zhou, Z. Peng, J. H. Cui, Z. Shi and A. Bagtzoglou, "Scalable Localization with
  *  Mobility Prediction for Underwater Sensor Networks," in IEEE Transactions on
  *  Mobile Computing, vol. 10, no. 3, pp. 335-348, March 2011.
+ *
+ * Keeps the latest range to every reference node and solves the position
+ * by confidence weighted Levenberg-Marquardt multilateration, warm started
+ * from the previous estimate so a refresh usually takes a couple of steps.
  */
 class AquaSimRBLocalization : public AquaSimLocalization {
 public:
@@ -92,16 +100,26 @@ public:
   void SetReferenceNode(bool ref);
   void SetConfidenceThreshold(double confidence);
   void SetLocalizationThreshold(double locThreshold);
+  Vector GetEstimatedPosition();
 
 protected:
   void Lateration();
   Vector GetAngleOfArrival(Ptr<Packet> p);
 
 private:
+  double Range(const LocalizationStructure &ls);
+  double Weight(const LocalizationStructure &ls);
+  bool SolveMultilateration(Vector &x);
+
   bool m_referenceNode;
   double m_confidence;  //estimated location confidence
   double m_confidenceThreshold;
   int m_localizationThreshold;
+  uint32_t m_maxIterations;
+  double m_tolerance;  //m, solver stops below this step
+  Time m_lifetime;  //measurements older than this are dropped
+  Vector m_estimate;  //warm start for the next solve
+  bool m_hasEstimate;
 }; // class AquaSimRBLocalization
 
 } // namespace ns3
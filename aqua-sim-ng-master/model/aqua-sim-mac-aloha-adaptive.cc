@@ -0,0 +1,246 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "aqua-sim-mac-aloha-adaptive.h"
+
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include "ns3/simulator.h"
+
+#include <sstream>
+#include <algorithm>
+
+namespace ns3{
+
+NS_LOG_COMPONENT_DEFINE("AquaSimAlohaAdaptive");
+NS_OBJECT_ENSURE_REGISTERED(AquaSimAlohaAdaptive);
+
+AquaSimAlohaAdaptive::AquaSimAlohaAdaptive() :
+	AquaSimAloha(), m_defaultArm(0), m_learningRate(0.1), m_epsilon(0.1),
+	m_epsilonDecay(0.999), m_minEpsilon(0.01), m_latencyWeight(0.5),
+	m_failurePenalty(1.0)
+{
+	m_learnRand = CreateObject<UniformRandomVariable> ();
+}
+
+AquaSimAlohaAdaptive::~AquaSimAlohaAdaptive()
+{
+}
+
+TypeId
+AquaSimAlohaAdaptive::GetTypeId(void)
+{
+  static TypeId tid = TypeId("ns3::AquaSimAlohaAdaptive")
+      .SetParent<AquaSimAloha>()
+      .AddConstructor<AquaSimAlohaAdaptive>()
+      .AddAttribute("LearningRate", "Step size of the arm value update",
+	DoubleValue(0.1),
+	MakeDoubleAccessor (&AquaSimAlohaAdaptive::m_learningRate),
+	MakeDoubleChecker<double>(0.0, 1.0))
+      .AddAttribute("Epsilon", "Initial exploration probability",
+	DoubleValue(0.1),
+	MakeDoubleAccessor (&AquaSimAlohaAdaptive::m_epsilon),
+	MakeDoubleChecker<double>(0.0, 1.0))
+      .AddAttribute("EpsilonDecay", "Factor applied to epsilon after every learnt outcome",
+	DoubleValue(0.999),
+	MakeDoubleAccessor (&AquaSimAlohaAdaptive::m_epsilonDecay),
+	MakeDoubleChecker<double>(0.0, 1.0))
+      .AddAttribute("MinEpsilon", "Lower bound of the exploration probability",
+	DoubleValue(0.01),
+	MakeDoubleAccessor (&AquaSimAlohaAdaptive::m_minEpsilon),
+	MakeDoubleChecker<double>(0.0, 1.0))
+      .AddAttribute("LatencyWeight", "Share of the success reward lost by a packet that waited a full maximum backoff",
+	DoubleValue(0.5),
+	MakeDoubleAccessor (&AquaSimAlohaAdaptive::m_latencyWeight),
+	MakeDoubleChecker<double>(0.0, 1.0))
+      .AddAttribute("FailurePenalty", "Negative reward of an ACK timeout",
+	DoubleValue(1.0),
+	MakeDoubleAccessor (&AquaSimAlohaAdaptive::m_failurePenalty),
+	MakeDoubleChecker<double>(0.0))
+    ;
+  return tid;
+}
+
+int64_t
+AquaSimAlohaAdaptive::AssignStreams (int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  int64_t used = AquaSimAloha::AssignStreams(stream);
+  m_learnRand->SetStream(stream + used);
+  return used + 1;
+}
+
+/*
+ * Arms: backoff window scales x persistence levels. The plain ALOHA setting
+ * (scale 1, configured persistence) is the default arm and wins ties, so an
+ * untrained table behaves like AquaSimAloha.
+ */
+void
+AquaSimAlohaAdaptive::BuildArms()
+{
+  static const double scales[] = {0.25, 0.5, 1.0, 2.0, 4.0};
+  static const double persist[] = {1.0, 0.75, 0.5};
+
+  m_windowScales.clear();
+  m_persistences.clear();
+  m_defaultArm = -1;
+  for (uint32_t i=0; i<sizeof(scales)/sizeof(double); i++) {
+    for (uint32_t j=0; j<sizeof(persist)/sizeof(double); j++) {
+      double p = persist[j] * m_persistent;
+      if (scales[i] == 1.0 && j == 0)
+        m_defaultArm = m_windowScales.size();
+      m_windowScales.push_back(scales[i]);
+      m_persistences.push_back(p);
+    }
+  }
+}
+
+AquaSimAlohaArmTable&
+AquaSimAlohaAdaptive::Table(AquaSimAddress recver)
+{
+  if (m_windowScales.empty())
+    BuildArms();
+
+  std::map<AquaSimAddress, AquaSimAlohaArmTable>::iterator it = m_tables.find(recver);
+  if (it == m_tables.end()) {
+    AquaSimAlohaArmTable table;
+    table.Q.assign(m_windowScales.size(), 0.0);
+    table.pulls.assign(m_windowScales.size(), 0);
+    it = m_tables.insert(std::make_pair(recver, table)).first;
+  }
+  return it->second;
+}
+
+int
+AquaSimAlohaAdaptive::GreedyArm(AquaSimAlohaArmTable &table)
+{
+  int best = m_defaultArm;
+  for (uint32_t i=0; i<table.Q.size(); i++) {
+    if (table.Q[i] > table.Q[best])
+      best = i;
+  }
+  return best;
+}
+
+int
+AquaSimAlohaAdaptive::SelectArm(AquaSimAlohaArmTable &table)
+{
+  if (m_learnRand->GetValue(0,1) < m_epsilon)
+    return m_learnRand->GetInteger(0, table.Q.size()-1);
+  return GreedyArm(table);
+}
+
+double
+AquaSimAlohaAdaptive::GetPersistence(AquaSimAddress recver)
+{
+  AquaSimAlohaArmTable &table = Table(recver);
+  if (recver == AquaSimAddress::GetBroadcast())
+    return m_persistences[GreedyArm(table)];
+
+  //a new head packet starts a new attempt
+  if (table.curArm < 0) {
+    table.curArm = SelectArm(table);
+    table.attemptStart = Simulator::Now();
+    NS_LOG_DEBUG("recver " << recver.GetAsInt() << " arm " << table.curArm <<
+		 " (scale " << m_windowScales[table.curArm] << ", p " <<
+		 m_persistences[table.curArm] << ")");
+  }
+  return m_persistences[table.curArm];
+}
+
+Time
+AquaSimAlohaAdaptive::GetBackoffTime(AquaSimAddress recver)
+{
+  AquaSimAlohaArmTable &table = Table(recver);
+  int arm = table.curArm < 0 ? GreedyArm(table) : table.curArm;
+  double window = (m_maxBackoff - m_minBackoff) * m_windowScales[arm];
+  return Seconds(m_rand->GetValue(m_minBackoff, m_minBackoff + window));
+}
+
+void
+AquaSimAlohaAdaptive::Update(AquaSimAddress recver, double reward, bool done)
+{
+  AquaSimAlohaArmTable &table = Table(recver);
+  if (table.curArm < 0)
+    return;
+
+  int arm = table.curArm;
+  table.Q[arm] += m_learningRate * (reward - table.Q[arm]);
+  table.pulls[arm]++;
+  m_epsilon = std::max(m_minEpsilon, m_epsilon * m_epsilonDecay);
+  NS_LOG_DEBUG("recver " << recver.GetAsInt() << " arm " << arm << " reward " <<
+	       reward << " Q " << table.Q[arm]);
+
+  if (done)
+    table.curArm = -1;
+}
+
+void
+AquaSimAlohaAdaptive::TxSuccess(AquaSimAddress recver)
+{
+  AquaSimAlohaArmTable &table = Table(recver);
+  double horizon = std::max(m_maxBackoff, 1e-6);
+  double waited = (Simulator::Now() - table.attemptStart).ToDouble(Time::S);
+  Update(recver, 1.0 - m_latencyWeight * std::min(1.0, waited/horizon), true);
+}
+
+void
+AquaSimAlohaAdaptive::TxFailure(AquaSimAddress recver)
+{
+  /*
+   * The arm is kept for the retries of the same packet, they belong to the
+   * same decision; it is released if the packet is given up.
+   */
+  Update(recver, -m_failurePenalty, m_boCounter+1 >= MAXIMUMCOUNTER);
+}
+
+void
+AquaSimAlohaAdaptive::TxDrop(AquaSimAddress recver)
+{
+  /*
+   * Given up after busy channel or persistence backoffs: release the arm so
+   * it does not carry over to the next packet. A no-op if TxFailure already
+   * released it on the last ACK timeout.
+   */
+  Update(recver, -m_failurePenalty, true);
+}
+
+void
+AquaSimAlohaAdaptive::PrintPolicy()
+{
+  for (std::map<AquaSimAddress, AquaSimAlohaArmTable>::iterator it = m_tables.begin();
+       it != m_tables.end(); it++) {
+    int arm = GreedyArm(it->second);
+    std::stringstream os;
+    os << "recver " << it->first.GetAsInt() << ": scale " << m_windowScales[arm] <<
+	", persistence " << m_persistences[arm] << ", Q " << it->second.Q[arm] <<
+	", pulls " << it->second.pulls[arm];
+    NS_LOG_INFO(os.str());
+  }
+}
+
+void
+AquaSimAlohaAdaptive::DoDispose()
+{
+  NS_LOG_FUNCTION(this);
+  m_tables.clear();
+  m_learnRand=0;
+  AquaSimAloha::DoDispose();
+}
+
+} // namespace ns3
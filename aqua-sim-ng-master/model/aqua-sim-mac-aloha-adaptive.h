@@ -0,0 +1,103 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AQUA_SIM_MAC_ALOHA_ADAPTIVE_H
+#define AQUA_SIM_MAC_ALOHA_ADAPTIVE_H
+
+#include "aqua-sim-mac-aloha.h"
+#include "aqua-sim-address.h"
+
+#include <vector>
+#include <map>
+
+namespace ns3 {
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Learnt backoff policy of one neighbourhood (receiver)
+ *
+ * Each arm is a (backoff window scale, persistence) pair; Q holds the
+ * running value estimate of every arm.
+ */
+struct AquaSimAlohaArmTable
+{
+  std::vector<double> Q;
+  std::vector<uint32_t> pulls;
+  int curArm;          //arm used by the ongoing attempt, -1 if none
+  Time attemptStart;   //when the head packet was first tried
+  AquaSimAlohaArmTable() : curArm(-1), attemptStart(Seconds(0)) {}
+};
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief ALOHA with a backoff window and persistence learnt per receiver
+ *
+ * An epsilon-greedy bandit picks, for every new head-of-queue packet, how
+ * wide the backoff window is (a multiple of MaxBackoff - MinBackoff) and
+ * with which probability to transmit. An ACK rewards the arm, discounted by
+ * the time the packet waited; an ACK timeout penalises it. Broadcast
+ * packets get no feedback and use the greedy arm of the broadcast entry.
+ */
+class AquaSimAlohaAdaptive: public AquaSimAloha
+{
+public:
+  AquaSimAlohaAdaptive();
+  ~AquaSimAlohaAdaptive();
+  static TypeId GetTypeId(void);
+  virtual int64_t AssignStreams (int64_t stream);
+
+  void	PrintPolicy();
+
+protected:
+  virtual double	GetPersistence(AquaSimAddress recver);
+  virtual Time	GetBackoffTime(AquaSimAddress recver);
+  virtual void	TxSuccess(AquaSimAddress recver);
+  virtual void	TxFailure(AquaSimAddress recver);
+  virtual void	TxDrop(AquaSimAddress recver);
+
+  virtual void DoDispose();
+
+private:
+  AquaSimAlohaArmTable&	Table(AquaSimAddress recver);
+  int	SelectArm(AquaSimAlohaArmTable &table);
+  int	GreedyArm(AquaSimAlohaArmTable &table);
+  void	Update(AquaSimAddress recver, double reward, bool done);
+  void	BuildArms();
+
+  std::vector<double>	m_windowScales;
+  std::vector<double>	m_persistences;
+  int	m_defaultArm;
+
+  std::map<AquaSimAddress, AquaSimAlohaArmTable> m_tables;
+
+  double m_learningRate;
+  double m_epsilon;
+  double m_epsilonDecay;
+  double m_minEpsilon;
+  double m_latencyWeight;
+  double m_failurePenalty;
+
+  Ptr<UniformRandomVariable> m_learnRand;
+
+};  // class AquaSimAlohaAdaptive
+
+} // namespace ns3
+
+#endif /* AQUA_SIM_MAC_ALOHA_ADAPTIVE_H */
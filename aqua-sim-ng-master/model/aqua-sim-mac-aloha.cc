@@ -92,10 +92,53 @@ AquaSimAloha::AssignStreams (int64_t stream)
   return 1;
 }
 
+double AquaSimAloha::GetPersistence(AquaSimAddress recver)
+{
+  return m_persistent;
+}
+
+Time AquaSimAloha::GetBackoffTime(AquaSimAddress recver)
+{
+  return Seconds(m_rand->GetValue(m_minBackoff,m_maxBackoff));
+}
+
+void AquaSimAloha::TxSuccess(AquaSimAddress recver)
+{
+}
+
+void AquaSimAloha::TxFailure(AquaSimAddress recver)
+{
+}
+
+void AquaSimAloha::TxDrop(AquaSimAddress recver)
+{
+}
+
+AquaSimAddress AquaSimAloha::HeadRecver()
+{
+  //same rule TxProcess uses to set the aloha DA, no copy of the packet
+  AquaSimHeader asHeader;
+  PktQ_.front()->PeekHeader(asHeader);
+  if (asHeader.GetNextHop() == AquaSimAddress::GetBroadcast())
+    return asHeader.GetDAddr();
+  return asHeader.GetNextHop();
+}
+
+void AquaSimAloha::AckTimeout()
+{
+  if (!PktQ_.empty())
+    TxFailure(HeadRecver());
+  DoBackoff();
+}
+
 void AquaSimAloha::DoBackoff()
 {
   //NS_LOG_FUNCTION(this);
-  Time BackoffTime=Seconds(m_rand->GetValue(m_minBackoff,m_maxBackoff));
+  if (PktQ_.empty()) {
+    ALOHA_Status = PASSIVE;
+    return;
+  }
+  Time BackoffTime=GetBackoffTime(HeadRecver());
   m_boCounter++;
   if (m_boCounter < MAXIMUMCOUNTER)
     {
@@ -107,7 +150,9 @@ void AquaSimAloha::DoBackoff()
     {
       m_boCounter=0;
       NS_LOG_INFO("Backoffhandler: too many backoffs");
+      ALOHA_Status = PASSIVE;
 			if (!PktQ_.empty()) {
+      	TxDrop(HeadRecver());
       	PktQ_.front()=0;
       	PktQ_.pop();
       ProcessPassive();
@@ -200,7 +245,7 @@ void AquaSimAloha::SendDataPkt()
 
   ALOHA_Status = SEND_DATA;
 
-  if( P<=m_persistent ) {
+  if( P<=GetPersistence(HeadRecver()) ) {
     if( asHeader.GetNextHop() == recver ) //why? {
 	SendPkt(tmp->Copy());
   }
@@ -243,7 +288,7 @@ void AquaSimAloha::SendPkt(Ptr<Packet> pkt)
 				if ((alohaH.GetDA() != AquaSimAddress::GetBroadcast()) && m_AckOn) {
 				  NS_LOG_DEBUG("Set status to WAIT_ACK");
 				  ALOHA_Status = WAIT_ACK;
-				  m_waitACKTimer = Simulator::Schedule(ertt,&AquaSimAloha::DoBackoff, this);
+				  m_waitACKTimer = Simulator::Schedule(ertt,&AquaSimAloha::AckTimeout, this);
 				  NS_LOG_DEBUG("estimated RTT: " << ertt.GetSeconds () << "seconds");
 				  NS_LOG_DEBUG("launch waitACKTimer");
 				}
@@ -329,6 +374,7 @@ bool AquaSimAloha::RecvProcess(Ptr<Packet> pkt)
     if( recver == myAddr && ALOHA_Status == WAIT_ACK) {
 	m_waitACKTimer.Cancel();
 	m_boCounter=0;
+	TxSuccess(alohaH.GetSA());
 	if (!PktQ_.empty()) {
 		PktQ_.front()=0;
 		PktQ_.pop();
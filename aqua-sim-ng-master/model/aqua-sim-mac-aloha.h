@@ -85,7 +85,7 @@ public:
   AquaSimAloha();
   ~AquaSimAloha();
   static TypeId GetTypeId(void);
-  int64_t AssignStreams (int64_t stream);
+  virtual int64_t AssignStreams (int64_t stream);
 
   virtual bool TxProcess(Ptr<Packet> pkt);
   virtual bool RecvProcess(Ptr<Packet> pkt);
@@ -134,6 +134,7 @@ protected:
   void	SendDataPkt();
   //	void 	DropPacket(Ptr<Packet>);
   void	DoBackoff();
+  void	AckTimeout();
   //	void	processDataSendTimer(Event *e);
   //void	ProcessWaitACKTimer(Ptr<EventId> e);
   void	ProcessPassive();
@@ -146,8 +147,21 @@ protected:
   //void	BackoffProcess();
   //bool	CarrierDected();
 
+  /*
+   * Policy hooks for adaptive variants. The defaults reproduce the plain
+   * protocol: fixed persistence and a uniform backoff in [min, max].
+   */
+  virtual double	GetPersistence(AquaSimAddress recver);
+  virtual Time	GetBackoffTime(AquaSimAddress recver);
+  // outcome of a unicast DATA transmission (ACK received / ACK timed out or given up)
+  virtual void	TxSuccess(AquaSimAddress recver);
+  virtual void	TxFailure(AquaSimAddress recver);
+  // head packet dropped after too many backoffs
+  virtual void	TxDrop(AquaSimAddress recver);
+
+  AquaSimAddress	HeadRecver();
+
   virtual void DoDispose();
-private:
   std::queue<Ptr<Packet> >	PktQ_;
   Ptr<UniformRandomVariable> m_rand;
 
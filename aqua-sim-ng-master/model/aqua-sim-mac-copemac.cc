@@ -26,6 +26,8 @@
 
 #include "ns3/log.h"
 #include "ns3/integer.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
 
 namespace ns3 {
 
@@ -39,49 +41,84 @@ PktWareHouse::Insert2PktQs(Ptr<Packet> pkt)
   AquaSimHeader asHeader;
   pkt->PeekHeader(asHeader);
 
-  PktElem* temp = new PktElem(pkt);
-
+  PktList &q = Queues[asHeader.GetNextHop()];
+  q.pkts.push_back(pkt);
   m_cachedPktNum ++;
-  if( Queues[asHeader.GetNextHop()].head == NULL ) {
-      Queues[asHeader.GetNextHop()].tail = temp;
-      Queues[asHeader.GetNextHop()].head = temp;
-  }
-  else {
-      Queues[asHeader.GetNextHop()].tail->next_ = temp;
-      Queues[asHeader.GetNextHop()].tail = temp;
+
+  if( !q.active ) {
+      q.active = true;
+      q.deficit = 0;
+      m_activeList.push_back(asHeader.GetNextHop());
   }
 }
 
 bool
 PktWareHouse::DeletePkt(AquaSimAddress Recver, int SeqNum)
 {
-  PktElem* pos = Queues[Recver].head;
-  PktElem* pre_pos = NULL;
-  AquaSimHeader asHeader;
+  std::map<AquaSimAddress, PktList>::iterator it = Queues.find(Recver);
+  if( it == Queues.end() )
+      return false;
 
-  while ( pos != NULL ) {
-      pos->pkt_->PeekHeader(asHeader);
+  AquaSimHeader asHeader;
+  std::deque<Ptr<Packet> > &pkts = it->second.pkts;
+  for( std::deque<Ptr<Packet> >::iterator pos = pkts.begin(); pos != pkts.end(); pos++ ) {
+      (*pos)->PeekHeader(asHeader);
       if( asHeader.GetUId() == SeqNum ) {
-	if( pre_pos == NULL ) {
-	    Queues[Recver].head = pos->next_;
-	}
-	else {
-	    pre_pos->next_ = pos->next_;
-	}
-
-	pos->pkt_=0;
-	//pos->pkt_ == NULL;
-	delete pos;
-	m_cachedPktNum --;
-	return true;
+	  pkts.erase(pos);
+	  m_cachedPktNum --;
+	  return true;
       }
-      pre_pos = pos;
-      pos = pos->next_;
   }
 
   return false;
 }
 
+void
+PktWareHouse::DrrSchedule(uint32_t quantum, uint32_t maxPerRecver, uint32_t maxRecvers,
+			  std::vector<std::pair<AquaSimAddress, Ptr<Packet> > > &out)
+{
+  //serve each receiver that is active at the start of the round at most once
+  uint32_t rounds = m_activeList.size();
+  uint32_t served = 0;
+
+  while( rounds-- > 0 && served < maxRecvers ) {
+      AquaSimAddress recver = m_activeList.front();
+      m_activeList.pop_front();
+      PktList &q = Queues[recver];
+
+      q.deficit += quantum;
+      uint32_t taken = 0;
+      while( !q.pkts.empty() && taken < maxPerRecver
+	     && q.pkts.front()->GetSize() <= q.deficit ) {
+	  q.deficit -= q.pkts.front()->GetSize();
+	  out.push_back(std::make_pair(recver, q.pkts.front()));
+	  q.pkts.pop_front();
+	  m_cachedPktNum --;
+	  taken ++;
+      }
+
+      if( q.pkts.empty() ) {
+	  //an idle receiver must not hoard credit
+	  q.deficit = 0;
+	  q.active = false;
+      }
+      else {
+	  m_activeList.push_back(recver);
+      }
+      if( taken > 0 ) {
+	  served ++;
+      }
+  }
+}
+
+void
+PktWareHouse::Clear()
+{
+  Queues.clear();
+  m_activeList.clear();
+  m_cachedPktNum = 0;
+}
+
 
 
 /**********************RevQueues******************************************/
@@ -90,6 +127,7 @@ NS_OBJECT_ENSURE_REGISTERED(RevQueues);
 RevElem::RevElem()
 {
   m_sendTimer = NULL;
+  prev = NULL;
   next = NULL;
 }
 
@@ -99,6 +137,7 @@ RevElem::RevElem(int RevID_, Time StartTime_, Time EndTime_,
 	Reservor(Reservor_), rev_type(rev_type_), RevID(RevID_)
 {
   m_sendTimer = NULL;
+  prev = NULL;
   next = NULL;
 }
 
@@ -160,6 +199,26 @@ RevQueues::~RevQueues()
       Head_ = Head_->next;
       delete tmp;
   }
+  m_revIndex.clear();
+}
+
+void
+RevQueues::Unlink(RevElem* elem)
+{
+  if( elem->prev != NULL ) {
+      elem->prev->next = elem->next;
+  }
+  else {
+      Head_ = elem->next;
+  }
+  if( elem->next != NULL ) {
+      elem->next->prev = elem->prev;
+  }
+
+  std::map<int, RevElem*>::iterator it = m_revIndex.find(elem->RevID);
+  if( it != m_revIndex.end() && it->second == elem ) {
+      m_revIndex.erase(it);
+  }
 }
 
 void
@@ -169,7 +228,7 @@ RevQueues::ClearExpired(Time ExpireTime)
 
   while( Head_ != NULL && Head_->EndTime < ExpireTime + BACKOFF_DELAY_ERROR ) {
       tmp = Head_;
-      Head_ = Head_->next;
+      Unlink(tmp);
       delete tmp;
   }
 }
@@ -188,27 +247,28 @@ RevQueues::Push(int RevID, Time StartTime, Time EndTime,
   if( pkt != NULL ) {
       tmp->m_sendTimer = new PktSendTimer(mac_, pkt);
   }
+  m_revIndex[RevID] = tmp;
 
-  if( Head_ == NULL ) {
-      Head_ = tmp;
-      return true;
-  }
-
-  RevElem* pre_pos = Head_;
-  RevElem* pos = Head_->next;
+  //keep the list sorted by EndTime
+  RevElem* pre_pos = NULL;
+  RevElem* pos = Head_;
 
-  while( pos != NULL ) {
-      if( pos->EndTime < EndTime ) {
-	  pre_pos = pos;
-	  pos = pos->next;
-      }
-      else {
-	  break;
-      }
+  while( pos != NULL && pos->EndTime < EndTime ) {
+      pre_pos = pos;
+      pos = pos->next;
   }
 
-  pre_pos->next = tmp;
+  tmp->prev = pre_pos;
   tmp->next = pos;
+  if( pre_pos == NULL ) {
+      Head_ = tmp;
+  }
+  else {
+      pre_pos->next = tmp;
+  }
+  if( pos != NULL ) {
+      pos->prev = tmp;
+  }
   return true;
 }
 
@@ -236,55 +296,39 @@ RevQueues::CheckAvailability(Time StartTime, Time EndTime, RevType rev_type)
 void
 RevQueues::DeleteRev(int RevID)
 {
-  RevElem* pos = Head_;
-
-  if( Head_->RevID == RevID ) {
-    Head_ = Head_->next;
-    delete pos;
-    return;
-  }
-
-  pos = Head_->next;
-  RevElem* pre_pos = Head_;
-
-  while( pos != NULL ) {
-    if( pos->RevID == RevID ) {
-	pre_pos->next = pos->next;
-
-	delete pos;
-	return;
-    }
-    pre_pos = pos;
-    pos = pos->next;
+  std::map<int, RevElem*>::iterator it = m_revIndex.find(RevID);
+  if( it == m_revIndex.end() ) {
+      return;
   }
 
+  RevElem* pos = it->second;
+  Unlink(pos);
+  delete pos;
 }
 
 
 void
 RevQueues::UpdateStatus(int RevID, RevType new_type)
 {
-  RevElem* pos = Head_;
-  Time send_time;
-
-  while( pos != NULL ) {
-    if( pos->RevID == RevID ) {
-      pos->rev_type = new_type;
-      send_time = pos->StartTime - Simulator::Now() + mac_->m_guardTime/2;
-      if( send_time < 0.0 ) {
-	  NS_LOG_WARN("UpdateStatus: handshake time takes too long, cancel sending");
-	  DeleteRev(RevID);
-	  return;
-      }
+  std::map<int, RevElem*>::iterator it = m_revIndex.find(RevID);
+  if( it == m_revIndex.end() ) {
+      return;
+  }
 
-      if( send_time > 0.0 && pos->m_sendTimer != NULL) {
-	  pos->m_sendTimer->SetFunction(&PktSendTimer::PktSendTimerExpire,pos->m_sendTimer);
-	  pos->m_sendTimer->Schedule(send_time);
+  RevElem* pos = it->second;
+  Time send_time;
 
-      }
+  pos->rev_type = new_type;
+  send_time = pos->StartTime - Simulator::Now() + mac_->m_guardTime/2;
+  if( send_time < 0.0 ) {
+      NS_LOG_WARN("UpdateStatus: handshake time takes too long, cancel sending");
+      DeleteRev(RevID);
       return;
-    }
-    pos = pos->next;
+  }
+
+  if( send_time > 0.0 && pos->m_sendTimer != NULL) {
+      pos->m_sendTimer->SetFunction(&PktSendTimer::PktSendTimerExpire,pos->m_sendTimer);
+      pos->m_sendTimer->Schedule(send_time);
   }
 }
 
@@ -376,7 +420,8 @@ AquaSimCopeMac::AquaSimCopeMac():
     DataAckAccumTimer(Timer::CANCEL_ON_DESTROY),
     m_NDInterval(6),m_dataAccuPeriod(10),m_revAckAccumTime(1),
     m_dataAckAccumTime(1), m_RevQ(this), m_nextHop(0),
-    m_neighborId(0), m_majorIntervalLB(2),/* MajorIntervalUB(3),IntervalStep(0.1),*/
+    m_drrQuantum(1024), m_maxRevPerRecver(4), m_maxRange(1000), m_soundSpeed(1500),
+    m_majorIntervalLB(2),/* MajorIntervalUB(3),IntervalStep(0.1),*/
     m_dataStartTime(15), m_guardTime(0.01),m_NDWin(2.0),
     m_NDReplyWin(2.0), m_ackTimeOut(10),
     m_pktSize(200), m_isParallel(1), m_NDProcessMaxTimes(3), m_backoffCounter(0)
@@ -406,8 +451,7 @@ AquaSimCopeMac::Start()
   //m_device->SetTransmissionStatus(NIDLE);
 
   m_dataStartTime = 3*m_NDInterval + Seconds(7);
-  Time MaxRTT = Seconds(2*1000/1500.0);
-  m_ackTimeOut = m_revAckAccumTime + m_dataAckAccumTime + 2*MaxRTT + Seconds(5); //5 is time error
+  m_ackTimeOut = m_revAckAccumTime + m_dataAckAccumTime + 2*MaxRtt() + Seconds(5); //5 is time error
 
   Simulator::Schedule(m_dataAccuPeriod+Seconds(m_rand->GetValue()),&AquaSimCopeMac::DataSendTimerExpire,this);
   //Random::seed_heuristically();
@@ -451,6 +495,22 @@ AquaSimCopeMac::GetTypeId(void)
 	IntegerValue(0),
 	MakeIntegerAccessor (&AquaSimCopeMac::m_isParallel),
 	MakeIntegerChecker<int>())
+     .AddAttribute("DrrQuantum", "Bytes of credit each receiver gets per deficit round robin round.",
+	UintegerValue(1024),
+	MakeUintegerAccessor (&AquaSimCopeMac::m_drrQuantum),
+	MakeUintegerChecker<uint32_t>(1))
+     .AddAttribute("MaxRevPerRecver", "Maximum number of packets reserved for one receiver in a multi-rev.",
+	UintegerValue(4),
+	MakeUintegerAccessor (&AquaSimCopeMac::m_maxRevPerRecver),
+	MakeUintegerChecker<uint32_t>(1))
+     .AddAttribute("MaxRange", "Farthest neighbour distance (m), bounds the round trip time.",
+	DoubleValue(1000),
+	MakeDoubleAccessor (&AquaSimCopeMac::m_maxRange),
+	MakeDoubleChecker<double>(0))
+     .AddAttribute("SoundSpeed", "Speed of sound (m/s).",
+	DoubleValue(1500),
+	MakeDoubleAccessor (&AquaSimCopeMac::m_soundSpeed),
+	MakeDoubleChecker<double>(1))
     ;
   return tid;
 }
@@ -821,6 +881,30 @@ AquaSimCopeMac::StartHandShake()
 //	return SlotNum*TimeSlotLen_ - m_propDelays[recver];
 //}
 
+Time
+AquaSimCopeMac::EarliestDataStart(AquaSimAddress recver)
+{
+  /*
+   * The data slot can only be used after the rev-ack came back, so the
+   * earliest start is one round trip plus the receiver's accumulation time.
+   * Near neighbours therefore get earlier slots and their data phase
+   * overlaps with the handshakes still running to farther ones.
+   */
+  Time rtt = MaxRtt();
+  std::map<AquaSimAddress, Time>::iterator it = m_propDelays.find(recver);
+  if( it != m_propDelays.end() ) {
+      rtt = 2*it->second;
+  }
+  Time earliest = m_revAckAccumTime + rtt + m_guardTime;
+  return (earliest > m_majorIntervalLB) ? earliest : m_majorIntervalLB;
+}
+
+Time
+AquaSimCopeMac::MaxRtt()
+{
+  return Seconds(2*m_maxRange/m_soundSpeed);
+}
+
 Ptr<Packet>
 AquaSimCopeMac::MakeMultiRev()
 {
@@ -839,14 +923,11 @@ AquaSimCopeMac::MakeMultiRev()
   //ash->addr_type()=NS_AF_ILINK;
   ptag.SetPacketType(AquaSimPtTag::PT_OTMAN);
 
-  uint rev_num = 0;
-  std::map<AquaSimAddress, PktList>::iterator pos;
-  for( pos = m_PktWH.Queues.begin(); pos != m_PktWH.Queues.end(); pos++ )
-  {
-    if( pos->second.head != NULL ) {
-	rev_num ++;
-    }
-  }
+  //pick the packets of this round; without parallel mode only one receiver is served
+  std::vector<std::pair<AquaSimAddress, Ptr<Packet> > > picked;
+  m_PktWH.DrrSchedule(m_drrQuantum, m_maxRevPerRecver,
+		      m_isParallel ? m_PktWH.m_activeList.size() : 1, picked);
+  uint rev_num = picked.size();
 
   if( rev_num == 0 ) {
       pkt=0;
@@ -860,120 +941,70 @@ AquaSimCopeMac::MakeMultiRev()
    *		Time	MajorStartTime;
    *		int	BackupRevID;
    *		Time	BackupStartTime;
+   * Several entries may address the same receiver, each one reserves
+   * a slot for one packet.
    */
-  //fill the neighbors to which this node already knows the delay
-  uint ithneighbor = m_neighborId%rev_num;
-  if( !m_isParallel ) {
-      rev_num = 1;
-  }
-
   uint32_t size = sizeof(uint)+ sizeof(Time)+ (sizeof(AquaSimAddress)+sizeof(Time)*3+sizeof(int)*2)*rev_num;
-  uint8_t *data = new uint8_t[size];
+  uint8_t *buf = new uint8_t[size];
+  uint8_t *data = buf;
 
-  //pkt->allocdata( sizeof(uint)+ sizeof(Time)+ (sizeof(AquaSimAddress)+sizeof(Time)*3+sizeof(int)*2)*rev_num);
-  //unsigned char* walk = (unsigned char*)pkt->accessdata();
   *(uint*)data = rev_num;
   data += sizeof(uint);
   *(Time*)data = Simulator::Now();   //record the time when filling the packet
   data += sizeof(Time);
 
-
-  PktElem* tmp;
-  uint i=0;
-  for( pos = m_PktWH.Queues.begin();pos != m_PktWH.Queues.end(); pos++ )
+  for( std::vector<std::pair<AquaSimAddress, Ptr<Packet> > >::iterator pos = picked.begin();
+       pos != picked.end(); pos++ )
   {
-      if( (!m_isParallel) && (i<ithneighbor) ) {
-	  i++;
-	  continue;
-      }
+      *((AquaSimAddress*)data) = pos->first;
+      data += sizeof(AquaSimAddress);
 
-      if( pos->second.head != NULL ) {
+      Ptr<Packet> TmpPkt = pos->second->Copy();
+      AquaSimHeader ashTemp;
+      TmpPkt->PeekHeader(ashTemp);
 
-	  *((AquaSimAddress*)data) = pos->first;
-	  data += sizeof(AquaSimAddress);
-	  tmp = pos->second.head;
-
-	  Ptr<Packet> TmpPkt = pos->second.head->pkt_->Copy();
-	  AquaSimHeader ashTemp;
-	  TmpPkt->PeekHeader(ashTemp);
-
-	  Time MajorInterval, BackupInterval;  //both refer to the start time of the interval
-	  Time PktLen_ = ashTemp.GetTxTime() + m_guardTime; //guardtime is used to avoid collision
-
-	  //Time LowerInterval = m_majorIntervalLB;
-	  //Time UpperInterval = MajorIntervalUB;
-	  //get major interval
-	  //Time SinceTime= round2RecverSlotBegin(NOW, pos->first);
-	  MajorInterval = m_RevQ.GetValidStartTime(PktLen_, Simulator::Now()+m_majorIntervalLB);
-	  /*do{
-		  counter++;
-		  if( counter == 100 ) {
-			  UpperInterval += IntervalStep;
-			  counter = 0;
-		  }
-		  MajorInterval =	Random::uniform(LowerInterval,
-										  UpperInterval);
-	  }while(!m_RevQ.checkAvailability(NOW+MajorInterval,
-		  NOW+MajorInterval+PktLen_, PRE_REV) );*/
-
-
-	  //get backup send interval
-	  BackupInterval = m_RevQ.GetValidStartTime(PktLen_, Simulator::Now()+MajorInterval + PktLen_);
-	  /*Time tmpInterval = MajorBackupInterval;
-	  do{
-		  counter++;
-		  if( counter == 100 ) {
-			  tmpInterval += IntervalStep;
-			  counter = 0;
-		  }
-		  BackupInterval = MajorInterval+PktLen_ +
-						   Random::uniform(tmpInterval);
-	  }while( !m_RevQ.checkAvailability(NOW+BackupInterval,
-						  NOW+BackupInterval+PktLen_, PRE_REV) );*/
-
-	  RevID++;
-	  m_RevQ.Push(RevID, Simulator::Now()+MajorInterval, Simulator::Now()+MajorInterval+PktLen_,
-				  AquaSimAddress::ConvertFrom(m_device->GetAddress()) , PRE_REV, TmpPkt->Copy());
-
-	  *(Time*)data = PktLen_;   //already includes m_guardTime
-	  data += sizeof(Time);
-	  *(int*)data = RevID;
-	  data += sizeof(int);
-	  *(Time*)data = MajorInterval;
-	  data += sizeof(Time);
+      Time MajorInterval, BackupInterval;  //both refer to the start time of the interval
+      Time PktLen_ = ashTemp.GetTxTime() + m_guardTime; //guardtime is used to avoid collision
 
-	  RevID++;
-	  m_RevQ.Push(RevID, Simulator::Now()+BackupInterval,
-		      Simulator::Now()+BackupInterval+PktLen_,
-		      AquaSimAddress::ConvertFrom(m_device->GetAddress()) , PRE_REV, TmpPkt);
-	  *(int*)data = RevID;
-	  data += sizeof(int);
-	  *(Time*)data = BackupInterval;   //this is the backup time slot. One of the 10 slots after major slot
-	  data += sizeof(Time);
+      //slots already pushed for earlier entries are skipped, so packets to
+      //the same or other receivers are pipelined back to back
+      MajorInterval = m_RevQ.GetValidStartTime(PktLen_, Simulator::Now()+EarliestDataStart(pos->first));
 
+      //get backup send interval
+      BackupInterval = m_RevQ.GetValidStartTime(PktLen_, Simulator::Now()+MajorInterval + PktLen_);
 
-	  //remove the packet from PacketWH_ and insert it into
-	  //AckWaitingList
-	  pos->second.head = tmp->next_;
-	  InsertAckWaitingList(tmp->pkt_->Copy(), m_ackTimeOut);
-	  AquaSimHeader ashTmp;
-	  tmp->pkt_->PeekHeader(ashTmp);
-	  m_PktWH.DeletePkt(pos->first, ashTmp.GetUId());
+      RevID++;
+      m_RevQ.Push(RevID, Simulator::Now()+MajorInterval, Simulator::Now()+MajorInterval+PktLen_,
+		  AquaSimAddress::ConvertFrom(m_device->GetAddress()) , PRE_REV, TmpPkt->Copy());
 
-	  if( !m_isParallel ) {
-		  break;
-	  }
-      }
+      *(Time*)data = PktLen_;   //already includes m_guardTime
+      data += sizeof(Time);
+      *(int*)data = RevID;
+      data += sizeof(int);
+      *(Time*)data = MajorInterval;
+      data += sizeof(Time);
+
+      RevID++;
+      m_RevQ.Push(RevID, Simulator::Now()+BackupInterval,
+		  Simulator::Now()+BackupInterval+PktLen_,
+		  AquaSimAddress::ConvertFrom(m_device->GetAddress()) , PRE_REV, TmpPkt);
+      *(int*)data = RevID;
+      data += sizeof(int);
+      *(Time*)data = BackupInterval;   //this is the backup time slot. One of the 10 slots after major slot
+      data += sizeof(Time);
+
+      //the packet already left PacketWH_, wait for its ack
+      InsertAckWaitingList(pos->second, m_ackTimeOut);
   }
 
   //node id use 8 bits, first time slot use 10bits, backup time slot use 4 bits
 
   ash.SetSize((4+(8+8+8+8))*rev_num/8);
 
-  m_neighborId = (m_neighborId+1)%m_propDelays.size();
   //m_RevQ.printRevQueue();
 
-  Ptr<Packet> tempPacket = Create<Packet>(data,size);
+  Ptr<Packet> tempPacket = Create<Packet>(buf,size);
+  delete[] buf;
   pkt->AddAtEnd(tempPacket);
   pkt->AddHeader(ch);
   pkt->AddHeader(ash);
@@ -996,7 +1027,8 @@ AquaSimCopeMac::ProcessMultiRev(Ptr<Packet> pkt)
   pkt->AddHeader(ash);
 
   uint32_t size = pkt->GetSize();
-  uint8_t *data = new uint8_t[size];
+  uint8_t *buf = new uint8_t[size];
+  uint8_t *data = buf;
   pkt->CopyData(data,size);
   //unsigned char* walk = (unsigned char*)pkt->accessdata();
   uint rev_num = *(uint*)data;
@@ -1020,51 +1052,52 @@ AquaSimCopeMac::ProcessMultiRev(Ptr<Packet> pkt)
       RevAckAccumTimer.Schedule(m_revAckAccumTime);
 	}
 
-	RevReq* tmp = new RevReq();
-	tmp->requestor = ch.GetSA();
-	//tmp->Sincetime = map2OwnTime(cmh->ts_, mh->macSA());
+	RevReq rev;
+	rev.requestor = ch.GetSA();
+	//rev.Sincetime = map2OwnTime(cmh->ts_, mh->macSA());
 
 	PktLen_ = *((Time*)data);
 	data += sizeof(Time);
-	tmp->acceptedRevID = *((int*)data);
+	rev.acceptedRevID = *((int*)data);
 	data += sizeof(int);
+	int majorRevID = rev.acceptedRevID;
 
 	//covert the time based on this node's timeline
-	tmp->StartTime = *((Time*)data)-delta_time + Simulator::Now();
+	rev.StartTime = *((Time*)data)-delta_time + Simulator::Now();
 	data += sizeof(Time);
-	tmp->EndTime = tmp->StartTime + PktLen_;
+	rev.EndTime = rev.StartTime + PktLen_;
 
 	//check major slot
-	if( m_RevQ.CheckAvailability(tmp->StartTime,tmp->EndTime, RECVING) ) {
-	    tmp->rejectedRevID = *((int*)data);
+	if( m_RevQ.CheckAvailability(rev.StartTime,rev.EndTime, RECVING) ) {
+	    rev.rejectedRevID = *((int*)data);
 	    data += sizeof(int)+sizeof(Time);
 
-	    m_RevQ.Push(RevID, tmp->StartTime, tmp->EndTime,
-		    tmp->requestor, RECVING, pkt);
+	    m_RevQ.Push(rev.acceptedRevID, rev.StartTime, rev.EndTime,
+		    rev.requestor, RECVING, pkt);
 	}
 	else{
-	    tmp->rejectedRevID = tmp->acceptedRevID;
-	    tmp->acceptedRevID = *((int*)data);
+	    rev.rejectedRevID = rev.acceptedRevID;
+	    rev.acceptedRevID = *((int*)data);
 	    data += sizeof(int);
 
 	    //covert the time based on this node's timeline
-	    tmp->StartTime = *((Time*)data)-delta_time + Simulator::Now();
+	    rev.StartTime = *((Time*)data)-delta_time + Simulator::Now();
 	    data += sizeof(Time);
-	    tmp->EndTime = tmp->StartTime + PktLen_;
+	    rev.EndTime = rev.StartTime + PktLen_;
 
-	    if( m_RevQ.CheckAvailability(tmp->StartTime, tmp->EndTime, RECVING) ) {
+	    if( m_RevQ.CheckAvailability(rev.StartTime, rev.EndTime, RECVING) ) {
 
-		m_RevQ.Push(RevID, tmp->StartTime, tmp->EndTime,
-			tmp->requestor, RECVING, pkt);
+		m_RevQ.Push(rev.acceptedRevID, rev.StartTime, rev.EndTime,
+			rev.requestor, RECVING, pkt);
 	    }
 	    else {
 		//give a wrong rev time interval, so the requestor will know both are wrong
-		tmp->StartTime = Seconds(-1);
-		tmp->EndTime = Seconds(-1);
+		rev.StartTime = Seconds(-1);
+		rev.EndTime = Seconds(-1);
 	    }
 
 	}
-	m_pendingRevs.push_back(tmp);
+	m_pendingRevs[majorRevID] = rev;
 
     }
     else{
@@ -1074,6 +1107,7 @@ AquaSimCopeMac::ProcessMultiRev(Ptr<Packet> pkt)
 	data += 2*sizeof(int);
     }
   }
+  delete[] buf;
   //m_RevQ.PrintRevQueue();
 }
 
@@ -1106,7 +1140,8 @@ AquaSimCopeMac::MakeMultiRevAck()
 
 
   uint32_t size = sizeof(uint)+ sizeof(Time)+ (sizeof(AquaSimAddress)+2*sizeof(int)+2*sizeof(Time))*m_pendingRevs.size();
-  uint8_t *data = new uint8_t[size];
+  uint8_t *buf = new uint8_t[size];
+  uint8_t *data = buf;
 
   //pkt->allocdata( sizeof(uint)+ sizeof(Time)+ (sizeof(AquaSimAddress)+2*sizeof(int)+2*sizeof(Time))*m_pendingRevs.size() );
   //unsigned char* walk = (unsigned char*)pkt->accessdata();
@@ -1115,18 +1150,18 @@ AquaSimCopeMac::MakeMultiRevAck()
   *(Time*)data = Simulator::Now();
   data += sizeof(Time);
 
-  for( std::vector<RevReq*>::iterator pos=m_pendingRevs.begin();
+  for( std::map<int, RevReq>::iterator pos=m_pendingRevs.begin();
 	      pos != m_pendingRevs.end(); pos++)
   {
-      *(AquaSimAddress*)data = (*pos)->requestor;  //ack to whom
+      *(AquaSimAddress*)data = pos->second.requestor;  //ack to whom
       data += sizeof(AquaSimAddress);
-      *(Time*)data = (*pos)->StartTime - Simulator::Now();
+      *(Time*)data = pos->second.StartTime - Simulator::Now();
       data += sizeof(Time);
-      *(Time*)data = (*pos)->EndTime - Simulator::Now();
+      *(Time*)data = pos->second.EndTime - Simulator::Now();
       data += sizeof(Time);
-      *(int*)data = (*pos)->acceptedRevID;
+      *(int*)data = pos->second.acceptedRevID;
       data += sizeof(int);
-      *(int*)data = (*pos)->rejectedRevID;
+      *(int*)data = pos->second.rejectedRevID;
       data += sizeof(int);
   }
 
@@ -1135,7 +1170,8 @@ AquaSimCopeMac::MakeMultiRevAck()
   //ch->size() = (m_pendingRevs.size()*(10+10+6+4))/8;
   ash.SetSize(m_pendingRevs.size()*(8+10+6+4)/8);
 
-  Ptr<Packet> tempPacket = Create<Packet>(data,size);
+  Ptr<Packet> tempPacket = Create<Packet>(buf,size);
+  delete[] buf;
   pkt->AddAtEnd(tempPacket);
   pkt->AddHeader(ch);
   pkt->AddHeader(ash);
@@ -1210,10 +1246,9 @@ AquaSimCopeMac::RecordDataPkt(Ptr<Packet> pkt)
   pkt->PeekHeader(ch);
   pkt->AddHeader(ash);
 
-  DataAck* tmp = new DataAck;
-  tmp->Sender = ch.GetSA();
-  tmp->SeqNum = ash.GetUId();
-  m_pendingDataAcks.push_back(tmp);
+  DataAck &tmp = m_pendingDataAcks[ash.GetUId()];
+  tmp.Sender = ch.GetSA();
+  tmp.SeqNum = ash.GetUId();
 
   m_sucDataNum[ch.GetSA()]++;
   // startAckTimer
@@ -1248,7 +1283,8 @@ AquaSimCopeMac::MakeDataAck()
 
 
   uint32_t size = sizeof(uint)+DataAckNum*(sizeof(AquaSimAddress)+sizeof(int));
-  uint8_t *data = new uint8_t[size];
+  uint8_t *buf = new uint8_t[size];
+  uint8_t *data = buf;
 
   //pkt->allocdata(sizeof(uint)+DataAckNum*(sizeof(AquaSimAddress)+sizeof(int)));
   //unsigned char* walk = (unsigned char*)pkt->accessdata();
@@ -1256,16 +1292,17 @@ AquaSimCopeMac::MakeDataAck()
   data += sizeof(uint);
 
 
-  for(std::vector<DataAck*>::iterator pos = m_pendingDataAcks.begin();
+  for(std::map<int, DataAck>::iterator pos = m_pendingDataAcks.begin();
 	  pos != m_pendingDataAcks.end(); pos++ )
   {
-      *(AquaSimAddress*)data = (*pos)->Sender;
+      *(AquaSimAddress*)data = pos->second.Sender;
       data += sizeof(AquaSimAddress);
-      *(int*)data = (*pos)->SeqNum;
+      *(int*)data = pos->second.SeqNum;
       data += sizeof(int);
   }
 
-  Ptr<Packet> tempPacket = Create<Packet>(data,size);
+  Ptr<Packet> tempPacket = Create<Packet>(buf,size);
+  delete[] buf;
   pkt->AddAtEnd(tempPacket);
   pkt->AddHeader(ch);
   pkt->AddHeader(ash);
@@ -1380,23 +1417,15 @@ AquaSimCopeMac::AckWaitTimerExpire(Ptr<Packet> pkt)
 void
 AquaSimCopeMac::CtrlPktInsert(Ptr<Packet> ctrl_p, Time delay)
 {
-  Simulator::Schedule(delay,&AquaSimCopeMac::SendPkt,this,ctrl_p);	//current work around...
-
-  /*Timer tmp = Timer (Timer::CANCEL_ON_DESTROY);
-  tmp.SetFunction(&AquaSimCopeMac::SendPkt);
-  tmp.SetArguments(ctrl_p);
-  tmp.Schedule(delay);
-  m_ctrlQ.push(tmp);*/
+  ClearExpiredElem();
+  m_ctrlQ.push_back(Simulator::Schedule(delay,&AquaSimCopeMac::SendPkt,this,ctrl_p));
 }
 
 void
 AquaSimCopeMac::ClearExpiredElem()
 {
-  Timer tmp;
-  while( (m_ctrlQ.size() >0) && ((m_ctrlQ.front()).IsExpired()) ) {
-      tmp = m_ctrlQ.front();
-      m_ctrlQ.pop();
-      tmp.Remove();
+  while( !m_ctrlQ.empty() && m_ctrlQ.front().IsExpired() ) {
+      m_ctrlQ.pop_front();
   }
 }
 
@@ -1465,14 +1494,13 @@ void AquaSimCopeMac::DoDispose()
     (iter->second).m_mac=0;
   }
   m_AckWaitingList.clear();
-  for (std::vector<RevReq*>::iterator itRev = m_pendingRevs.begin() ; itRev != m_pendingRevs.end(); ++itRev) {
-    delete *itRev;
-    *itRev=0;
-  }
-  for (std::vector<DataAck*>::iterator itData = m_pendingDataAcks.begin() ; itData != m_pendingDataAcks.end(); ++itData) {
-    delete *itData;
-    *itData=0;
+  m_pendingRevs.clear();
+  m_pendingDataAcks.clear();
+  for (std::list<EventId>::iterator itCtrl = m_ctrlQ.begin(); itCtrl != m_ctrlQ.end(); ++itCtrl) {
+    Simulator::Cancel(*itCtrl);
   }
+  m_ctrlQ.clear();
+  m_PktWH.Clear();
   AquaSimMac::DoDispose();
 }
 
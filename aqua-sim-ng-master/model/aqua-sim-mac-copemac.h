@@ -38,7 +38,8 @@
 
 #include <map>
 #include <vector>
-#include <queue>
+#include <deque>
+#include <list>
 
 #define COPEMAC_CALLBACK_DELAY 	0.001
 #define COPEMAC_BACKOFF_TIME	0.01
@@ -54,29 +55,14 @@ namespace ns3{
 //save the incoming packets.
 //-----------------------------------------------
 
-
-struct PktElem{
-  Ptr<Packet> pkt_;
-  PktElem* next_;
-  inline PktElem(): next_(NULL) {
-  }
-  inline PktElem(Ptr<Packet> pkt): pkt_(pkt), next_(NULL) {
-  }
-};
-
+/**
+ * \brief Per-receiver packet queue served by the deficit round robin scheduler
+ */
 struct PktList{
-  PktElem* head;
-  PktElem* tail;
-  inline PktList(): head(NULL), tail(NULL){
-  };
-  inline ~PktList() {
-    PktElem* temp = NULL;
-    while (head != tail ) {
-	temp = head;
-	head = head->next_;
-	temp->pkt_=0;
-	temp->next_ = NULL;
-    }
+  std::deque<Ptr<Packet> > pkts;
+  uint32_t deficit;   //bytes this receiver may still send in the current round
+  bool active;        //true if the receiver is linked into the DRR active list
+  inline PktList(): deficit(0), active(false) {
   }
 };
 
@@ -87,11 +73,17 @@ class AquaSimCopeMac;
  * \ingroup aqua-sim-ng
  *
  * \brief Stores all pending packets within this data structure
+ *
+ * Packets are kept in one FIFO per receiver. Receivers with backlog are
+ * linked into an active list which is served with deficit round robin,
+ * so every neighbour gets the same share of reservation slots regardless
+ * of how many packets are queued for the others.
  */
 class PktWareHouse{
   friend class AquaSimCopeMac;
 private:
   std::map<AquaSimAddress, PktList> Queues;
+  std::deque<AquaSimAddress> m_activeList;
   int m_cachedPktNum;
   bool m_locked;
 public:
@@ -110,6 +102,15 @@ public:
   //}
   void	Insert2PktQs(Ptr<Packet> p);
   bool	DeletePkt(AquaSimAddress Recver, int SeqNum);
+  /*
+   * Run one deficit round robin round. Each backlogged receiver gets
+   * quantum bytes of credit and hands out packets while its credit lasts.
+   * At most maxPerRecver packets are taken from one receiver and at most
+   * maxRecvers receivers are served. Dequeued packets are appended to out.
+   */
+  void	DrrSchedule(uint32_t quantum, uint32_t maxPerRecver, uint32_t maxRecvers,
+		    std::vector<std::pair<AquaSimAddress, Ptr<Packet> > > &out);
+  void	Clear();
 };
 
 
@@ -166,6 +167,7 @@ struct RevElem{
 
   //node may reserve time for itself to send out packet, this timer is used to send packet
   PktSendTimer* m_sendTimer;
+  RevElem*	prev;
   RevElem*	next;
   RevElem();
   RevElem(int RevID_, Time StartTime_,
@@ -179,7 +181,9 @@ struct RevElem{
 class RevQueues : public Object{
 private:
   RevElem* Head_;
+  std::map<int, RevElem*> m_revIndex;  //RevID -> element, avoids list scans on ack
   Ptr<AquaSimCopeMac> mac_;
+  void Unlink(RevElem* elem);
 public:
   RevQueues(Ptr<AquaSimCopeMac> mac);
   ~RevQueues();
@@ -268,6 +272,8 @@ protected:
   void InsertAckWaitingList(Ptr<Packet> p, Time delay);
   void ClearExpiredElem();
   void CtrlPktInsert(Ptr<Packet> ctrl_p, Time delay);
+  Time EarliestDataStart(AquaSimAddress recver);
+  Time MaxRtt();
 
   //timeout functions & Events
 
@@ -300,13 +306,16 @@ private:
   std::map<AquaSimAddress, Time> m_propDelays;  //the propagation delay to neighbors
   std::map<AquaSimAddress, Time> m_ndReceiveTime;   //the time when receives ND packet
   std::map<AquaSimAddress, Time> m_ndDepartNeighborTime;    //the time when neighbor send ND to this node
-  std::vector<RevReq*> m_pendingRevs;  //all pending revs are stored here. Schedule it before sending ack
-  std::vector<DataAck*> m_pendingDataAcks;
+  std::map<int, RevReq> m_pendingRevs;  //all pending revs, keyed by the requestor's major RevID. Schedule it before sending ack
+  std::map<int, DataAck> m_pendingDataAcks;  //keyed by packet uid so duplicated data is acked once
   std::map<AquaSimAddress, int> m_sucDataNum;   //result is here
 
   RevQueues m_RevQ;
   uint m_nextHop;
-  uint m_neighborId;
+  uint32_t m_drrQuantum;	//bytes of credit a receiver gets per DRR round
+  uint32_t m_maxRevPerRecver;	//maximum reservations for one receiver in a multi-rev
+  double m_maxRange;	//m, farthest neighbour a handshake has to reach
+  double m_soundSpeed;	//m/s
   //Time MajorBackupInterval;
   //int MaxSlotRange_;  //the interval between majorInterval and backup
 
@@ -324,7 +333,7 @@ private:
   std::map<int, AckWaitTimer> m_AckWaitingList; //stores the packet is (prepared to) sent out but not receive the ack yet.
 
   Time m_ackTimeOut;
-  std::queue<Timer> m_ctrlQ;
+  std::list<EventId> m_ctrlQ;
   int m_pktSize;
   int m_isParallel;
   int m_NDProcessMaxTimes; //the maximum times of delay measurement
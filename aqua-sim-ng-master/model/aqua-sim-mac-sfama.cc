@@ -27,6 +27,10 @@
 #include "ns3/simulator.h"
 #include "ns3/double.h"
 #include "ns3/integer.h"
+#include "ns3/boolean.h"
+
+#include <sstream>
+#include <algorithm>
 
 namespace ns3 {
 
@@ -62,8 +66,11 @@ void AquaSimSFama_DataSend_Timer::expire()
 AquaSimSFama::AquaSimSFama():m_status(IDLE_WAIT), m_guardTime(0.00001),
     m_slotLen(0), m_isInRound(false), m_isInBackoff(false),
     m_maxBackoffSlots(4), m_maxBurst(1), m_dataSendingInterval(0.0000001),
+  m_trainReservation(false), m_maxTrainGrant(8),
+  m_expectedTrainPkts(1), m_recvTrainPkts(0),
   m_waitSendTimer(this), m_waitReplyTimer(this),
-  m_backoffTimer(this), m_datasendTimer(this)
+  m_backoffTimer(this), m_datasendTimer(this),
+  m_pktRing(16), m_ringHead(0), m_ringSpan(0), m_ringPkts(0), m_trainSent(0)
 {
 	NS_LOG_FUNCTION(this);
 
@@ -91,10 +98,18 @@ AquaSimSFama::GetTypeId(void)
       IntegerValue(4),
       MakeIntegerAccessor (&AquaSimSFama::m_maxBackoffSlots),
       MakeIntegerChecker<int>())
-    .AddAttribute("MaxBurst", "The maximum number of packets in the train. Default is 1",
+    .AddAttribute("MaxBurst", "The maximum number of packets in the train without TrainReservation. Default is 1",
       IntegerValue(1),
       MakeIntegerAccessor(&AquaSimSFama::m_maxBurst),
-      MakeIntegerChecker<int>())
+      MakeIntegerChecker<int>(1, 255))
+    .AddAttribute("TrainReservation", "Reserve a whole packet train with one RTS/CTS and ack it at once. Default is false",
+      BooleanValue(false),
+      MakeBooleanAccessor(&AquaSimSFama::m_trainReservation),
+      MakeBooleanChecker())
+    .AddAttribute("MaxTrainGrant", "The maximum number of packets a receiver grants in one CTS. Default is 8",
+      IntegerValue(8),
+      MakeIntegerAccessor(&AquaSimSFama::m_maxTrainGrant),
+      MakeIntegerChecker<int>(1, 255))
     ;
   return tid;
 }
@@ -164,16 +179,12 @@ AquaSimSFama::TxProcess(Ptr<Packet> p)
 	cmh->size() += hdr_SFAMA::getSize(hdr_SFAMA::SFAMA_DATA);
 	cmh->txtime() = getTxtimeByPktSize(cmh->size());
 */
-#ifdef AquaSimSFama_DEBUG
-  NS_LOG_DEBUG("TxProcess(before)");
-  NS_LOG_DEBUG(PrintAllQ());
-#endif
-	m_CachedPktQ.push(p);
+	RingPush(p);
 #ifdef AquaSimSFama_DEBUG
   NS_LOG_DEBUG("TxProcess(after)");
-  NS_LOG_DEBUG(PrintAllQ());
+  PrintAllQ();
 #endif
-	if( m_CachedPktQ.size() == 1 && GetStatus() == IDLE_WAIT ) {
+	if( m_ringPkts == 1 && GetStatus() == IDLE_WAIT ) {
 		PrepareSendingDATA();
 	}
 	return true;
@@ -198,9 +209,9 @@ AquaSimSFama::GetTime2ComingSlot(double t)
 }
 
 Ptr<Packet>
-AquaSimSFama::MakeRTS(AquaSimAddress recver, int slot_num)
+AquaSimSFama::MakeRTS(AquaSimAddress recver, int slot_num, int pkt_num)
 {
-	NS_LOG_FUNCTION(this << recver.GetAsInt() << slot_num);
+	NS_LOG_FUNCTION(this << recver.GetAsInt() << slot_num << pkt_num);
 
 	Ptr<Packet> rts_pkt = Create<Packet>();
   AquaSimHeader ash;
@@ -221,6 +232,7 @@ AquaSimSFama::MakeRTS(AquaSimAddress recver, int slot_num)
 	//SFAMAh->SA = index_;
 	//SFAMAh->DA = recver;
 	SFAMAh.SetSlotNum(slot_num);
+	SFAMAh.SetPktNum(pkt_num);
 
 	//rts_pkt->next_ = NULL;
 
@@ -233,9 +245,9 @@ AquaSimSFama::MakeRTS(AquaSimAddress recver, int slot_num)
 
 
 Ptr<Packet>
-AquaSimSFama::MakeCTS(AquaSimAddress rts_sender, int slot_num)
+AquaSimSFama::MakeCTS(AquaSimAddress rts_sender, int slot_num, int pkt_num)
 {
-	NS_LOG_FUNCTION(this << rts_sender.GetAsInt() << slot_num);
+	NS_LOG_FUNCTION(this << rts_sender.GetAsInt() << slot_num << pkt_num);
 
 	Ptr<Packet> cts_pkt = Create<Packet>();
   AquaSimHeader ash;
@@ -256,6 +268,7 @@ AquaSimSFama::MakeCTS(AquaSimAddress rts_sender, int slot_num)
 	//SFAMAh->SA = index_;
 	//SFAMAh->DA = rts_sender;
 	SFAMAh.SetSlotNum(slot_num);
+	SFAMAh.SetPktNum(pkt_num);
 
   //cts_pkt->next_ = NULL;
 
@@ -302,9 +315,9 @@ AquaSimSFama::FillDATA(Ptr<Packet> data_pkt)
 
 
 Ptr<Packet>
-AquaSimSFama::MakeACK(AquaSimAddress data_sender)
+AquaSimSFama::MakeACK(AquaSimAddress data_sender, int pkt_num)
 {
-	NS_LOG_FUNCTION(this << data_sender.GetAsInt());
+	NS_LOG_FUNCTION(this << data_sender.GetAsInt() << pkt_num);
 
   Ptr<Packet> ack_pkt = Create<Packet>();
   AquaSimHeader ash;
@@ -324,6 +337,7 @@ AquaSimSFama::MakeACK(AquaSimAddress data_sender)
   SFAMAh.SetPType(SFamaHeader::SFAMA_ACK);
   //SFAMAh->SA = index_;
   //SFAMAh->DA = data_sender;
+  SFAMAh.SetPktNum(pkt_num);
 
 	ack_pkt->AddHeader(mach);
   ack_pkt->AddHeader(SFAMAh);
@@ -361,8 +375,20 @@ AquaSimSFama::ProcessRTS(Ptr<Packet> rts_pkt)
 
 				StopTimers();
 				SetStatus(WAIT_SEND_CTS);
+
+				int slot_num = SFAMAh.GetSlotNum();
+				int pkt_num = SFAMAh.GetPktNum();
+				if( m_trainReservation && pkt_num > m_maxTrainGrant ) {
+					//shrink the window, slots scale with the granted packets
+					slot_num = (slot_num*m_maxTrainGrant + pkt_num - 1)/pkt_num;
+					pkt_num = m_maxTrainGrant;
+				}
+				m_trainSender = mach.GetSA();
+				m_expectedTrainPkts = pkt_num;
+				m_recvTrainPkts = 0;
+
 				//reply a cts
-				m_waitSendTimer.m_pkt = MakeCTS(mach.GetSA(), SFAMAh.GetSlotNum());
+				m_waitSendTimer.m_pkt = MakeCTS(mach.GetSA(), slot_num, pkt_num);
         m_waitSendTimer.SetFunction(&AquaSimSFama_Wait_Send_Timer::expire,&m_waitSendTimer);
         m_waitSendTimer.Schedule(Seconds(time2comingslot));
 		}
@@ -404,6 +430,10 @@ AquaSimSFama::ProcessCTS(Ptr<Packet> cts_pkt)
 		//send DATA
 		StopTimers();
 		SetStatus(WAIT_SEND_DATA);
+		if( m_trainReservation && SFAMAh.GetPktNum() > 0 && SFAMAh.GetPktNum() < m_trainIdx.size() ) {
+			//packets beyond the granted window stay in the ring for the next train
+			m_trainIdx.resize(SFAMAh.GetPktNum());
+		}
 		//send the packet
 		m_waitSendTimer.m_pkt = NULL;
     m_waitSendTimer.SetFunction(&AquaSimSFama_Wait_Send_Timer::expire,&m_waitSendTimer);
@@ -445,7 +475,30 @@ AquaSimSFama::ProcessDATA(Ptr<Packet> data_pkt)
 	data_pkt->AddHeader(SFAMAh);
 	data_pkt->AddHeader(ash);
 
-	if( mach.GetDA() == AquaSimAddress::ConvertFrom(m_device->GetAddress()) && GetStatus() == WAIT_RECV_DATA ) {
+	if( m_trainReservation && mach.GetDA() == AquaSimAddress::ConvertFrom(m_device->GetAddress()) &&
+	    GetStatus() == WAIT_RECV_DATA && mach.GetSA() == m_trainSender ) {
+		//only the in-order prefix is acked, packets behind a gap are resent
+		uint32_t pos = SFAMAh.GetPktNum();
+		if( pos == (uint32_t)m_recvTrainPkts ) {
+			data_pkt->RemoveHeader(ash);
+			data_pkt->RemoveHeader(SFAMAh);
+			ash.SetSize(SFAMAh.GetSize(SFamaHeader::SFAMA_DATA));
+			data_pkt->AddHeader(SFAMAh);
+			data_pkt->AddHeader(ash);
+			SendUp(data_pkt->Copy());
+			m_recvTrainPkts++;
+		}
+
+		//ack the whole train once its last packet arrived
+		if( m_recvTrainPkts >= m_expectedTrainPkts || pos + 1 >= (uint32_t)m_expectedTrainPkts ) {
+			StopTimers();
+			SetStatus(WAIT_SEND_ACK);
+			m_waitSendTimer.m_pkt = MakeACK(mach.GetSA(), m_recvTrainPkts);
+			m_waitSendTimer.SetFunction(&AquaSimSFama_Wait_Send_Timer::expire,&m_waitSendTimer);
+			m_waitSendTimer.Schedule(Seconds(GetTime2ComingSlot(Simulator::Now().ToDouble(Time::S))));
+		}
+	}
+	else if( mach.GetDA() == AquaSimAddress::ConvertFrom(m_device->GetAddress()) && GetStatus() == WAIT_RECV_DATA ) {
 		//send ACK
 		StopTimers();
 		SetStatus(WAIT_SEND_ACK);
@@ -463,6 +516,9 @@ AquaSimSFama::ProcessDATA(Ptr<Packet> data_pkt)
 
 		SendUp(data_pkt->Copy()); /*the original one will be released*/
 	}
+	else if( mach.GetDA() == AquaSimAddress::ConvertFrom(m_device->GetAddress()) && GetStatus() == WAIT_SEND_ACK ) {
+		//tail of a train which is already being acked, keep the ack timer
+	}
 	else {
 		//do backoff
 		double backoff_time = 1+GetTime2ComingSlot(Simulator::Now().ToDouble(Time::S)) /*for ack*/;
@@ -488,10 +544,6 @@ AquaSimSFama::ProcessACK(Ptr<Packet> ack_pkt)
 	ack_pkt->AddHeader(SFAMAh);
 	ack_pkt->AddHeader(ash);
 
-  NS_LOG_DEBUG("ProcessACK(before)");
-#ifdef AquaSimSFama_DEBUG
-  NS_LOG_DEBUG(PrintAllQ());
-#endif
   NS_LOG_DEBUG("ProcessACK: Status is " << GetStatus());
 
 	if( mach.GetDA() == AquaSimAddress::ConvertFrom(m_device->GetAddress()) && GetStatus() == WAIT_RECV_ACK ) {
@@ -499,7 +551,7 @@ AquaSimSFama::ProcessACK(Ptr<Packet> ack_pkt)
 		SetStatus(IDLE_WAIT);
 
 		//release data packets have been sent successfully
-		ReleaseSentPkts();
+		ReleaseSentPkts(m_trainReservation ? SFAMAh.GetPktNum() : m_trainIdx.size());
 
 		//start to prepare for sending next DATA packet
 		PrepareSendingDATA();
@@ -516,7 +568,7 @@ AquaSimSFama::ProcessACK(Ptr<Packet> ack_pkt)
 	*/
   NS_LOG_DEBUG("ProcessACK(after)");
 #ifdef AquaSimSFama_DEBUG
-  NS_LOG_DEBUG(PrintAllQ());
+  PrintAllQ();
 #endif
 }
 
@@ -531,90 +583,113 @@ AquaSimSFama::StopTimers()
 
 
 void
-AquaSimSFama::ReleaseSentPkts()
+AquaSimSFama::ReleaseSentPkts(uint32_t pkt_num)
 {
-	Ptr<Packet> tmp = Create<Packet>();
+	if( pkt_num > m_trainIdx.size() ) {
+		pkt_num = m_trainIdx.size();
+	}
 
-	while( !m_sendingPktQ.empty() ) {
-		tmp = m_sendingPktQ.front();
-		m_sendingPktQ.pop();
-		tmp=0;
+	for( uint32_t i=0; i<pkt_num; i++ ) {
+		m_pktRing[m_trainIdx[i]].pkt = 0;
+		m_ringPkts--;
 	}
+	//unacked packets of the train are picked up again by the next train
+	m_trainIdx.clear();
+	m_trainSent = 0;
+	RingTrimHead();
 }
 
 void
-AquaSimSFama::PrepareSendingDATA()
+AquaSimSFama::RingPush(Ptr<Packet> pkt)
 {
-	std::queue<Ptr<Packet> > tmpQ_;
-	Ptr<Packet> tmp_pkt;
-	AquaSimAddress recver_addr;
-	int pkt_num = 1;
+	if( m_ringSpan == m_pktRing.size() ) {
+		RingGrow();
+	}
 
-	if( m_sendingPktQ.empty() && m_CachedPktQ.empty() ) {
-		return;
+	AquaSimHeader ash;
+	SFamaHeader SFAMAh;
+	MacHeader mach;
+	pkt->RemoveHeader(ash);
+	pkt->RemoveHeader(SFAMAh);
+	pkt->PeekHeader(mach);
+	pkt->AddHeader(SFAMAh);
+	pkt->AddHeader(ash);
+
+	AquaSimSFamaPktEntry &entry = m_pktRing[(m_ringHead+m_ringSpan) % m_pktRing.size()];
+	entry.pkt = pkt;
+	entry.recver = mach.GetDA();
+	entry.txTime = ash.GetTxTime();
+	m_ringSpan++;
+	m_ringPkts++;
+}
+
+void
+AquaSimSFama::RingGrow()
+{
+	uint32_t cap = m_pktRing.size();
+	std::vector<AquaSimSFamaPktEntry> ring(2*cap);
+	for( uint32_t i=0; i<m_ringSpan; i++ ) {
+		ring[i] = m_pktRing[(m_ringHead+i) % cap];
+	}
+	for( uint32_t i=0; i<m_trainIdx.size(); i++ ) {
+		m_trainIdx[i] = (m_trainIdx[i] + cap - m_ringHead) % cap;
 	}
+	m_pktRing.swap(ring);
+	m_ringHead = 0;
+}
 
-	if( !m_sendingPktQ.empty() && GetStatus() == IDLE_WAIT  ) {
-			AquaSimHeader ash;
-			SFamaHeader SFAMAh;
-			MacHeader mach;
-			m_sendingPktQ.front()->RemoveHeader(ash);
-			m_sendingPktQ.front()->RemoveHeader(SFAMAh);
-			m_sendingPktQ.front()->PeekHeader(mach);
-			m_sendingPktQ.front()->AddHeader(SFAMAh);
-			m_sendingPktQ.front()->AddHeader(ash);
-      recver_addr = mach.GetDA();
-	} else if( !m_CachedPktQ.empty() && GetStatus() == IDLE_WAIT ) {
-    NS_LOG_DEBUG("PrepareSendingDATA(before)");
-#ifdef AquaSimSFama_DEBUG
-    NS_LOG_DEBUG(PrintAllQ());
-#endif
-		AquaSimHeader ash_tmp;
-		SFamaHeader SFAMAh_tmp;
-		MacHeader mach_tmp;
-
-		tmp_pkt = m_CachedPktQ.front();
-		tmp_pkt->RemoveHeader(ash_tmp);
-		tmp_pkt->RemoveHeader(SFAMAh_tmp);
-		tmp_pkt->PeekHeader(mach_tmp);
-		tmp_pkt->AddHeader(SFAMAh_tmp);
-		tmp_pkt->AddHeader(ash_tmp);
-    recver_addr = mach_tmp.GetDA();
-		m_CachedPktQ.pop();
-		m_sendingPktQ.push(tmp_pkt);
-		pkt_num = 1;
-
-		/*get at most m_maxBurst DATA packets with same receiver*/
-		while( (pkt_num < m_maxBurst) && (!m_CachedPktQ.empty()) ) {
-			tmp_pkt = m_CachedPktQ.front();
-			m_CachedPktQ.pop();
-
-			if( recver_addr == mach_tmp.GetDA() ) {
-				m_sendingPktQ.push(tmp_pkt);
-				pkt_num ++;
-			}
-			else {
-				tmpQ_.push(tmp_pkt);
-			}
+void
+AquaSimSFama::RingTrimHead()
+{
+	while( m_ringSpan > 0 && m_pktRing[m_ringHead].pkt == NULL ) {
+		m_ringHead = (m_ringHead+1) % m_pktRing.size();
+		m_ringSpan--;
+	}
+}
 
+void
+AquaSimSFama::BuildTrain()
+{
+	/*
+	 * get at most m_maxBurst DATA packets with same receiver, in arrival order.
+	 * With train reservation take every packet queued for the receiver, the
+	 * RTS advertises them all (up to the 255 its pkt_num holds) and the CTS
+	 * trims the train to the grant.
+	 */
+	m_trainIdx.clear();
+	m_trainSent = 0;
+
+	uint32_t maxTrain = m_trainReservation ? std::min<uint32_t>(m_pktRing.size(), 255) : (uint32_t)m_maxBurst;
+	AquaSimAddress recver_addr;
+	for( uint32_t i=0; i<m_ringSpan && m_trainIdx.size() < maxTrain; i++ ) {
+		uint32_t pos = (m_ringHead+i) % m_pktRing.size();
+		if( m_pktRing[pos].pkt == NULL ) {
+			continue;
 		}
-
-		//make sure the rest packets are stored in the original order
-		while( !m_CachedPktQ.empty() ) {
-			tmpQ_.push(m_CachedPktQ.front());
-			m_CachedPktQ.pop();
+		if( m_trainIdx.empty() ) {
+			recver_addr = m_pktRing[pos].recver;
 		}
-
-		while( !tmpQ_.empty() ) {
-			m_CachedPktQ.push(tmpQ_.front());
-			tmpQ_.pop();
+		if( m_pktRing[pos].recver == recver_addr ) {
+			m_trainIdx.push_back(pos);
 		}
+	}
+}
 
-  NS_LOG_DEBUG("PrepareSendingDATA(after)");
+void
+AquaSimSFama::PrepareSendingDATA()
+{
+	if( m_ringPkts == 0 || GetStatus() != IDLE_WAIT ) {
+		return;
+	}
+
+	if( m_trainIdx.empty() ) {
+		BuildTrain();
 #ifdef AquaSimSFama_DEBUG
-  NS_LOG_DEBUG(PrintAllQ());
+		NS_LOG_DEBUG("PrepareSendingDATA(after)");
+		PrintAllQ();
 #endif
 	}
+	AquaSimAddress recver_addr = m_pktRing[m_trainIdx.front()].recver;
 
   SFamaHeader SFAMAh;
 	double additional_txtime = GetPktTrainTxTime()-
@@ -622,7 +697,7 @@ AquaSimSFama::PrepareSendingDATA()
 
 
 	ScheduleRTS(recver_addr, (additional_txtime/m_slotLen)+1 /*for ceil*/
-	+1/*the basic slot*/ );
+	+1/*the basic slot*/, m_trainIdx.size() );
 }
 
 double
@@ -630,35 +705,22 @@ AquaSimSFama::GetPktTrainTxTime()
 {
 	double txtime = 0.0;
 
-	int q_size = m_sendingPktQ.size();
-  NS_LOG_DEBUG("GetPktTrainTxTime(before) \n");
-#ifdef AquaSimSFama_DEBUG
-	NS_LOG_DEBUG(PrintAllQ());
-#endif
-  AquaSimHeader ash;
-	for(int i=0; i<q_size; i++ ) {
-    m_sendingPktQ.front()->PeekHeader(ash);
-    txtime += ash.GetTxTime().ToDouble(Time::S);
-		m_sendingPktQ.push(m_sendingPktQ.front());
-		m_sendingPktQ.pop();
+	for( uint32_t i=0; i<m_trainIdx.size(); i++ ) {
+		txtime += m_pktRing[m_trainIdx[i]].txTime.ToDouble(Time::S);
 	}
-NS_LOG_DEBUG("GetPktTrainTxTime(after) \n");
-#ifdef AquaSimSFama_DEBUG
-NS_LOG_DEBUG(PrintAllQ());
-#endif
 
-	txtime += (q_size-1)*m_dataSendingInterval;
+	txtime += ((int)m_trainIdx.size()-1)*m_dataSendingInterval;
 
 	return txtime;
 }
 
 
 void
-AquaSimSFama::ScheduleRTS(AquaSimAddress recver, int slot_num)
+AquaSimSFama::ScheduleRTS(AquaSimAddress recver, int slot_num, int pkt_num)
 {
 	double backoff_time = RandBackoffSlots()*m_slotLen+GetTime2ComingSlot(Simulator::Now().ToDouble(Time::S));
 	SetStatus(WAIT_SEND_RTS);
-	m_waitSendTimer.m_pkt = MakeRTS(recver, slot_num);
+	m_waitSendTimer.m_pkt = MakeRTS(recver, slot_num, pkt_num);
   m_waitSendTimer.SetFunction(&AquaSimSFama_Wait_Send_Timer::expire,&m_waitSendTimer);
   m_waitSendTimer.Schedule(Seconds(backoff_time));
 }
@@ -809,6 +871,15 @@ AquaSimSFama::WaitSendTimerProcess(Ptr<Packet> pkt)
 void
 AquaSimSFama::WaitReplyTimerProcess(bool directcall)
 {
+	if( !directcall && m_trainReservation && GetStatus() == WAIT_RECV_DATA && m_recvTrainPkts > 0 ) {
+		//part of the train is lost, ack what arrived so the sender only resends the rest
+		SetStatus(WAIT_SEND_ACK);
+		m_waitSendTimer.m_pkt = MakeACK(m_trainSender, m_recvTrainPkts);
+		m_waitSendTimer.SetFunction(&AquaSimSFama_Wait_Send_Timer::expire,&m_waitSendTimer);
+		m_waitSendTimer.Schedule(Seconds(GetTime2ComingSlot(Simulator::Now().ToDouble(Time::S))));
+		return;
+	}
+
 	/*do backoff*/
 	double backoff_time = RandBackoffSlots()*m_slotLen + GetTime2ComingSlot(Simulator::Now().ToDouble(Time::S));
 	#ifdef AquaSimSFama_DEBUG
@@ -831,58 +902,32 @@ AquaSimSFama::WaitReplyTimerProcess(bool directcall)
 void
 AquaSimSFama::DataSendTimerProcess()
 {
-  NS_LOG_DEBUG("DataSendTimerProcess(before) \n");
-#ifdef AquaSimSFama_DEBUG
-  NS_LOG_DEBUG(PrintAllQ());
-#endif
-
-	if( !m_sendingPktQ.empty() ) {
-		Ptr<Packet> pkt = m_sendingPktQ.front();
-    AquaSimHeader ash;
-    pkt->PeekHeader(ash);
-		Time txtime = ash.GetTxTime();
-		m_BackupSendingPktQ.push(pkt);
-
-		m_sendingPktQ.pop();
+	if( m_trainSent < m_trainIdx.size() ) {
+		AquaSimSFamaPktEntry &entry = m_pktRing[m_trainIdx[m_trainSent]];
+		Ptr<Packet> pkt = entry.pkt->Copy();
+		if( m_trainReservation ) {
+			//position in the train, the receiver acks the in-order prefix
+			AquaSimHeader ash;
+			SFamaHeader SFAMAh;
+			pkt->RemoveHeader(ash);
+			pkt->RemoveHeader(SFAMAh);
+			SFAMAh.SetPktNum(m_trainSent);
+			pkt->AddHeader(SFAMAh);
+			pkt->AddHeader(ash);
+		}
+		m_trainSent++;
 
-		SendDataPkt(pkt->Copy());
+		SendDataPkt(pkt);
 
     m_datasendTimer.SetFunction(&AquaSimSFama_DataSend_Timer::expire,&m_datasendTimer);
-    m_datasendTimer.Schedule(Seconds(m_dataSendingInterval)+txtime);
+    m_datasendTimer.Schedule(Seconds(m_dataSendingInterval)+entry.txTime);
 	}
 	else {
-	  while( !m_BackupSendingPktQ.empty() ) {
-		//push all packets into m_sendingPktQ. After getting ack, release them
-		m_sendingPktQ.push(m_BackupSendingPktQ.front());
-		m_BackupSendingPktQ.pop();
-	  }
+	  //the train stays in the ring. After getting ack, release them
+	  m_trainSent = 0;
 	  //status_handler.is_ack() = false;
     Simulator::Schedule(Seconds(0.0000001),&AquaSimSFama::SlotInitHandler,this);
-	  /*
-		UnderwaterSensorNode* n=(UnderwaterSensorNode*) node_;
-		n->SetTransmissionStatus(IDLE);
-		m_waitReplyTimer.resched(m_slotLen+getTime2ComingSlot(Simulator::Now()));
-			switch(getStatus()) {
-			  case WAIT_SEND_RTS:
-				setStatus(WAIT_RECV_CTS);
-				break;
-			  case WAIT_SEND_CTS:
-				setStatus(WAIT_RECV_DATA);
-				break;
-			  case WAIT_SEND_DATA:
-				setStatus(WAIT_RECV_ACK);
-				break;
-			  default:
-				printf("status error!\n");
-				break;
-
-			}
-			*/
 	}
-  NS_LOG_DEBUG("DataSendTimerProcess(after) \n");
-#ifdef AquaSimSFama_DEBUG
-  NS_LOG_DEBUG(PrintAllQ());
-#endif
 }
 
 
@@ -953,18 +998,10 @@ AquaSimSFama::SlotInitHandler()
 
 void AquaSimSFama::DoDispose()
 {
-	while (!m_sendingPktQ.empty()) {
-		m_sendingPktQ.front()=0;
-		m_sendingPktQ.pop();
-	}
-	while (!m_CachedPktQ.empty()) {
-		m_CachedPktQ.front()=0;
-		m_CachedPktQ.pop();
-	}
-	while (!m_BackupSendingPktQ.empty()) {
-		m_BackupSendingPktQ.front()=0;
-		m_BackupSendingPktQ.pop();
-	}
+	m_pktRing.clear();
+	m_trainIdx.clear();
+	m_ringSpan = 0;
+	m_ringPkts = 0;
 	m_rand=0;
 	AquaSimMac::DoDispose();
 }
@@ -973,29 +1010,18 @@ void AquaSimSFama::DoDispose()
 void
 AquaSimSFama::PrintAllQ()
 {
-  NS_LOG_INFO("Time " << Simulator::Now().GetSeconds() << " node " <<
-                m_device->GetNode() << ". m_CachedPktQ:");
-  NS_LOG_INFO(m_CachedPktQ);
-  NS_LOG_INFO("m_sendingPktQ:");
-  NS_LOG_INFO(m_sendingPktQ);
-}
-
-void
-AquaSimSFama::PrintQ(std::queue< Ptr<Packet> >& my_q)
-{
-	std::queue<Ptr<Packet> > tmp_q;
+  std::ostringstream ring;
   AquaSimHeader ash;
-  while(!my_q.empty()) {
-    my_q.front()->PeekHeader(ash);
-    printf("%d\t", ash.GetUId());
-		tmp_q.push(my_q.front());
-		my_q.pop();
-	}
-
-	while(!tmp_q.empty()) {
-	  my_q.push(tmp_q.front());
-	  tmp_q.pop();
-	}
+  for( uint32_t i=0; i<m_ringSpan; i++ ) {
+    uint32_t pos = (m_ringHead+i) % m_pktRing.size();
+    if( m_pktRing[pos].pkt != NULL ) {
+      m_pktRing[pos].pkt->PeekHeader(ash);
+      ring << ash.GetUId() << "->" << m_pktRing[pos].recver << "\t";
+    }
+  }
+  NS_LOG_INFO("Time " << Simulator::Now().GetSeconds() << " node " <<
+                m_device->GetNode() << ". ring: " << ring.str() <<
+                " train size: " << m_trainIdx.size());
 }
 
 #endif
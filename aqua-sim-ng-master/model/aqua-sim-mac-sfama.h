@@ -29,7 +29,7 @@
 #include "ns3/timer.h"
 #include "ns3/random-variable-stream.h"
 
-#include <queue>
+#include <vector>
 
 #define AquaSimSFAMA_DEBUG 0
 
@@ -161,8 +161,24 @@ enum AquaSimSFama_Status{
 	  BACKOFF_FAIR
 };
 
+/**
+ * \brief Entry of the SFAMA outgoing packet ring
+ */
+struct AquaSimSFamaPktEntry {
+  Ptr<Packet> pkt;	//NULL once the packet has been acked
+  AquaSimAddress recver;
+  Time txTime;
+};
+
 /**
  * \brief Slotted FAMA protocol
+ *
+ * With TrainReservation enabled the RTS advertises how many packets are
+ * queued for the receiver, the CTS grants a window of packets (and slots)
+ * and the ACK reports how many packets of the train arrived in order, so a
+ * single handshake covers a whole packet train. Every data packet carries
+ * its position in the train; the receiver drops packets behind a gap and the
+ * sender resends everything after the acked prefix.
  */
 class AquaSimSFama: public AquaSimMac{
 public:
@@ -203,6 +219,12 @@ private:
 	int m_maxBurst; /*maximum number of packets in the train*/
 	double m_dataSendingInterval;
 
+	bool m_trainReservation;	/*grant and ack packet trains in one handshake*/
+	int m_maxTrainGrant;	/*maximum number of packets granted in one CTS*/
+	int m_expectedTrainPkts;	/*packets granted to the current data sender*/
+	int m_recvTrainPkts;	/*in-order prefix of the current train received so far*/
+	AquaSimAddress m_trainSender;
+
 	//wait to send pkt at the beginning of next slot
 	AquaSimSFama_Wait_Send_Timer m_waitSendTimer;
 	//wait for the corresponding reply. Timeout if fail to get
@@ -211,9 +233,17 @@ private:
 	AquaSimSFama_Backoff_Timer    m_backoffTimer;
 	AquaSimSFama_DataSend_Timer	m_datasendTimer;
 
-	std::queue<Ptr<Packet> > m_sendingPktQ;
-	std::queue<Ptr<Packet> > m_CachedPktQ;
-	std::queue<Ptr<Packet> > m_BackupSendingPktQ;
+	/*
+	 * All outgoing DATA packets in arrival order. Acked packets leave a hole
+	 * which is skipped once it reaches the head. The current train is a list
+	 * of ring positions, so nothing is moved between queues.
+	 */
+	std::vector<AquaSimSFamaPktEntry> m_pktRing;
+	uint32_t m_ringHead;
+	uint32_t m_ringSpan;	/*occupied positions from head, holes included*/
+	uint32_t m_ringPkts;	/*packets still waiting for an ack*/
+	std::vector<uint32_t> m_trainIdx;
+	uint32_t m_trainSent;
 
 	//packet_t UpperLayerPktType;
   Ptr<UniformRandomVariable> m_rand;
@@ -221,10 +251,10 @@ private:
   int m_slotNumHandler;
 protected:
   /// creating packets, with the appropriate headers, using the assigned parameter(s)
-	Ptr<Packet> MakeRTS(AquaSimAddress recver, int slot_num);
-	Ptr<Packet> MakeCTS(AquaSimAddress rts_sender, int slot_num);
+	Ptr<Packet> MakeRTS(AquaSimAddress recver, int slot_num, int pkt_num=1);
+	Ptr<Packet> MakeCTS(AquaSimAddress rts_sender, int slot_num, int pkt_num=1);
 	Ptr<Packet> FillDATA(Ptr<Packet> data_pkt);
-	Ptr<Packet> MakeACK(AquaSimAddress data_sender);
+	Ptr<Packet> MakeACK(AquaSimAddress data_sender, int pkt_num=1);
 
   /// handle different packet types
 	void ProcessRTS(Ptr<Packet> rts_pkt);
@@ -241,13 +271,18 @@ protected:
 	enum AquaSimSFama_Status GetStatus();
 
 	void StopTimers();
-	void ReleaseSentPkts();
+	void ReleaseSentPkts(uint32_t pkt_num);
+
+	void RingPush(Ptr<Packet> pkt);
+	void RingGrow();
+	void RingTrimHead();
+	void BuildTrain();
 
 	void PrepareSendingDATA();
 
 	double GetPktTrainTxTime();
 
-	void ScheduleRTS(AquaSimAddress recver, int slot_num);
+	void ScheduleRTS(AquaSimAddress recver, int slot_num, int pkt_num=1);
 
 	double GetTime2ComingSlot(double t);
 
@@ -255,7 +290,6 @@ protected:
   void SlotInitHandler();
 
 #ifdef AquaSimSFama_DEBUG
-	void PrintQ(std::queue<Ptr<Packet> >& my_q);
 	void PrintAllQ();
 #endif
 
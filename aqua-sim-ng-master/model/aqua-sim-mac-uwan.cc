@@ -24,41 +24,28 @@
 #include "aqua-sim-pt-tag.h"
 //#include "vbf/vectorbasedforward.h"
 
+#include "aqua-sim-phy.h"
+#include "aqua-sim-energy-model.h"
+
 #include "ns3/double.h"
+#include "ns3/integer.h"
 #include "ns3/log.h"
+#include "ns3/simulator.h"
 
 #include <algorithm>
+#include <cmath>
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE("AquaSimUwan");
 NS_OBJECT_ENSURE_REGISTERED(AquaSimUwan);
 
-AquaSimUwan_WakeTimer::~AquaSimUwan_WakeTimer()
-{
-  m_mac=0;
-  //most likely memory leak
-}
-
-void
-AquaSimUwan_WakeTimer::expire()
-{
-  m_mac->Wakeup(m_ScheT->nodeId_);
-}
-
 void
 AquaSimUwan_SleepTimer::expire()
 {
   m_mac->Sleep();
 }
 
-
-void
-AquaSimUwan_PktSendTimer::expire()
-{
-  m_mac->TxPktProcess(this);
-}
-
 void
 AquaSimUwan_StartTimer::expire()
 {
@@ -85,6 +72,9 @@ AquaSimUwan::AquaSimUwan():
   m_startTimer.SetFunction(&AquaSimUwan_StartTimer::expire,&m_startTimer);
 	m_startTimer.Schedule(Seconds(0.001));
 	m_nextHopNum = 0;
+	m_maxBatch = 4;
+	m_alignWindow = Seconds(1.0);
+	m_maxMissedCycles = 3;
 
   m_rand=CreateObject<UniformRandomVariable> ();
 }
@@ -107,6 +97,18 @@ AquaSimUwan::GetTypeId(void)
       TimeValue(MilliSeconds(1)),
       MakeTimeAccessor(&AquaSimUwan::m_stdCyclePeriod),
       MakeTimeChecker ())
+    .AddAttribute ("MaxBatch", "Maximum number of queued packets sent in one own wake window.",
+      IntegerValue(4),
+      MakeIntegerAccessor(&AquaSimUwan::m_maxBatch),
+      MakeIntegerChecker<int>(1))
+    .AddAttribute ("AlignWindow", "Maximum shift of the own send time to fall into a neighbour's wake window.",
+      TimeValue(Seconds(1.0)),
+      MakeTimeAccessor(&AquaSimUwan::m_alignWindow),
+      MakeTimeChecker ())
+    .AddAttribute ("MaxMissedCycles", "Number of silent cycles a neighbour's wake-up is still predicted for.",
+      IntegerValue(3),
+      MakeIntegerAccessor(&AquaSimUwan::m_maxMissedCycles),
+      MakeIntegerChecker<int>(0))
     ;
   return tid;
 }
@@ -130,7 +132,7 @@ AquaSimUwan::SendInfo()
 }
 
 
-void
+Time
 AquaSimUwan::SendFrame(Ptr<Packet> p, bool IsMacPkt, Time delay)
 {
   AquaSimHeader ash;
@@ -139,31 +141,14 @@ AquaSimUwan::SendFrame(Ptr<Packet> p, bool IsMacPkt, Time delay)
   ash.SetTxTime( Seconds(ash.GetSize() * m_encodingEfficiency/m_bitRate));
   p->AddHeader(ash);
 
-	AquaSimUwan_PktSendTimer *tmp = new AquaSimUwan_PktSendTimer(this);
-	tmp->SetTxTime(ash.GetTxTime());
-	tmp->m_p = p;
-  tmp->SetFunction(&AquaSimUwan_PktSendTimer::expire,tmp);
-  tmp->Schedule(delay);
-	m_pktSendTimerSet.insert(tmp);
-
-	//pkt_send_timer.SetTxTime(HDR_CMN(p)->txtime());
-	//pkt_send_timer.m_p = p;
-	//pkt_send_timer.resched(delay);  //set transmission status when this timer expires
-
-	//Scheduler::instance().schedule(downtarget_, p, delay+0.0001);  //phy->Recv(p)
-	/*if( !IsMacPkt ) {
-		Scheduler::instance().schedule(&callback_handler,
-						&callback_event, delay_time+UWAN_CALLBACK_DELAY);
-	}*/
-	//callback_handler ?????????
+	m_wakeSchQueue.PushTx(Simulator::Now()+delay, p, ash.GetTxTime());
+	return ash.GetTxTime();
 }
 
 
 void
-AquaSimUwan::TxPktProcess(AquaSimUwan_PktSendTimer* pkt_send_timer)
+AquaSimUwan::TxPktProcess(Ptr<Packet> p, Time txTime)
 {
-	Ptr<Packet> p = pkt_send_timer->m_p;
-	pkt_send_timer->m_p = NULL;
 	if( m_device->GetTransmissionStatus() == SEND
 			|| m_device->GetTransmissionStatus() == RECV ) {
 		//if the status is not IDLE (SEND or RECV), the scheduled event cannot be
@@ -173,18 +158,16 @@ AquaSimUwan::TxPktProcess(AquaSimUwan_PktSendTimer* pkt_send_timer)
 			drop_->recv(p,"Schedule Failure");
 		else*/
       p=0;
-		m_pktSendTimerSet.erase(pkt_send_timer);
 		return;
 	}
 
 	//m_device->SetTransmissionStatus(SEND);
 	AquaSimHeader ashLocal;
 	p->RemoveHeader(ashLocal);
-	ashLocal.SetTxTime(pkt_send_timer->GetTxTime());
+	ashLocal.SetTxTime(txTime);
 	p->AddHeader(ashLocal);
 
 	SendDown(p);
-	m_pktSendTimerSet.erase(pkt_send_timer);
 }
 
 
@@ -320,26 +303,34 @@ AquaSimUwan::Wakeup(AquaSimAddress node_id)
 */
 			default:
 				//not this node's SYNC period, just send out the data packet
-				m_nextCyclePeriod = GenNxCyclePeriod();
+				m_nextCyclePeriod = AlignToSharedWindow(GenNxCyclePeriod());
 				break;
 		}
 
     Time maxPropTime = Seconds(2*m_maxPropTime.ToDouble(Time::S));
-		if( ! m_wakeSchQueue.CheckGuardTime(m_nextCyclePeriod, maxPropTime, m_maxTxTime) ) {
+		if( ! m_wakeSchQueue.CheckGuardTime(m_nextCyclePeriod, maxPropTime, BatchTxTime()) ) {
 			m_nextCyclePeriod =
 				m_wakeSchQueue.GetAvailableSendTime(now+m_wakePeriod,
-										m_nextCyclePeriod, maxPropTime, m_maxTxTime);
+										m_nextCyclePeriod, maxPropTime, BatchTxTime());
 		}
 
-		m_wakeSchQueue.Push(m_nextCyclePeriod, AquaSimAddress::ConvertFrom(m_device->GetAddress()) , m_nextCyclePeriod-now);
+		m_wakeSchQueue.Push(m_nextCyclePeriod, AquaSimAddress::ConvertFrom(m_device->GetAddress()));
 		//m_wakeSchQueue.Print(2*m_maxPropTime, m_maxTxTime, true, AquaSimAddress::ConvertFrom(m_device->GetAddress()) );
+		Time batchTime = Seconds(0);
 		if( m_packetQueue.empty() )
 			SendFrame(MakeSYNCPkt(m_nextCyclePeriod-now),true);
 		else
-			SendoutPkt(m_nextCyclePeriod);
+			batchTime = SendoutBatch(m_nextCyclePeriod);
+
+		//stay awake until the whole batch is out
+		if( m_sleepTimer.IsRunning() )
+			m_sleepTimer.Cancel();
+		SetSleepTimer(m_wakePeriod + batchTime);
+		return;
 	}
 	else {
 		m_CL.erase(node_id);
+		PredictWake(node_id);
 	}
 
 	//set the sleep timer
@@ -351,6 +342,94 @@ AquaSimUwan::Wakeup(AquaSimAddress node_id)
 }
 
 
+Time
+AquaSimUwan::BatchTxTime()
+{
+	return Seconds(m_maxBatch*m_maxTxTime.ToDouble(Time::S));
+}
+
+
+/*
+ * Move the own send time into the wake window of a neighbour that wakes up
+ * close to it anyway. The own transmission then starts one guard time plus
+ * one frame after the neighbour's, which keeps it collision free while both
+ * wake-ups are served by a single power-on.
+ */
+Time
+AquaSimUwan::AlignToSharedWindow(Time Candidate)
+{
+	Time wakeTime;
+	Time guardTime = Seconds(2*m_maxPropTime.ToDouble(Time::S));
+
+	if( !m_wakeSchQueue.FindSharedWindow(Candidate, m_alignWindow,
+				AquaSimAddress::ConvertFrom(m_device->GetAddress()), wakeTime) ) {
+		return Candidate;
+	}
+
+	Time aligned = wakeTime + guardTime + m_maxTxTime;
+	if( aligned < Simulator::Now() + m_wakePeriod ||
+	    !m_wakeSchQueue.CheckGuardTime(aligned, guardTime, BatchTxTime()) ) {
+		return Candidate;
+	}
+	return aligned;
+}
+
+
+/*
+ * Record a send time announced by src and (re)schedule the wake-up for it.
+ * Two announcements that are less than a wake period apart describe the
+ * same cycle (e.g. SYNC and hello), only distinct cycles update the average.
+ */
+void
+AquaSimUwan::LearnSchedule(AquaSimAddress src, Time WakeTime)
+{
+	UwanNeighborSchedule &sch = m_nbSchedule[src];
+
+	if( sch.samples_ > 0 && WakeTime - sch.lastWake_ > m_wakePeriod ) {
+		double cycle = (WakeTime - sch.lastWake_).ToDouble(Time::S);
+		if( sch.samples_ > 1 ) {
+			//announcements may have been missed in between, average per cycle
+			double avg = sch.avgCycle_.ToDouble(Time::S);
+			double cycles = (avg > 0) ? std::floor(cycle/avg + 0.5) : 1;
+			if( cycles > 1 )
+				cycle /= cycles;
+		}
+		if( sch.samples_ == 1 )
+			sch.avgCycle_ = Seconds(cycle);
+		else
+			sch.avgCycle_ = Seconds(0.875*sch.avgCycle_.ToDouble(Time::S) + 0.125*cycle);
+		sch.samples_++;
+	}
+	else if( sch.samples_ == 0 ) {
+		sch.samples_ = 1;
+	}
+	sch.lastWake_ = WakeTime;
+	sch.missed_ = 0;
+
+	m_wakeSchQueue.Push(WakeTime, src);
+}
+
+
+/*
+ * We are waking up for node_id now. Its next send time will normally be
+ * announced during this wake window and replace the prediction pushed here;
+ * if the announcement is lost we still wake up for it on its usual cycle.
+ */
+void
+AquaSimUwan::PredictWake(AquaSimAddress node_id)
+{
+	std::map<AquaSimAddress, UwanNeighborSchedule>::iterator it = m_nbSchedule.find(node_id);
+	if( it == m_nbSchedule.end() || it->second.samples_ < 2 ||
+	    it->second.missed_ >= m_maxMissedCycles ) {
+		return;
+	}
+
+	it->second.missed_++;
+	it->second.predictedWake_ = Simulator::Now() + it->second.avgCycle_;
+	m_wakeSchQueue.Push(it->second.predictedWake_, node_id, true);
+}
+
+
 void
 AquaSimUwan::Sleep()
 {
@@ -424,8 +503,7 @@ AquaSimUwan::RecvProcess(Ptr<Packet> p)
 	if( (ptag.GetPacketType() == AquaSimPtTag::PT_UWAN_HELLO) ||
         (ptag.GetPacketType() == AquaSimPtTag::PT_UWAN_SYNC) ) {
 		//the process to hello packet is same to SYNC packet
-		m_wakeSchQueue.Push(Seconds(SYNC_h.GetCyclePeriod())+Simulator::Now(), src,
-                          Seconds(SYNC_h.GetCyclePeriod()));
+		LearnSchedule(src, Seconds(SYNC_h.GetCyclePeriod())+Simulator::Now());
 		//m_wakeSchQueue.Print(2*m_maxPropTime, m_maxTxTime, false, index_);
 	}
 	else {
@@ -440,8 +518,13 @@ AquaSimUwan::RecvProcess(Ptr<Packet> p)
         NS_LOG_INFO("RecvProcess: node(" << m_device->GetNode() << ")" );
 				//printf("node(%d) recv %s\n", index_, packet_info.name(cmh->ptype()));
 
-			m_wakeSchQueue.Push(Seconds(SYNC_h.GetCyclePeriod())+Simulator::Now(), src,
-                            Seconds(SYNC_h.GetCyclePeriod()) );
+			LearnSchedule(src, Seconds(SYNC_h.GetCyclePeriod())+Simulator::Now());
+
+			//more frames of the sender's batch may follow
+			if( m_sleepTimer.IsRunning() && m_sleepTimer.GetDelayLeft() < m_listenPeriod ) {
+				m_sleepTimer.Cancel();
+				SetSleepTimer(m_listenPeriod);
+			}
 			//m_wakeSchQueue.Print(2*m_maxPropTime, m_maxTxTime, false, index_);
       p->Print(std::cout);
 
@@ -449,6 +532,8 @@ AquaSimUwan::RecvProcess(Ptr<Packet> p)
 			ProcessMissingList(p, src);  //hello is sent to src in this function
 
 			if( dst == m_device->GetAddress() || dst == AquaSimAddress::GetBroadcast() ) {
+				if( Phy()->EM() != NULL )
+					Phy()->EM()->NotifyPktDelivered();
 				SendUp(p);
 				return true;
 			}
@@ -494,7 +579,7 @@ AquaSimUwan::SYNCSchedule(bool initial)
 	m_nextCyclePeriod = m_initialCyclePeriod + now;
 	if( initial ) {
 		Time RandomDelay = Seconds(m_rand->GetValue(0.0, m_initialCyclePeriod.ToDouble(Time::S)) );
-		m_wakeSchQueue.Push(m_nextCyclePeriod+RandomDelay, AquaSimAddress::ConvertFrom(m_device->GetAddress()) , m_nextCyclePeriod+RandomDelay-now);
+		m_wakeSchQueue.Push(m_nextCyclePeriod+RandomDelay, AquaSimAddress::ConvertFrom(m_device->GetAddress()));
 		//m_wakeSchQueue.Print(2*m_maxPropTime, m_maxTxTime, true, index_);
 		SendFrame(MakeSYNCPkt(m_nextCyclePeriod-now), true, RandomDelay);
 		return;
@@ -509,7 +594,7 @@ AquaSimUwan::SYNCSchedule(bool initial)
 						m_nextCyclePeriod, Seconds(2*m_maxPropTime.ToDouble(Time::S)), m_maxTxTime);
 	}
 
-	m_wakeSchQueue.Push(m_nextCyclePeriod, AquaSimAddress::ConvertFrom(m_device->GetAddress()) , m_nextCyclePeriod-now);
+	m_wakeSchQueue.Push(m_nextCyclePeriod, AquaSimAddress::ConvertFrom(m_device->GetAddress()));
 	//m_wakeSchQueue.Print(2*m_maxPropTime, m_maxTxTime, true, index_);
 	SendFrame(MakeSYNCPkt(m_nextCyclePeriod-now),true);
 }
@@ -535,13 +620,32 @@ AquaSimUwan::Start()
 /*
  * send out one packet from upper layer
  */
-void
-AquaSimUwan::SendoutPkt(Time NextCyclePeriod)
+Time
+AquaSimUwan::SendoutBatch(Time NextCyclePeriod)
+{
+  NS_LOG_FUNCTION(this);
+
+	/*
+	 * Neighbours woke up for this window anyway, so drain up to m_maxBatch
+	 * packets back to back instead of one packet per cycle.
+	 */
+	Time offset = Seconds(0);
+	for( int i=0; i<m_maxBatch && !m_packetQueue.empty(); i++ ) {
+		if( i > 0 )
+			offset += Seconds(0.0001);
+		offset += SendoutPkt(NextCyclePeriod, offset);
+	}
+	return offset;
+}
+
+
+Time
+AquaSimUwan::SendoutPkt(Time NextCyclePeriod, Time delay)
 {
   NS_LOG_FUNCTION(this);
 
 	if( m_packetQueue.empty() ) {
-			return; /*because there is no packet, this node cannot sendout packet.
+			return Seconds(0); /*because there is no packet, this node cannot sendout packet.
 					 * This is due to the stupid idea proposed by the authors of this protocol.
 					 * They think mac protocol cannot when it will sendout the next packet.
 					 * However, even a newbie knows it is impossible.
@@ -563,8 +667,8 @@ AquaSimUwan::SendoutPkt(Time NextCyclePeriod)
 	//hdr_uwvb* vbh = hdr_uwvb::access(pkt);
 	/*next_hop() is set in IP layerequal to the */
 
-	//fill the SYNC & Missing list header
-	FillSYNCHdr(pkt, NextCyclePeriod-Simulator::Now());
+	//fill the SYNC & Missing list header, the period counts from when it goes on air
+	FillSYNCHdr(pkt, NextCyclePeriod-(Simulator::Now()+delay));
 	//whether backoff?
 	FillMissingList(pkt);
 
@@ -588,7 +692,7 @@ AquaSimUwan::SendoutPkt(Time NextCyclePeriod)
   pkt->AddHeader(mach);
   pkt->AddHeader(ash);
 
-	SendFrame(pkt, false);
+	return SendFrame(pkt, false, delay);
 }
 
 
@@ -649,10 +753,8 @@ void AquaSimUwan::DoDispose()
     m_packetQueue.front()=0;
     m_packetQueue.pop();
   }
-  for (std::set<AquaSimUwan_PktSendTimer *>::iterator it=m_pktSendTimerSet.begin(); it!=m_pktSendTimerSet.end(); ++it) {
-    delete (*it);
-  }
-  m_pktSendTimerSet.clear();
+  m_wakeSchQueue.Clear();
+  m_nbSchedule.clear();
   m_rand=0;
   AquaSimMac::DoDispose();
 }
@@ -668,175 +770,227 @@ ScheduleQueue::GetTypeId(void)
 }
 
 void
-ScheduleQueue::Push(Time SendTime, AquaSimAddress node_id, Time Interval)
+ScheduleQueue::Push(Time SendTime, AquaSimAddress node_id, bool predicted)
 {
-	ScheduleTime* newElem = new ScheduleTime(SendTime, node_id, m_mac);
-	newElem->timer_.SetFunction(&AquaSimUwan_WakeTimer::expire,&newElem->timer_);
-	newElem->Start(Interval);
+	//a node has only one next send time, drop the older one
+	std::map<AquaSimAddress, EventMap::iterator>::iterator idx = m_wakeIndex.find(node_id);
+	if( idx != m_wakeIndex.end() ) {
+		m_events.erase(idx->second);
+		m_wakeIndex.erase(idx);
+	}
 
-	ScheduleTime* pos = m_head->next_;
-	ScheduleTime* pre_pos = m_head;
+	if( SendTime < Simulator::Now() ) {
+		Rearm();
+		return;
+	}
 
-	//find the position where new element should be insert
-	while( pos != NULL ) {
-		if( pos->SendTime_ > SendTime ) {
-			break;
-		}
-		else {
-			pos = pos->next_;
-			pre_pos = pre_pos->next_;
-		}
+	ScheduleTime newElem;
+	newElem.type_ = UWAN_WAKE;
+	newElem.SendTime_ = SendTime;
+	newElem.nodeId_ = node_id;
+	newElem.predicted_ = predicted;
 
-	}
-	/*
-	 * insert new element after pre_pos
-	 */
-	newElem->next_ = pos;
-	pre_pos->next_ = newElem;
+	//equal times keep insertion order
+	m_wakeIndex[node_id] = m_events.insert(std::make_pair(SendTime, newElem));
+	Rearm();
 }
 
 
-//get the top element, but not pop it
-ScheduleTime*
-ScheduleQueue::Top()
+void
+ScheduleQueue::PushTx(Time SendTime, Ptr<Packet> pkt, Time txTime)
 {
-	return m_head->next_;
+	ScheduleTime newElem;
+	newElem.type_ = UWAN_TX;
+	newElem.SendTime_ = SendTime;
+	newElem.pkt_ = pkt;
+	newElem.txTime_ = txTime;
+
+	m_events.insert(std::make_pair(SendTime, newElem));
+	Rearm();
 }
 
-//pop the top element
+
 void
-ScheduleQueue::Pop()
+ScheduleQueue::Rearm()
 {
-	if( m_head->next_ != NULL ) {
+	if( m_events.empty() ) {
+		m_timer.Cancel();
+		return;
+	}
+
+	m_timer.Cancel();
+	Time delay = m_events.begin()->first - Simulator::Now();
+	if( delay.IsNegative() )
+		delay = Seconds(0);
+	m_timer = Simulator::Schedule(delay, &ScheduleQueue::Expire, this);
+}
 
-		ScheduleTime* tmp = m_head->next_;
-		m_head->next_ = m_head->next_->next_;
 
-    //may not be necessary due to CANCEL_ON_DESTROY
-		if( tmp->timer_.IsRunning() ) {
-			tmp->timer_.Cancel();
+void
+ScheduleQueue::Expire()
+{
+	//take every due event first, the handlers push new ones
+	std::vector<ScheduleTime> due;
+	Time now = Simulator::Now();
+	while( !m_events.empty() && m_events.begin()->first <= now ) {
+		EventMap::iterator it = m_events.begin();
+		if( it->second.type_ == UWAN_WAKE ) {
+			m_wakeIndex.erase(it->second.nodeId_);
 		}
+		due.push_back(it->second);
+		m_events.erase(it);
+	}
 
-		delete tmp;
+	for( std::vector<ScheduleTime>::iterator it = due.begin(); it != due.end(); it++ ) {
+		if( it->type_ == UWAN_WAKE )
+			m_mac->Wakeup(it->nodeId_);
+		else
+			m_mac->TxPktProcess(it->pkt_, it->txTime_);
 	}
+	Rearm();
 }
 
 
-bool
-ScheduleQueue::CheckGuardTime(Time SendTime, Time GuardTime, Time MaxTxTime)
+/*
+ * Find the latest WAKE entry before SendTime and the first one at or after it.
+ */
+void
+ScheduleQueue::PrevNextWake(Time SendTime, bool &hasPrev, Time &prev, bool &hasNext, Time &next)
 {
-	ScheduleTime* pos = m_head->next_;
-	ScheduleTime* pre_pos = m_head;
-
-	while( pos != NULL && SendTime > pos->SendTime_ ) {
-		pos = pos->next_;
-		pre_pos = pre_pos->next_;
-	}
+	EventMap::iterator pos = m_events.lower_bound(SendTime);
 
-	/*now, pos->SendTime > SendTime > pre_pos->SendTime
-	 *start to check the sendtime.
-	 */
-	if( pos == NULL ) {
-		if( pre_pos == m_head )
-			return true;
-		else {
-			if( SendTime - pre_pos->SendTime_ >= GuardTime )
-				return true;
-			else
-				return false;
+	hasNext = false;
+	for( EventMap::iterator it = pos; it != m_events.end(); it++ ) {
+		if( it->second.type_ == UWAN_WAKE ) {
+			next = it->first;
+			hasNext = true;
+			break;
 		}
 	}
-	else {
-		if( pre_pos == m_head ) {
-			if( (pos->SendTime_ - SendTime) > (GuardTime + MaxTxTime) )
-				return true;
-			else
-				return false;
-		}
-		else {
-			if( ((pos->SendTime_ - SendTime) > (GuardTime + MaxTxTime))
-				&& (SendTime - pre_pos->SendTime_ >= GuardTime) )
-				return true;
-			else
-				return false;
+
+	hasPrev = false;
+	for( EventMap::iterator it = pos; it != m_events.begin(); ) {
+		it--;
+		if( it->second.type_ == UWAN_WAKE ) {
+			prev = it->first;
+			hasPrev = true;
+			break;
 		}
 	}
 }
 
 
+bool
+ScheduleQueue::CheckGuardTime(Time SendTime, Time GuardTime, Time MaxTxTime)
+{
+	bool hasPrev, hasNext;
+	Time prev, next;
+	PrevNextWake(SendTime, hasPrev, prev, hasNext, next);
+
+	/*now, next >= SendTime > prev
+	 *start to check the sendtime.
+	 */
+	if( hasPrev && SendTime - prev < GuardTime )
+		return false;
+	if( hasNext && (next - SendTime) <= (GuardTime + MaxTxTime) )
+		return false;
+	return true;
+}
+
+
 
 Time
 ScheduleQueue::GetAvailableSendTime(Time StartTime,
 							Time OriginalSchedule, Time GuardTime, Time MaxTxTime)
 {
-	ScheduleTime* pos = m_head->next_;
-	ScheduleTime* pre_pos = m_head;
+	bool hasPrev, hasNext;
+	Time prev, next;
+	PrevNextWake(StartTime, hasPrev, prev, hasNext, next);
+	if( !hasPrev )
+		prev = Seconds(0.0);
 
 	Time DeltaTime = Seconds(0.0);
-	while( pos != NULL && StartTime > pos->SendTime_ ) {
-		pos = pos->next_;
-		pre_pos = pre_pos->next_;
-	}
+	EventMap::iterator pos = m_events.lower_bound(StartTime);
+	for( ; pos != m_events.end(); pos++ ) {
+		if( pos->second.type_ != UWAN_WAKE )
+			continue;
 
-	while( pos != NULL ) {
-		DeltaTime = pos->SendTime_ - pre_pos->SendTime_ -
+		DeltaTime = pos->first - prev -
                         (Seconds(2*GuardTime.ToDouble(Time::S)) + MaxTxTime);
 		if( DeltaTime.IsPositive() ) {
-      double min = pre_pos->SendTime_.ToDouble(Time::S) +
+      double min = prev.ToDouble(Time::S) +
                     GuardTime.ToDouble(Time::S) +
                     MaxTxTime.ToDouble(Time::S);
-      double max = pre_pos->SendTime_.ToDouble(Time::S) +
+      double max = prev.ToDouble(Time::S) +
                     DeltaTime.ToDouble(Time::S);
-      Ptr<UniformRandomVariable> m_rand = CreateObject<UniformRandomVariable> ();
-      return Seconds(m_rand->GetValue(min,max));
+      return Seconds(m_mac->m_rand->GetValue(min,max));
 		}
-
-		pos = pos->next_;
-		pre_pos = pre_pos->next_;
+		prev = pos->first;
 	}
 
 	//there is no available interval, so the time out of range of this queue is returned.
 	/*
 	 * Before calling this function, OriginalSchedule collides with other times,
-	 * so originalSchedule is at most pre_pos->SendTime_ + GuardTime + MaxTxTime.
+	 * so originalSchedule is at most prev + GuardTime + MaxTxTime.
 	 * Otherwise, it cannot collides.
 	 */
-	return pre_pos->SendTime_ + MaxTxTime + GuardTime ;
+	return prev + MaxTxTime + GuardTime ;
+}
+
+
+bool
+ScheduleQueue::FindSharedWindow(Time Candidate, Time Tolerance, AquaSimAddress self, Time &WakeTime)
+{
+	EventMap::iterator it = m_events.lower_bound(Candidate - Tolerance);
+	for( ; it != m_events.end() && it->first <= Candidate + Tolerance; it++ ) {
+		if( it->second.type_ == UWAN_WAKE && !(it->second.nodeId_ == self) ) {
+			WakeTime = it->first;
+			return true;
+		}
+	}
+	return false;
 }
 
 
 void
 ScheduleQueue::ClearExpired(Time CurTime)
 {
-	ScheduleTime* NextSch = NULL;
-	while( (NextSch = Top()) && NextSch->SendTime_ < CurTime ) {
-		Pop();
+	//due entries are removed when they fire, only stale wake-ups can be left
+	EventMap::iterator it = m_events.begin();
+	while( it != m_events.end() && it->first < CurTime ) {
+		if( it->second.type_ == UWAN_WAKE ) {
+			m_wakeIndex.erase(it->second.nodeId_);
+			m_events.erase(it++);
+		}
+		else {
+			it++;
+		}
 	}
 }
 
 
+void
+ScheduleQueue::Clear()
+{
+	m_timer.Cancel();
+	m_events.clear();
+	m_wakeIndex.clear();
+}
+
+
 void
 ScheduleQueue::Print(Time GuardTime, Time MaxTxTime, bool IsMe, AquaSimAddress index)
 {
-	ScheduleTime* pos = m_head->next_;
-	/*char file_name[30];
-	strcpy(file_name, "schedule_");
-	file_name[strlen(file_name)+1] = '\0';
-	file_name[strlen(file_name)] = char(index+'0');
-	FILE* stream = fopen(file_name, "a");
-	*/
 	if( IsMe )
 	  NS_LOG_INFO("I send ");
-	while( pos != NULL ) {
-	    NS_LOG_INFO("(" << pos->SendTime_ << "--" <<
-			pos->SendTime_+MaxTxTime << ", " <<
-			pos->SendTime_+GuardTime+MaxTxTime);
-	   	//fprintf(stream, "(%f--%f, %f) ", pos->SendTime_,
-		//	pos->SendTime_+MaxTxTime, pos->SendTime_+GuardTime+MaxTxTime);
-		pos = pos->next_;
+	for( EventMap::iterator pos = m_events.begin(); pos != m_events.end(); pos++ ) {
+	    if( pos->second.type_ != UWAN_WAKE )
+	      continue;
+	    NS_LOG_INFO("(" << pos->first << "--" <<
+			pos->first+MaxTxTime << ", " <<
+			pos->first+GuardTime+MaxTxTime <<
+			(pos->second.predicted_ ? ", predicted)" : ")"));
 	}
-	//fprintf(stream, "\n");
-	//fclose(stream);
 }
 
 } // namespace ns3
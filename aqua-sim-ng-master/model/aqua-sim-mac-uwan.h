@@ -23,12 +23,14 @@
 
 #include "ns3/timer.h"
 #include "ns3/nstime.h"
+#include "ns3/event-id.h"
 
 #include "aqua-sim-address.h"
 #include "aqua-sim-mac.h"
 #include "aqua-sim-channel.h"
 
 #include <set>
+#include <map>
 #include <queue>
 
 #define UWAN_CALLBACK_DELAY 0.001
@@ -38,92 +40,85 @@
 namespace ns3{
 
 class AquaSimUwan;
-struct ScheduleTime;
-
-/**
- * \ingroup aqua-sim-ng
- *
- * \brief Helper timer class for UWAN
- */
-class AquaSimUwan_WakeTimer: public Timer {
-friend class AquaSimUwan;
-friend class ScheduleQueue;
-public:
-  AquaSimUwan_WakeTimer() {}
-  ~AquaSimUwan_WakeTimer();
-  AquaSimUwan_WakeTimer(Ptr<AquaSimUwan> mac, ScheduleTime* ScheT)
-    : Timer(Timer::CANCEL_ON_DESTROY)
-  {
-    m_mac = mac;
-    m_ScheT = ScheT;
-  }
-
-protected:
-	Ptr<AquaSimUwan> m_mac;
-	ScheduleTime* m_ScheT;
-	void expire();
-};
 
 /*
- * Data structure for neighbors' schedule
+ * Events kept in the UWAN schedule. WAKE entries are the send times of this
+ * node and its neighbours (announced in SYNC/hello/data headers or predicted
+ * from a neighbour's observed cycle), TX entries are frames waiting for their
+ * transmission time.
  */
+enum UwanEventType {
+	UWAN_WAKE,
+	UWAN_TX
+};
 
 struct ScheduleTime {
-	ScheduleTime* next_;
+	UwanEventType	type_;
 	Time		SendTime_;
 	AquaSimAddress	nodeId_;  //with this field, we can determine that which node will send packet.
-	AquaSimUwan_WakeTimer	timer_;  //necessary
-	//Ptr<Packet>  pkt_;    //the packet this node should send out
+	bool		predicted_;  //WAKE only: not announced, derived from the observed cycle
+	Ptr<Packet>	pkt_;    //TX only: the packet this node should send out
+	Time		txTime_;
 
-	ScheduleTime(Time SendTime, AquaSimAddress node_id, Ptr<AquaSimUwan> mac):
-			next_(NULL), SendTime_(SendTime), nodeId_(node_id), timer_(mac, this) {
+	ScheduleTime(): type_(UWAN_WAKE), predicted_(false) {
 	}
+};
 
-	~ScheduleTime() {
-    if (timer_.IsRunning()) timer_.Remove();
-    //memory leak most likely
-  }
-
-	void Start(Time Delay) {
-		if( Delay.IsPositive() || Delay.IsZero() )
-		  timer_.Schedule(Delay);
+/*
+ * Observed schedule of one neighbour
+ */
+struct UwanNeighborSchedule {
+	Time	lastWake_;	//latest announced send time (absolute)
+	Time	avgCycle_;	//smoothed interval between two announced send times
+	Time	predictedWake_;	//wake-up predicted while announcements are missed
+	int	samples_;
+	int	missed_;	//cycles predicted in a row without hearing an announcement
+
+	UwanNeighborSchedule(): samples_(0), missed_(0) {
 	}
-
 };
 
 
 /**
  * \brief Helper scheduling class for UWAN
  * The SendTime in SYNC should be translated to absolute time and then insert into ScheduleQueue
+ *
+ * Wake-ups and frame transmissions share one time ordered map and a single
+ * simulator event which is always armed for the earliest entry. Each node
+ * has at most one pending WAKE entry, so a newer announcement replaces the
+ * older (or predicted) one.
  */
 class ScheduleQueue{
 private:
-	ScheduleTime* m_head;
+	typedef std::multimap<Time, ScheduleTime> EventMap;
+
+	EventMap	m_events;
+	std::map<AquaSimAddress, EventMap::iterator> m_wakeIndex;
+	EventId		m_timer;
 	Ptr<AquaSimUwan> m_mac;
+
+	void Rearm();
+	void Expire();
+	void PrevNextWake(Time SendTime, bool &hasPrev, Time &prev, bool &hasNext, Time &next);
 public:
 	ScheduleQueue(Ptr<AquaSimUwan> mac): m_mac(mac) {
-		m_head = new ScheduleTime(Seconds(0), AquaSimAddress(), NULL);
 	}
 
 	~ScheduleQueue() {
-		ScheduleTime* tmp;
-		while( m_head != NULL ) {
-			tmp = m_head;
-			m_head = m_head->next_;
-			delete tmp;
-		}
-    m_mac=0;
+		Clear();
+		m_mac=0;
 	}
 
 	static TypeId GetTypeId(void);
 
 public:
-	void Push(Time SendTime, AquaSimAddress node_id, Time Interval);  //first parameter is the time when sending next packet, the last one is the time interval between current time and sending time
-	ScheduleTime* Top();		//NULL is returned if the queue is empty
-	void Pop();
-	bool CheckGuardTime(Time SendTime, Time GuardTime, Time MaxTxTime); //the efficiency is too low, I prefer to use the function below
+	void Push(Time SendTime, AquaSimAddress node_id, bool predicted = false);  //SendTime is the absolute time when node_id sends next packet
+	void PushTx(Time SendTime, Ptr<Packet> pkt, Time txTime);
+	bool CheckGuardTime(Time SendTime, Time GuardTime, Time MaxTxTime);
 	Time GetAvailableSendTime(Time StartTime, Time OriginalSchedule, Time GuardTime, Time MaxTxTime);
+	bool FindSharedWindow(Time Candidate, Time Tolerance, AquaSimAddress self, Time &WakeTime);
 	void ClearExpired(Time CurTime);
+	void Clear();
 	void Print(Time GuardTime, Time MaxTxTime, bool IsMe, AquaSimAddress index);
 };
 
@@ -145,38 +140,6 @@ protected:
 	void expire();
 };
 
-/**
- * \brief Helper timer class for UWAN
- */
-class AquaSimUwan_PktSendTimer: public Timer {
-friend class AquaSimUwan;
-public:
-	AquaSimUwan_PktSendTimer(Ptr<AquaSimUwan> mac): Timer(Timer::CANCEL_ON_DESTROY) {
-		m_mac = mac;
-	}
-  ~AquaSimUwan_PktSendTimer() {
-    m_p=0;
-    m_mac=0;
-  }
-
-  void SetTxTime(Time txTime) {
-    m_txTime = txTime;
-  }
-	Time GetTxTime() {
-		return m_txTime;
-	}
-
-	//Ptr<Packet>& pkt() {
-	//	return m_p;
-	//}
-public:
-	Ptr<Packet> m_p;
-protected:
-	Ptr<AquaSimUwan> m_mac;
-	Time	m_txTime;
-	void expire();
-};
-
 /**
  * \brief Helper timer class for UWAN
  */
@@ -200,11 +163,10 @@ protected:
  */
 class AquaSimUwan: public AquaSimMac{
 	friend class AquaSimUwan_CallbackHandler;
-	friend class AquaSimUwan_WakeTimer;
 	friend class AquaSimUwan_SleepTimer;
 	friend class AquaSimUwan_StatusHandler;
-	friend class AquaSimUwan_PktSendTimer;
 	friend class AquaSimUwan_StartTimer;
+	friend class ScheduleQueue;
 	friend class AquaSimUwan_TxStatusHandler;
 	//friend AquaSimUwan_SendPktTimer;
 
@@ -223,8 +185,8 @@ public:
 	virtual  bool TxProcess(Ptr<Packet>);
 
 protected:
-	void	SendFrame(Ptr<Packet> p, bool IsMacPkt, Time delay = Seconds(0.0));
-	void	TxPktProcess(AquaSimUwan_PktSendTimer* pkt_send_timer);
+	Time	SendFrame(Ptr<Packet> p, bool IsMacPkt, Time delay = Seconds(0.0));	//returns the tx time of p
+	void	TxPktProcess(Ptr<Packet> p, Time txTime);
 
 
 //	AquaSimUwan_PktSendTimer	pkt_send_timer;
@@ -239,7 +201,12 @@ protected:
 
 	void	Wakeup(AquaSimAddress node_id);  //perhaps I should calculate the energy consumption in these two functions
 	void	Sleep();
-	void	SendoutPkt(Time NextCyclePeriod);
+	Time	SendoutPkt(Time NextCyclePeriod, Time delay = Seconds(0.0));
+	Time	SendoutBatch(Time NextCyclePeriod);
+	Time	AlignToSharedWindow(Time Candidate);
+	Time	BatchTxTime();
+	void	LearnSchedule(AquaSimAddress src, Time WakeTime);
+	void	PredictWake(AquaSimAddress node_id);
 	//bool	setWakeupTimer(); //if the node still need to keep wake, return false.
 	void	SetSleepTimer(Time Interval);     //keep awake for To, and then fall sleep
 	void	Start();	//initilize NexCyclePeriod_ and the sleep timer, sendout first SYNC pkt
@@ -277,7 +244,11 @@ private:
 	int		m_cycleCounter;   //count the number of cycle.
 	int		m_numPktSend;
 	uint		m_nextHopNum;
-	std::set<AquaSimUwan_PktSendTimer *> m_pktSendTimerSet;
+
+	std::map<AquaSimAddress, UwanNeighborSchedule> m_nbSchedule;
+	int		m_maxBatch;	//packets sent back to back in one own wake window
+	Time		m_alignWindow;	//how far the own send time may move to share a neighbour's wake window
+	int		m_maxMissedCycles;	//stop predicting a neighbour after this many silent cycles
 
   Ptr<UniformRandomVariable> m_rand;
 
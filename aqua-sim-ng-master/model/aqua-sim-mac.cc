@@ -74,11 +74,17 @@ AquaSimMac::GetTypeId(void)
     "Trace source indicating a packet has been received and will be delivered to the Routing layer.",
     MakeTraceSourceAccessor (&AquaSimMac::m_macRxTrace),
     "ns3::AquaSimMac::RxCallback")
+  .AddTraceSource ("HolBlocking",
+    "Time a frame spent at the head of the send queue before it was transmitted.",
+    MakeTraceSourceAccessor (&AquaSimMac::m_holTrace),
+    "ns3::AquaSimMac::HolBlockingCallback")
   ;
   return tid;
 }
 
 AquaSimMac::AquaSimMac() :
+  m_txEndTime(Seconds(0)), m_headSince(Seconds(0)),
+  m_holTotal(Seconds(0)), m_holMax(Seconds(0)), m_holSamples(0),
   m_bitRate(1e4)/*10kbps*/, m_encodingEfficiency(1)
 {
 }
@@ -170,24 +176,134 @@ AquaSimMac::SendDown(Ptr<Packet> p, TransStatus afterTrans)
       return false;
    }
 
-  if (m_device->GetTransmissionStatus() == RECV) {
-      NS_LOG_DEBUG("SendDown::Recv, queuing pkt");
+  /*
+   * Busy while receiving or while our own frame is still on air; frames
+   * queued earlier also go first so the queue stays FIFO.
+   */
+  TransStatus status = m_device->GetTransmissionStatus();
+  if (status == RECV || (status == SEND && Simulator::Now() < m_txEndTime) ||
+      !m_sendQueue.empty()) {
+      NS_LOG_DEBUG("SendDown::Busy(" << status << "), queuing pkt");
+      if (m_sendQueue.empty())
+        m_headSince = Simulator::Now();
       m_sendQueue.push(std::make_pair(p,afterTrans));
+      ScheduleDrain();
       return true;
   }
-  else {
-      m_device->SetTransmissionStatus(SEND);
-      AquaSimHeader ash;
-      p->RemoveHeader(ash);
-      if (ash.GetTxTime().IsNegative()) ash.SetTxTime(GetTxTime(p));
-      NS_LOG_DEBUG("Me(" << this->m_address.GetAsInt() << "): Sending packet to Phy : " << ash.GetSize() << " bytes ; " << ash.GetTxTime().GetSeconds() << " sec. ; Dest: " << ash.GetDAddr().GetAsInt() << " ; Src: " << ash.GetSAddr().GetAsInt() << " ; Next H.: " << ash.GetNextHop().GetAsInt());
-      Simulator::Schedule(ash.GetTxTime(), &AquaSimNetDevice::SetTransmissionStatus,m_device,afterTrans);
-      p->AddHeader(ash);
-      //slightly awkard but for phy header Buffer
-      AquaSimPacketStamp pstamp;
-      p->AddHeader(pstamp);
-      return Phy()->Recv(p);
+  return TransmitFrame(p, afterTrans);
+}
+
+bool
+AquaSimMac::TransmitFrame(Ptr<Packet> p, TransStatus afterTrans)
+{
+  m_device->SetTransmissionStatus(SEND);
+  AquaSimHeader ash;
+  p->RemoveHeader(ash);
+  if (ash.GetTxTime().IsNegative()) ash.SetTxTime(GetTxTime(p));
+  NS_LOG_DEBUG("Me(" << this->m_address.GetAsInt() << "): Sending packet to Phy : " << ash.GetSize() << " bytes ; " << ash.GetTxTime().GetSeconds() << " sec. ; Dest: " << ash.GetDAddr().GetAsInt() << " ; Src: " << ash.GetSAddr().GetAsInt() << " ; Next H.: " << ash.GetNextHop().GetAsInt());
+  m_txEndTime = Simulator::Now() + ash.GetTxTime();
+  Simulator::Schedule(ash.GetTxTime(), &AquaSimNetDevice::SetTransmissionStatus,m_device,afterTrans);
+  p->AddHeader(ash);
+  //slightly awkard but for phy header Buffer
+  AquaSimPacketStamp pstamp;
+  p->AddHeader(pstamp);
+  return Phy()->Recv(p);
+}
+
+/*
+ * Earliest time the head of the send queue may go out. While receiving the
+ * end of the reception is unknown here, as it is while sleeping, so the
+ * next status transition has to tell us (known == false).
+ */
+Time
+AquaSimMac::EarliestTxTime(bool &known)
+{
+  known = true;
+  switch (m_device->GetTransmissionStatus())
+  {
+    case NIDLE:
+      return Max(Simulator::Now(), m_txEndTime);
+    case SEND:
+      if (m_txEndTime > Simulator::Now())
+        return m_txEndTime;
+      //the status change at the end of our frame is still pending
+      known = false;
+      return Simulator::Now();
+    default:
+      known = false;
+      return Simulator::Now();
+  }
+}
+
+void
+AquaSimMac::ScheduleDrain()
+{
+  if (m_sendQueue.empty() || m_drainEvent.IsRunning())
+    return;
+
+  bool known;
+  Time at = EarliestTxTime(known);
+  if (!known)
+    return;
+  //never call back into SendDown from inside a status change
+  m_drainEvent = Simulator::Schedule(at - Simulator::Now(), &AquaSimMac::DrainSendQueue, this);
+}
+
+void
+AquaSimMac::DrainSendQueue()
+{
+  if (m_sendQueue.empty())
+    return;
+
+  bool known;
+  Time at = EarliestTxTime(known);
+  if (!known || at > Simulator::Now()) {
+    ScheduleDrain();
+    return;
   }
+
+  std::pair<Ptr<Packet>,TransStatus> element = SendQueuePop();
+  NS_LOG_DEBUG("DrainSendQueue: sending queued pkt, " << m_sendQueue.size() << " left");
+  TransmitFrame(element.first, element.second);
+  ScheduleDrain();
+}
+
+void
+AquaSimMac::NotifyTransmissionStatus(TransStatus status)
+{
+  NS_LOG_FUNCTION(this << status);
+  ScheduleDrain();
+}
+
+void
+AquaSimMac::RecordHolBlocking()
+{
+  Time hol = Simulator::Now() - m_headSince;
+  m_holTotal += hol;
+  m_holSamples++;
+  if (hol > m_holMax)
+    m_holMax = hol;
+  m_holTrace(hol);
+}
+
+Time
+AquaSimMac::GetMeanHolBlocking()
+{
+  if (m_holSamples == 0)
+    return Seconds(0);
+  return Seconds(m_holTotal.ToDouble(Time::S) / m_holSamples);
+}
+
+Time
+AquaSimMac::GetMaxHolBlocking()
+{
+  return m_holMax;
+}
+
+uint32_t
+AquaSimMac::GetHolSamples()
+{
+  return m_holSamples;
 }
 
 void
@@ -225,10 +341,7 @@ AquaSimMac::Recv(Ptr<Packet> p) {
   //assert(initialized());
   NS_LOG_FUNCTION(this);
   NS_ASSERT(m_device);// && m_phy && m_rout);
-  AquaSimHeader asHeader;
-  p->PeekHeader(asHeader);
-
-  switch (asHeader.GetDirection())
+  switch (AquaSimHeader::PeekDirection(p))
   {
     case (AquaSimHeader::DOWN):
       // Handle outgoing packets.
@@ -328,6 +441,8 @@ AquaSimMac::SendQueuePop()
   std::pair<Ptr<Packet>,TransStatus> element = m_sendQueue.front();
   m_sendQueue.front().first=0;
   m_sendQueue.pop();
+  RecordHolBlocking();
+  m_headSince = Simulator::Now();
   return element;
 }
 
@@ -376,6 +491,7 @@ void AquaSimMac::DoDispose()
 {
   NS_LOG_FUNCTION(this);
   m_device=0;
+  m_drainEvent.Cancel();
   while(!m_sendQueue.empty()) {
     m_sendQueue.front().first=0;
     m_sendQueue.pop();
@@ -36,6 +36,7 @@
 #include "ns3/nstime.h"
 #include "ns3/callback.h"
 #include "ns3/traced-callback.h"
+#include "ns3/event-id.h"
 
 
 namespace ns3{
@@ -52,6 +53,9 @@ class AquaSimRouting;
  *
  *  Implemented with a sender queue to delay packets if the device's status is set to busy (currently receiving or sending).
  *  This is meant to remove the "Busy Terminal Problem".
+ *  The queue is drained by the base class itself: every device status
+ *  transition reschedules the head frame at the earliest time the half-duplex
+ *  modem may transmit again, so derived MACs never need to pop it by hand.
  */
 class AquaSimMac : public Object {
 public:
@@ -107,6 +111,15 @@ public:
 
   bool SendQueueEmpty();
   std::pair<Ptr<Packet>,TransStatus> SendQueuePop();
+  // called by the device after every transmission status change
+  void NotifyTransmissionStatus(TransStatus status);
+
+  // head-of-line blocking: time a frame spent at the head of m_sendQueue
+  Time GetMeanHolBlocking(void);
+  Time GetMaxHolBlocking(void);
+  uint32_t GetHolSamples(void);
+
+  typedef void (* HolBlockingCallback)(Time holTime);
 
   double GetBitRate();
   double GetEncodingEff();
@@ -121,6 +134,21 @@ private:
 
   TracedCallback<Ptr<const Packet> > m_macRxTrace;
   TracedCallback<Ptr<const Packet> > m_macTxTrace;
+  TracedCallback<Time> m_holTrace;
+
+  // transmit pipeline
+  bool TransmitFrame(Ptr<Packet> p, TransStatus afterTrans);
+  Time EarliestTxTime(bool &known);
+  void ScheduleDrain(void);
+  void DrainSendQueue(void);
+  void RecordHolBlocking(void);
+
+  EventId m_drainEvent;
+  Time m_txEndTime;   //end of our own ongoing transmission
+  Time m_headSince;   //when the current head of m_sendQueue became head
+  Time m_holTotal;
+  Time m_holMax;
+  uint32_t m_holSamples;
   /*
    * virtual void Recv(Ptr<Packet>);	//handler not imlemented... handler can be 0 unless needed in operation
   */
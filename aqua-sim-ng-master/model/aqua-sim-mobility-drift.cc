@@ -0,0 +1,340 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "aqua-sim-mobility-drift.h"
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/string.h"
+
+#include <cstdio>
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AquaSimMobilityDrift");
+NS_OBJECT_ENSURE_REGISTERED(AquaSimMobilityDrift);
+
+/**** AquaSimCurrentField ****/
+
+AquaSimCurrentField::AquaSimCurrentField() :
+  m_map(NULL), m_mapLen(0), m_data(NULL)
+{
+  std::fill((char*)&m_hdr, (char*)&m_hdr + sizeof(m_hdr), 0);
+}
+
+AquaSimCurrentField::~AquaSimCurrentField()
+{
+  if (m_map != NULL)
+    munmap(m_map, m_mapLen);
+}
+
+/*
+ * Return the field of filename, loading it on first use. All drift
+ * models of a simulation share one copy.
+ */
+Ptr<AquaSimCurrentField>
+AquaSimCurrentField::Load(const std::string &filename)
+{
+  static std::map<std::string, Ptr<AquaSimCurrentField> > cache;
+
+  std::map<std::string, Ptr<AquaSimCurrentField> >::iterator it = cache.find(filename);
+  if (it != cache.end())
+    return it->second;
+
+  Ptr<AquaSimCurrentField> field = Ptr<AquaSimCurrentField>(new AquaSimCurrentField(), false);
+  if (!field->Map(filename))
+    {
+      if (!ParseText(filename, field->m_hdr, field->m_tab))
+        NS_FATAL_ERROR("Cannot read current field file " << filename);
+      field->m_data = &field->m_tab[0];
+    }
+  NS_LOG_INFO("Current field " << filename << ": " << field->m_hdr.n[0] << "x" <<
+      field->m_hdr.n[1] << "x" << field->m_hdr.n[2] << " points, " << field->m_hdr.n[3] <<
+      " time steps" << (field->IsMapped() ? " (mapped)" : ""));
+
+  cache[filename] = field;
+  return field;
+}
+
+static size_t
+GridPoints(const uint32_t n[4])
+{
+  return (size_t)n[0] * n[1] * n[2] * n[3];
+}
+
+/*
+ * Map filename if it is a binary current file, false otherwise.
+ */
+bool
+AquaSimCurrentField::Map(const std::string &filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  FileHeader hdr;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(hdr) ||
+      read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != CF_FILE_MAGIC)
+    {
+      close(fd);
+      return false;
+    }
+
+  size_t need = sizeof(hdr) + GridPoints(hdr.n) * 3 * sizeof(float);
+  if (hdr.version != CF_FILE_VERSION || GridPoints(hdr.n) == 0 || (size_t)st.st_size < need)
+    {
+      close(fd);
+      NS_FATAL_ERROR("Current field " << filename << " is truncated or of an unknown version");
+    }
+
+  void *map = mmap(NULL, need, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  m_map = map;
+  m_mapLen = need;
+  m_data = (const float*)((const char*)map + sizeof(hdr));
+  m_hdr = hdr;
+  return true;
+}
+
+/*
+ * Parse a text current file: the grid description followed by the
+ * velocity of each grid point.
+ */
+bool
+AquaSimCurrentField::ParseText(const std::string &filename, FileHeader &hdr,
+                               std::vector<float> &data)
+{
+  FILE* stream = fopen(filename.c_str(), "r");
+  if (stream == NULL)
+    return false;
+
+  hdr.magic = CF_FILE_MAGIC;
+  hdr.version = CF_FILE_VERSION;
+  if (fscanf(stream, "%u %u %u %u %lf %lf %lf %lf %lf %lf %lf %lf",
+             &hdr.n[0], &hdr.n[1], &hdr.n[2], &hdr.n[3],
+             &hdr.origin[0], &hdr.origin[1], &hdr.origin[2],
+             &hdr.spacing[0], &hdr.spacing[1], &hdr.spacing[2],
+             &hdr.t0, &hdr.dt) != 12 || GridPoints(hdr.n) == 0)
+    {
+      fclose(stream);
+      return false;
+    }
+
+  data.resize(GridPoints(hdr.n) * 3);
+  size_t i = 0;
+  for (; i < data.size(); i++)
+    if (fscanf(stream, "%f", &data[i]) != 1)
+      break;
+  fclose(stream);
+  return i == data.size();
+}
+
+/*
+ * Offline compiler: turn a text current file into a binary one.
+ */
+bool
+AquaSimCurrentField::Compile(const std::string &textFile, const std::string &binFile)
+{
+  std::vector<float> data;
+  FileHeader hdr;
+  if (!ParseText(textFile, hdr, data))
+    return false;
+
+  FILE* stream = fopen(binFile.c_str(), "wb");
+  if (stream == NULL)
+    return false;
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, stream) == 1 &&
+    fwrite(&data[0], sizeof(float), data.size(), stream) == data.size();
+  return (fclose(stream) == 0) && ok;
+}
+
+/*
+ * Grid cell of coordinate x along an axis of n points: the lower index,
+ * the upper one and the weight of the upper one. Clamped at the edges.
+ */
+static void
+Cell(double x, double origin, double spacing, uint32_t n,
+     uint32_t &i0, uint32_t &i1, double &w)
+{
+  double f = (n > 1 && spacing > 0) ? (x - origin) / spacing : 0;
+  if (f <= 0)
+    {
+      i0 = i1 = 0;
+      w = 0;
+      return;
+    }
+  if (f >= n - 1)
+    {
+      i0 = i1 = n - 1;
+      w = 0;
+      return;
+    }
+  i0 = (uint32_t)std::floor(f);
+  i1 = i0 + 1;
+  w = f - i0;
+}
+
+Vector
+AquaSimCurrentField::GetVelocity(const Vector &p, double t) const
+{
+  const FileHeader &h = m_hdr;
+  uint32_t lo[4], hi[4];
+  double w[4];
+  Cell(p.x, h.origin[0], h.spacing[0], h.n[0], lo[0], hi[0], w[0]);
+  Cell(p.y, h.origin[1], h.spacing[1], h.n[1], lo[1], hi[1], w[1]);
+  Cell(p.z, h.origin[2], h.spacing[2], h.n[2], lo[2], hi[2], w[2]);
+  Cell(t, h.t0, h.dt, h.n[3], lo[3], hi[3], w[3]);
+
+  //sum over the 16 corners of the space-time cell
+  double u = 0, v = 0, wz = 0;
+  for (int c = 0; c < 16; c++)
+    {
+      double weight = 1;
+      size_t idx = 0;
+      for (int d = 3; d >= 0; d--)
+        {
+          bool up = (c >> d) & 1;
+          weight *= up ? w[d] : 1 - w[d];
+          idx = idx * h.n[d] + (up ? hi[d] : lo[d]);
+        }
+      if (weight == 0)
+        continue;
+      const float *cell = m_data + idx * 3;
+      u += weight * cell[0];
+      v += weight * cell[1];
+      wz += weight * cell[2];
+    }
+  return Vector(u, v, wz);
+}
+
+
+/**** AquaSimMobilityDrift ****/
+
+AquaSimMobilityDrift::AquaSimMobilityDrift() :
+  m_tolerance(0.1), m_minStep(1), m_maxStep(600), m_step(0),
+  m_reportSegments(true)
+{
+}
+
+TypeId
+AquaSimMobilityDrift::GetTypeId(void)
+{
+  static TypeId tid = TypeId("ns3::AquaSimMobilityDrift")
+    .SetParent<AquaSimMobilityPattern>()
+    .AddConstructor<AquaSimMobilityDrift>()
+    .AddAttribute ("FieldFile", "Gridded current file, text or compiled binary.",
+      StringValue(""),
+      MakeStringAccessor(&AquaSimMobilityDrift::SetFieldFile,
+                         &AquaSimMobilityDrift::GetFieldFile),
+      MakeStringChecker())
+    .AddAttribute ("Tolerance", "Position error allowed per step, in meters.",
+      DoubleValue(0.1),
+      MakeDoubleAccessor(&AquaSimMobilityDrift::m_tolerance),
+      MakeDoubleChecker<double>(0))
+    .AddAttribute ("MinStep", "Shortest integration step, in seconds (at least 1 ms).",
+      DoubleValue(1),
+      MakeDoubleAccessor(&AquaSimMobilityDrift::m_minStep),
+      MakeDoubleChecker<double>(1e-3))
+    .AddAttribute ("MaxStep", "Longest integration step, in seconds (at least 1 ms).",
+      DoubleValue(600),
+      MakeDoubleAccessor(&AquaSimMobilityDrift::m_maxStep),
+      MakeDoubleChecker<double>(1e-3))
+    .AddAttribute ("ReportSegments", "Fire CourseChange at the end of every integration step.",
+      BooleanValue(true),
+      MakeBooleanAccessor(&AquaSimMobilityDrift::m_reportSegments),
+      MakeBooleanChecker())
+    ;
+  return tid;
+}
+
+void
+AquaSimMobilityDrift::SetFieldFile(std::string filename)
+{
+  m_fieldFile = filename;
+  m_field = filename.empty() ? NULL : AquaSimCurrentField::Load(filename);
+  m_step = 0;
+}
+
+std::string
+AquaSimMobilityDrift::GetFieldFile() const
+{
+  return m_fieldFile;
+}
+
+/*
+ * One adaptive Bogacki-Shampine 3(2) step from p0. The step is shrunk
+ * until the embedded error estimate is within tolerance, the segment then
+ * leaves p0 with the local current and bends to reach the third order
+ * solution exactly at t1.
+ */
+KinematicSegment
+AquaSimMobilityDrift::GenSegment(double t0, const Vector &p0, const Vector &v0)
+{
+  if (m_field == NULL)
+    return KinematicSegment(t0, p0, Vector(0,0,0));
+
+  double h = (m_step > 0) ? m_step : m_maxStep;
+  h = std::min(std::max(h, m_minStep), m_maxStep);
+
+  Vector k1 = m_field->GetVelocity(p0, t0);
+  Vector p3;
+  while (true)
+    {
+      Vector k2 = m_field->GetVelocity(Vector(p0.x + k1.x*h/2, p0.y + k1.y*h/2,
+                                              p0.z + k1.z*h/2), t0 + h/2);
+      Vector k3 = m_field->GetVelocity(Vector(p0.x + k2.x*h*3/4, p0.y + k2.y*h*3/4,
+                                              p0.z + k2.z*h*3/4), t0 + h*3/4);
+      p3 = Vector(p0.x + h*(2*k1.x + 3*k2.x + 4*k3.x)/9,
+                  p0.y + h*(2*k1.y + 3*k2.y + 4*k3.y)/9,
+                  p0.z + h*(2*k1.z + 3*k2.z + 4*k3.z)/9);
+      Vector k4 = m_field->GetVelocity(p3, t0 + h);
+      Vector p2(p0.x + h*(7*k1.x/24 + k2.x/4 + k3.x/3 + k4.x/8),
+                p0.y + h*(7*k1.y/24 + k2.y/4 + k3.y/3 + k4.y/8),
+                p0.z + h*(7*k1.z/24 + k2.z/4 + k3.z/3 + k4.z/8));
+      double err = CalculateDistance(p3, p2);
+
+      double scale = (err > 0) ? 0.9 * std::pow(m_tolerance / err, 1.0/3) : 4;
+      scale = std::min(std::max(scale, 0.2), 4.0);
+      if (err <= m_tolerance || h <= m_minStep)
+        {
+          m_step = std::min(std::max(h * scale, m_minStep), m_maxStep);
+          break;
+        }
+      h = std::max(h * scale, m_minStep);
+    }
+
+  KinematicSegment seg(t0, p0, k1);
+  seg.a = Vector(2*(p3.x - p0.x - k1.x*h)/(h*h),
+                 2*(p3.y - p0.y - k1.y*h)/(h*h),
+                 2*(p3.z - p0.z - k1.z*h)/(h*h));
+  seg.t1 = t0 + h;
+  seg.notify = m_reportSegments;
+  NS_LOG_DEBUG("Drift step " << h << "s from " << p0 << " to " << p3);
+  return seg;
+}
@@ -0,0 +1,116 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AQUA_SIM_MOBILITY_DRIFT_H
+#define AQUA_SIM_MOBILITY_DRIFT_H
+
+#include "aqua-sim-mobility-pattern.h"
+#include "ns3/simple-ref-count.h"
+#include "ns3/ptr.h"
+
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/*binary current file: header followed by float (u,v,w)[nt][nz][ny][nx]*/
+#define CF_FILE_MAGIC 0x46435341	// "ASCF"
+#define CF_FILE_VERSION 1
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Gridded, time varying ocean current field shared by all drift
+ * models using the same file.
+ *
+ * Text files start with "nx ny nz nt ox oy oz dx dy dz t0 dt" followed by
+ * one "u v w" triple (m/s) per grid point, x varying fastest and time
+ * slowest. Binary files, as written by Compile(), are memory mapped. The
+ * velocity is interpolated trilinearly in space and linearly in time;
+ * outside the grid the nearest edge value is used.
+ */
+class AquaSimCurrentField : public SimpleRefCount<AquaSimCurrentField> {
+public:
+  ~AquaSimCurrentField();
+
+  static Ptr<AquaSimCurrentField> Load(const std::string &filename);
+  static bool Compile(const std::string &textFile, const std::string &binFile);
+
+  Vector GetVelocity(const Vector &p, double t) const;
+  bool IsMapped() const { return m_map != NULL; }
+
+private:
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n[4];	// nx, ny, nz, nt
+    double origin[3];
+    double spacing[3];
+    double t0;
+    double dt;
+  };
+
+  AquaSimCurrentField();
+  static bool ParseText(const std::string &filename, FileHeader &hdr,
+                        std::vector<float> &data);
+  bool Map(const std::string &filename);
+
+  FileHeader m_hdr;
+  std::vector<float> m_tab;	// parsed text grid
+  void *m_map;			// mapped binary file
+  size_t m_mapLen;
+  const float *m_data;
+};  // class AquaSimCurrentField
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Passive drift through an ocean current field.
+ *
+ * The node is advected by the field with an adaptive Bogacki-Shampine
+ * step: each accepted step becomes one quadratic segment that starts with
+ * the local current and ends exactly on the integrated position, so the
+ * step size follows the field instead of a fixed update interval. With
+ * ReportSegments set every segment end fires CourseChange at its exact
+ * time, and GetSegmentEnd() tells how long the current position formula
+ * holds.
+ */
+class AquaSimMobilityDrift : public AquaSimMobilityPattern {
+public:
+  AquaSimMobilityDrift();
+  static TypeId GetTypeId(void);
+
+  void SetFieldFile(std::string filename);
+  std::string GetFieldFile() const;
+
+protected:
+  virtual KinematicSegment GenSegment(double t0, const Vector &p0, const Vector &v0);
+
+private:
+  Ptr<AquaSimCurrentField> m_field;
+  std::string m_fieldFile;
+  double m_tolerance;
+  double m_minStep;
+  double m_maxStep;
+  double m_step;	// step size suggested by the last error estimate
+  bool m_reportSegments;
+};  // class AquaSimMobilityDrift
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_MOBILITY_DRIFT_H */
@@ -85,24 +85,24 @@ void
 AquaSimMobilityKinematic::Init()
 {
 	//this is obsolete
-	m_lce.Set(0,0,0, 0,0,0);
-			//node->X(), node->Y(), node->Z(),
-			//node->dX(), node->dY(), node->dZ());
 }
 
-LocationCacheElem
-AquaSimMobilityKinematic::GenNewLoc()
+/*
+ * The current field is sampled once per update interval, the node drifts
+ * with the sampled velocity until the next sample. Segments are only
+ * computed when the position is asked for.
+ */
+KinematicSegment
+AquaSimMobilityKinematic::GenSegment(double t0, const Vector &p0, const Vector &v0)
 {
 	double interval = UptIntv();
 
     //start to calculate the position after the coming interval
-	double yVel = m_k5-m_lambda*m_v*cos(m_k2*m_lce.m_loc.x)*sin(m_k3*m_lce.m_loc.y);
-	double xVel = m_k1*m_lambda*m_v*sin(m_k2*m_lce.m_loc.x)*cos(m_k3*m_lce.m_loc.y)
-					+ m_k4 + m_k1*m_lambda*cos(2*m_k1*Simulator::Now().ToDouble(Time::S));
-	double x = m_lce.m_loc.x + xVel*interval;
-	double y = m_lce.m_loc.y + yVel*interval;
-
-	m_lce.Set(x,y,m_lce.m_loc.z, xVel,yVel,m_lce.m_sp.GetSpeedVect().z);
+	double yVel = m_k5-m_lambda*m_v*cos(m_k2*p0.x)*sin(m_k3*p0.y);
+	double xVel = m_k1*m_lambda*m_v*sin(m_k2*p0.x)*cos(m_k3*p0.y)
+					+ m_k4 + m_k1*m_lambda*cos(2*m_k1*t0);
 
-	return m_lce;
+	KinematicSegment seg(t0, p0, Vector(xVel, yVel, v0.z));
+	seg.t1 = t0 + interval;
+	return seg;
 }
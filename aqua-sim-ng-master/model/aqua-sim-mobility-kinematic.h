@@ -35,9 +35,11 @@ class AquaSimMobilityKinematic : public AquaSimMobilityPattern {
 public:
 	AquaSimMobilityKinematic();
 	static TypeId GetTypeId(void);
-	virtual	LocationCacheElem GenNewLoc();
 	virtual void Init();
 
+protected:
+	virtual KinematicSegment GenSegment(double t0, const Vector &p0, const Vector &v0);
+
 private:
 	double m_k1;
 	double m_k2;
@@ -46,8 +48,6 @@ private:
 	double m_k5;
 	double m_lambda;
 	double m_v;
-
-	LocationCacheElem m_lce;
 };  // class AquaSimMobilityKinematic
 
 }  // namespace ns3
@@ -20,95 +20,45 @@
 
 #include "ns3/log.h"
 #include "ns3/double.h"
+#include "ns3/simulator.h"
 #include "aqua-sim-mobility-pattern.h"
 
+#include <algorithm>
+
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("AquaSimMobilityPattern");
 
-AquaSimPosUpdateHelper::~AquaSimPosUpdateHelper()
+static double&
+Axis(Vector &v, int i)
 {
-  delete m_mP;
-  m_mP=0;
-}
-
-void
-AquaSimPosUpdateHelper::Expire()
-{
-  m_mP->HandleLocUpdate();
-  if (m_updateIntv.IsRunning()) {
-      m_updateIntv.Cancel();
-  }
-  m_updateIntv.Schedule(Seconds(m_mP->UptIntv()));
+  return (i == 0) ? v.x : ((i == 1) ? v.y : v.z);
 }
 
 /**
-* @param duration trajectory during this duration time can be cached
-* @param interval the time interval between two adjacent locations
-* 					in the trajectory, i.e., location update interval
-* @param X	   	node's X coordinate
-* @param Y		node's Y coordinate
-* @param Z		node's Z coordinate
+* @return the earliest tau in (0, limit) where p + v*tau + a*tau^2/2
+*         reaches bound, limit if there is none
 */
-LocationCache::LocationCache(double duration, double interval,
-			     double X, double Y, double Z,
-			     double dX, double dY, double dZ) :
-  m_locations(1 + size_t(ceil(duration / interval))),
-  m_bIndex(0), m_size(1)
+static double
+HitTime(double p, double v, double a, double bound, double limit)
 {
-  m_interval = interval;
-  m_locations[0].m_loc = Vector(X, Y, Z);
-  m_locations[0].m_sp = Speed(Vector(dX, dY, dZ));
-}
-
-/**
-* @return the max number of locations can be stored
-*/
-inline size_t
-LocationCache::Capacity() {
-  return m_locations.size();
-}
-
-inline double
-LocationCache::LastUpdateTime() {
-  return Empty() ? -1 : m_fstUptTime + m_interval * (m_size - 1);
-}
-
-bool
-LocationCache::InRange(double t) {
-  return t >= m_fstUptTime &&
-          t < (Simulator::Now() + m_interval * (Capacity() - 1));
-}
-
-/**
-* append a new location in the cache
-* the time gap between this new one and the last one in
-* the cache must equal to the attribute interval
-*
-* @param loc the new location
-*/
-void
-LocationCache::AddNewLoc(const LocationCacheElem &lce) {
-  m_locations[(m_bIndex + m_size) % Capacity()] = lce;
-  if (Full())
-    m_bIndex++;
-  else
-    m_size++;
-}
-
-LocationCacheElem
-LocationCache::GetLocByTime(double t) {
-  if (t < m_fstUptTime || t > LastUpdateTime()) {
-    throw std::out_of_range("LocationCache::GetLocByTime");
+  double c = p - bound;
+  double hit = limit;
+  if (std::fabs(a) < 1e-12) {
+    if (v != 0 && -c/v > 1e-9 && -c/v < hit)
+      hit = -c/v;
+    return hit;
   }
-
-  return m_locations[m_bIndex + size_t((t - m_fstUptTime) / m_interval)];
-}
-
-LocationCacheElem
-LocationCache::GetLastLoc()
-{
-  return m_locations[m_size];
+  double disc = v*v - 2*a*c;
+  if (disc < 0)
+    return hit;
+  double r1 = (-v - std::sqrt(disc)) / a;
+  double r2 = (-v + std::sqrt(disc)) / a;
+  if (r1 > 1e-9 && r1 < hit)
+    hit = r1;
+  if (r2 > 1e-9 && r2 < hit)
+    hit = r2;
+  return hit;
 }
 
 /*****
@@ -117,7 +67,8 @@ LocationCache::GetLastLoc()
 NS_OBJECT_ENSURE_REGISTERED(AquaSimMobilityPattern);
 
 AquaSimMobilityPattern::AquaSimMobilityPattern() :
-  m_lc(NULL), m_posUpdateHelper(this)
+  m_started(false), m_planEnd(std::numeric_limits<double>::infinity()),
+  m_planNotify(false)
 {
 }
 
@@ -127,7 +78,7 @@ AquaSimMobilityPattern::GetTypeId(void)
   static TypeId tid = TypeId("ns3::AquaSimMobilityPattern")
     .SetParent<MobilityModel>()
     .AddConstructor<AquaSimMobilityPattern>()
-    .AddAttribute ("UpdateInt", "Set the update interval. Default is 0.001.",
+    .AddAttribute ("UpdateInt", "Set the update interval, the segment length of sampled patterns. Default is 0.001.",
       DoubleValue(0.001),
       MakeDoubleAccessor(&AquaSimMobilityPattern::m_updateInterval),
       MakeDoubleChecker<double>())
@@ -145,7 +96,6 @@ AquaSimMobilityPattern::GetTypeId(void)
 
 
 AquaSimMobilityPattern::~AquaSimMobilityPattern() {
-  delete m_lc;
 }
 
 /**
@@ -153,20 +103,12 @@ AquaSimMobilityPattern::~AquaSimMobilityPattern() {
 */
 void
 AquaSimMobilityPattern::Start() {
-  Vector position = Vector(0,0,0);
-  Vector speed = Vector(0,0,0);
-  if (NULL != m_lc) {
-    position = m_lc->GetLastLoc().m_loc;
-    speed = m_lc->GetLastLoc().m_sp.GetSpeedVect();
-    delete m_lc;
-    m_lc = NULL;
-  }
-
-  m_lc = new LocationCache(5, m_updateInterval,
-                            position.x,position.y,position.z,
-                            speed.x, speed.y, speed.z);
+  Vector position = DoGetPosition();
+  Vector speed = DoGetVelocity();
+  m_started = true;
   Init();
-  m_posUpdateHelper.Expire();
+  Restart(position, speed, true);
+  NotifyCourseChange();
 }
 
 
@@ -179,13 +121,11 @@ return;
 }
 
 /**
-* a dummy one
+* plain constant velocity, derived classes overload this one
 */
-LocationCacheElem
-AquaSimMobilityPattern::GenNewLoc() {
-  NS_LOG_FUNCTION(this << "A Dummy one! Shouldn't call this function!");
-  LocationCacheElem newLoc;
-  return newLoc;
+KinematicSegment
+AquaSimMobilityPattern::GenSegment(double t0, const Vector &p0, const Vector &v0) {
+  return KinematicSegment(t0, p0, v0);
 }
 
 /*
@@ -200,54 +140,132 @@ AquaSimMobilityPattern::UpdateGridKeeper()
 }*/
 
 /**
-* the interface for AquaSimPosUpdateHelper to call
+* throw away the trajectory and move on from position with velocity;
+* callers notify the course change (SetPosition already does)
+*
+* @param replan ask GenSegment for a new plan, otherwise keep velocity
+*               until the current plan would have ended
 */
 void
-AquaSimMobilityPattern::HandleLocUpdate() {
-  LocationCacheElem e;
-  while (m_lc->LastUpdateTime() < Simulator::Now().ToDouble(Time::S)) {
-    e = GenNewLoc();
-    RestrictLocByBound(e);
-    m_lc->AddNewLoc(e);
+AquaSimMobilityPattern::Restart(const Vector &position, const Vector &velocity, bool replan)
+{
+  double now = Simulator::Now().ToDouble(Time::S);
+  KinematicSegment seg(now, position, velocity);
+  if (replan && m_started) {
+    seg = GenSegment(now, position, velocity);
+    m_planEnd = seg.t1;
+    m_planNotify = seg.notify;
   }
+  else if (m_started && m_planEnd > now) {
+    seg.t1 = m_planEnd;
+    seg.notify = m_planNotify;
+  }
+  else {
+    m_planEnd = seg.t1;
+    m_planNotify = false;
+  }
+  ClipToBounds(seg);
+  m_trajectory.clear();
+  m_trajectory.push_back(seg);
+  ScheduleCourseChange();
+}
+
+/**
+* make sure the trajectory covers time t; segments that ended before now
+* are dropped on the way, so a long jump ahead keeps only a few of them
+*
+* @return true if segments were dropped
+*/
+bool
+AquaSimMobilityPattern::Extend(double t) {
+  double now = Simulator::Now().ToDouble(Time::S);
+  bool pruned = false;
+  if (m_trajectory.empty())
+    m_trajectory.push_back(KinematicSegment(now));
+
+  while (true) {
+    while (m_trajectory.size() > 1 && m_trajectory.front().t1 <= now + 1e-9) {
+      m_trajectory.pop_front();
+      pruned = true;
+    }
+    if (m_trajectory.back().t1 > t)
+      break;
+
+    const KinematicSegment last = m_trajectory.back();
+    Vector p = last.PositionAt(last.t1);
+    Vector v = last.VelocityAt(last.t1);
+    KinematicSegment next(last.t1, p, v);
+    if (last.t1 < m_planEnd) {
+      //stopped by a bound, finish the planned segment mirrored
+      next.a = last.a;
+      next.t1 = m_planEnd;
+      next.notify = m_planNotify;
+    }
+    else {
+      next = GenSegment(last.t1, p, v);
+      NS_ASSERT_MSG(next.t1 > next.t0, "GenSegment must plan a segment of positive length");
+      m_planEnd = next.t1;
+      m_planNotify = next.notify;
+    }
+    ClipToBounds(next);
+    m_trajectory.push_back(next);
+  }
+  return pruned;
+}
+
+/**
+* the segment covering time t; segments that ended before now are dropped
+*/
+const KinematicSegment&
+AquaSimMobilityPattern::Locate(double t) {
+  if (Extend(t) && !m_courseEvent.IsRunning())
+    ScheduleCourseChange();
+
+  std::deque<KinematicSegment>::const_iterator it = m_trajectory.begin();
+  for (; it != m_trajectory.end(); it++)
+    if (t < it->t1)
+      return *it;
+  return m_trajectory.back();
+}
+
+void
+AquaSimMobilityPattern::ScheduleCourseChange()
+{
+  Simulator::Cancel(m_courseEvent);
+  if (m_trajectory.empty() || !m_trajectory.front().notify ||
+      m_trajectory.front().t1 == std::numeric_limits<double>::infinity())
+    return;
+  double delay = m_trajectory.front().t1 - Simulator::Now().ToDouble(Time::S);
+  m_courseEvent = Simulator::Schedule(Seconds(std::max(delay, 0.0)),
+                                      &AquaSimMobilityPattern::HandleCourseChange, this);
+}
 
-  //find the time closest one to NOW
-  double t = Simulator::Now().ToDouble(Time::S);
-  e = GetLocByTime(t);
-  //Ptr<MobilityModel> model = GetNetDevice()->GetNode()->GetObject<MobilityModel>();
-  //double oldX = GetPosition().x;
-  SetPosition(Vector(e.m_loc.x,e.m_loc.y,e.m_loc.z));
-  SetVelocity(Vector(e.m_sp.GetSpeedVect().x,
-                        e.m_sp.GetSpeedVect().y,
-                        e.m_sp.GetSpeedVect().z));
-  //m_node->speed() = e.m_sp.GetSpeed(); //already handled by model->GetVelocity()
-
-  /*if (oldX != model->GetPosition().x)			// adjust node to satisfy topography use here T()
-    m_node->T()->UpdateNodesList(m_node, oldX); //X_ is the key value of SortList
-  */      //Topography not supported
-
-  //updateGridKeeper(); //do I really need this?!!!!!
-      // TODO this shoudl be a callback... see MobilityModel class...
-      //m_device->SetPositionUpdateTime(Simulator::Now());
-  //record the movement
-  //namLogMobility(m_lc->lastUpdateTime(), e);
+void
+AquaSimMobilityPattern::HandleCourseChange()
+{
+  Locate(Simulator::Now().ToDouble(Time::S));
+  NotifyCourseChange();
+  ScheduleCourseChange();
 }
 
 
 LocationCacheElem
 AquaSimMobilityPattern::GetLocByTime(double t) {
-  if (!m_lc->InRange(t)) {
-    throw std::out_of_range("AquaSimMobilityPattern::GetLocByTime");
-  }
-
-  LocationCacheElem newLce;
-  while (m_lc->LastUpdateTime() < t) {
-    newLce = GenNewLoc();
-    RestrictLocByBound(newLce);
-    m_lc->AddNewLoc(newLce);
-  }
+  const KinematicSegment &seg = Locate(t);
+  Vector p = seg.PositionAt(t);
+  Vector v = seg.VelocityAt(t);
+  LocationCacheElem lce;
+  lce.Set(p.x, p.y, p.z, v.x, v.y, v.z);
+  return lce;
+}
 
-  return m_lc->GetLocByTime(t);
+/**
+* end of the segment the node is moving on: up to then the position is a
+* known quadratic of time, callers may cache it until that instant
+*/
+double
+AquaSimMobilityPattern::GetSegmentEnd() {
+  return Locate(Simulator::Now().ToDouble(Time::S)).t1;
 }
 
 
@@ -287,83 +305,90 @@ AquaSimMobilityPattern::SetBounds(Vector min, Vector max)
 }
 
 /**
-* update node's position. if it's out of bound
-* We simply bounce the node by the corresponding edge
+* keep the segment inside the topography: a start outside is clamped, a
+* start on an edge moving out bounces, and the segment ends where it
+* first hits an edge. Axes whose max bound is not above the min bound
+* are unbounded.
 */
 void
-AquaSimMobilityPattern::RestrictLocByBound(LocationCacheElem &lce)
+AquaSimMobilityPattern::ClipToBounds(KinematicSegment &seg)
 {
-  /*
-   * //should probably write a CubicPositionAllocator class to clean this up
-   */
-  bool recheck = true;
-  //Ptr<CubicPositionAllocator> T = m_node->T();
-
-  while (recheck) {
-    recheck = false;
-    recheck = recheck || BounceByEdge(lce.m_loc.x, lce.m_sp.GetSpeedVect().x, m_minBound.x, true);
-    recheck = recheck || BounceByEdge(lce.m_loc.x, lce.m_sp.GetSpeedVect().x, m_maxBound.x, false);
-    recheck = recheck || BounceByEdge(lce.m_loc.y, lce.m_sp.GetSpeedVect().y, m_minBound.y, true);
-    recheck = recheck || BounceByEdge(lce.m_loc.y, lce.m_sp.GetSpeedVect().y, m_maxBound.y, false);
-    recheck = recheck || BounceByEdge(lce.m_loc.z, lce.m_sp.GetSpeedVect().z, m_minBound.z, true);
-    recheck = recheck || BounceByEdge(lce.m_loc.z, lce.m_sp.GetSpeedVect().z, m_maxBound.z, false);
+  Reflect(seg);
+  double limit = seg.t1 - seg.t0;
+  double hit = limit;
+  for (int i = 0; i < 3; i++) {
+    double lo = Axis(m_minBound, i), hi = Axis(m_maxBound, i);
+    if (hi <= lo)
+      continue;
+    hit = HitTime(Axis(seg.p0, i), Axis(seg.v, i), Axis(seg.a, i), lo, hit);
+    hit = HitTime(Axis(seg.p0, i), Axis(seg.v, i), Axis(seg.a, i), hi, hit);
+  }
+  if (hit < limit) {
+    seg.t1 = seg.t0 + hit;
+    seg.notify = true;
   }
 }
 
 /**
-* bounce the node by the edge if it is out of range
-*
-* @param coord 1D coordinate, could be one of X, Y, Z
-* @param speed speed projected to the same axis as coord
-* @param bound the value of lower/upper bound
-* @param lowerBound to specify if bound is lower Bound (true),
-* 				otherwise, it's upper bound
-*
-* @return  true for coord is changed, false for not
+* bounce the node by the edge it sits on if it is moving out
 */
-bool
-AquaSimMobilityPattern::BounceByEdge(double coord, double dspeed,
-double bound, bool lowerBound) {
-  if ((lowerBound && (coord < bound)) /*below lower bound*/
-	  || (!lowerBound && (coord > bound)) /*beyond upper bound*/) {
-    coord = bound + bound - coord;
-    dspeed = -dspeed;
-    return true;
+void
+AquaSimMobilityPattern::Reflect(KinematicSegment &seg)
+{
+  for (int i = 0; i < 3; i++) {
+    double lo = Axis(m_minBound, i), hi = Axis(m_maxBound, i);
+    if (hi <= lo)
+      continue;
+    double &p = Axis(seg.p0, i);
+    double &v = Axis(seg.v, i);
+    double &a = Axis(seg.a, i);
+    if (p <= lo + 1e-9) {
+      p = lo;
+      if (v < 0 || (v == 0 && a < 0)) {
+        v = -v;
+        a = -a;
+      }
+    }
+    else if (p >= hi - 1e-9) {
+      p = hi;
+      if (v > 0 || (v == 0 && a > 0)) {
+        v = -v;
+        a = -a;
+      }
+    }
   }
-
-  return false;
 }
 
 void
 AquaSimMobilityPattern::SetVelocity(Vector vector)
 {
-  m_lc->GetLastLoc().m_sp.Set(vector);
+  Restart(DoGetPosition(), vector, false);
+  NotifyCourseChange();
 }
 
 Vector
 AquaSimMobilityPattern::DoGetPosition (void) const
 {
-  return m_lc->GetLastLoc().m_loc;
+  double now = Simulator::Now().ToDouble(Time::S);
+  return const_cast<AquaSimMobilityPattern*>(this)->Locate(now).PositionAt(now);
 }
 
 void
 AquaSimMobilityPattern::DoSetPosition (const Vector &position)
 {
-  LocationCacheElem e = GenNewLoc();
-  e.Set(position.x,position.y,position.z,0,0,0);
-  //e.m_sp = m_lc->GetLastLoc().m_sp;
-  RestrictLocByBound(e);
-  m_lc->AddNewLoc(e);
+  Restart(position, DoGetVelocity(), true);
 }
 
 Vector
 AquaSimMobilityPattern::DoGetVelocity (void) const
 {
-  return m_lc->GetLastLoc().m_sp.GetSpeedVect();
+  double now = Simulator::Now().ToDouble(Time::S);
+  return const_cast<AquaSimMobilityPattern*>(this)->Locate(now).VelocityAt(now);
 }
 
 void AquaSimMobilityPattern::DoDispose()
 {
-  delete m_lc;
-  m_lc=0;
+  Simulator::Cancel(m_courseEvent);
+  m_trajectory.clear();
+  MobilityModel::DoDispose();
 }
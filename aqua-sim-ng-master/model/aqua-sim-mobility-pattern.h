@@ -23,12 +23,13 @@
 
 
 #include <cmath>
-#include <vector>
+#include <deque>
+#include <limits>
 #include <stdexcept>
 
 #include "ns3/vector.h"
 #include "ns3/mobility-model.h"
-#include "ns3/timer.h"
+#include "ns3/event-id.h"
 
 // Aqua Sim Mobility Pattern
 
@@ -39,26 +40,6 @@ const double PI = 3.1415926;
 but for this port this ns2 version will suffix
 */
 
-class AquaSimMobilityPattern;
-
-/**
- * \ingroup aqua-sim-ng
- *
- * \brief Position Helper for mobility model
- */
-class AquaSimPosUpdateHelper : public Timer {
-public:
-  AquaSimPosUpdateHelper(AquaSimMobilityPattern *mP) : Timer() {
-    m_mP = mP;
-  }
-  AquaSimPosUpdateHelper();
-  ~AquaSimPosUpdateHelper();
-  void Expire(void);
-private:
-  AquaSimMobilityPattern * m_mP;
-  Timer m_updateIntv;
-};  //class AquaSimPosUpdateHelper
-
 /*  **NOTE: Vector does exactly this **
 class Location3D {
 private:
@@ -105,42 +86,42 @@ struct LocationCacheElem {
 };
 
 /**
-* \brief Location Helper for mobility model
+* \brief One piece of a trajectory: p(t) = p0 + v*(t-t0) + a*(t-t0)^2/2
+*   for t0 <= t < t1. Times are in seconds, t1 may be infinite.
 */
-class LocationCache{
-private:
-  std::vector<LocationCacheElem> m_locations;
-  size_t m_bIndex; //beginning index;
-  size_t m_size;	//end index
-  double m_interval;
-  double m_fstUptTime;
-
-protected:
-  bool	Empty() { return m_size == 0; }
-  bool	Full() { return m_size == Capacity(); }
-
-public:
-  LocationCache(double duration, double interval,
-	  double X, double Y, double Z,
-	  double dX, double dY, double dZ);
-
-  size_t Capacity();
-  //double FirstUpdateTime();
-  double LastUpdateTime();
-  bool InRange(double t);
-
-  LocationCacheElem GetLocByTime(double t);
-  void AddNewLoc(const LocationCacheElem &lce);
-  LocationCacheElem GetLastLoc();
-  /*
-  void pop_front();
-  const LocationCacheElem & front();
-  */
-};  // class LocationCache
+struct KinematicSegment {
+  double t0;
+  double t1;
+  Vector p0;
+  Vector v;
+  Vector a;
+  bool notify;  //the end of the segment is a course change worth an event
+
+  KinematicSegment(double t = 0, Vector p = Vector(0,0,0), Vector vel = Vector(0,0,0)) :
+    t0(t), t1(std::numeric_limits<double>::infinity()), p0(p), v(vel),
+    a(Vector(0,0,0)), notify(false) {}
+  Vector PositionAt(double t) const {
+    double d = t - t0;
+    return Vector(p0.x + v.x*d + 0.5*a.x*d*d,
+                  p0.y + v.y*d + 0.5*a.y*d*d,
+                  p0.z + v.z*d + 0.5*a.z*d*d);
+  }
+  Vector VelocityAt(double t) const {
+    double d = t - t0;
+    return Vector(v.x + a.x*d, v.y + a.y*d, v.z + a.z*d);
+  }
+};
 
 
 /**
 * \brief Base class for mobility pattern.
+*
+* The trajectory is a queue of closed form segments, evaluated on demand.
+* Derived classes plan the next segment in GenSegment() when the previous
+* one ends; nothing runs per update interval. Only the end of a segment
+* with notify set gets a scheduled event (to fire CourseChange), other
+* segments are advanced when someone asks for the position. Nodes bounce
+* off the topography bounds, computed exactly from the segment.
 */
 class AquaSimMobilityPattern : public MobilityModel {
 public:
@@ -149,31 +130,37 @@ public:
   static TypeId GetTypeId(void);
 
   void Start();
-  void HandleLocUpdate(); //a public interface for AquaSimPosUpdateHelper
   double UptIntv() { return m_updateInterval; };
 
   //tell future position
   LocationCacheElem GetLocByTime(double t);
+  //time until which the position follows the current segment
+  double GetSegmentEnd();
   void SetBounds(double minx,double miny,double minz,
                   double maxx, double maxy, double maxz);
   void SetBounds(Vector min, Vector max);
   void SetVelocity(Vector vector);
 
 protected:
-  virtual LocationCacheElem GenNewLoc(); /* the actual method that each
-					  * derived class need to overload to
-					  * update node's position;
-					  */
+  /* the actual method that each derived class need to overload: plan the
+   * movement starting at t0 from p0 with velocity v0. The default keeps
+   * the velocity forever.
+   */
+  virtual KinematicSegment GenSegment(double t0, const Vector &p0, const Vector &v0);
   /*initialize mobility pattern here*/
   virtual void Init();
 
   //void UpdateGridKeeper();
-  void RestrictLocByBound(LocationCacheElem &lce);
   void NamLogMobility(double t, LocationCacheElem &lce);
-private:
-  bool BounceByEdge(double coord, double speed,
-		double bound, bool lowerBound);
 
+  const KinematicSegment& Locate(double t);
+  void Restart(const Vector &position, const Vector &velocity, bool replan);
+private:
+  bool Extend(double t);
+  void ClipToBounds(KinematicSegment &seg);
+  void Reflect(KinematicSegment &seg);
+  void ScheduleCourseChange();
+  void HandleCourseChange();
 
   //inherited functions
   virtual Vector DoGetPosition (void) const;
@@ -183,9 +170,12 @@ private:
 protected:
   virtual void DoDispose();
 
-  LocationCache *m_lc;
+  std::deque<KinematicSegment> m_trajectory;
   double m_updateInterval;
-  AquaSimPosUpdateHelper m_posUpdateHelper;
+  bool m_started;
+  double m_planEnd;     //end of the segment GenSegment planned last
+  bool m_planNotify;
+  EventId m_courseEvent;
 
   //topography
   Vector m_minBound;
@@ -29,22 +29,15 @@ NS_LOG_COMPONENT_DEFINE("AquaSimMobilityRWP");
 NS_OBJECT_ENSURE_REGISTERED(AquaSimMobilityRWP);
 
 
-AquaSimMobilityRWP::AquaSimMobilityRWP()
+AquaSimMobilityRWP::AquaSimMobilityRWP() :
+  m_moving(false)
 {
 }
 
 void
 AquaSimMobilityRWP::Init()
 {
-	//obsolete
-	LocationCacheElem elem = m_lc->GetLastLoc();
-	m_destX = elem.m_loc.x;
-	m_destY = elem.m_loc.y;
-	m_destZ = elem.m_loc.z;
-	m_speed = elem.m_sp.GetSpeed();
-	PrepareNextPoint();
-	m_startTime = Simulator::Now().ToDouble(Time::S);
-	m_duplicatedNamTrace = false;
+	m_moving = false;
 }
 
 TypeId
@@ -96,37 +89,39 @@ AquaSimMobilityRWP::PrepareNextPoint()
 }
 
 
-LocationCacheElem
-AquaSimMobilityRWP::GenNewLoc()
+/*
+ * Alternates a straight run to the next way point with thinking at it,
+ * one segment each, so the node costs one event per leg.
+ */
+KinematicSegment
+AquaSimMobilityRWP::GenSegment(double t0, const Vector &p0, const Vector &v0)
 {
-	LocationCacheElem ret;
-	//the time since node start to move from previous way point
-	double passed_len = m_speed*(Simulator::Now().ToDouble(Time::S) - m_startTime);
+	KinematicSegment seg(t0, p0);
+	seg.notify = true;
 
-	if( passed_len < m_distance )
+	if (m_moving && m_thinkTime > 0)
 	{
-		m_x = m_originalX + passed_len * m_ratioX;
-		m_y = m_originalY + passed_len * m_ratioY;
-		m_z = m_originalZ + passed_len * m_ratioZ;
+		//I am thinking of that where I will go
+		m_moving = false;
+		seg.t1 = t0 + m_thinkTime;
+		return seg;
 	}
-	else{
-		//now I must arrive at the way point
-
-		if( (Simulator::Now().ToDouble(Time::S) - m_startTime - m_distance/m_speed) < m_thinkTime )
-		{
-			//I am still thinking of that where I will go
-			m_x = m_destX;
-			m_y = m_destY;
-			m_z = m_destZ;
-		}
-		else{
-			//I am on the way to next way point again.
-			m_startTime = m_startTime + m_distance/m_speed + m_thinkTime;
-			PrepareNextPoint();
-			return GenNewLoc();
-		}
+
+	//I am on the way to next way point again.
+	m_destX = p0.x;
+	m_destY = p0.y;
+	m_destZ = p0.z;
+	PrepareNextPoint();
+	if (m_speed <= 0 || m_distance <= 0)
+	{
+		//nowhere to go, stay
+		m_moving = false;
+		seg.notify = false;
+		return seg;
 	}
-	ret.Set(m_x, m_y, m_z, m_speed*m_ratioX, m_speed*m_ratioY, m_speed*m_ratioZ);
 
-	return ret;
+	m_moving = true;
+	seg.v = Vector(m_speed*m_ratioX, m_speed*m_ratioY, m_speed*m_ratioZ);
+	seg.t1 = t0 + m_distance/m_speed;
+	return seg;
 }
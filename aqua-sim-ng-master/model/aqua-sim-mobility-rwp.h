@@ -34,9 +34,11 @@ class AquaSimMobilityRWP : public AquaSimMobilityPattern {
 public:
 	AquaSimMobilityRWP();
 	static TypeId GetTypeId(void);
-	virtual LocationCacheElem GenNewLoc();
 	virtual void Init();
 
+protected:
+	virtual KinematicSegment GenSegment(double t0, const Vector &p0, const Vector &v0);
+
 private:
 	inline void PrepareNextPoint();
 
@@ -48,10 +50,6 @@ private:
 	double m_originalY;
 	double m_originalZ;
 
-	double m_x;
-	double m_y;
-	double m_z;
-
 	/* the ratio between dimensions and the distance between
 	 * previous way point and next way point
 	 */
@@ -67,10 +65,7 @@ private:
 	double m_thinkTime;
 
 	double m_distance;     //the distance to next point
-	double m_startTime;   //the time when this node start to next point
-	double m_thoughtTime; //the time taken by deciding where I will go
-
-	bool   m_duplicatedNamTrace;
+	bool   m_moving;       //false while thinking at a way point
 };  // class AquaSimMobilityRWP
 
 }  // namespace ns3
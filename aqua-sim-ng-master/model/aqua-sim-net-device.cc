@@ -228,7 +228,7 @@ AquaSimNetDevice::SetMac (Ptr<AquaSimMac> mac, Ptr<AquaSimSync> sync, Ptr<AquaSi
 
       if (sync != NULL)
       {
-        sync = Create<AquaSimSync>();
+        sync = CreateObject<AquaSimSync>();
         m_macSync = sync;
         sync->SetDevice(Ptr<AquaSimNetDevice>(this));
       }
@@ -688,10 +688,9 @@ AquaSimNetDevice::SetTransmissionStatus(TransStatus status)
     NS_LOG_DEBUG("END TRANSMITTING PACKET");
   m_transStatus = status;
 
- if (!m_mac->SendQueueEmpty()) {
-     std::pair<Ptr<Packet>,TransStatus> sendPacket = m_mac->SendQueuePop();
-     m_mac->SendDown(sendPacket.first,sendPacket.second);
- }
+ //let the mac pipeline pick the next queued frame, if any
+ if (m_mac)
+   m_mac->NotifyTransmissionStatus(status);
 }
 
 TransStatus
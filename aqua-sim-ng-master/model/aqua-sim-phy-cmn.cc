@@ -20,6 +20,7 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 
 #include "ns3/nstime.h"
 #include "ns3/simulator.h"
@@ -33,6 +34,7 @@
 #include "aqua-sim-header-mac.h"
 #include "aqua-sim-energy-model.h"
 #include "aqua-sim-phy-cmn.h"
+#include "aqua-sim-synchronization.h"
 
 //Aqua Sim Phy Cmn
 
@@ -47,7 +49,6 @@ AquaSimPhyCmn::AquaSimPhyCmn(void) :
 {
   NS_LOG_FUNCTION(this);
 
-  m_updateEnergyTime = Simulator::Now().GetSeconds();
   m_preamble = 1.5;
   m_trigger = 0.45;
   //GetNetDevice()->SetTransmissionStatus(NIDLE);
@@ -80,8 +81,6 @@ AquaSimPhyCmn::AquaSimPhyCmn(void) :
   incPktCounter = 0;	//debugging purposes only
   outPktCounter = 0;
   pktRecvCounter = 0;
-
-  Simulator::Schedule(Seconds(1), &AquaSimPhyCmn::UpdateIdleEnergy, this); //start energy drain
 }
 
 AquaSimPhyCmn::~AquaSimPhyCmn(void)
@@ -217,17 +216,10 @@ AquaSimPhyCmn::AddModulation(Ptr<AquaSimModulation> modulation, std::string modu
  */
 void
 AquaSimPhyCmn::UpdateTxEnergy(Time txTime) {
-	NS_LOG_FUNCTION(this << "Currently not implemented");
-	double startTime = Simulator::Now().GetSeconds(), endTime = Simulator::Now().GetSeconds() + txTime.GetSeconds();
-
-	if (NULL != EM()) {
-		if (startTime >= m_updateEnergyTime) {
-			EM()->DecrIdleEnergy(startTime - m_updateEnergyTime);
-			m_updateEnergyTime = startTime;
-		}
-		EM()->DecrTxEnergy(txTime.GetSeconds());
-		m_updateEnergyTime = endTime;
-	}
+	NS_LOG_FUNCTION(this << txTime);
+
+	if (NULL != EM())
+		EM()->SetStateFor(SEND, txTime.GetSeconds());
 	else
 		NS_LOG_FUNCTION(this << " No EnergyModel set.");
 }
@@ -237,61 +229,29 @@ void
 AquaSimPhyCmn::UpdateRxEnergy(Time txTime, bool errorFlag) {
   NS_LOG_FUNCTION(txTime);
 
-  double startTime = Simulator::Now().GetSeconds();
-  double endTime = startTime + txTime.GetSeconds();
-
   if (EM() == NULL) {
     NS_LOG_FUNCTION(this << " No EnergyModel set.");
     return;
   }
+  if (!m_PoweredOn)
+    return;
 
-  if (startTime > m_updateEnergyTime) {
-    EM()->DecrIdleEnergy(startTime - m_updateEnergyTime);
-    EM()->DecrRcvEnergy(txTime.GetSeconds());
-    m_updateEnergyTime = endTime;
-  }
-  else{
-    /* In this case, this device is receiving some other packet*/
-    if (endTime > m_updateEnergyTime && errorFlag)
-    {
-      EM()->DecrRcvEnergy(endTime - m_updateEnergyTime);
-      m_updateEnergyTime = endTime;
-    }
-  }
-
-
-  if (EM()->GetEnergy() <= 0) {
-    EM()->SetEnergy(-1);
-    //GetNetDevice()->LogEnergy(0);
-    //NS_LOG_INFO("AquaSimPhyCmn::UpdateRxEnergy: -t " << Simulator::Now().GetSeconds() <<
-      //" -n " << GetNetDevice()->GetAddress() << " -e 0");
-  }
+  /* if this device is already receiving some other packet the energy
+   * model only extends the reception past its current end */
+  EM()->SetStateFor(RECV, txTime.GetSeconds());
 }
 
+/**
+ * idle energy is integrated by the energy model when it is asked for,
+ * this only brings it up to date
+ */
 void
 AquaSimPhyCmn::UpdateIdleEnergy()
 {
   if (!m_PoweredOn || EM() == NULL )
     return;
 
-  if (Simulator::Now().GetSeconds() > m_updateEnergyTime && m_PoweredOn) {
-    EM()->DecrIdleEnergy(Simulator::Now().GetSeconds() - m_updateEnergyTime);
-    m_updateEnergyTime = Simulator::Now().GetSeconds();
-  }
-
-  // log device energy
-  if (EM()->GetEnergy() > 0) {
-    //GetNetDevice()->LogEnergy(1);
-    //NS_LOG_INFO("AquaSimPhyCmn::UpdateRxEnergy: -t " << Simulator::Now().GetSeconds() <<
-      //" -n " << GetNetDevice()->GetAddress() << " -e " << EM()->GetEnergy());
-  }
-  else {
-    //GetNetDevice()->LogEnergy(0);
-    //NS_LOG_INFO("AquaSimPhyCmn::UpdateRxEnergy: -t " << Simulator::Now().GetSeconds() <<
-      //" -n " << GetNetDevice()->GetAddress() << " -e 0");
-  }
-
-  Simulator::Schedule(Seconds(1), &AquaSimPhyCmn::UpdateIdleEnergy, this);
+  EM()->GetEnergy();
 }
 
 bool
@@ -309,6 +269,29 @@ AquaSimPhyCmn::Decodable(double noise, double ps) {
   return m_sinrChecker->Decodable(ps / noise);
 }
 
+void
+AquaSimPhyCmn::SetPowerLevels(std::vector<double> levels)
+{
+  NS_ASSERT(!levels.empty());
+  m_powerLevels = levels;
+  m_ptLevel = std::min((uint32_t)m_ptLevel, (uint32_t)levels.size() - 1);
+}
+
+/**
+* switch transmission power level; the energy model's tx power is scaled
+* with the drained power of the level
+*/
+void
+AquaSimPhyCmn::SetPtLevel(uint32_t level)
+{
+  NS_LOG_FUNCTION(this << level);
+  NS_ASSERT(level < m_powerLevels.size());
+
+  if (EM() != NULL && m_powerLevels[m_ptLevel] > 0)
+    EM()->SetTxPower(EM()->GetTxPower() * m_powerLevels[level] / m_powerLevels[m_ptLevel]);
+  m_ptLevel = level;
+}
+
 /**
 * stamp the packet with information required by channel
 * different channel model may require different information
@@ -342,20 +325,17 @@ AquaSimPhyCmn::Recv(Ptr<Packet> p)
   std::cout << "\n";*/
 
   AquaSimPacketStamp pstamp;
-  AquaSimHeader asHeader;
-  p->RemoveHeader(pstamp);
-  p->PeekHeader(asHeader);
-  p->AddHeader(pstamp);
+  uint8_t direction = AquaSimHeader::PeekDirection(p, pstamp.GetSerializedSize());
 
-  //NS_LOG_DEBUG ("direction=" << asHeader.GetDirection());
+  //NS_LOG_DEBUG ("direction=" << direction);
 
-  if (asHeader.GetDirection() == AquaSimHeader::DOWN) {
+  if (direction == AquaSimHeader::DOWN) {
     NS_LOG_DEBUG("Phy_Recv DOWN. Pkt counter(" << outPktCounter++ << ") on node(" <<
 		 GetNetDevice()->GetAddress() << ")");
     PktTransmit(p);
   }
   else {
-    if (asHeader.GetDirection() != AquaSimHeader::UP) {
+    if (direction != AquaSimHeader::UP) {
       NS_LOG_WARN("Direction for pkt-flow not specified, "
 	      "sending pkt up the stack on default.");
     }
@@ -496,6 +476,23 @@ AquaSimPhyCmn::PktTransmit(Ptr<Packet> p, int channelId) {
     return false;
   }
 
+  /*
+  *  Sync packets carry the sender's time at the moment they go on air,
+  *  no MAC queueing or backoff in between. Only they are rewritten, the
+  *  MAC type is read in place behind the AquaSimHeader.
+  */
+  Ptr<AquaSimSync> sync = GetNetDevice()->GetMacSync();
+  if (sync != 0)
+    {
+      uint8_t type = MacHeader::PeekDemuxPType(p, asHeader.GetSerializedSize());
+      if (type == MacHeader::UWPTYPE_SYNC || type == MacHeader::UWPTYPE_SYNC_BEACON)
+        {
+          p->RemoveHeader(asHeader);
+          asHeader.SetTimeStamp(sync->GetSyncedTime());
+          p->AddHeader(asHeader);
+        }
+    }
+
   /*
   *  Stamp the packet with the interface arguments
   */
@@ -596,7 +593,7 @@ AquaSimPhyCmn::PowerOn() {
     if (EM() != NULL) {
 	    //minus the energy consumed by power on
 	    EM()->SetEnergy(std::max(0.0, EM()->GetEnergy() - m_EnergyTurnOn));
-	    m_updateEnergyTime = std::max(Simulator::Now().GetSeconds(), m_updateEnergyTime);
+	    EM()->ChangeState(NIDLE);
     }
   }
 }
@@ -618,11 +615,7 @@ AquaSimPhyCmn::PowerOff() {
 
     //minus the energy consumed by power off
     EM()->SetEnergy(std::max(0.0, EM()->GetEnergy() - m_EnergyTurnOff));
-
-    if (Simulator::Now().GetSeconds() > m_updateEnergyTime) {
-      EM()->DecrIdleEnergy(Simulator::Now().GetSeconds() - m_updateEnergyTime);
-      m_updateEnergyTime = Simulator::Now().GetSeconds();
-    }
+    EM()->ChangeState(SLEEP);
   }
 }
 
@@ -643,25 +636,14 @@ AquaSimPhyCmn::Dump(void) const
 
 void
 AquaSimPhyCmn::StatusShift(double txTime) {
-  double endTime = Simulator::Now().GetSeconds() + txTime;
   /*  The receiver is receiving a packet when the
   transmitter begins to transmit a data.
   We assume the half-duplex mode, the transmitter
   stops the receiving process and begins the sending
   process.
   */
-  if (m_updateEnergyTime < endTime)
-  {
-    double overlapTime = m_updateEnergyTime - Simulator::Now().GetSeconds();
-    double actualTxTime = endTime - m_updateEnergyTime;
-    EM()->DecrEnergy(overlapTime, EM()->GetTxPower() - EM()->GetRxPower());
-    EM()->DecrTxEnergy(actualTxTime);
-    m_updateEnergyTime = endTime;
-  }
-  else {
-    double overlapTime = txTime;
-    EM()->DecrEnergy(overlapTime, EM()->GetTxPower() - EM()->GetRxPower());
-  }
+  if (EM() != NULL)
+    EM()->SetStateFor(SEND, txTime);
 }
 
 /**
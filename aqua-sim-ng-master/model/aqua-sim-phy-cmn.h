@@ -93,6 +93,11 @@ public:
   */
 
   virtual inline double GetPt() { return m_pT; }
+  //transmission power levels, in increasing order
+  void SetPowerLevels(std::vector<double> levels);
+  void SetPtLevel(uint32_t level);
+  uint32_t GetPtLevel() { return m_ptLevel; }
+  uint32_t GetPowerLevelCount() { return m_powerLevels.size(); }
   virtual inline double GetRXThresh() { return m_RXThresh; }
   virtual inline double GetCSThresh() { return m_CSThresh; }
 
@@ -127,7 +132,6 @@ protected:
 
   //TODO energy model could substitute this and better define it all.
   double m_pT;		// transmitted signal power (W)
-  double m_updateEnergyTime;	// the last time we update energy.
 
   double m_RXThresh;	// receive power threshold (W)
   double m_CSThresh;	// carrier sense threshold (W)
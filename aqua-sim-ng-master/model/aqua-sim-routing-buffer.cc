@@ -22,17 +22,90 @@
 #include "aqua-sim-header-routing.h"
 #include "aqua-sim-header.h"
 
+#include "ns3/simulator.h"
+
 using namespace ns3;
 
+AquaSimRoutingBuffer::AquaSimRoutingBuffer(int size, int myuser) :
+  m_usr(myuser), m_numOfPacket(0), m_head(0), m_span(0)
+{
+  m_maximumSize = (size > 0) ? size : 1;
+  m_ring.resize(m_maximumSize);
+  for (int i = 0; i < m_maximumSize; i++)
+    m_ring[i].used = false;
+
+  uint32_t n = 1;
+  while (n < 2 * (uint32_t)m_maximumSize)
+    n <<= 1;
+  m_index.assign(n, -1);
+  m_mask = n - 1;
+}
+
 AquaSimRoutingBuffer::~AquaSimRoutingBuffer()
 {
 }
 
+uint32_t
+AquaSimRoutingBuffer::Home(AquaSimAddress sender, unsigned int num) const
+{
+  uint32_t h = ((uint32_t)sender.GetAsInt() << 16) ^ num;
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return h & m_mask;
+}
+
+/*
+ * Position in m_index of (sender, num), -1 if not buffered.
+ */
+int
+AquaSimRoutingBuffer::Find(AquaSimAddress sender, unsigned int num) const
+{
+  for (uint32_t i = Home(sender, num); m_index[i] != -1; i = (i + 1) & m_mask)
+    {
+      const Slot &s = m_ring[m_index[i]];
+      if (s.sender == sender && s.pkNum == num)
+        return i;
+    }
+  return -1;
+}
+
 void
-AquaSimRoutingBuffer::AddNewPacket(Ptr<Packet> p)
+AquaSimRoutingBuffer::IndexAdd(uint32_t slot)
 {
-	Ptr<routing_buffer_cell> t1=Create<routing_buffer_cell>();
+  uint32_t i = Home(m_ring[slot].sender, m_ring[slot].pkNum);
+  while (m_index[i] != -1)
+    i = (i + 1) & m_mask;
+  m_index[i] = slot;
+}
 
+// backward shift deletion, keeps probe sequences intact without tombstones
+void
+AquaSimRoutingBuffer::IndexRemove(uint32_t pos)
+{
+  m_index[pos] = -1;
+  uint32_t j = pos;
+  while (true)
+    {
+      j = (j + 1) & m_mask;
+      if (m_index[j] == -1)
+        return;
+      const Slot &s = m_ring[m_index[j]];
+      uint32_t home = Home(s.sender, s.pkNum);
+      // leave it if its home lies cyclically in (pos, j]
+      bool stays = (pos <= j) ? (home > pos && home <= j) : (home > pos || home <= j);
+      if (!stays)
+        {
+          m_index[pos] = m_index[j];
+          m_index[j] = -1;
+          pos = j;
+        }
+    }
+}
+
+void
+AquaSimRoutingBuffer::Insert(Ptr<Packet> p)
+{
 	AquaSimHeader ash;
   VBHeader vbh;
   p->RemoveHeader(ash);
@@ -45,123 +118,105 @@ AquaSimRoutingBuffer::AddNewPacket(Ptr<Packet> p)
   source = vbh.GetSenderAddr();
   unsigned int pkt_num;
   pkt_num = vbh.GetPkNum();
-  /*
-  if(m_usr) pkt_num=vbh->pk_num;
-	else pkt_num= vbvah->pk_num;
-  */
 
 	Ptr<Packet> tpkt=DeQueue(source,pkt_num); // avoid duplication
 	if(tpkt) tpkt=0;
 
-
 	if (IsFull()) {
 		//      printf("ok, full\n");
 		Dehead()=0;
 	}
-	if(!t1) {
-		//  printf("AquaSimRoutingBuffer: can't get allocated  memory\n");
-		return;
-	}
-
-	t1->packet=p;
-	t1->next=NULL;
-
-	if(m_head==NULL) {
-		// printf("head is empty ok\n");
-		m_tail=t1;
-		m_head=t1;
-	}
-	else{
-		//  printf("head is not empty ok\n");
-		m_tail->next=t1;
-		m_tail=t1;
-	}
+	if (m_span == (uint32_t)m_maximumSize)
+		Compact();
+
+	uint32_t slot = (m_head + m_span) % m_maximumSize;
+	Slot &s = m_ring[slot];
+	s.packet = p;
+	s.sender = source;
+	s.pkNum = pkt_num;
+	s.arrival_time = Simulator::Now().ToDouble(Time::S);
+	s.used = true;
+	m_span++;
+	IndexAdd(slot);
 
 	m_numOfPacket++;
 }
 
-
 void
-AquaSimRoutingBuffer::CopyNewPacket(Ptr<Packet> pkt){
-	Ptr<routing_buffer_cell> t1=Create<routing_buffer_cell>();
-	Ptr<Packet> p=pkt->Copy();
-
-	AquaSimHeader ash;
-  VBHeader vbh;
-	p->RemoveHeader(ash);
-  p->PeekHeader(vbh);
-	p->AddHeader(ash);
-
-	AquaSimAddress source;
-	/*if (m_usr) source=vbh->sender_id;
-	else source=vbvah->sender_id;*/
-  source = vbh.GetSenderAddr();
-	unsigned int pkt_num;
-  pkt_num = vbh.GetPkNum();
-	/*if(m_usr) pkt_num=vbh->pk_num;
-	else pkt_num= vbvah->pk_num;*/
-
-
-	/*
-	   AquaSimAddress source=((m_usr)?: vbh->sender_id,vbvah->sender_id);
-	   unsigned int pkt_num=((m_usr)?: vbh->pk_num, vbvah->pk_num);
+AquaSimRoutingBuffer::AddNewPacket(Ptr<Packet> p)
+{
+	Insert(p);
+}
 
 
-	   AquaSimAddress source=vbh->sender_id;
-	   unsigned int pkt_num=vbh->pk_num;
-	 */
+void
+AquaSimRoutingBuffer::CopyNewPacket(Ptr<Packet> pkt){
+	Insert(pkt->Copy());
+	//printf("CopyNewPacket the pkt_num is %d and %d packets in buffer\n",vbh->pk_num,m_numOfPacket);
+}
 
-	//  printf("uw_buffer: pkt_num is%d\n",pkt_num);
-	Ptr<Packet> tpkt=DeQueue(source,pkt_num); // avoid duplication
-	if(tpkt) tpkt=0;
+/*
+ * Close the holes DeQueue left behind, keeping arrival order.
+ */
+void
+AquaSimRoutingBuffer::Compact()
+{
+	uint32_t to = m_head;
+	for (uint32_t k = 0; k < m_span; k++)
+	{
+		uint32_t from = (m_head + k) % m_maximumSize;
+		if (!m_ring[from].used)
+			continue;
+		if (from != to)
+		{
+			m_ring[to] = m_ring[from];
+			m_ring[from].packet = 0;
+			m_ring[from].used = false;
+		}
+		to = (to + 1) % m_maximumSize;
+	}
+	m_span = m_numOfPacket;
 
-	if (IsFull()) Dehead()=0;
+	m_index.assign(m_index.size(), -1);
+	for (uint32_t k = 0; k < m_span; k++)
+		IndexAdd((m_head + k) % m_maximumSize);
+}
 
-	t1->packet=p;
-	t1->next=NULL;
+Ptr<Packet>
+AquaSimRoutingBuffer::Remove(uint32_t slot)
+{
+	Slot &s = m_ring[slot];
+	IndexRemove(Find(s.sender, s.pkNum));
+	Ptr<Packet> p = s.packet;
+	s.packet = 0;
+	s.used = false;
+	m_numOfPacket--;
 
-	if(m_head==NULL) {
-		m_tail=t1;
-		m_head=t1;
-	}
-	else{
-		m_tail->next=t1;
-		m_tail=t1;
+	// trim the holes at both ends
+	while (m_span > 0 && !m_ring[m_head].used)
+	{
+		m_head = (m_head + 1) % m_maximumSize;
+		m_span--;
 	}
-
-	m_numOfPacket++;
-	//printf("CopyNewPacket the pkt_num is %d and %d packets in buffer\n",vbh->pk_num,m_numOfPacket);
+	while (m_span > 0 && !m_ring[(m_head + m_span - 1) % m_maximumSize].used)
+		m_span--;
+	return p;
 }
 
 
 Ptr<Packet>
 AquaSimRoutingBuffer::Head()
 {
-	//routing_buffer_cell* t1;
-	//routing_buffer_cell* t2;
-	Ptr<Packet> p;
-
-	if(!m_head) return NULL;
-	else return m_head->packet;
+	if(IsEmpty()) return NULL;
+	else return m_ring[m_head].packet;
 }
 
 
 Ptr<Packet>
 AquaSimRoutingBuffer::Dehead()
 {
-	//routing_buffer_cell* t1;
-	Ptr<routing_buffer_cell> t2;
-	Ptr<Packet> p;
-
-	if(!m_head) return NULL;
-	p=m_head->packet;
-	t2=m_head;
-	m_head=m_head->next;
-	m_numOfPacket--;
-
-	if(!m_head) m_tail=NULL;
-	t2=0;//delete t2;
-	return p;
+	if(IsEmpty()) return NULL;
+	return Remove(m_head);
 }
 
 bool
@@ -181,120 +236,38 @@ AquaSimRoutingBuffer::IsFull()
 Ptr<Packet>
 AquaSimRoutingBuffer::DeQueue( AquaSimAddress sender,unsigned int num)
 {
-	Ptr<routing_buffer_cell> current_p=m_head;
-	Ptr<routing_buffer_cell> previous_p=m_head;
-	Ptr<Packet> p;
 	if(IsEmpty()) return NULL;
-	while (current_p)
-	{
-		AquaSimHeader ash;
-    VBHeader vbh;
-		(current_p->packet)->RemoveHeader(ash);
-    (current_p->packet)->PeekHeader(vbh);
-		(current_p->packet)->AddHeader(ash);
-
-		AquaSimAddress source;
-		/*if (m_usr) source=vbh->sender_id;
-		else source=vbvah->sender_id;*/
-    source = vbh.GetSenderAddr();
-		unsigned int pkt_num;
-    pkt_num = vbh.GetPkNum();
-		/*if(m_usr) pkt_num=vbh->pk_num;
-		else pkt_num= vbvah->pk_num;*/
-
-		/*
-		   AquaSimAddress source=((m_usr)?: vbh->sender_id,vbvah->sender_id);
-		   unsigned int pkt_num=((m_usr)?: vbh->pk_num, vbvah->pk_num);
-		 */
-
-		//printf("ok, DEQUEUE buffer sender id is %d num=%d\n",vbh->sender_id.addr_,vbh->pk_num);
-		if((source == sender) && /*(source.port_==sender.port_)&&*/(pkt_num==num))
-		{
-			p=current_p->packet;
-
-			if(current_p==m_head)
-      {
-				m_head=m_head->next;
-				if(!m_head) m_tail=0;
-				//	delete current_p;
-			}
-			else
-			{
-				if(current_p==m_tail) m_tail=previous_p;
-				previous_p->next=current_p->next;
-				//    delete current_p;
-			}
-
-			current_p=0;//delete current_p;
-			m_numOfPacket--;
-			return p;
-		}
-		previous_p=current_p;
-		current_p=current_p->next;
-
-	}
-	return NULL;
+	int pos = Find(sender, num);
+	if (pos < 0)
+		return NULL;
+	return Remove(m_index[pos]);
 }
 
 
 Ptr<Packet>
 AquaSimRoutingBuffer::LookupCopy( AquaSimAddress sender,unsigned int num)
 {
-	Ptr<routing_buffer_cell> current_p=m_head;
-	Ptr<Packet> p;
 	if(IsEmpty())
   {
 		//printf("buffer: the data link is empty\n");
 		return NULL;
 	}
-	while (current_p)
-	{
-		AquaSimHeader ash;
-    VBHeader vbh;
-		(current_p->packet)->RemoveHeader(ash);
-    (current_p->packet)->PeekHeader(vbh);
-		(current_p->packet)->AddHeader(ash);
-
-		AquaSimAddress source;
-		/*if (m_usr) source=vbh->sender_id;
-		else source=vbvah->sender_id;*/
-    source = vbh.GetSenderAddr();
-		unsigned int pkt_num;
-    pkt_num = vbh.GetPkNum();
-		/*if(m_usr) pkt_num=vbh->pk_num;
-		else pkt_num= vbvah->pk_num;*/
-
-		/*
-		   AquaSimAddress source=((m_usr)?: vbh->sender_id,vbvah->sender_id);
-		   unsigned int pkt_num=((m_usr)?: vbh->pk_num, vbvah->pk_num);
-		 */
-
-		//printf("ok, Lookup buffer sender id is %d num=%d\n",vbh->sender_id.addr_,vbh->pk_num);
-		if((source == sender) && /*(source.port_==sender.port_)&&*/ (pkt_num==num))
-    {
-			p=current_p->packet;
-			return p;
-		}
-		current_p=current_p->next;
-	}
-	return p;
+	int pos = Find(sender, num);
+	if (pos < 0)
+		return NULL;
+	return m_ring[m_index[pos]].packet;
 }
 
 void
 AquaSimRoutingBuffer::DoDispose()
 {
-	Ptr<routing_buffer_cell> tmp;
-	while (m_head != NULL) {
-		m_head = m_head->next;
-		tmp->packet=0;
-		tmp=0;//delete tmp;
-		tmp = m_head;
-	}
-	while (m_tail != NULL) {
-		m_tail = m_tail->next;
-		tmp->packet=0;
-		tmp=0;//delete tmp;
-		tmp = m_tail;
+	for (uint32_t i = 0; i < m_ring.size(); i++)
+	{
+		m_ring[i].packet = 0;
+		m_ring[i].used = false;
 	}
+	m_index.assign(m_index.size(), -1);
+	m_numOfPacket = 0;
+	m_head = m_span = 0;
 	Object::DoDispose();
 }
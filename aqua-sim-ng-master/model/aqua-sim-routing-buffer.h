@@ -25,27 +25,22 @@
 #include "ns3/packet.h"
 #include "ns3/object.h"
 
-namespace ns3 {
+#include <vector>
 
-typedef struct AquaSimRoutingBufferCell : Object {
-  Ptr<Packet> packet;
-  Ptr<AquaSimRoutingBufferCell> next;
-  double arrival_time;
-} routing_buffer_cell;
+namespace ns3 {
 
 /**
  * \ingroup aqua-sim-ng
  *
  * \brief Buffer helper class for underwater routing
+ *
+ * Fixed capacity ring of packets in arrival order. An open addressing
+ * index on (sender, packet number) makes DeQueue and LookupCopy O(1), and
+ * no memory is allocated once the buffer is constructed.
  */
 class AquaSimRoutingBuffer : public Object{
 public:
-  AquaSimRoutingBuffer(int size=10, int myuser=1)
-  {
-    m_numOfPacket=0;
-    m_maximumSize=size;
-    m_usr=myuser;
-  };
+  AquaSimRoutingBuffer(int size=10, int myuser=1);
   ~AquaSimRoutingBuffer();
 
   void AddNewPacket(Ptr<Packet>);
@@ -62,10 +57,29 @@ public:
 protected:
   void DoDispose();
 private:
+  struct Slot {
+    Ptr<Packet> packet;
+    AquaSimAddress sender;
+    unsigned int pkNum;
+    double arrival_time;
+    bool used;
+  };
+
+  void Insert(Ptr<Packet> p);
+  Ptr<Packet> Remove(uint32_t slot);
+  void Compact();
+  uint32_t Home(AquaSimAddress sender, unsigned int num) const;
+  int Find(AquaSimAddress sender, unsigned int num) const;
+  void IndexAdd(uint32_t slot);
+  void IndexRemove(uint32_t pos);
+
   int m_numOfPacket;
   int m_maximumSize;
-  Ptr<routing_buffer_cell> m_head;
-  Ptr<routing_buffer_cell> m_tail;
+  std::vector<Slot> m_ring;
+  uint32_t m_head;	// oldest packet
+  uint32_t m_span;	// slots from m_head to the newest packet, holes included
+  std::vector<int> m_index;	// ring slot of each (sender, packet number), -1 if free
+  uint32_t m_mask;
 };  // class AquaSimRoutingBuffer
 
 }  // namespace ns3
@@ -81,128 +81,124 @@ QueueItemDbr::~QueueItemDbr()
 	m_p=0;
 }
 
-// Insert the item into queue.
-// The queue is sorted by the expected sending time
-// of the packet.
-void MyPacketQueue::insert(QueueItemDbr *q)
+void MyPacketQueue::Place(uint32_t slot, QueueItemDbr* q)
 {
-	QueueItemDbr *tmp;
-	std::deque<QueueItemDbr*>::iterator iter;
+	m_heap[slot] = q;
+	m_index[q->m_pid] = slot;
+}
 
-	// find the insert point
-	iter = m_dq.begin();
-	while (iter != m_dq.end())
+void MyPacketQueue::SiftUp(uint32_t slot)
+{
+	QueueItemDbr *q = m_heap[slot];
+	while (slot > 0)
 	{
-		tmp = *iter;
-		if (tmp->m_sendTime > q->m_sendTime)
-		{
-			m_dq.insert(iter, q);
-			return;
-		}
-		iter++;
+		uint32_t parent = (slot - 1) / 2;
+		if (m_heap[parent]->m_sendTime <= q->m_sendTime)
+			break;
+		Place(slot, m_heap[parent]);
+		slot = parent;
 	}
+	Place(slot, q);
+}
 
-	// insert at the end of the queue
-	m_dq.push_back(q);
+void MyPacketQueue::SiftDown(uint32_t slot)
+{
+	QueueItemDbr *q = m_heap[slot];
+	uint32_t n = m_heap.size();
+	while (true)
+	{
+		uint32_t child = 2 * slot + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && m_heap[child + 1]->m_sendTime < m_heap[child]->m_sendTime)
+			child++;
+		if (q->m_sendTime <= m_heap[child]->m_sendTime)
+			break;
+		Place(slot, m_heap[child]);
+		slot = child;
+	}
+	Place(slot, q);
 }
 
-// Check if packet p in queue needs to be updated.
+// Take the item at slot out of the heap, the caller owns it afterwards.
+void MyPacketQueue::Remove(uint32_t slot)
+{
+	m_index.erase(m_heap[slot]->m_pid);
+	QueueItemDbr *last = m_heap.back();
+	m_heap.pop_back();
+	if (slot == m_heap.size())
+		return;
+
+	Place(slot, last);
+	if (slot > 0 && m_heap[(slot - 1) / 2]->m_sendTime > last->m_sendTime)
+		SiftUp(slot);
+	else
+		SiftDown(slot);
+}
+
+void MyPacketQueue::pop()
+{
+	Remove(0);
+}
+
+// Insert the item into queue.
+// The queue is sorted by the expected sending time
+// of the packet.
+void MyPacketQueue::insert(QueueItemDbr *q)
+{
+	// one entry per packet, a stale one is replaced
+	purge(q->m_pid);
+	m_heap.push_back(q);
+	SiftUp(m_heap.size() - 1);
+}
+
+// Check if packet pid in queue needs to be updated.
 // If packet is not found, or previous sending time
-// is larger than current one, return true.
+// is larger than current one, return true (the old
+// entry is removed then).
 // Otherwise return false.
 bool
-MyPacketQueue::update(Ptr<Packet> p, double t)
+MyPacketQueue::update(uint32_t pid, double t)
 {
-	Ptr<Packet> pkt;
-	uint32_t curID;
-	std::deque<QueueItemDbr*>::iterator iter;
-  DBRHeader dbrh;
-	AquaSimHeader ash;
-	p->RemoveHeader(ash);
-  p->PeekHeader(dbrh);
-	p->AddHeader(ash);
-
-	// get current packet ID
-	curID = dbrh.GetPacketID();
+	std::unordered_map<uint32_t, uint32_t>::iterator it = m_index.find(pid);
+	if (it == m_index.end())
+		return true;
 
-	// search the queue
-	iter = m_dq.begin();
-	while (iter != m_dq.end())
+	uint32_t slot = it->second;
+	if (m_heap[slot]->m_sendTime > t)
 	{
-		((*iter)->m_p)->RemoveHeader(ash);
-    ((*iter)->m_p)->PeekHeader(dbrh);
-		((*iter)->m_p)->AddHeader(ash);
-		if (dbrh.GetPacketID() == curID)
-		{ // entry found
-			if ((*iter)->m_sendTime > t)
-			{
-				m_dq.erase(iter);
-				return true;
-			}
-			else
-				return false;
-		}
+		QueueItemDbr *old = m_heap[slot];
+		Remove(slot);
+		delete old;
+		return true;
 	}
-
-	// not found
-	return true;
+	return false;
 }
 
-// Find the item in queue which has the same packet ID
-// as p, and remove it.
+// Find the item in queue which has packet ID pid
+// and remove it.
 // If such a item is found, return true, otherwise
 // return false.
 bool
-MyPacketQueue::purge(Ptr<Packet> p)
+MyPacketQueue::purge(uint32_t pid)
 {
-	Ptr<Packet> pkt;
-	uint32_t curID;
-	std::deque<QueueItemDbr*>::iterator iter;
-  DBRHeader dbrh;
-	AquaSimHeader ash;
-	p->RemoveHeader(ash);
-  p->PeekHeader(dbrh);
-	p->AddHeader(ash);
-
-	// get current packet ID
-	curID = dbrh.GetPacketID();
-
-	// search the queue
-	iter = m_dq.begin();
-	while (iter != m_dq.end())
-	{
-		((*iter)->m_p)->RemoveHeader(ash);
-    ((*iter)->m_p)->PeekHeader(dbrh);
-		((*iter)->m_p)->AddHeader(ash);
-		if (dbrh.GetPacketID() == curID)
-		{
-			m_dq.erase(iter);
-			return true;
-		}
-		iter++;
-	}
+	std::unordered_map<uint32_t, uint32_t>::iterator it = m_index.find(pid);
+	if (it == m_index.end())
+		return false;
 
-	return false;
+	QueueItemDbr *old = m_heap[it->second];
+	Remove(it->second);
+	delete old;
+	return true;
 }
 
-// Dump all the items in queue for debug
+// Dump all the items in queue for debug (heap order)
 void MyPacketQueue::dump()
 {
-	std::deque<QueueItemDbr*>::iterator iter;
-  DBRHeader dbrh;
-	AquaSimHeader ash;
-	int i = 0;
-
-	iter = m_dq.begin();
-	while (iter != m_dq.end())
+	for (uint32_t i = 0; i < m_heap.size(); i++)
 	{
-		((*iter)->m_p)->RemoveHeader(ash);
-    ((*iter)->m_p)->PeekHeader(dbrh);
-		((*iter)->m_p)->AddHeader(ash);
     NS_LOG_INFO("MyPacketQueue::dump:[" << i << "] packetID " <<
-      dbrh.GetPacketID() << ", send time " << (*iter)->m_sendTime);
-		iter++;
-		i++;
+      m_heap[i]->m_pid << ", send time " << m_heap[i]->m_sendTime);
 	}
 }
 
@@ -291,9 +287,8 @@ NeighbTable::EntDelete(const NeighbEnt *ne)
 	owslot = m_tab[m];
 
 	// slide the entries
-	i = m + 1;
-	while (i < m_numEnts)
-		m_tab[i - 1] = m_tab[i+1];
+	for (i = m + 1; i < m_numEnts; i++)
+		m_tab[i - 1] = m_tab[i];
 
 	m_tab[m_numEnts-1] = owslot;
 	m_numEnts--;
@@ -539,25 +534,15 @@ NS_OBJECT_ENSURE_REGISTERED(ASPktCache);
 
 ASPktCache::ASPktCache()
 {
-	//int i;
-
 	m_maxSize = 1500;
 	m_size = 0;
-
-	m_pCache = new int[1500];
-
-	//for (i = 0; i < 100; i++)
-	//	m_pCache[i] = new Packet;
+	m_pCache.reserve(m_maxSize);
 }
 
 ASPktCache::~ASPktCache()
 {
-	//int i;
-
-	//for (i = 0; i < m_maxSize; i++)
-	//	delete m_pCache[i];
-
-	delete[] m_pCache;
+	m_pCache.clear();
+	m_lru.clear();
 }
 
 TypeId
@@ -571,52 +556,52 @@ ASPktCache::GetTypeId()
 int
 ASPktCache::AccessPacket(int p)
 {
-	int i, j;
-	int tmp;
-
-	for (i = 0; i < m_size; i++) {
-		if (m_pCache[i] == p) {
-			// if the pkt is existing
-			// put it to the tail
-			tmp = p;
-			for (j = i; j < m_size - 1; j++)
-				m_pCache[j] = m_pCache[j+1];
-			m_pCache[m_size-1] = tmp;
-
-			return 1;
-		}
-	}
+	std::unordered_map<int, std::list<int>::iterator>::iterator it = m_pCache.find(p);
+	if (it == m_pCache.end())
+		return 0;
 
-	return 0;
+	// if the pkt is existing
+	// put it to the tail
+	m_lru.splice(m_lru.end(), m_lru, it->second);
+	return 1;
 }
 
 void
 ASPktCache::AddPacket(int p)
 {
-	if (m_size == m_maxSize) {
-    NS_LOG_WARN("Cache is full!");
+	if (AccessPacket(p))
 		return;
+
+	if (m_size == m_maxSize) {
+		// forget the least recently seen packet
+		m_pCache.erase(m_lru.front());
+		m_lru.pop_front();
+		m_size--;
 	}
 
-	m_pCache[m_size] = p;
+	m_pCache[p] = m_lru.insert(m_lru.end(), p);
 	m_size++;
-
-	return;
 }
 
 void
 ASPktCache::DeletePacket(int p)
 {
+	std::unordered_map<int, std::list<int>::iterator>::iterator it = m_pCache.find(p);
+	if (it == m_pCache.end())
+		return;
+	m_lru.erase(it->second);
+	m_pCache.erase(it);
+	m_size--;
 }
 
 void
 ASPktCache::Dump(void)
 {
-	int i;
+	int i = 0;
 
-	for (i = 0; i < m_size; i++)
+	for (std::list<int>::iterator it = m_lru.begin(); it != m_lru.end(); it++, i++)
   {
-    NS_LOG_INFO("[" << i << "]: " << m_pCache[i]);
+    NS_LOG_INFO("[" << i << "]: " << *it);
   }
 }
 
@@ -760,8 +745,6 @@ void
 AquaSimDBR::Send_Callback(void)
 {
 	QueueItemDbr *q;
-  DBRHeader dbrh;
-	AquaSimHeader ash;
 
 	// we're done if there is no packet in queue
 	if (m_pq.empty())
@@ -774,19 +757,32 @@ AquaSimDBR::Send_Callback(void)
                         q->m_p,AquaSimAddress::GetBroadcast(),Seconds(0));
 
 	// put the packet into cache
-	(q->m_p)->RemoveHeader(ash);
-  (q->m_p)->PeekHeader(dbrh);
-	(q->m_p)->AddHeader(ash);
-	m_pc->AddPacket(dbrh.GetPacketID());
+	m_pc->AddPacket(q->m_pid);
+	delete q;
 
 	// reschedule the timer if there are
 	// other packets in the queue
-	if (!m_pq.empty())
+	RescheduleSendTimer();
+}
+
+// keep the sending timer armed for the head of the queue
+void
+AquaSimDBR::RescheduleSendTimer(void)
+{
+	if (m_pq.empty())
 	{
-		q = m_pq.front();
-		m_latest = q->m_sendTime;
-    m_sendTimer->Schedule(Seconds(m_latest - Simulator::Now().ToDouble(Time::S)));
+		m_sendTimer->Cancel();
+		return;
 	}
+
+	double head = m_pq.front()->m_sendTime;
+	if (m_sendTimer->IsRunning() && head == m_latest)
+		return;
+
+	m_sendTimer->Cancel();
+	m_latest = head;
+	double delay = m_latest - Simulator::Now().ToDouble(Time::S);
+	m_sendTimer->Schedule(Seconds(delay > 0 ? delay : 0));
 }
 
 void
@@ -1217,7 +1213,7 @@ AquaSimDBR::HandlePktForward(Ptr<Packet> p)
 
 #if 0
 	// search sending queue for p
-	if (m_pq.purge(p))
+	if (m_pq.purge(dbrh.GetPacketID()))
 	{
 		drop(p, DROP_RTR_TTL);
 		return;
@@ -1243,10 +1239,9 @@ AquaSimDBR::HandlePktForward(Ptr<Packet> p)
 		// only forward the packet from lower level
 		if (delta < DBR_DEPTH_THRESHOLD)
 		{
-			//p->AddHeader(dbrh);
-      p->AddHeader(ash);
-      p->AddPacketTag(ptag);
-			m_pq.purge(p);
+			// a shallower node forwarded it, give up our copy
+			if (m_pq.purge(dbrh.GetPacketID()))
+				RescheduleSendTimer();
       p=0;
       //drop(p, DROP_RTR_TTL);
 			return;
@@ -1313,34 +1308,11 @@ AquaSimDBR::HandlePktForward(Ptr<Packet> p)
 	p->AddHeader(dbrh);
   p->AddHeader(ash);
   p->AddPacketTag(ptag);
-	QueueItemDbr *q = new QueueItemDbr(p, expected_send_time);
-
-	/*
-	m_pq.insert(q);
-	QueueItemDbr *qf;
-	qf = m_pq.front();
-	send_timer_->resched(qf->m_sendTime - NOW);
-	*/
 
-	if (m_pq.empty())
+	if (m_pq.update(dbrh.GetPacketID(), expected_send_time))
 	{
-		m_pq.insert(q);
-		m_latest = expected_send_time;
-    m_sendTimer->Schedule(Seconds(delay));
-	}
-	else
-	{
-		if (m_pq.update(p, expected_send_time))
-		{
-			m_pq.insert(q);
-
-			// update the sending timer
-			if (expected_send_time < m_latest)
-			{
-				m_latest = expected_send_time;
-        m_sendTimer->Schedule(Seconds(delay));
-			}
-		}
+		m_pq.insert(new QueueItemDbr(p, expected_send_time, dbrh.GetPacketID()));
+		RescheduleSendTimer();
 	}
 }
 #endif	// end of USE_FLOODING_ALG
@@ -36,7 +36,9 @@
 #include "ns3/vector.h"
 #include "ns3/timer.h"
 
-#include <deque>
+#include <vector>
+#include <list>
+#include <unordered_map>
 
 #define	DBR_PORT		0xFF
 
@@ -87,39 +89,49 @@ private:
 
 class QueueItemDbr : public Object {
 public:
-	QueueItemDbr() : /*m_p(0),*/ m_sendTime(0) {}
-	QueueItemDbr(Ptr<Packet> p, double t) : m_p(p), m_sendTime(t) {}
+	QueueItemDbr() : /*m_p(0),*/ m_sendTime(0), m_pid(0) {}
+	QueueItemDbr(Ptr<Packet> p, double t, uint32_t pid) : m_p(p), m_sendTime(t), m_pid(pid) {}
 	~QueueItemDbr();
 
 	Ptr<Packet> m_p;		// pointer to the packet
 	double m_sendTime;	// time to send the packet
+	uint32_t m_pid;		// DBR packet ID of m_p
 };  // class QueueItemDbr
 
+/*
+ * Holding queue ordered by sending time: a binary min-heap on m_sendTime
+ * plus a packet ID -> heap slot index, so insert, update and purge are
+ * O(log n) and never have to decode queued packets.
+ */
 class MyPacketQueue : public Object {
 public:
-	MyPacketQueue() : m_dq() {}
+	MyPacketQueue() {}
 	~MyPacketQueue() {
-		QueueItemDbr* tmp;
-		while(!m_dq.empty()) {
-			tmp = m_dq.back();
-			m_dq.pop_back();
-			delete tmp;
-		}
-		m_dq.clear();
+		for (uint32_t i = 0; i < m_heap.size(); i++)
+			delete m_heap[i];
+		m_heap.clear();
+		m_index.clear();
 	}
 
-	bool empty() { return m_dq.empty(); }
-	int size() { return m_dq.size(); }
+	bool empty() { return m_heap.empty(); }
+	int size() { return m_heap.size(); }
 	void dump();
 
-	void pop() { m_dq.pop_front(); };
-	QueueItemDbr* front() { return m_dq.front(); };
+	// pop() hands the front item over to the caller
+	void pop();
+	QueueItemDbr* front() { return m_heap.front(); };
 	void insert(QueueItemDbr* q);
-	bool update(Ptr<Packet> p, double t);
-	bool purge(Ptr<Packet> p);
+	bool update(uint32_t pid, double t);
+	bool purge(uint32_t pid);
 
 private:
-	std::deque<QueueItemDbr*> m_dq;
+	void Remove(uint32_t slot);
+	void SiftUp(uint32_t slot);
+	void SiftDown(uint32_t slot);
+	void Place(uint32_t slot, QueueItemDbr* q);
+
+	std::vector<QueueItemDbr*> m_heap;
+	std::unordered_map<uint32_t, uint32_t> m_index;
 };  // class MyPacketQueue
 
 class NeighbEnt{
@@ -173,7 +185,9 @@ public:
 	void Dump(void);
 
 private:
-	int *m_pCache;			// packet cache
+	// least recently accessed at the front, evicted when the cache is full
+	std::list<int> m_lru;
+	std::unordered_map<int, std::list<int>::iterator> m_pCache;
 	int	m_size;					// cache size
 	int m_maxSize;				// max cache size
 };  // class ASPktCache
@@ -227,6 +241,7 @@ protected:
 	void BeaconIn(Ptr<Packet>);
 
 	void HandlePktForward(Ptr<Packet> p);
+	void RescheduleSendTimer(void);
 	virtual void DoDispose();
 };
 
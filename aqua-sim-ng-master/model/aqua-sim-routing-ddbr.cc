@@ -37,6 +37,13 @@
 #include "ns3/nstime.h"
 #include "ns3/simulator.h"
 #include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/trace-source-accessor.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
 
 // #include "underwatersensor/uw_common/uw_hash_table.h"
 
@@ -70,6 +77,12 @@ AquaSimDDBR::AquaSimDDBR()
   m_sendTimer->SetFunction(&DDBR_SendingTimer::Expire,m_sendTimer);
 
   m_rand=CreateObject<UniformRandomVariable> ();
+
+  m_opportunistic = false;
+  m_numCandidates = 3;
+  m_slotTime = MilliSeconds(100);
+  m_neighborTimeout = Seconds(60);
+  m_dupTx = 0;
 }
 
 AquaSimDDBR::~AquaSimDDBR()
@@ -84,6 +97,30 @@ AquaSimDDBR::GetTypeId()
   static TypeId tid = TypeId ("ns3::AquaSimDDBR")
     .SetParent<AquaSimRouting> ()
     .AddConstructor<AquaSimDDBR> ()
+    .AddAttribute ("Opportunistic", "Forward through a prioritised candidate list instead of holding times only.",
+      BooleanValue (false),
+      MakeBooleanAccessor (&AquaSimDDBR::m_opportunistic),
+      MakeBooleanChecker ())
+    .AddAttribute ("Candidates", "Number of forwarding candidates named by each transmission.",
+      UintegerValue (3),
+      MakeUintegerAccessor (&AquaSimDDBR::m_numCandidates),
+      MakeUintegerChecker<uint32_t> (0, DDBR_MAX_CANDIDATES))
+    .AddAttribute ("SlotTime", "Holding time step between two candidate priorities.",
+      TimeValue (MilliSeconds (100)),
+      MakeTimeAccessor (&AquaSimDDBR::m_slotTime),
+      MakeTimeChecker ())
+    .AddAttribute ("NeighborTimeout", "A neighbour not overheard for this long is no candidate anymore.",
+      TimeValue (Seconds (60)),
+      MakeTimeAccessor (&AquaSimDDBR::m_neighborTimeout),
+      MakeTimeChecker ())
+    .AddTraceSource ("EndToEndDelay",
+      "Delay of a data packet from its source to the sink.",
+      MakeTraceSourceAccessor (&AquaSimDDBR::m_e2eDelayTrace),
+      "ns3::AquaSimDDBR::DelayCallback")
+    .AddTraceSource ("DuplicateTx",
+      "Number of overheard redundant relays (same packet and hop, another sender).",
+      MakeTraceSourceAccessor (&AquaSimDDBR::m_dupTx),
+      "ns3::TracedValueCallback::Uint32")
   ;
   return tid;
 }
@@ -100,6 +137,9 @@ bool
 AquaSimDDBR::Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumber)
 {
   NS_LOG_FUNCTION(this << packet << GetNetDevice()->GetAddress());
+  if (m_opportunistic)
+    return RecvOpportunistic(packet, dest);
+
   VBHeader vbh;
   AquaSimHeader ash;
   //Ipv4Header iph; //not used, removed to reduce overhead.
@@ -116,7 +156,7 @@ AquaSimDDBR::Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumb
     // Time txdelay = (Simulator::Now()/10000000);
     //double txdelay = Simulator::Now().ToDouble(Time::S);
     vbh.SetSenderAddr(AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()));
-    vbh.SetPkNum(packet->GetUid());
+    vbh.SetPkNum(m_pkCount++);
     vbh.SetMessType(AS_DATA);
     vbh.SetTargetAddr(AquaSimAddress::ConvertFrom(dest));
     //vbh.SetDepth(model->GetPosition().z);
@@ -149,7 +189,7 @@ AquaSimDDBR::Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumb
     vbh.SetTs(Simulator::Now().ToDouble(Time::S));
     vbh.SetMessType(AS_DATA);
     vbh.SetSenderAddr(AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()));
-    vbh.SetPkNum(packet->GetUid());
+    vbh.SetPkNum(m_pkCount++);
     vbh.SetTargetAddr(AquaSimAddress::ConvertFrom(dest));
     // NS_LOG_DEBUG("vbf ts"<< vbh.GetTs());
     // ash.SetUId(packet->GetUid());
@@ -212,7 +252,7 @@ NS_LOG_DEBUG("Expired node depth :"<<model->GetPosition().z <<" id: "<<ash.GetUI
     }
   }
   // Packet Hash Table is used to keep info about experienced pkts.
-  vbf_neighborhood *hashPtr= PktTable.GetHash(vbh.GetSenderAddr(), packet->GetUid());
+  vbf_neighborhood *hashPtr= PktTable.GetHash(vbh.GetSenderAddr(), vbh.GetPkNum());
   double delays = 1;
   // m_pq.print();
 
@@ -332,6 +372,7 @@ NS_LOG_DEBUG("Expired node depth :"<<model->GetPosition().z <<" id: "<<ash.GetUI
     float diff_time = fabs(ash.GetTimeStamp().ToDouble(Time::S) - c_time);
     cum_time = cum_time + fabs(diff_time);
     double avg_delay= (cum_time / tot_pkt );
+    m_e2eDelayTrace(Seconds(diff_time));
     // double avg_delay= (cum_time / (tot_pkt + delays )) + delays;previous
     NS_LOG_DEBUG("sink:c_time:"<< c_time<<" c_delay_pkt:" << diff_time << " sendtime: "
       << ash.GetTimeStamp()<<" pck_ID:"<<packet->GetUid()
@@ -1110,6 +1151,25 @@ AquaSimDDBR::Send_Callback(void)
   // we're done if there is no packet in queue
   if (m_pq.empty())
     return;
+
+  if (m_opportunistic)
+  {
+    q = m_pq.front();
+    m_pq.pop();
+    // purged by an implicit ACK meanwhile
+    if (q->m_p != 0)
+      SendOpportunistic(q->m_p);
+    delete q;
+
+    if (!m_pq.empty())
+    {
+      m_latest = m_pq.front()->m_sendTime;
+      double delay = m_latest - Simulator::Now().ToDouble(Time::S);
+      m_sendTimer->Schedule(Seconds(delay > 0 ? delay : 0));
+    }
+    return;
+  }
+
   // send the first packet out
   q = m_pq.front();
   // g = m_pq.front();
@@ -1139,6 +1199,180 @@ AquaSimDDBR::Send_Callback(void)
   }
 }
 
+bool
+AquaSimDDBR::RecvOpportunistic(Ptr<Packet> packet, const Address &dest)
+{
+  AquaSimHeader ash;
+  DDBRHeader ddbrh;
+  AquaSimAddress myAddr = AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress());
+  double myDepth = GetNetDevice()->GetNode()->GetObject<MobilityModel>()->GetPosition().z;
+  int uid = packet->GetUid();
+
+  if (FromUpperLayer(packet))  //we are the source
+  {
+    packet->RemoveHeader(ash);	//the device's header, reused below
+    ash.SetTimeStamp(Simulator::Now());
+    ash.SetDirection(AquaSimHeader::DOWN);
+    ash.SetNextHop(AquaSimAddress::GetBroadcast());
+    ash.SetSAddr(myAddr);
+    ash.SetDAddr(AquaSimAddress::ConvertFrom(dest));
+    ash.SetErrorFlag(false);
+    ash.SetNumForwards(0);
+    packet->AddHeader(ddbrh);
+    packet->AddHeader(ash);
+    m_pc->AddPacket(uid);
+    SendOpportunistic(packet);
+    return true;
+  }
+
+  packet->RemoveHeader(ash);
+  packet->RemoveHeader(ddbrh);
+  AquaSimAddress prevHop = ddbrh.GetPrevHop();
+
+  OppNeighbor &nb = m_oppNeighbors[prevHop];
+  nb.depth = ddbrh.GetDepth();
+  nb.lastHeard = Simulator::Now();
+
+  // two senders relaying the same hop means one transmission was redundant
+  std::map<int, std::pair<uint8_t, AquaSimAddress> >::iterator h = m_oppHeard.find(uid);
+  if (h == m_oppHeard.end())
+  {
+    m_oppHeard[uid] = std::make_pair(ddbrh.GetHopCount(), prevHop);
+    if (m_oppHeard.size() > 1500)
+      m_oppHeard.erase(m_oppHeard.begin());
+  }
+  else if (h->second.first == ddbrh.GetHopCount() && h->second.second != prevHop)
+    m_dupTx++;
+  else if (ddbrh.GetHopCount() > h->second.first)
+    h->second = std::make_pair(ddbrh.GetHopCount(), prevHop);
+
+  if (ash.GetDAddr() == myAddr)
+  {
+    if (m_pc->AccessPacket(uid))
+    {
+      packet=0;
+      return false;
+    }
+    m_pc->AddPacket(uid);
+    m_e2eDelayTrace(Simulator::Now() - ash.GetTimeStamp());
+    packet->AddHeader(ash);
+    DataForSink(packet);
+    return true;
+  }
+
+  if (m_pc->AccessPacket(uid))
+  {
+    // implicit ACK: a node at least as deep as us relayed it
+    if (ddbrh.GetDepth() >= myDepth && m_pq.purge(packet))
+      NS_LOG_DEBUG("Node " << myAddr << " cancels pkt " << uid << ", relayed by " << prevHop);
+    packet=0;
+    return false;
+  }
+
+  // only deeper nodes make progress
+  double delta = myDepth - ddbrh.GetDepth();
+  if (delta < DBR_DEPTH_THRESHOLD)
+  {
+    packet=0;
+    return false;
+  }
+  m_pc->AddPacket(uid);
+
+  double slot = m_slotTime.ToDouble(Time::S);
+  double delay;
+  int prio = ddbrh.GetPriority(myAddr);
+  if (prio >= 0)
+    delay = prio * slot;
+  else
+  {
+    // not a candidate: DBR holding time, after all the candidate slots
+    double speed = 1500;
+    double alpha1 = 2 * DBR_MAX_RANGE / speed;
+    double alpha = fabs(DBR_MAX_RANGE - delta);
+    delay = ddbrh.GetNumCandidates() * slot + (alpha * alpha1) / DBR_DELTA;
+  }
+  // desynchronize nodes with the same priority
+  delay += m_rand->GetValue(0, 0.1 * slot);
+
+  NS_LOG_DEBUG("Node " << myAddr << " holds pkt " << uid << " for " << delay <<
+      "s, priority " << prio);
+  packet->AddHeader(ddbrh);
+  packet->AddHeader(ash);
+  HoldPacket(packet, delay);
+  return true;
+}
+
+void
+AquaSimDDBR::HoldPacket(Ptr<Packet> p, double delay)
+{
+  double expected_send_time = Simulator::Now().ToDouble(Time::S) + delay;
+  m_pq.insert(new QqueueItem(p, expected_send_time, p->GetUid()));
+
+  if (!m_sendTimer->IsRunning() || expected_send_time < m_latest)
+  {
+    m_sendTimer->Cancel();
+    m_latest = expected_send_time;
+    m_sendTimer->Schedule(Seconds(delay));
+  }
+}
+
+void
+AquaSimDDBR::SendOpportunistic(Ptr<Packet> p)
+{
+  AquaSimHeader ash;
+  DDBRHeader ddbrh;
+  double myDepth = GetNetDevice()->GetNode()->GetObject<MobilityModel>()->GetPosition().z;
+
+  p->RemoveHeader(ash);
+  p->RemoveHeader(ddbrh);
+  ddbrh.SetPrevHop(AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()));
+  ddbrh.SetDepth(myDepth);
+  ddbrh.SetHopCount(ddbrh.GetHopCount() + 1);
+  SelectCandidates(ddbrh, myDepth);
+
+  ash.SetDirection(AquaSimHeader::DOWN);
+  ash.SetNextHop(AquaSimAddress::GetBroadcast());
+  ash.SetErrorFlag(false);
+  ash.SetNumForwards(ash.GetNumForwards() + 1);
+  ash.SetSize(64 + ddbrh.GetSerializedSize()); //(God::instance()->data_pkt_size);
+  p->AddHeader(ddbrh);
+  p->AddHeader(ash);
+
+  NS_LOG_DEBUG("Node " << GetNetDevice()->GetAddress() << " sends pkt " << p->GetUid() <<
+      ", hop " << (int)ddbrh.GetHopCount() << ", " << (int)ddbrh.GetNumCandidates() << " candidates");
+  Simulator::Schedule(Seconds(0), &AquaSimRouting::SendDown,this,
+                          p,AquaSimAddress::GetBroadcast(),Seconds(0));
+}
+
+/*
+ * The deepest recently overheard neighbours that are deeper than us,
+ * deepest first.
+ */
+void
+AquaSimDDBR::SelectCandidates(DDBRHeader &ddbrh, double myDepth)
+{
+  std::vector<std::pair<double, AquaSimAddress> > deeper;
+  std::map<AquaSimAddress, OppNeighbor>::iterator it = m_oppNeighbors.begin();
+  while (it != m_oppNeighbors.end())
+  {
+    if (Simulator::Now() - it->second.lastHeard > m_neighborTimeout)
+      m_oppNeighbors.erase(it++);
+    else
+    {
+      if (it->second.depth - myDepth >= DBR_DEPTH_THRESHOLD)
+        deeper.push_back(std::make_pair(it->second.depth, it->first));
+      it++;
+    }
+  }
+
+  uint32_t n = std::min((uint32_t)deeper.size(), m_numCandidates);
+  std::partial_sort(deeper.begin(), deeper.begin() + n, deeper.end(),
+                    std::greater<std::pair<double, AquaSimAddress> >());
+  ddbrh.ClearCandidates();
+  for (uint32_t i = 0; i < n; i++)
+    ddbrh.AddCandidate(deeper[i].second);
+}
+
 #if 1
 bool
 AquaSimDDBR::Recv1(Ptr<Packet> p, const Address &dest, uint16_t protocolNumber)
@@ -23,13 +23,18 @@
 #include "aqua-sim-routing-vbf.h"
 #include "aqua-sim-routing-dbr.h"
 #include "aqua-sim-address.h"
+#include "aqua-sim-header-routing.h"
 
 #include "ns3/random-variable-stream.h"
 #include "ns3/packet.h"
 #include "ns3/mobility-model.h"
 #include "ns3/vector.h"
 #include "ns3/timer.h"
+#include "ns3/nstime.h"
+#include "ns3/traced-value.h"
+#include "ns3/traced-callback.h"
 #include <deque>
+#include <map>
 
 
 #define DBR_PORT    0xFF
@@ -203,6 +208,8 @@ class AquaSimDDBR : public AquaSimRouting {
   void Send_Callback(void);
   void DeadNeighb_Callback(MNeighbEnt *ne);
 
+  typedef void (* DelayCallback)(Time delay);
+
  protected:
   int m_pkCount;
   double cum_time;
@@ -238,6 +245,34 @@ class AquaSimDDBR : public AquaSimRouting {
   // void ForwardPacket(Ptr<Packet>, int = 0);
   void HandlePktForward(Ptr<Packet> p);
 
+  /*
+   * Opportunistic mode: each transmission names a prioritised list of
+   * deeper neighbours. Candidate i holds the packet for i slots, anyone
+   * else for the DBR holding time after all the slots, and overhearing
+   * the packet from a node at least as deep cancels the held copy
+   * (implicit ACK).
+   */
+  bool RecvOpportunistic(Ptr<Packet> packet, const Address &dest);
+  void SendOpportunistic(Ptr<Packet> p);
+  void SelectCandidates(DDBRHeader &ddbrh, double myDepth);
+  void HoldPacket(Ptr<Packet> p, double delay);
+
+  struct OppNeighbor {
+    double depth;
+    Time lastHeard;
+  };
+  std::map<AquaSimAddress, OppNeighbor> m_oppNeighbors;
+  // packet uid -> (hop, first sender heard for that hop)
+  std::map<int, std::pair<uint8_t, AquaSimAddress> > m_oppHeard;
+
+  bool m_opportunistic;
+  uint32_t m_numCandidates;
+  Time m_slotTime;
+  Time m_neighborTimeout;
+
+  TracedCallback<Time> m_e2eDelayTrace;
+  TracedValue<uint32_t> m_dupTx;	// redundant relays of the same hop overheard
+
 };
 
 
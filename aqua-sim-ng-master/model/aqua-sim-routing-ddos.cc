@@ -27,6 +27,8 @@
 #include "ns3/boolean.h"
 #include "ns3/double.h"
 #include "ns3/integer.h"
+#include "ns3/uinteger.h"
+#include "ns3/string.h"
 #include "ns3/log.h"
 
 #include <vector>
@@ -36,15 +38,14 @@
 
 using namespace ns3;
 
-#define Malloc(type,n) (type *)malloc((n)*sizeof(type))
-
 NS_LOG_COMPONENT_DEFINE("AquaSimDDOS");
 NS_OBJECT_ENSURE_REGISTERED(AquaSimDDOS);
 
 AquaSimDDOS::AquaSimDDOS() :
   m_totalPktSent(0), m_totalPktRecv(0), //m_dataCacheSize(10),
   isAttacker(false), m_pushbackReduction(0.01), m_throttleReduction(0.015),
-  m_statisticalIteration(0)
+  m_statisticalIteration(0), m_svmHead(0), m_svmNew(0), m_svmWindow(100),
+  m_svmOnline(true), m_svmLambda(0.01), m_svmUpdates(0)
 {
   m_pitEntryTimeout = Seconds(60);
   m_ddosCheckFrequency = Minutes(2);//Minutes(10);
@@ -108,6 +109,8 @@ AquaSimDDOS::AquaSimDDOS() :
   #endif
 
   m_modelTrained=false;
+  for (int i = 0; i <= DDOS_SVM_FEATURES; i++)
+    m_svmW[i] = 0;
 }
 
 TypeId
@@ -132,6 +135,22 @@ AquaSimDDOS::GetTypeId()
       IntegerValue(20),
       MakeIntegerAccessor(&AquaSimDDOS::m_minCompTrans),
       MakeIntegerChecker<int>())
+    .AddAttribute ("OnlineSvm", "Train a linear SVM online, one sample at a time, instead of batch training with libsvm.",
+      BooleanValue(true),
+      MakeBooleanAccessor(&AquaSimDDOS::m_svmOnline),
+      MakeBooleanChecker())
+    .AddAttribute ("SvmWindow", "Number of most recent samples the SVM learns from.",
+      UintegerValue(100),
+      MakeUintegerAccessor(&AquaSimDDOS::m_svmWindow),
+      MakeUintegerChecker<uint32_t>(1))
+    .AddAttribute ("SvmLambda", "Regularization of the online SVM.",
+      DoubleValue(0.01),
+      MakeDoubleAccessor(&AquaSimDDOS::m_svmLambda),
+      MakeDoubleChecker<double>(0))
+    .AddAttribute ("SvmModelFile", "File batch trained libsvm models are saved to, empty to keep them in memory only.",
+      StringValue(""),
+      MakeStringAccessor(&AquaSimDDOS::m_svmModelFile),
+      MakeStringChecker())
   ;
   return tid;
 }
@@ -560,6 +579,10 @@ AquaSimDDOS::DdosAttackCheck()
     totalPitUsage++;
   }
 
+  m_batchX.clear();
+  m_batchY.clear();
+  m_batchNode.clear();
+
   std::map<int,DdosTable>::iterator it=DdosDetectionTable.begin();
   for (; it!=DdosDetectionTable.end(); it++) {
     int localNodeId = it->first;     // for readability
@@ -616,23 +639,11 @@ AquaSimDDOS::DdosAttackCheck()
               attackee fully throttles the attacker.) */
       }
 
-    //collect for SVM
-    SvmTable.push(SvmInput(timeoutRatio,std::max(transDominance,pitUsage),potentialAttack));
-    //svm classification
-    if (m_modelTrained) {
-      m_space = Malloc(struct svm_node,3);
-      m_space[0].index=0;
-      m_space[0].value=timeoutRatio;
-      m_space[1].index=1;
-      m_space[1].value=std::max(transDominance,pitUsage);
-      m_space[2].index=-1;
-
-
-      std::cout << "Predicted(" << GetNetDevice()->GetAddress() << ") @" << Simulator::Now().ToDouble(Time::S) <<
-        ":" << localNodeId << "," << svm_predict(m_model,m_space) << "\n";
-
-      free(m_space);
-    }
+    //collect for SVM, classified in one pass after the loop
+    m_batchX.push_back(timeoutRatio);
+    m_batchX.push_back(std::max(transDominance,pitUsage));
+    m_batchY.push_back(potentialAttack ? 1 : -1);
+    m_batchNode.push_back(localNodeId);
 
     // --- for mobility analysis ----
     Ptr<Object> object = GetNetDevice()->GetChannel()->GetDevice(localNodeId-1)->GetNode();
@@ -662,6 +673,8 @@ AquaSimDDOS::DdosAttackCheck()
         (ml_it->second).push(mlTable);
       }
   }
+  SvmClassify();
+
   Time delay = m_ddosCheckFrequency + m_ddosCheckFrequency * m_rand->GetValue(); //add a slight variation
   Simulator::Schedule(delay, &AquaSimDDOS::DdosAttackCheck, this);
 }
@@ -816,84 +829,130 @@ std::vector<StatisticalTable> AquaSimDDOS::Statistical()
   return scores;
 }
 
-void AquaSimDDOS::SVM()
+/*
+ * Predicts every sample of the last check, then stores it in the sample
+ * window and, for the online SVM, learns from it. Labels are the outcome
+ * of the threshold rules.
+ */
+void AquaSimDDOS::SvmClassify()
 {
-  NS_LOG_FUNCTION(this);
+  const double *x = m_batchY.empty() ? NULL : &m_batchX[0];
+  for (size_t k = 0; k < m_batchY.size(); k++, x += DDOS_SVM_FEATURES) {
+    if (m_modelTrained)
+      NS_LOG_DEBUG("Predicted(" << GetNetDevice()->GetAddress() << ") @" << Simulator::Now().ToDouble(Time::S) <<
+        ":" << m_batchNode[k] << "," << (SvmDecision(x) > 0 ? 1 : 0));
 
-  //NOTE: this is for training model, classification should be separate.
-  if (SvmTable.size() < 100) return;
-  std::cout << GetNetDevice()->GetAddress() << " SVM table size:" << SvmTable.size() << "\n";
+    //boundry check.
+    NS_ASSERT((x[0] >= 0 && x[0] <= 1) || (x[1] >= 0 && x[1] <= 1));
 
-  m_prob.l = SvmTable.size();
-  size_t elements, j;
-  elements = m_prob.l * 3;
-  j=0;
+    SvmInput entry(x[0], x[1], m_batchY[k] > 0);
+    if (SvmTable.size() < m_svmWindow)
+      SvmTable.push_back(entry);
+    else {
+      SvmTable[m_svmHead] = entry;
+      m_svmHead = (m_svmHead + 1) % m_svmWindow;
+    }
+    m_svmNew++;
 
-  m_prob.y = Malloc(double,m_prob.l);
-  m_prob.x = Malloc(struct svm_node *,m_prob.l);
-  m_space = Malloc(struct svm_node,elements);
+    if (m_svmOnline)
+      SvmOnlineUpdate(x, m_batchY[k]);
+  }
+}
 
-  int i=0;
-  while(!SvmTable.empty()) {
-    //LIBSVM expected layout: <label> <index1>:<value1> <index2>:<value2> ...
-    SvmInput entry=SvmTable.front();
-    m_prob.x[i] = &m_space[j];
-    m_prob.y[i] = (entry.compromised)?1:0;
+double AquaSimDDOS::SvmDecision(const double *x)
+{
+  double d = m_svmW[DDOS_SVM_FEATURES];
+  for (int i = 0; i < DDOS_SVM_FEATURES; i++)
+    d += m_svmW[i] * x[i];
+  return d;
+}
 
-    //boundry check.
-    NS_ASSERT((entry.timeoutR >= 0 && entry.timeoutR <= 1) || (entry.maxR >= 0 && entry.maxR <= 1));
+/*
+ * One Pegasos step of a linear SVM with hinge loss. The step size stops
+ * shrinking after a window's worth of samples so the model keeps tracking
+ * the recent ones. Constant time per sample.
+ */
+void AquaSimDDOS::SvmOnlineUpdate(const double *x, double y)
+{
+  m_svmUpdates++;
+  double t = std::min(m_svmUpdates, (uint64_t)m_svmWindow);
+  double eta = (m_svmLambda > 0) ? 1.0 / (m_svmLambda * t) : 1.0 / t;
+  bool violated = (y * SvmDecision(x) < 1);
+
+  double norm = 0;
+  for (int i = 0; i <= DDOS_SVM_FEATURES; i++) {
+    m_svmW[i] *= (1 - eta * m_svmLambda);
+    if (violated)
+      m_svmW[i] += eta * y * (i < DDOS_SVM_FEATURES ? x[i] : 1);
+    norm += m_svmW[i] * m_svmW[i];
+  }
+  //project back onto the ball of radius 1/sqrt(lambda)
+  if (m_svmLambda > 0 && norm * m_svmLambda > 1) {
+    double scale = 1 / sqrt(norm * m_svmLambda);
+    for (int i = 0; i <= DDOS_SVM_FEATURES; i++)
+      m_svmW[i] *= scale;
+  }
+
+  if (m_svmUpdates >= m_svmWindow)
+    m_modelTrained = true;
+}
+
+void AquaSimDDOS::SVM()
+{
+  NS_LOG_FUNCTION(this);
 
-    m_space[j].index = 0;
-    m_space[j].value = entry.timeoutR;
-    ++j;
-    m_space[j].index = 1;
-    m_space[j].value = entry.maxR;
-    m_space[++j].index = -1;
+  //NOTE: this is for training model, classification is done in SvmClassify.
+  if (m_svmOnline || SvmTable.size() < m_svmWindow || m_svmNew < m_svmWindow) return;
+  NS_LOG_DEBUG(GetNetDevice()->GetAddress() << " SVM table size:" << SvmTable.size());
+  m_svmNew = 0;
+
+  struct svm_problem prob;
+  prob.l = SvmTable.size();
+  if (m_svmSpace.size() < (size_t)prob.l * 3) {
+    m_svmSpace.resize(prob.l * 3);
+    m_svmX.resize(prob.l);
+    m_svmY.resize(prob.l);
+  }
 
-    SvmTable.pop();
-    i++;
+  //LIBSVM expected layout: <label> <index1>:<value1> <index2>:<value2> ...
+  for (int i = 0; i < prob.l; i++) {
+    m_svmX[i] = &m_svmSpace[i*3];
+    m_svmY[i] = (SvmTable[i].compromised)?1:0;
+    m_svmSpace[i*3].index = 0;
+    m_svmSpace[i*3].value = SvmTable[i].timeoutR;
+    m_svmSpace[i*3+1].index = 1;
+    m_svmSpace[i*3+1].value = SvmTable[i].maxR;
+    m_svmSpace[i*3+2].index = -1;
   }
+  prob.x = &m_svmX[0];
+  prob.y = &m_svmY[0];
 
   const char *error_msg;
-  error_msg = svm_check_parameter(&m_prob,&m_param);
+  error_msg = svm_check_parameter(&prob,&m_param);
   if(error_msg) {
     NS_LOG_ERROR("SVM Error:" << error_msg);
     return;
   }
 
-  // -------------- cross validation ----------------------------
-  /*
-  int k, total_correct = 0, nr_fold = 2;
-  double *target = Malloc(double,m_prob.l);
-
-  svm_cross_validation(&m_prob,&m_param,nr_fold,target);
-
-  for(k=0;k<m_prob.l;k++)
-    if(target[k] == m_prob.y[k])
-      ++total_correct;
-  printf("Cross Validation Accuracy = %g%%\n",100.0*total_correct/m_prob.l);
-  free(target);
-  */
+  // ------------- training and handing over model -------------------
+  struct svm_model *model = svm_train(&prob,&m_param);
+  if (model->nr_class==2) {
+    /* linear kernel: fold the support vectors into a single weight vector,
+       which no longer points into the training buffers. */
+    double sign = (model->label[0]==1) ? 1 : -1;
+    for (int i = 0; i <= DDOS_SVM_FEATURES; i++)
+      m_svmW[i] = 0;
+    for (int s = 0; s < model->l; s++)
+      for (struct svm_node *n = model->SV[s]; n->index != -1; n++)
+        m_svmW[n->index] += sign * model->sv_coef[0][s] * n->value;
+    m_svmW[DDOS_SVM_FEATURES] = -sign * model->rho[0];
+    m_modelTrained=true;
 
-  // ------------- training and saving model -------------------
-  struct svm_model *tmp_model;
-  tmp_model = svm_train(&m_prob,&m_param);
-  if (tmp_model->nr_class==1) {
-    //only one class from training data, therefore not saving model
-    //Do nothing.
-    free(tmp_model);
-  } else {
-    m_model = tmp_model;
-    if(svm_save_model("ddos_svm.model",m_model)) {
+    if (!m_svmModelFile.empty() && svm_save_model(m_svmModelFile.c_str(),model))
       NS_LOG_WARN("Not able to save SVM model to file");
-      return;
-    }
-    m_modelTrained=true;
   }
-
-  free(m_prob.y);
-  free(m_prob.x);
-  free(m_space);
+  //else only one class in the window, keep the previous model
+  svm_free_and_destroy_model(&model);
 }
 
 std::vector<StatisticalTable> AquaSimDDOS::RulesMining()
@@ -1114,9 +1173,12 @@ AquaSimDDOS::UpdateInterest()
 void AquaSimDDOS::DoDispose()
 {
   #if LIBSVM
-  svm_free_and_destroy_model(&m_model);
   svm_destroy_param(&m_param);
   #endif
+  SvmTable.clear();
+  m_svmSpace.clear();
+  m_svmX.clear();
+  m_svmY.clear();
   m_rand=0;
   AquaSimRouting::DoDispose();
 }
@@ -40,6 +40,7 @@
 #include "ns3/svm.h"
 
 #define LIBSVM 1
+#define DDOS_SVM_FEATURES 2
 
 namespace ns3 {
 
@@ -132,6 +133,9 @@ private:
   void Analysis();
   std::vector<StatisticalTable> Statistical();
   void SVM();
+  void SvmClassify();
+  void SvmOnlineUpdate(const double *x, double y);
+  double SvmDecision(const double *x);
   std::vector<StatisticalTable> RulesMining();
   void Pushback(int nodeID);
   void Throttle(int nodeID);
@@ -185,13 +189,26 @@ private:
   int m_minCompTrans;   //minimum size of compromised transactions to adjust rules
 
   //SVM components
-  std::queue<SvmInput> SvmTable;
+  std::vector<SvmInput> SvmTable;   //ring of the last m_svmWindow samples
+  uint32_t m_svmHead;
+  uint32_t m_svmNew;      //samples since the last batch training
+  uint32_t m_svmWindow;
+  bool m_svmOnline;       //online linear SVM instead of batch libsvm training
+  double m_svmLambda;
+  uint64_t m_svmUpdates;
+  std::string m_svmModelFile;
   Time m_svmLearningFreq;
   bool m_modelTrained;
+  double m_svmW[DDOS_SVM_FEATURES+1];   //linear model, the last weight is the bias
+  //features of one DdosAttackCheck, classified as a batch
+  std::vector<double> m_batchX;
+  std::vector<double> m_batchY;
+  std::vector<int> m_batchNode;
+  //libsvm training buffers, reused between trainings
+  std::vector<struct svm_node> m_svmSpace;
+  std::vector<struct svm_node*> m_svmX;
+  std::vector<double> m_svmY;
   struct svm_parameter m_param;
-  struct svm_problem m_prob;
-  struct svm_model *m_model;
-  struct svm_node *m_space;
 
   //TODO remove here, under constructor and on sink recv.
   int sinkCounter;
@@ -25,14 +25,18 @@
 #include "ns3/ipv4-header.h"
 #include "ns3/log.h"
 #include "ns3/integer.h"
+#include "ns3/uinteger.h"
 #include "ns3/nstime.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("AquaSimDynamicRouting");
 NS_OBJECT_ENSURE_REGISTERED(AquaSimDynamicRoutingTable);
 
-AquaSimDynamicRoutingTable::AquaSimDynamicRoutingTable()
+AquaSimDynamicRoutingTable::AquaSimDynamicRoutingTable() :
+  m_chg(0), m_holdDown(Seconds(60))
 {
   NS_LOG_FUNCTION(this);
 }
@@ -59,13 +63,20 @@ AquaSimDynamicRoutingTable::SetRouting(Ptr<AquaSimDynamicRouting> dynamic)
   m_dr = dynamic;
 }
 
+void
+AquaSimDynamicRoutingTable::SetHoldDown(Time holdDown)
+{
+  m_holdDown = holdDown;
+}
+
 void
 AquaSimDynamicRoutingTable::Print(AquaSimAddress id)
 {
   NS_LOG_FUNCTION(this << id << Simulator::Now().GetSeconds());
 	for (t_table::iterator it = m_rt.begin(); it != m_rt.end(); it++) {
     NS_LOG_INFO(id << "," << (*it).first << "," <<
-                  (*it).second.first << "," << it->second.second);
+                  (*it).second.first << "," << it->second.second <<
+                  "," << it->second.seqNum);
 	}
 }
 
@@ -79,25 +90,56 @@ void
 AquaSimDynamicRoutingTable::Clear()
 {
 	m_rt.clear();
+	m_via.clear();
+	m_dirty.clear();
+	m_broken.clear();
+}
+
+void
+AquaSimDynamicRoutingTable::SetNextHop(AquaSimAddress dest,
+                                       AquaSimAddress oldHop, AquaSimAddress newHop)
+{
+	std::map<AquaSimAddress, std::set<AquaSimAddress> >::iterator v = m_via.find(oldHop);
+	if (v != m_via.end()) {
+		v->second.erase(dest);
+		if (v->second.empty())
+			m_via.erase(v);
+	}
+	if (newHop != AquaSimAddress::GetBroadcast())
+		m_via[newHop].insert(dest);
 }
 
 void
 AquaSimDynamicRoutingTable::RemoveEntry(AquaSimAddress dest)
 {
-	m_rt.erase(dest);
+	t_table::iterator it = m_rt.find(dest);
+	if (it == m_rt.end())
+		return;
+	SetNextHop(dest, it->second.first, AquaSimAddress::GetBroadcast());
+	m_dirty.erase(dest);
+	m_broken.erase(dest);
+	m_rt.erase(it);
 }
 
 void
 AquaSimDynamicRoutingTable::AddEntry(AquaSimAddress dest, DN next)
 {
+	t_table::iterator it = m_rt.find(dest);
+	SetNextHop(dest, (it == m_rt.end() ? AquaSimAddress::GetBroadcast() : it->second.first),
+             next.first);
 	m_rt[dest] = next;
+	m_dirty.insert(dest);
+	if (next.second.GetAsInt() >= DR_INFINITY)
+		m_broken.insert(dest);
+	else
+		m_broken.erase(dest);
 }
 
 AquaSimAddress
 AquaSimDynamicRoutingTable::Lookup(AquaSimAddress dest)
 {
 	t_table::iterator it = m_rt.find(dest);
-	if (it == m_rt.end())
+	if (it == m_rt.end() || (*it).second.second.GetAsInt() >= DR_INFINITY)
 		return AquaSimAddress::GetBroadcast();
 	else
 		return (*it).second.first; //add by jun
@@ -109,72 +151,153 @@ AquaSimDynamicRoutingTable::Size()
 	return m_rt.size();
 }
 
-void
-AquaSimDynamicRoutingTable::Update(t_table* newrt, AquaSimAddress Source_N) //add by jun
+/*
+ * Merge one advertised route heard from neighbour 'from'. Fresher sequence
+ * numbers always win; with the same sequence number only a shorter route,
+ * or a new metric from the current next hop, is taken, and nothing is taken
+ * while the route is held down. Returns true if next hop or hop count changed.
+ */
+bool
+AquaSimDynamicRoutingTable::Merge(AquaSimAddress dest, uint8_t hops,
+                                  uint16_t seqNum, AquaSimAddress from)
 {
-	DN tp;
-	AquaSimAddress tmp;
-	m_chg=0;
+	if (dest == NodeId())
+		return false;
 
+	uint16_t metric = (hops >= DR_INFINITY - 1) ? DR_INFINITY : hops + 1;
+	t_table::iterator it = m_rt.find(dest);
+	if (it == m_rt.end())
+	{
+		// nothing to forget about an unknown destination
+		if (metric == DR_INFINITY)
+			return false;
+		DN tp;
+		tp.first = from;
+		tp.second = AquaSimAddress(metric);
+		tp.seqNum = seqNum;
+		tp.holdDown = Seconds(0);
+		AddEntry(dest, tp);
+		return true;
+	}
 
-	if (Lookup(Source_N) == AquaSimAddress::GetBroadcast())
-  {
-		tp.first= Source_N;
-		tp.second=1;
-		AddEntry(Source_N, tp);
-		m_chg=1;
+	DN &e = it->second;
+	int16_t fresher = (int16_t)(seqNum - e.seqNum);
+	if (fresher < 0)
+		return false;
+	if (fresher == 0)
+	{
+		if (Simulator::Now() < e.holdDown)
+			return false;
+		if (!(metric < e.second.GetAsInt() ||
+		      (from == e.first && metric != e.second.GetAsInt())))
+			return false;
 	}
 
-	for( t_table:: iterator it=newrt->begin(); it !=newrt->end(); it++)
-  {
+	e.seqNum = seqNum;
+	if (from == e.first && metric == e.second.GetAsInt())
+		return false;	// only the sequence number moved on, wait for the next full dump
+
+	bool wasUp = e.second.GetAsInt() < DR_INFINITY;
+	if (from != e.first)
+		SetNextHop(dest, e.first, from);
+	e.first = from;
+	e.second = AquaSimAddress(metric);
+	if (metric == DR_INFINITY)
+	{
+		if (wasUp)
+			e.holdDown = Simulator::Now() + m_holdDown;
+		m_broken.insert(dest);
+	}
+	else
+		m_broken.erase(dest);
+	m_dirty.insert(dest);
+	return true;
+}
+
+/*
+ * Neighbour nb went silent: break every route through it. Only the routes
+ * indexed under nb are visited.
+ */
+uint32_t
+AquaSimDynamicRoutingTable::NeighborDown(AquaSimAddress nb)
+{
+	std::map<AquaSimAddress, std::set<AquaSimAddress> >::iterator v = m_via.find(nb);
+	if (v == m_via.end())
+		return 0;
 
-		if( it->first == NodeId() )
+	uint32_t n = 0;
+	for (std::set<AquaSimAddress>::iterator d = v->second.begin(); d != v->second.end(); d++)
+	{
+		DN &e = m_rt[*d];
+		if (e.second.GetAsInt() >= DR_INFINITY)
 			continue;
+		e.second = AquaSimAddress(DR_INFINITY);
+		// an odd sequence number marks a broken route, the destination
+		// itself always advertises even ones
+		if (!(e.seqNum & 1))
+			e.seqNum++;
+		e.holdDown = Simulator::Now() + m_holdDown;
+		m_broken.insert(*d);
+		m_dirty.insert(*d);
+		n++;
+	}
+	m_chg = (n > 0);
+	return n;
+}
 
-		if (Lookup((*it).first) != AquaSimAddress::GetBroadcast() )
-    {
-			tmp = Lookup((*it).first);
+/*
+ * Hand out the routes changed since the last call (or the whole table) and
+ * forget broken routes whose hold-down is over.
+ */
+uint32_t
+AquaSimDynamicRoutingTable::CollectUpdates(t_table &out, bool full)
+{
+	if (full)
+		out = m_rt;
+	else
+		for (std::set<AquaSimAddress>::iterator d = m_dirty.begin(); d != m_dirty.end(); d++)
+			out[*d] = m_rt[*d];
+	m_dirty.clear();
 
-			if (m_rt[it->first].second.GetAsInt() > (*it).second.second.GetAsInt() +1 )
-      {
-				RemoveEntry((*it).first);
-				tp.first=Source_N;
-				tp.second= AquaSimAddress((*it).second.second.GetAsInt() + 1);
-				AddEntry((*it).first, tp);
-				m_chg=1;
-			}
-		}
-		else{
-			tp.first= Source_N;
-			tp.second=AquaSimAddress((*it).second.second.GetAsInt() + 1);
-			AddEntry((*it).first, tp);
+	std::set<AquaSimAddress>::iterator b = m_broken.begin();
+	while (b != m_broken.end())
+	{
+		AquaSimAddress dest = *b++;
+		if (m_rt[dest].holdDown <= Simulator::Now())
+			RemoveEntry(dest);
+	}
+	return out.size();
+}
+
+void
+AquaSimDynamicRoutingTable::Update(t_table* newrt, AquaSimAddress Source_N) //add by jun
+{
+	m_chg=0;
+
+	for( t_table:: iterator it=newrt->begin(); it !=newrt->end(); it++)
+  {
+		if (Merge(it->first, it->second.second.GetAsInt(), it->second.seqNum, Source_N))
 			m_chg=1;
-		}
 	}
 }
 
 /**** AquaSimDynamicRouting_PktTimer ****/
-AquaSimDynamicRouting_PktTimer::AquaSimDynamicRouting_PktTimer(AquaSimDynamicRouting* routing, double updateInterval)
+AquaSimDynamicRouting_PktTimer::AquaSimDynamicRouting_PktTimer(AquaSimDynamicRouting* routing)
  : Timer()
 {
   NS_LOG_FUNCTION(this);
 
   m_routing = routing;
-  m_updateInterval = updateInterval;
 }
 
 AquaSimDynamicRouting_PktTimer::~AquaSimDynamicRouting_PktTimer()
 {
-  delete m_routing;
 }
 
 void
 AquaSimDynamicRouting_PktTimer::Expire()
 {
-  m_routing->SendDRoutingPkt();
-  //m_routing->ResetDRoutingPktTimer();
-  double delay = (GetUpdateInterval() + m_routing->BroadcastJitter(10));
-  Simulator::Schedule(Seconds(delay),&AquaSimDynamicRouting_PktTimer::Expire,this);
+  m_routing->PeriodicUpdate();
 }
 
 
@@ -182,17 +305,20 @@ AquaSimDynamicRouting_PktTimer::Expire()
 
 NS_OBJECT_ENSURE_REGISTERED(AquaSimDynamicRouting);
 
-AquaSimDynamicRouting::AquaSimDynamicRouting() : m_pktTimer(this, 50)
+AquaSimDynamicRouting::AquaSimDynamicRouting() :
+  m_pktTimer(this), m_seqNum(0), m_ownSeq(0), m_periodicCount(0),
+  m_updateInterval(Seconds(50)), m_fullDumpPeriod(4),
+  m_minTriggerInterval(Seconds(1)), m_holdDown(Seconds(60)),
+  m_routeTimeout(Seconds(180)), m_lastUpdate(Seconds(0))
 {
   NS_LOG_FUNCTION(this);
-  m_coun=0;
 
+  m_rand = CreateObject<UniformRandomVariable> ();
   m_rTable.SetRouting(this);
+  m_rTable.SetHoldDown(m_holdDown);
 
   m_pktTimer.SetFunction(&AquaSimDynamicRouting_PktTimer::Expire,&m_pktTimer);
   m_pktTimer.Schedule(Seconds(0.0000001+10*m_rand->GetValue()));
-
-  m_rand = CreateObject<UniformRandomVariable> ();
 }
 
 TypeId
@@ -205,10 +331,48 @@ AquaSimDynamicRouting::GetTypeId(void)
         IntegerValue(0),
         MakeIntegerAccessor (&AquaSimDynamicRouting::m_accessibleVar),
         MakeIntegerChecker<int> ())
+      .AddAttribute("UpdateInterval", "Interval between periodic (incremental) updates.",
+        TimeValue(Seconds(50)),
+        MakeTimeAccessor (&AquaSimDynamicRouting::m_updateInterval),
+        MakeTimeChecker ())
+      .AddAttribute("FullDumpPeriod", "Every n-th periodic update carries the whole table, 0 never.",
+        UintegerValue(4),
+        MakeUintegerAccessor (&AquaSimDynamicRouting::m_fullDumpPeriod),
+        MakeUintegerChecker<uint32_t> ())
+      .AddAttribute("MinTriggerInterval", "Minimum gap between two triggered updates.",
+        TimeValue(Seconds(1)),
+        MakeTimeAccessor (&AquaSimDynamicRouting::m_minTriggerInterval),
+        MakeTimeChecker ())
+      .AddAttribute("HoldDown", "Time a broken route ignores advertisements that are not fresher.",
+        TimeValue(Seconds(60)),
+        MakeTimeAccessor (&AquaSimDynamicRouting::SetHoldDown,
+                          &AquaSimDynamicRouting::GetHoldDown),
+        MakeTimeChecker ())
+      .AddAttribute("RouteTimeout", "A neighbour not heard from for this long is considered gone.",
+        TimeValue(Seconds(180)),
+        MakeTimeAccessor (&AquaSimDynamicRouting::m_routeTimeout),
+        MakeTimeChecker ())
+      .AddTraceSource("RoutingUpdate",
+        "A routing update was sent: number of route entries, full dump or not.",
+        MakeTraceSourceAccessor (&AquaSimDynamicRouting::m_updateTrace),
+        "ns3::AquaSimDynamicRouting::UpdateCallback")
     ;
   return tid;
 }
 
+void
+AquaSimDynamicRouting::SetHoldDown(Time holdDown)
+{
+  m_holdDown = holdDown;
+  m_rTable.SetHoldDown(holdDown);
+}
+
+Time
+AquaSimDynamicRouting::GetHoldDown() const
+{
+  return m_holdDown;
+}
+
 int64_t
 AquaSimDynamicRouting::AssignStreams (int64_t stream)
 {
@@ -342,9 +506,10 @@ AquaSimDynamicRouting::RecvDRoutingPkt(Ptr<Packet> p)
 {
 	DRoutingHeader drh;
   AquaSimHeader ash;
+  Ipv4Header iph;
   p->RemoveHeader(ash);
-	p->PeekHeader(drh);
-  p->AddHeader(ash);
+	p->RemoveHeader(drh);
+  p->RemoveHeader(iph);
 
 	// All routing messages are sent from and to port RT_PORT,
 	// so we check it.
@@ -352,43 +517,28 @@ AquaSimDynamicRouting::RecvDRoutingPkt(Ptr<Packet> p)
 	//assert(ih->dport() == RT_PORT);
 	// take out the packet, rtable
 
-	DN temp_DN;
-	t_table temp_rt;
-	AquaSimAddress temp1;
+	AquaSimAddress src = drh.GetPktSrc();
+	if (src == RaAddr())
+		return;
+	m_lastHeard[src] = Simulator::Now();
+
 	uint32_t size = p->GetSize();
 	uint8_t *data = new uint8_t[size];
 	p->CopyData(data,size);
-	for(uint i=0; i < drh.GetEntryNum(); i++) {
-
-		temp1 = *((AquaSimAddress*)data);
-		data += sizeof(AquaSimAddress);
-
-		temp_DN.first = *((AquaSimAddress*)data);
-		//temp2 = *((AquaSimAddress*)data);
-		data += sizeof(AquaSimAddress);
-
-		//temp_DN[temp2]== *((int*)data);
-		temp_DN.second = *((int*)data);
-		data += sizeof(int);
-		temp_rt[temp1]=temp_DN;
-	}
-
-
-	m_rTable.Update(&temp_rt, drh.GetPktSrc());
 
-	if (m_rTable.IfChg() ==1) {
-		m_pktTimer.SetUpdateInterval(30.0);
-	}
-
-	if (m_rTable.IfChg() ==0)
+	m_rTable.m_chg = 0;
+	for (uint32_t i = 0; i < drh.GetEntryNum() && (i+1)*DR_ENTRY_LEN <= size; i++)
 	{
-		m_coun++;
+		uint8_t *e = data + i*DR_ENTRY_LEN;
+		AquaSimAddress dest((uint16_t)((e[0] << 8) | e[1]));
+		uint16_t seqNum = (e[3] << 8) | e[4];
+		if (m_rTable.Merge(dest, e[2], seqNum, src))
+			m_rTable.m_chg = 1;
 	}
+	delete[] data;
 
-	if (m_coun ==2) {
-		m_pktTimer.SetUpdateInterval(100.0);
-		m_coun=0;
-	}
+	if (m_rTable.IfChg() == 1)
+		TriggerUpdate();
 
 	// Release resources
   p=0;
@@ -400,40 +550,108 @@ AquaSimDynamicRouting::BroadcastJitter(double range)
 	return range*m_rand->GetValue();
 }
 
+void
+AquaSimDynamicRouting::PeriodicUpdate()
+{
+  CheckNeighbors();
+
+  // a new sequence number lets the network drop broken routes to us
+  m_ownSeq += 2;
+  bool full = (m_fullDumpPeriod > 0 && ++m_periodicCount % m_fullDumpPeriod == 0);
+
+  // pending changes go out with this update
+  m_triggerEvent.Cancel();
+  SendDRoutingPkt(full);
+  ResetDRoutingPktTimer();
+}
 
 void
-AquaSimDynamicRouting::SendDRoutingPkt()
+AquaSimDynamicRouting::CheckNeighbors()
 {
-  NS_LOG_FUNCTION(this);
+  std::map<AquaSimAddress, Time>::iterator it = m_lastHeard.begin();
+  while (it != m_lastHeard.end())
+  {
+    if (Simulator::Now() - it->second > m_routeTimeout)
+    {
+      NS_LOG_DEBUG("Node " << RaAddr() << " lost neighbour " << it->first <<
+          ", " << m_rTable.NeighborDown(it->first) << " routes broken");
+      m_lastHeard.erase(it++);
+    }
+    else
+      it++;
+  }
+}
+
+// Changed routes are sent soon, but never closer than MinTriggerInterval
+// after the previous update.
+void
+AquaSimDynamicRouting::TriggerUpdate()
+{
+  if (m_triggerEvent.IsRunning())
+    return;
+
+  Time delay = Seconds(BroadcastJitter(0.5));
+  Time earliest = m_lastUpdate + m_minTriggerInterval;
+  if (Simulator::Now() + delay < earliest)
+    delay = earliest - Simulator::Now();
+  m_triggerEvent = Simulator::Schedule(delay, &AquaSimDynamicRouting::SendTriggeredUpdate, this);
+}
+
+void
+AquaSimDynamicRouting::SendTriggeredUpdate()
+{
+  if (m_rTable.m_dirty.empty())
+    return;
+  SendDRoutingPkt(false);
+}
+
+static uint8_t*
+WriteRouteEntry(uint8_t *buf, AquaSimAddress dest, uint8_t hops, uint16_t seqNum)
+{
+  buf[0] = dest.GetAsInt() >> 8;
+  buf[1] = dest.GetAsInt() & 0xff;
+  buf[2] = hops;
+  buf[3] = seqNum >> 8;
+  buf[4] = seqNum & 0xff;
+  return buf + DR_ENTRY_LEN;
+}
+
+void
+AquaSimDynamicRouting::SendDRoutingPkt(bool full)
+{
+  NS_LOG_FUNCTION(this << full);
 	Ptr<Packet> p = Create<Packet>();
   AquaSimHeader ash;
   DRoutingHeader drh;
   Ipv4Header iph;
   AquaSimPtTag ptag;
 
+  t_table routes;
+  m_rTable.CollectUpdates(routes, full);
+  m_lastUpdate = Simulator::Now();
+
 	//add by jun
 	//struct hdr_uw_drouting_pkt* ph = HDR_UW_DROUTING_PKT(p);
 
+	// our own entry always goes first, it keeps us alive at the neighbours
+	uint32_t entries = routes.size() + 1;
 	drh.SetPktSrc(RaAddr());
-	drh.SetPktLen(7);
 	drh.SetPktSeqNum(m_seqNum++);
-	drh.SetEntryNum(m_rTable.Size());
+	drh.SetEntryNum(entries);
 	drh.SetPktLen(sizeof(drh.GetPktLen())+sizeof(drh.GetPktSrc()) +
                   sizeof(drh.GetPktSeqNum())+sizeof(drh.GetEntryNum()) );
 
-  uint32_t size = (m_rTable.Size())*(3*sizeof(AquaSimAddress));
+  uint32_t size = entries*DR_ENTRY_LEN;
   uint8_t* payload = new uint8_t[size];
-  int iter=0;
+  uint8_t* e = WriteRouteEntry(payload, RaAddr(), 0, m_ownSeq);
 
-  for(t_table::iterator it=m_rTable.m_rt.begin(); it!=m_rTable.m_rt.end(); it++)
+  for(t_table::iterator it=routes.begin(); it!=routes.end(); it++)
   {
-    payload[iter]=it->first.GetAsInt();
-    payload[iter+1]=it->second.first.GetAsInt();
-    payload[iter+2]=it->second.second.GetAsInt();
-    iter+=3;
+    e = WriteRouteEntry(e, it->first, it->second.second.GetAsInt(), it->second.seqNum);
 	}
 
   Ptr<Packet> tempPacket = Create<Packet>(payload,size);
+  delete[] payload;
   p->AddAtEnd(tempPacket);
 
   ptag.SetPacketType(AquaSimPtTag::PT_UW_DROUTING);
@@ -455,6 +673,7 @@ AquaSimDynamicRouting::SendDRoutingPkt()
   p->AddHeader(drh);
   p->AddHeader(ash);
   p->AddPacketTag(ptag);
+  m_updateTrace(routes.size(), full);
   Time jitter = Seconds(m_rand->GetValue()*0.5);
   Simulator::Schedule(jitter,&AquaSimRouting::SendDown,this,p,ash.GetNextHop(),jitter);
 }
@@ -462,7 +681,7 @@ AquaSimDynamicRouting::SendDRoutingPkt()
 void
 AquaSimDynamicRouting::ResetDRoutingPktTimer()
 {
-  m_pktTimer.Schedule( Seconds(50 + BroadcastJitter(10)) );
+  m_pktTimer.Schedule(m_updateInterval + Seconds(BroadcastJitter(10)));
 }
 
 void
@@ -512,6 +731,9 @@ AquaSimDynamicRouting::ForwardData(Ptr<Packet> p)
 
 void AquaSimDynamicRouting::DoDispose()
 {
+  m_triggerEvent.Cancel();
+  m_pktTimer.Cancel();
+  m_rTable.Clear();
   m_rand=0;
   AquaSimRouting::DoDispose();
 }
@@ -25,18 +25,26 @@
 #include "aqua-sim-routing.h"
 
 #include "ns3/timer.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/traced-callback.h"
 #include "ns3/random-variable-stream.h"
 
 #include <map>
+#include <set>
 
 #define IP_HDR_LEN 20
+#define DR_INFINITY 255		// hop count of an unreachable destination
+#define DR_ENTRY_LEN 5		// dest(2) + hops(1) + seq(2) on the wire
 
 namespace ns3 {
 
 /***** Dynamic Routing Table ******/
 struct DN {
-  AquaSimAddress first;
-  AquaSimAddress second;
+  AquaSimAddress first;		// next hop
+  AquaSimAddress second;	// hop count
+  uint16_t seqNum;		// destination sequence number, odd once broken
+  Time holdDown;		// only fresher sequence numbers accepted before this
 };
 //typedef std::map<AquaSimAddress, int> DN;//should be defined
 class AquaSimDynamicRouting;
@@ -46,6 +54,10 @@ typedef std::map<AquaSimAddress, DN> t_table;//should be defined
  * \ingroup aqua-sim-ng
  *
  * \brief Helper table for dynamic routing protocol.
+ *
+ * Destination sequenced distance vector table. Advertised entries are
+ * merged one at a time and routes are indexed by next hop, so losing a
+ * neighbour only touches the routes going through it.
  */
 class AquaSimDynamicRoutingTable {
 
@@ -60,19 +72,29 @@ public:
 
  AquaSimAddress NodeId();
  void SetRouting(Ptr<AquaSimDynamicRouting> dynamic);
+ void SetHoldDown(Time holdDown);
  void Print(AquaSimAddress id);
  void Clear();
  void RemoveEntry(AquaSimAddress);
  //void AddEntry(AquaSimAddress, AquaSimAddress);
  void AddEntry(AquaSimAddress, DN);//add by jun
  void Update(t_table*, AquaSimAddress); // add by jun
+ bool Merge(AquaSimAddress dest, uint8_t hops, uint16_t seqNum, AquaSimAddress from);
+ uint32_t NeighborDown(AquaSimAddress nb);
+ uint32_t CollectUpdates(t_table &out, bool full);
  AquaSimAddress Lookup(AquaSimAddress);
 
  uint32_t Size();
  int IfChg ();
 
 private:
+  void SetNextHop(AquaSimAddress dest, AquaSimAddress oldHop, AquaSimAddress newHop);
+
   Ptr<AquaSimDynamicRouting> m_dr;
+  Time m_holdDown;
+  std::map<AquaSimAddress, std::set<AquaSimAddress> > m_via;	// next hop -> destinations
+  std::set<AquaSimAddress> m_dirty;	// changed since the last update was sent
+  std::set<AquaSimAddress> m_broken;	// unreachable, dropped once hold-down is over
 };  // class AquaSimDynamicRoutingTable
 
 
@@ -85,20 +107,11 @@ private:
  */
 class AquaSimDynamicRouting_PktTimer : public Timer {
 public:
-  AquaSimDynamicRouting_PktTimer(AquaSimDynamicRouting* routing, double updateInterval);
+  AquaSimDynamicRouting_PktTimer(AquaSimDynamicRouting* routing);
   ~AquaSimDynamicRouting_PktTimer();
 
-  double GetUpdateInterval()
-  {
-    return m_updateInterval;
-  }
-  void SetUpdateInterval(double updateInterval)
-  {
-    m_updateInterval = updateInterval;
-  }
 protected:
   AquaSimDynamicRouting* m_routing;
-  double m_updateInterval;
   void Expire();
 
   friend class AquaSimDynamicRouting;
@@ -106,6 +119,11 @@ protected:
 
 /**
  * \brief Dynamic routing protocol
+ *
+ * Routes are only advertised when they change: a triggered update carries
+ * the changed entries, the periodic update carries the changed entries plus
+ * our own (which keeps neighbours alive), and every FullDumpPeriod-th
+ * periodic update carries the whole table.
  */
 class AquaSimDynamicRouting : public AquaSimRouting {
 
@@ -117,9 +135,13 @@ public:
   int64_t AssignStreams (int64_t stream);
 
   virtual bool Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumber);
-  int m_coun;
 
   inline AquaSimAddress RaAddr() { return AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()); }
+
+  void SetHoldDown(Time holdDown);
+  Time GetHoldDown() const;
+
+  typedef void (* UpdateCallback)(uint32_t entries, bool full);
 protected:
   //PortClassifier* dmux_; // For passing packets up to agents.
   //Trace* logtarget_; // For logging.
@@ -130,7 +152,11 @@ protected:
 
   void ForwardData(Ptr<Packet>);
   void RecvDRoutingPkt(Ptr<Packet>);
-  void SendDRoutingPkt();
+  void SendDRoutingPkt(bool full);
+  void PeriodicUpdate();
+  void TriggerUpdate();
+  void SendTriggeredUpdate();
+  void CheckNeighbors();
   void ResetDRoutingPktTimer();
   double BroadcastJitter(double range);
 
@@ -142,8 +168,22 @@ private:
 
   int m_accessibleVar;
   uint8_t m_seqNum;
+  uint16_t m_ownSeq;		// our own destination sequence number, always even
+  uint32_t m_periodicCount;
+  std::map<AquaSimAddress, Time> m_lastHeard;	// neighbour liveness
+
+  Time m_updateInterval;
+  uint32_t m_fullDumpPeriod;
+  Time m_minTriggerInterval;
+  Time m_holdDown;
+  Time m_routeTimeout;
+
+  EventId m_triggerEvent;
+  Time m_lastUpdate;
   Ptr<UniformRandomVariable> m_rand;
 
+  TracedCallback<uint32_t, bool> m_updateTrace;
+
 };  // class AquaSimDynamicRouting
 
 }  // namespace ns3
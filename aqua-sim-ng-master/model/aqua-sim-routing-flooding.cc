@@ -27,6 +27,11 @@
 #include "ns3/log.h"
 #include "ns3/nstime.h"
 #include "ns3/simulator.h"
+#include "ns3/enum.h"
+#include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/mobility-model.h"
+#include "ns3/trace-source-accessor.h"
 
 //#include "underwatersensor/uw_common/uw_hash_table.h"
 
@@ -41,6 +46,14 @@ AquaSimFloodingRouting::AquaSimFloodingRouting()
   // Initialize variables.
   //  printf("VB initialized\n");
   m_pkCount = 0;
+  m_mode = FLOOD;
+  m_probability = 0.65;
+  m_counterThreshold = 3;
+  m_distanceThreshold = 600;
+  m_assessmentDelay = Seconds(1);
+  m_relayed = 0;
+  m_suppressed = 0;
+  m_rand = CreateObject<UniformRandomVariable> ();
 }
 
 TypeId
@@ -49,6 +62,35 @@ AquaSimFloodingRouting::GetTypeId()
   static TypeId tid = TypeId ("ns3::AquaSimFloodingRouting")
     .SetParent<AquaSimRouting> ()
     .AddConstructor<AquaSimFloodingRouting> ()
+    .AddAttribute ("Mode", "Rebroadcast decision of relays.",
+      EnumValue (FLOOD),
+      MakeEnumAccessor (&AquaSimFloodingRouting::m_mode),
+      MakeEnumChecker (FLOOD, "Flood",
+                       PROBABILISTIC, "Probabilistic",
+                       COUNTER, "Counter",
+                       DISTANCE, "Distance"))
+    .AddAttribute ("Probability", "Rebroadcast probability (Probabilistic mode).",
+      DoubleValue (0.65),
+      MakeDoubleAccessor (&AquaSimFloodingRouting::m_probability),
+      MakeDoubleChecker<double> (0, 1))
+    .AddAttribute ("CounterThreshold", "Copies overheard before a relay gives up (Counter mode).",
+      UintegerValue (3),
+      MakeUintegerAccessor (&AquaSimFloodingRouting::m_counterThreshold),
+      MakeUintegerChecker<uint32_t> (1, MAX_NEIGHBOR))
+    .AddAttribute ("DistanceThreshold", "A copy sent closer than this (m) suppresses the relay (Distance mode).",
+      DoubleValue (600),
+      MakeDoubleAccessor (&AquaSimFloodingRouting::m_distanceThreshold),
+      MakeDoubleChecker<double> ())
+    .AddAttribute ("AssessmentDelay", "Upper bound of the random delay before a relay decides.",
+      TimeValue (Seconds (1)),
+      MakeTimeAccessor (&AquaSimFloodingRouting::m_assessmentDelay),
+      MakeTimeChecker ())
+    .AddTraceSource ("Relayed", "Number of packets this node rebroadcast.",
+      MakeTraceSourceAccessor (&AquaSimFloodingRouting::m_relayed),
+      "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("Suppressed", "Number of rebroadcasts this node gave up.",
+      MakeTraceSourceAccessor (&AquaSimFloodingRouting::m_suppressed),
+      "ns3::TracedValueCallback::Uint32")
   ;
   return tid;
 }
@@ -57,7 +99,8 @@ int64_t
 AquaSimFloodingRouting::AssignStreams (int64_t stream)
 {
   NS_LOG_FUNCTION (this << stream);
-  return 0;
+  m_rand->SetStream(stream);
+  return 1;
 }
 
 bool
@@ -67,10 +110,11 @@ AquaSimFloodingRouting::Recv(Ptr<Packet> packet, const Address &dest, uint16_t p
 
   VBHeader vbh;
   AquaSimHeader ash;
-  if (!vbh.GetMessType())  //no headers
+  if (FromUpperLayer(packet))
   {
+    packet->RemoveHeader(ash);	//the device's header, reused below
     vbh.SetSenderAddr(AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()));
-    vbh.SetPkNum(packet->GetUid());
+    vbh.SetPkNum(m_pkCount++);
     vbh.SetMessType(AS_DATA);
     vbh.SetTargetAddr(AquaSimAddress::ConvertFrom(dest));
 
@@ -104,15 +148,17 @@ AquaSimFloodingRouting::Recv(Ptr<Packet> packet, const Address &dest, uint16_t p
   std::cout << "\n";*/
 
 	// Packet Hash Table is used to keep info about experienced pkts.
-  vbf_neighborhood *hashPtr= PktTable.GetHash(vbh.GetSenderAddr(), packet->GetUid());
+  vbf_neighborhood *hashPtr= PktTable.GetHash(vbh.GetSenderAddr(), vbh.GetPkNum());
 	// Received this packet before ?
 
 	if (hashPtr != NULL) {
+    // remember who else relayed it, gossiping relays decide on that
+    PktTable.PutInHash(vbh.GetSenderAddr(), vbh.GetPkNum(), vbh.GetExtraInfo().f);
     packet=0;
     return false;
   }
 	else {
-		PktTable.PutInHash(vbh.GetSenderAddr(), packet->GetUid());
+		PktTable.PutInHash(vbh.GetSenderAddr(), vbh.GetPkNum(), vbh.GetExtraInfo().f);
 		// Take action for a new pkt.
 		ConsiderNew(packet);
     return true;
@@ -164,10 +210,15 @@ AquaSimFloodingRouting::ConsiderNew(Ptr<Packet> pkt)
 			DataForSink(pkt); // process it
 		}
 
-		else{
+		else if (m_mode == FLOOD) {
 			// printf("uwflooding: %d is the not  target\n", here_.addr_);
 			MACprepare(pkt);
 			MACsend(pkt, Seconds(0));
+			m_relayed++;
+		}
+		else {
+			MACprepare(pkt);
+			Gossip(pkt, vbh.GetSenderAddr(), vbh.GetPkNum());
 		}
 		return;
 
@@ -265,6 +316,8 @@ AquaSimFloodingRouting::MACprepare(Ptr<Packet> pkt)
 	// hdr_ip*  iph = HDR_IP(pkt); // I am not sure if we need it
 
 	vbh.SetForwardAddr(AquaSimAddress::ConvertFrom(m_device->GetAddress()));
+	// lets receivers tell how far away this copy came from
+	vbh.SetExtraInfo_f(MyPosition());
 
   ash.SetErrorFlag(false);
 	//cmh->xmit_failure_ = 0;
@@ -297,6 +350,63 @@ AquaSimFloodingRouting::MACsend(Ptr<Packet> pkt, Time delay)
                         pkt,AquaSimAddress::GetBroadcast(),Seconds(0));
 }
 
+/*
+ * Start the rebroadcast decision for a new packet: the probabilistic mode
+ * decides at once, the other modes after listening for a random
+ * assessment delay. Either way the rebroadcast is desynchronized.
+ */
+void
+AquaSimFloodingRouting::Gossip(Ptr<Packet> pkt, AquaSimAddress sender, unsigned int pkNum)
+{
+  if (m_mode == PROBABILISTIC && m_rand->GetValue() >= m_probability)
+    {
+      NS_LOG_DEBUG("Node " << m_device->GetAddress() << " drops pkt " << pkNum << " by coin toss");
+      m_suppressed++;
+      pkt=0;
+      return;
+    }
+
+  Time rad = Seconds(m_rand->GetValue(0, m_assessmentDelay.GetSeconds()));
+  Simulator::Schedule(rad, &AquaSimFloodingRouting::Assess, this, pkt, sender, pkNum);
+}
+
+void
+AquaSimFloodingRouting::Assess(Ptr<Packet> pkt, AquaSimAddress sender, unsigned int pkNum)
+{
+  // the entry may be gone from the table already, then just send
+  vbf_neighborhood *hashPtr = PktTable.GetHash(sender, pkNum);
+  if (hashPtr != NULL)
+    {
+      bool suppress = false;
+      if (m_mode == COUNTER)
+        suppress = (hashPtr->number >= (int)m_counterThreshold);
+      else if (m_mode == DISTANCE)
+        {
+          Vector me = MyPosition();
+          for (int i = 0; i < hashPtr->number && !suppress; i++)
+            suppress = (CalculateDistance(me, hashPtr->neighbor[i]) < m_distanceThreshold);
+        }
+
+      if (suppress)
+        {
+          NS_LOG_DEBUG("Node " << m_device->GetAddress() << " suppresses pkt " << pkNum <<
+              ", " << hashPtr->number << " copies heard");
+          m_suppressed++;
+          pkt=0;
+          return;
+        }
+    }
+
+  MACsend(pkt, Seconds(0));
+  m_relayed++;
+}
+
+Vector
+AquaSimFloodingRouting::MyPosition()
+{
+  return GetNetDevice()->GetNode()->GetObject<MobilityModel>()->GetPosition();
+}
+
 void
 AquaSimFloodingRouting::DataForSink(Ptr<Packet> pkt)
 {
@@ -310,6 +420,7 @@ void
 AquaSimFloodingRouting::DoDispose()
 {
   NS_LOG_FUNCTION(this);
+  m_rand=0;
   AquaSimRouting::DoDispose();
 }
 
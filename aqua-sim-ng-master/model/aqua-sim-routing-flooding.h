@@ -25,6 +25,9 @@
 #include "aqua-sim-routing.h"
 #include "aqua-sim-routing-vbf.h"
 
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-value.h"
+
 namespace ns3 {
 
 // Vectorbasedforward  Entry
@@ -37,9 +40,21 @@ class Time;
  * \ingroup aqua-sim-ng
  *
  * \brief Flooding routing approach.
+ *
+ * Besides plain flooding, relays can gossip: rebroadcast with a fixed
+ * probability, or wait a random assessment delay and give up if enough
+ * copies were overheard meanwhile (counter based) or one came from close
+ * by (distance based).
  */
 class AquaSimFloodingRouting : public AquaSimRouting {
  public:
+  enum GossipMode {
+    FLOOD,
+    PROBABILISTIC,
+    COUNTER,
+    DISTANCE
+  };
+
   AquaSimFloodingRouting();
   static TypeId GetTypeId(void);
   int64_t AssignStreams (int64_t stream);
@@ -67,7 +82,20 @@ class AquaSimFloodingRouting : public AquaSimRouting {
   void StopSource();
   void MACprepare(Ptr<Packet> pkt);
   void MACsend(Ptr<Packet> pkt, Time delay=Seconds(0));
+  void Gossip(Ptr<Packet> pkt, AquaSimAddress sender, unsigned int pkNum);
+  void Assess(Ptr<Packet> pkt, AquaSimAddress sender, unsigned int pkNum);
+  Vector MyPosition();
   virtual void DoDispose();
+
+  GossipMode m_mode;
+  double m_probability;
+  uint32_t m_counterThreshold;
+  double m_distanceThreshold;
+  Time m_assessmentDelay;
+  Ptr<UniformRandomVariable> m_rand;
+
+  TracedValue<uint32_t> m_relayed;
+  TracedValue<uint32_t> m_suppressed;
 };
 
 } // namespace ns3
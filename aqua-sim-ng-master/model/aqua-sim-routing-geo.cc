@@ -0,0 +1,470 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+* Copyright (c) 2016 University of Connecticut
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License version 2 as
+* published by the Free Software Foundation;
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "aqua-sim-routing-geo.h"
+#include "aqua-sim-address.h"
+#include "aqua-sim-header-routing.h"
+#include "aqua-sim-header.h"
+#include "aqua-sim-net-device.h"
+
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/node-list.h"
+#include "ns3/uinteger.h"
+#include "ns3/trace-source-accessor.h"
+
+#include <cmath>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AquaSimGeoRouting");
+NS_OBJECT_ENSURE_REGISTERED(AquaSimGeoRouting);
+
+/* planar geometry, on the projection onto the horizontal plane */
+static double
+Bearing(const Vector &from, const Vector &to)
+{
+  return std::atan2(to.y - from.y, to.x - from.x);
+}
+
+static double
+Distance2D(const Vector &a, const Vector &b)
+{
+  return std::sqrt((a.x-b.x)*(a.x-b.x) + (a.y-b.y)*(a.y-b.y));
+}
+
+/*
+ * Crossing of segment p1-p2 with segment p3-p4, not counting p1 itself.
+ * The depth of the crossing is interpolated along p1-p2.
+ */
+static bool
+Intersect(const Vector &p1, const Vector &p2, const Vector &p3, const Vector &p4, Vector &cross)
+{
+  double rx = p2.x - p1.x, ry = p2.y - p1.y;
+  double sx = p4.x - p3.x, sy = p4.y - p3.y;
+  double d = rx*sy - ry*sx;
+  if (std::fabs(d) < 1e-9)
+    return false;
+  double qx = p3.x - p1.x, qy = p3.y - p1.y;
+  double t = (qx*sy - qy*sx) / d;
+  double u = (qx*ry - qy*rx) / d;
+  if (t <= 1e-9 || t > 1 || u < 0 || u > 1)
+    return false;
+  cross = Vector(p1.x + t*rx, p1.y + t*ry, p1.z + t*(p2.z - p1.z));
+  return true;
+}
+
+AquaSimGeoRouting::AquaSimGeoRouting() :
+  m_pkCount(0), m_beaconInterval(Seconds(10)), m_neighborTimeout(Seconds(30)),
+  m_maxHops(64)
+{
+  m_dataTx = 0;
+  m_beaconTx = 0;
+  m_faceEntered = 0;
+  m_dropped = 0;
+  m_rand = CreateObject<UniformRandomVariable> ();
+  m_beaconEvent = Simulator::Schedule(Seconds(0.0000001+m_rand->GetValue(0,1)),
+                                      &AquaSimGeoRouting::SendBeacon, this);
+}
+
+TypeId
+AquaSimGeoRouting::GetTypeId()
+{
+  static TypeId tid = TypeId ("ns3::AquaSimGeoRouting")
+    .SetParent<AquaSimRouting> ()
+    .AddConstructor<AquaSimGeoRouting> ()
+    .AddAttribute ("BeaconInterval", "Period of position beacons, zero to rely on piggybacked positions only.",
+      TimeValue (Seconds (10)),
+      MakeTimeAccessor (&AquaSimGeoRouting::m_beaconInterval),
+      MakeTimeChecker ())
+    .AddAttribute ("NeighborTimeout", "Neighbours not heard of for this long leave the position cache.",
+      TimeValue (Seconds (30)),
+      MakeTimeAccessor (&AquaSimGeoRouting::m_neighborTimeout),
+      MakeTimeChecker ())
+    .AddAttribute ("MaxHops", "Data packets are dropped after this many hops.",
+      UintegerValue (64),
+      MakeUintegerAccessor (&AquaSimGeoRouting::m_maxHops),
+      MakeUintegerChecker<uint32_t> (1, 255))
+    .AddTraceSource ("DataTx", "Number of data transmissions by this node.",
+      MakeTraceSourceAccessor (&AquaSimGeoRouting::m_dataTx),
+      "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("BeaconTx", "Number of position beacons sent by this node.",
+      MakeTraceSourceAccessor (&AquaSimGeoRouting::m_beaconTx),
+      "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("FaceEntered", "Number of packets this node switched to face routing.",
+      MakeTraceSourceAccessor (&AquaSimGeoRouting::m_faceEntered),
+      "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("Dropped", "Number of data packets this node could not forward.",
+      MakeTraceSourceAccessor (&AquaSimGeoRouting::m_dropped),
+      "ns3::TracedValueCallback::Uint32")
+  ;
+  return tid;
+}
+
+int64_t
+AquaSimGeoRouting::AssignStreams (int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  m_rand->SetStream(stream);
+  return 1;
+}
+
+bool
+AquaSimGeoRouting::Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumber)
+{
+  NS_LOG_FUNCTION(this << packet << GetNetDevice()->GetAddress());
+  AquaSimHeader ash;
+  GeoHeader gh;
+  AquaSimAddress myAddr = AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress());
+
+  if (FromUpperLayer(packet))  //we are the source
+  {
+    AquaSimAddress dst = AquaSimAddress::ConvertFrom(dest);
+    packet->RemoveHeader(ash);	//the device's header, reused below
+    gh.SetMessType(GEOH_DATA);
+    gh.SetMode(GEOH_GREEDY);
+    gh.SetPkNum(m_pkCount++);
+    gh.SetSource(myAddr);
+    gh.SetTarget(dst);
+    gh.SetTargetPosition(TargetPosition(dst));
+
+    ash.SetTimeStamp(Simulator::Now());
+    ash.SetSAddr(myAddr);
+    ash.SetDAddr(dst);
+    ash.SetNumForwards(0);
+    ash.SetUId(packet->GetUid());
+    ash.SetSize(packet->GetSize() + gh.GetSerializedSize());
+    return Forward(packet, ash, gh);
+  }
+
+  packet->RemoveHeader(ash);
+  packet->RemoveHeader(gh);
+  Learn(gh.GetPrevHop(), gh.GetPrevPosition());
+
+  if (gh.GetMessType() == GEOH_BEACON)
+  {
+    packet=0;
+    return true;
+  }
+  if (ash.GetNextHop() != myAddr)
+  {
+    // overheard a unicast, its position was all we wanted
+    packet=0;
+    return false;
+  }
+
+  if (gh.GetTarget() == myAddr)
+  {
+    bool isNew;
+    if (m_delivered.Insert(gh.GetSource(), gh.GetPkNum(), isNew) == NULL || !isNew)
+    {
+      packet=0;
+      return false;
+    }
+    NS_LOG_DEBUG("Node " << myAddr << " got pkt " << gh.GetPkNum() << " from " <<
+        gh.GetSource() << " in " << (int)gh.GetHopCount() << " hops");
+    packet->AddHeader(ash);
+    DataForSink(packet);
+    return true;
+  }
+
+  return Forward(packet, ash, gh);
+}
+
+/*
+ * Picks the next hop of a data packet and unicasts it. Face routing is
+ * left as soon as we are closer to the destination than the node where
+ * it started.
+ */
+bool
+AquaSimGeoRouting::Forward(Ptr<Packet> packet, AquaSimHeader &ash, GeoHeader &gh)
+{
+  AquaSimAddress myAddr = AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress());
+  Vector me = MyPosition();
+  Vector dst = gh.GetTargetPosition();
+
+  if (gh.GetHopCount() >= m_maxHops)
+  {
+    NS_LOG_DEBUG("Node " << myAddr << " drops pkt " << gh.GetPkNum() << ", too many hops");
+    m_dropped++;
+    packet=0;
+    return false;
+  }
+
+  PurgeNeighbors();
+  if (gh.GetMode() == GEOH_FACE &&
+      CalculateDistance(me, dst) < CalculateDistance(gh.GetEntryPosition(), dst))
+    gh.SetMode(GEOH_GREEDY);
+
+  AquaSimAddress next;
+  bool found;
+  if (gh.GetMode() == GEOH_GREEDY)
+  {
+    found = GreedyNextHop(dst, next);
+    if (!found)
+    {
+      NS_LOG_DEBUG("Node " << myAddr << " is a void for pkt " << gh.GetPkNum());
+      m_faceEntered++;
+      found = FaceNextHop(gh, true, next);
+    }
+  }
+  else
+    found = FaceNextHop(gh, false, next);
+
+  if (!found)
+  {
+    NS_LOG_DEBUG("Node " << myAddr << " drops pkt " << gh.GetPkNum() << ", no route");
+    m_dropped++;
+    packet=0;
+    return false;
+  }
+
+  gh.SetHopCount(gh.GetHopCount() + 1);
+  gh.SetPrevHop(myAddr);
+  gh.SetPrevPosition(me);
+  ash.SetNumForwards(ash.GetNumForwards() + 1);
+  ash.SetErrorFlag(false);
+  ash.SetDirection(AquaSimHeader::DOWN);
+  ash.SetNextHop(next);
+
+  packet->AddHeader(gh);
+  packet->AddHeader(ash);
+  m_dataTx++;
+  return SendDown(packet, next, Seconds(0));
+}
+
+void
+AquaSimGeoRouting::SendBeacon()
+{
+  if (!m_beaconInterval.IsZero())
+    m_beaconEvent = Simulator::Schedule(m_beaconInterval +
+        Seconds(m_rand->GetValue(0, 0.1*m_beaconInterval.GetSeconds())),
+        &AquaSimGeoRouting::SendBeacon, this);
+  if (m_beaconInterval.IsZero() || !m_device)
+    return;
+
+  AquaSimAddress myAddr = AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress());
+  Ptr<Packet> p = Create<Packet>();
+  GeoHeader gh;
+  AquaSimHeader ash;
+  gh.SetMessType(GEOH_BEACON);
+  gh.SetPrevHop(myAddr);
+  gh.SetPrevPosition(MyPosition());
+
+  ash.SetTimeStamp(Simulator::Now());
+  ash.SetSAddr(myAddr);
+  ash.SetDAddr(AquaSimAddress::GetBroadcast());
+  ash.SetNextHop(AquaSimAddress::GetBroadcast());
+  ash.SetDirection(AquaSimHeader::DOWN);
+  ash.SetNumForwards(1);
+  ash.SetErrorFlag(false);
+  ash.SetSize(gh.GetSerializedSize());
+
+  p->AddHeader(gh);
+  p->AddHeader(ash);
+  m_beaconTx++;
+  SendDown(p, AquaSimAddress::GetBroadcast(), Seconds(0));
+}
+
+void
+AquaSimGeoRouting::DataForSink(Ptr<Packet> pkt)
+{
+  NS_LOG_FUNCTION(this << pkt << "Sending up to dmux.");
+  if (!SendUp(pkt))
+    NS_LOG_WARN("DataForSink: Something went wrong when passing packet up to dmux.");
+}
+
+void
+AquaSimGeoRouting::Learn(AquaSimAddress addr, Vector pos)
+{
+  if (addr == AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()))
+    return;
+  GeoNeighbor &nb = m_neighbors[addr];
+  nb.pos = pos;
+  nb.lastHeard = Simulator::Now();
+}
+
+void
+AquaSimGeoRouting::PurgeNeighbors()
+{
+  std::map<AquaSimAddress, GeoNeighbor>::iterator it = m_neighbors.begin();
+  while (it != m_neighbors.end())
+  {
+    if (Simulator::Now() - it->second.lastHeard > m_neighborTimeout)
+      m_neighbors.erase(it++);
+    else
+      ++it;
+  }
+}
+
+bool
+AquaSimGeoRouting::GreedyNextHop(Vector target, AquaSimAddress &next)
+{
+  double best = CalculateDistance(MyPosition(), target);
+  bool found = false;
+  std::map<AquaSimAddress, GeoNeighbor>::iterator it;
+  for (it = m_neighbors.begin(); it != m_neighbors.end(); ++it)
+  {
+    double d = CalculateDistance(it->second.pos, target);
+    if (d < best)
+    {
+      best = d;
+      next = it->first;
+      found = true;
+    }
+  }
+  return found;
+}
+
+/*
+ * GPSR perimeter forwarding. On entering, the first edge counterclockwise
+ * from the line towards the destination is taken; afterwards the first
+ * edge counterclockwise from the one the packet came in on. Whenever that
+ * edge crosses the line from Lp to the destination closer than Lf the
+ * packet moves on to the next face. Taking the first edge of a face twice
+ * means the destination cannot be reached.
+ */
+bool
+AquaSimGeoRouting::FaceNextHop(GeoHeader &gh, bool entering, AquaSimAddress &next)
+{
+  AquaSimAddress myAddr = AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress());
+  Vector me = MyPosition();
+  Vector dst = gh.GetTargetPosition();
+  Planarize(me);
+
+  if (entering)
+  {
+    gh.SetMode(GEOH_FACE);
+    gh.SetEntryPosition(me);
+    gh.SetFacePosition(me);
+    if (!RightHandNeighbor(me, Bearing(me, dst), next))
+      return false;
+    gh.SetFirstEdge(myAddr, next);
+  }
+  else if (!RightHandNeighbor(me, Bearing(me, gh.GetPrevPosition()), next))
+    return false;
+
+  bool faceChanged = false;
+  for (uint32_t n = 0; n < m_planar.size(); n++)
+  {
+    Vector cross;
+    if (!Intersect(me, m_neighbors[next].pos, gh.GetEntryPosition(), dst, cross) ||
+        Distance2D(cross, dst) >= Distance2D(gh.GetFacePosition(), dst))
+      break;
+    gh.SetFacePosition(cross);
+    RightHandNeighbor(me, Bearing(me, m_neighbors[next].pos), next);
+    gh.SetFirstEdge(myAddr, next);
+    faceChanged = true;
+  }
+
+  if (!entering && !faceChanged &&
+      gh.GetFirstEdgeFrom() == myAddr && gh.GetFirstEdgeTo() == next)
+    return false;
+  return true;
+}
+
+/* first planar neighbour counterclockwise from the given bearing */
+bool
+AquaSimGeoRouting::RightHandNeighbor(Vector me, double bearing, AquaSimAddress &next)
+{
+  double best = 3*M_PI;
+  for (uint32_t i = 0; i < m_planar.size(); i++)
+  {
+    double delta = Bearing(me, m_neighbors[m_planar[i]].pos) - bearing;
+    while (delta <= 0)
+      delta += 2*M_PI;
+    while (delta > 2*M_PI)
+      delta -= 2*M_PI;
+    if (delta < best)
+    {
+      best = delta;
+      next = m_planar[i];
+    }
+  }
+  return best < 3*M_PI;
+}
+
+/*
+ * Gabriel graph: the edge to v stays unless another neighbour lies inside
+ * the circle whose diameter it is. Neighbours straight above or below us
+ * have no bearing and are left out.
+ */
+void
+AquaSimGeoRouting::Planarize(Vector me)
+{
+  m_planar.clear();
+  std::map<AquaSimAddress, GeoNeighbor>::iterator v, w;
+  for (v = m_neighbors.begin(); v != m_neighbors.end(); ++v)
+  {
+    double d = Distance2D(me, v->second.pos);
+    if (d < 1e-3)
+      continue;
+    Vector mid((me.x + v->second.pos.x)/2, (me.y + v->second.pos.y)/2, 0);
+    bool keep = true;
+    for (w = m_neighbors.begin(); w != m_neighbors.end() && keep; ++w)
+      if (w != v && Distance2D(mid, w->second.pos) < d/2)
+        keep = false;
+    if (keep)
+      m_planar.push_back(v->first);
+  }
+}
+
+Vector
+AquaSimGeoRouting::MyPosition()
+{
+  return GetNetDevice()->GetNode()->GetObject<MobilityModel>()->GetPosition();
+}
+
+Vector
+AquaSimGeoRouting::TargetPosition(AquaSimAddress dst)
+{
+  std::map<AquaSimAddress, Ptr<MobilityModel> >::iterator it = m_locations.find(dst);
+  if (it == m_locations.end())
+  {
+    Ptr<MobilityModel> model;
+    for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End() && !model; ++n)
+      for (uint32_t i = 0; i < (*n)->GetNDevices(); i++)
+      {
+        Ptr<AquaSimNetDevice> dev = DynamicCast<AquaSimNetDevice>((*n)->GetDevice(i));
+        if (dev && AquaSimAddress::ConvertFrom(dev->GetAddress()) == dst)
+        {
+          model = (*n)->GetObject<MobilityModel>();
+          break;
+        }
+      }
+    it = m_locations.insert(std::make_pair(dst, model)).first;
+  }
+  if (!it->second)
+  {
+    NS_LOG_WARN("TargetPosition: no position known for " << dst);
+    return Vector();
+  }
+  return it->second->GetPosition();
+}
+
+void
+AquaSimGeoRouting::DoDispose()
+{
+  NS_LOG_FUNCTION(this);
+  Simulator::Cancel(m_beaconEvent);
+  m_neighbors.clear();
+  m_planar.clear();
+  m_locations.clear();
+  m_rand=0;
+  AquaSimRouting::DoDispose();
+}
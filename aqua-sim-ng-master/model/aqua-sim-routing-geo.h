@@ -0,0 +1,107 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+* Copyright (c) 2016 University of Connecticut
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License version 2 as
+* published by the Free Software Foundation;
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef AQUA_SIM_ROUTING_GEO_H
+#define AQUA_SIM_ROUTING_GEO_H
+
+#include "aqua-sim-routing.h"
+#include "aqua-sim-address.h"
+#include "aqua-sim-dup-table.h"
+
+#include "ns3/vector.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/mobility-model.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-value.h"
+
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+class GeoHeader;
+class AquaSimHeader;
+
+struct GeoNeighbor {
+  Vector pos;
+  Time lastHeard;
+};
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Greedy geographic forwarding with face routing around voids.
+ *
+ * Nodes learn the positions of their neighbours from periodic beacons and
+ * from the position every packet piggybacks. A data packet is unicast to
+ * the neighbour closest to the destination; at a void (no neighbour closer
+ * than us) it switches to face routing on the Gabriel graph of the
+ * neighbourhood, projected onto the horizontal plane, following the right
+ * hand rule until it reaches a node closer to the destination than where
+ * recovery started (GPSR).
+ *
+ * The destination position is taken from its mobility model, i.e. an
+ * ideal location service.
+ */
+class AquaSimGeoRouting : public AquaSimRouting {
+public:
+  AquaSimGeoRouting();
+  static TypeId GetTypeId(void);
+  int64_t AssignStreams (int64_t stream);
+
+  virtual bool Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumber);
+
+protected:
+  bool Forward(Ptr<Packet> packet, AquaSimHeader &ash, GeoHeader &gh);
+  void SendBeacon();
+  void DataForSink(Ptr<Packet> pkt);
+
+  void Learn(AquaSimAddress addr, Vector pos);
+  void PurgeNeighbors();
+  bool GreedyNextHop(Vector target, AquaSimAddress &next);
+  bool FaceNextHop(GeoHeader &gh, bool entering, AquaSimAddress &next);
+  bool RightHandNeighbor(Vector me, double bearing, AquaSimAddress &next);
+  void Planarize(Vector me);
+
+  Vector MyPosition();
+  Vector TargetPosition(AquaSimAddress dst);
+  virtual void DoDispose();
+
+  std::map<AquaSimAddress, GeoNeighbor> m_neighbors;
+  // Gabriel graph neighbours, only built when a packet is in face mode
+  std::vector<AquaSimAddress> m_planar;
+  std::map<AquaSimAddress, Ptr<MobilityModel> > m_locations;
+  AquaSimDupTable<uint8_t> m_delivered;
+  uint32_t m_pkCount;
+
+  Time m_beaconInterval;
+  Time m_neighborTimeout;
+  uint32_t m_maxHops;
+  EventId m_beaconEvent;
+  Ptr<UniformRandomVariable> m_rand;
+
+  TracedValue<uint32_t> m_dataTx;
+  TracedValue<uint32_t> m_beaconTx;
+  TracedValue<uint32_t> m_faceEntered;
+  TracedValue<uint32_t> m_dropped;
+};  // class AquaSimGeoRouting
+
+} // namespace ns3
+
+#endif /* AQUA_SIM_ROUTING_GEO_H */
@@ -25,19 +25,175 @@
 #include "ns3/log.h"
 
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE("AquaSimStaticRouting");
 NS_OBJECT_ENSURE_REGISTERED(AquaSimStaticRouting);
 
+/**** AquaSimStaticRouteFile ****/
+
+AquaSimStaticRouteFile::AquaSimStaticRouteFile() :
+  m_map(NULL), m_mapLen(0), m_data(NULL), m_numNodes(0), m_numDsts(0)
+{
+}
+
+AquaSimStaticRouteFile::~AquaSimStaticRouteFile()
+{
+  if (m_map != NULL)
+    munmap(m_map, m_mapLen);
+}
+
+/*
+ * Return the table of filename, loading it on first use. All routing
+ * instances of a simulation share one copy.
+ */
+Ptr<AquaSimStaticRouteFile>
+AquaSimStaticRouteFile::Load(const std::string &filename)
+{
+  static std::map<std::string, Ptr<AquaSimStaticRouteFile> > cache;
+
+  std::map<std::string, Ptr<AquaSimStaticRouteFile> >::iterator it = cache.find(filename);
+  if (it != cache.end())
+    return it->second;
+
+  Ptr<AquaSimStaticRouteFile> file = Ptr<AquaSimStaticRouteFile>(new AquaSimStaticRouteFile(), false);
+  if (!file->Map(filename))
+    {
+      if (!ParseText(filename, file->m_tab, file->m_numNodes, file->m_numDsts))
+        NS_FATAL_ERROR("Cannot read routing table file " << filename);
+      file->m_data = file->m_tab.empty() ? NULL : &file->m_tab[0];
+    }
+  NS_LOG_INFO("Route file " << filename << ": " << file->m_numNodes << " nodes, " <<
+      file->m_numDsts << " destinations" << (file->IsMapped() ? " (mapped)" : ""));
+
+  cache[filename] = file;
+  return file;
+}
+
+/*
+ * Map filename if it is a binary route file, false otherwise.
+ */
+bool
+AquaSimStaticRouteFile::Map(const std::string &filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  FileHeader hdr;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(hdr) ||
+      read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != SR_FILE_MAGIC)
+    {
+      close(fd);
+      return false;
+    }
+
+  size_t need = sizeof(hdr) + (size_t)hdr.numNodes * hdr.numDsts * sizeof(uint16_t);
+  if (hdr.version != SR_FILE_VERSION || (size_t)st.st_size < need)
+    {
+      close(fd);
+      NS_FATAL_ERROR("Route file " << filename << " is truncated or of an unknown version");
+    }
+
+  void *map = mmap(NULL, need, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  m_map = map;
+  m_mapLen = need;
+  m_data = (const uint16_t*)((const char*)map + sizeof(hdr));
+  m_numNodes = hdr.numNodes;
+  m_numDsts = hdr.numDsts;
+  return true;
+}
+
+/*
+ * Parse a text routing table, one "node:dst:nexthop" per line, into a
+ * dense numNodes x numDsts next hop matrix.
+ */
+bool
+AquaSimStaticRouteFile::ParseText(const std::string &filename, std::vector<uint16_t> &tab,
+                                  uint32_t &numNodes, uint32_t &numDsts)
+{
+  FILE* stream = fopen(filename.c_str(), "r");
+  if (stream == NULL)
+    return false;
+
+  std::vector<uint16_t> entries;
+  int current_node, dst_node, nxt_hop;
+  numNodes = numDsts = 0;
+  while (fscanf(stream, "%d:%d:%d", &current_node, &dst_node, &nxt_hop) == 3)
+    {
+      if (current_node < 0 || dst_node < 0 || nxt_hop < 0 ||
+          current_node >= SR_NO_ROUTE || dst_node >= SR_NO_ROUTE || nxt_hop >= SR_NO_ROUTE)
+        continue;
+      entries.push_back(current_node);
+      entries.push_back(dst_node);
+      entries.push_back(nxt_hop);
+      numNodes = std::max(numNodes, (uint32_t)current_node + 1);
+      numDsts = std::max(numDsts, (uint32_t)dst_node + 1);
+    }
+  fclose(stream);
+
+  tab.assign((size_t)numNodes * numDsts, SR_NO_ROUTE);
+  for (size_t i = 0; i < entries.size(); i += 3)
+    tab[(size_t)entries[i] * numDsts + entries[i+1]] = entries[i+2];
+  return true;
+}
+
+/*
+ * Offline compiler: turn a text routing table into a binary route file.
+ */
+bool
+AquaSimStaticRouteFile::Compile(const std::string &textFile, const std::string &binFile)
+{
+  std::vector<uint16_t> tab;
+  FileHeader hdr;
+  if (!ParseText(textFile, tab, hdr.numNodes, hdr.numDsts))
+    return false;
+  hdr.magic = SR_FILE_MAGIC;
+  hdr.version = SR_FILE_VERSION;
+
+  FILE* stream = fopen(binFile.c_str(), "wb");
+  if (stream == NULL)
+    return false;
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, stream) == 1 &&
+    (tab.empty() || fwrite(&tab[0], sizeof(uint16_t), tab.size(), stream) == tab.size());
+  return (fclose(stream) == 0) && ok;
+}
+
+const uint16_t*
+AquaSimStaticRouteFile::Row(uint16_t node, uint32_t &len) const
+{
+  if (node >= m_numNodes || m_data == NULL)
+    {
+      len = 0;
+      return NULL;
+    }
+  len = m_numDsts;
+  return m_data + (size_t)node * m_numDsts;
+}
+
+
+/**** AquaSimStaticRouting ****/
+
 AquaSimStaticRouting::AquaSimStaticRouting() :
-		m_hasSetRouteFile(false), m_hasSetNode(false)
+		m_hasSetRouteFile(false), m_hasSetNode(false), m_row(NULL), m_rowLen(0)
 {
+  m_routeFile[0] = '\0';
 }
 
 AquaSimStaticRouting::AquaSimStaticRouting(char *routeFile) :
-    m_hasSetNode(false)
+    m_hasSetRouteFile(false), m_hasSetNode(false), m_row(NULL), m_rowLen(0)
 {
   SetRouteTable(routeFile);
 }
@@ -52,6 +208,11 @@ AquaSimStaticRouting::GetTypeId()
   static TypeId tid = TypeId ("ns3::AquaSimStaticRouting")
     .SetParent<AquaSimRouting> ()
     .AddConstructor<AquaSimStaticRouting> ()
+    .AddAttribute ("RouteFile", "Routing table, text (node:dst:nexthop) or compiled binary.",
+      StringValue (""),
+      MakeStringAccessor (&AquaSimStaticRouting::SetRouteFile,
+                          &AquaSimStaticRouting::GetRouteFile),
+      MakeStringChecker ())
   ;
   return tid;
 }
@@ -66,11 +227,29 @@ AquaSimStaticRouting::AssignStreams (int64_t stream)
 void
 AquaSimStaticRouting::SetRouteTable(char *routeFile)
 {
-  m_hasSetRouteFile = false;
-  strcpy(m_routeFile,routeFile);
-  //if( m_hasSetNode ) {
-    ReadRouteTable(m_routeFile);
-  //}
+  SetRouteFile(routeFile);
+}
+
+void
+AquaSimStaticRouting::SetRouteFile(std::string routeFile)
+{
+  // the empty attribute default must not wipe a table given to the constructor
+  if (routeFile.empty() && m_hasSetRouteFile)
+    return;
+  strncpy(m_routeFile, routeFile.c_str(), sizeof(m_routeFile) - 1);
+  m_routeFile[sizeof(m_routeFile) - 1] = '\0';
+  m_hasSetRouteFile = !routeFile.empty();
+  // our own row is picked once the device (and so our address) is known
+  m_hasSetNode = false;
+  m_file = 0;
+  m_row = NULL;
+  m_rowLen = 0;
+}
+
+std::string
+AquaSimStaticRouting::GetRouteFile() const
+{
+  return m_routeFile;
 }
 
 /*
@@ -83,23 +262,9 @@ AquaSimStaticRouting::ReadRouteTable(char *filename)
 {
   NS_LOG_FUNCTION(this);
 
-	FILE* stream = fopen(filename, "r");
-	int current_node, dst_node, nxt_hop;
-
-	if( stream == NULL ) {
-		printf("ERROR: Cannot find routing table file!\nEXIT...\n");
-		exit(0);
-	}
-
-	while( !feof(stream) ) {
-		fscanf(stream, "%d:%d:%d", &current_node, &dst_node, &nxt_hop);
-
-		if( AquaSimAddress::ConvertFrom(m_device->GetAddress()).GetAsInt() == current_node ) {
-			m_rTable[AquaSimAddress(dst_node)] = AquaSimAddress(nxt_hop);
-		}
-	}
-
-	fclose(stream);
+  m_file = AquaSimStaticRouteFile::Load(filename);
+  m_row = m_file->Row(AquaSimAddress::ConvertFrom(m_device->GetAddress()).GetAsInt(), m_rowLen);
+  m_hasSetNode = true;
 }
 
 
@@ -171,8 +336,14 @@ AquaSimStaticRouting::FindNextHop(const Ptr<Packet> p)
 {
   AquaSimHeader ash;
   p->PeekHeader(ash);
-  std::map<AquaSimAddress, AquaSimAddress>::iterator it = m_rTable.find(ash.GetDAddr());
-  return it == m_rTable.end() ? AquaSimAddress::GetBroadcast() : it->second;
+
+  if (!m_hasSetNode && m_hasSetRouteFile)
+    ReadRouteTable(m_routeFile);
+
+  uint16_t dst = ash.GetDAddr().GetAsInt();
+  if (dst >= m_rowLen || m_row[dst] == SR_NO_ROUTE)
+    return AquaSimAddress::GetBroadcast();
+  return AquaSimAddress(m_row[dst]);
 }
 
 
@@ -23,13 +23,63 @@
 
 #include "aqua-sim-routing.h"
 #include "aqua-sim-address.h"
+#include "ns3/simple-ref-count.h"
 #include <map>
+#include <string>
+#include <vector>
 
 namespace ns3 {
 
 /*header length of Static routing*/
 #define SR_HDR_LEN (3*sizeof(AquaSimAddress)+sizeof(int))
 
+/*binary route file: header followed by uint16_t nextHop[numNodes][numDsts]*/
+#define SR_FILE_MAGIC 0x54525341	// "ASRT"
+#define SR_FILE_VERSION 1
+#define SR_NO_ROUTE 0xFFFF
+
+/**
+ * \ingroup aqua-sim-ng
+ *
+ * \brief Next hop matrix shared by all static routing instances using the
+ * same route file.
+ *
+ * Text files ("node:dst:nexthop" per line) are parsed once per simulation.
+ * Binary files, as written by Compile(), are memory mapped so loading does
+ * not depend on the network size.
+ */
+class AquaSimStaticRouteFile : public SimpleRefCount<AquaSimStaticRouteFile> {
+public:
+  ~AquaSimStaticRouteFile();
+
+  static Ptr<AquaSimStaticRouteFile> Load(const std::string &filename);
+  static bool Compile(const std::string &textFile, const std::string &binFile);
+
+  // next hops of node indexed by destination, NULL if node has none
+  const uint16_t* Row(uint16_t node, uint32_t &len) const;
+  bool IsMapped() const { return m_map != NULL; }
+
+private:
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numNodes;
+    uint32_t numDsts;
+  };
+
+  AquaSimStaticRouteFile();
+  static bool ParseText(const std::string &filename, std::vector<uint16_t> &tab,
+                        uint32_t &numNodes, uint32_t &numDsts);
+  bool Map(const std::string &filename);
+
+  std::vector<uint16_t> m_tab;	// parsed text table
+  void *m_map;			// mapped binary file
+  size_t m_mapLen;
+  const uint16_t *m_data;
+  uint32_t m_numNodes;
+  uint32_t m_numDsts;
+};  // class AquaSimStaticRouteFile
+
 /**
  * \ingroup aqua-sim-ng
  *
@@ -46,6 +96,8 @@ public:
 	virtual bool Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumber);
 
   void SetRouteTable(char *routeFile);
+  void SetRouteFile(std::string routeFile);
+  std::string GetRouteFile() const;
 
 protected:
 	bool m_hasSetRouteFile;
@@ -57,7 +109,9 @@ protected:
 
 
 private:
-	std::map<AquaSimAddress, AquaSimAddress> m_rTable;
+	Ptr<AquaSimStaticRouteFile> m_file;
+	const uint16_t *m_row;	// our next hops, indexed by destination
+	uint32_t m_rowLen;
 
 };  // class AquaSimStaticRouting
 
@@ -27,6 +27,10 @@
 #include "ns3/log.h"
 #include "ns3/integer.h"
 #include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/nstime.h"
+
+#include <algorithm>
 #include "ns3/mobility-model.h"
 #include "ns3/simulator.h"
 
@@ -37,182 +41,57 @@ NS_LOG_COMPONENT_DEFINE("AquaSimVBF");
 
 AquaSimPktHashTable::AquaSimPktHashTable() {
   NS_LOG_FUNCTION(this);
-  m_windowSize=WINDOW_SIZE;
-  //  lower_counter=0;
-  // 50 items in the hash table, however, because it begins by 0, so, minus 1
-  //Tcl_InitHashTable(&m_htable, 3);
 }
 
 AquaSimPktHashTable::~AquaSimPktHashTable()
 {
   NS_LOG_FUNCTION(this);
-  for (std::map<hash_entry,vbf_neighborhood*>::iterator it=m_htable.begin(); it!=m_htable.end(); ++it) {
-
-    delete it->second;
-  }
-  m_htable.clear();
 }
 
 void
 AquaSimPktHashTable::Reset()
 {
-  m_htable.clear();
-  /*
-	vbf_neighborhood *hashPtr;
-	Tcl_HashEntry *entryPtr;
-	Tcl_HashSearch searchPtr;
-
-	entryPtr = Tcl_FirstHashEntry(&m_htable, &searchPtr);
-	while (entryPtr != NULL) {
-		hashPtr = (vbf_neighborhood *)Tcl_GetHashValue(entryPtr);
-		delete hashPtr;
-		Tcl_DeleteHashEntry(entryPtr);
-		entryPtr = Tcl_NextHashEntry(&searchPtr);
-	}
-  */
+  m_htable.Reset();
 }
 
 vbf_neighborhood*
 AquaSimPktHashTable::GetHash(AquaSimAddress senderAddr, unsigned int pk_num)
 {
-  hash_entry entry = std::make_pair (senderAddr,pk_num);
-  std::map<hash_entry,vbf_neighborhood*>::iterator it;
-
-  it = m_htable.find(entry);
-
-  if (it == m_htable.end())
-    return NULL;
-
-  return it->second;
-  /*
-  unsigned int key[3];
-
-	key[0] = senderAddr;
-	key[1] = 0; //sender_id.port_;
-	key[2] = pk_num;
-
-	Tcl_HashEntry *entryPtr = Tcl_FindHashEntry(&m_htable, (char *)key);
-
-	if (entryPtr == NULL )
-		return NULL;
+  return m_htable.Get(senderAddr, pk_num);
+}
 
-	return (vbf_neighborhood *)Tcl_GetHashValue(entryPtr);
-  */
+bool
+AquaSimPktHashTable::IsDuplicate(AquaSimAddress senderAddr, unsigned int pk_num)
+{
+  return m_htable.IsDuplicate(senderAddr, pk_num);
 }
 
 void
 AquaSimPktHashTable::PutInHash(AquaSimAddress sAddr, unsigned int pkNum)
 {
-	//Tcl_HashEntry *entryPtr;
-	// Pkt_Hash_Entry    *hashPtr;
-	vbf_neighborhood* hashPtr;
-  //unsigned int key[3];
-	//bool newPtr = true;
-
-	//key[1]=0; //(vbh->sender_id).port_;
-  hash_entry entry = std::make_pair (sAddr,pkNum);
-  std::map<hash_entry,vbf_neighborhood*>::iterator it;
-
-	int k=pkNum-m_windowSize;
-	if(k>0)    //TODO verify this in future work
-	{
-		for (int i=0; i<k; i++)
-		{
-      entry.second = i;
-      it = m_htable.find(entry);
-      if(it != m_htable.end())
-      {
-        hashPtr = it->second;
-        delete hashPtr;
-        m_htable.erase(it);
-      }
-		}
-	}
-
-  entry.second = pkNum;
-  hashPtr = GetHash(sAddr,pkNum);
-  //entryPtr = Tcl_CreateHashEntry(&m_htable, (char *)key, &newPtr);
-	if (hashPtr != NULL) {
-		int m=hashPtr->number;
-		if (m<MAX_NEIGHBOR) {
-			hashPtr->number++;
-			hashPtr->neighbor[m].x=0;
-			hashPtr->neighbor[m].y=0;
-			hashPtr->neighbor[m].z=0;
-		}
-		return;
-	}
-	hashPtr=new vbf_neighborhood[1];
-	hashPtr[0].number=1;
-	hashPtr[0].neighbor[0].x=0;
-	hashPtr[0].neighbor[0].y=0;
-	hashPtr[0].neighbor[0].z=0;
-  std::pair<hash_entry,vbf_neighborhood*> newPair;
-  newPair.first=entry; newPair.second=hashPtr;
-  if (m_htable.insert(newPair).second == false)
-  {
-    delete newPair.second;
-  }
-	//Tcl_SetHashValue(entryPtr, hashPtr);
+  PutInHash(sAddr, pkNum, Vector(0,0,0));
 }
 
 void
 AquaSimPktHashTable::PutInHash(AquaSimAddress sAddr, unsigned int pkNum, Vector p)
 {
   NS_LOG_DEBUG("PutinHash begin:" << sAddr << "," << pkNum << ",(" << p.x << "," << p.y << "," << p.z << ")");
-	//Tcl_HashEntry *entryPtr;
-	// Pkt_Hash_Entry    *hashPtr;
-	vbf_neighborhood* hashPtr;
-	//unsigned int key[3];
-	//bool newPtr = true;
-
-	//key[1]=0; //(vbh->sender_id).port_;
-  hash_entry entry = std::make_pair (sAddr,pkNum);
-  std::map<hash_entry,vbf_neighborhood*>::iterator it;
-	int k=pkNum-m_windowSize;
-	if(k>0)
-	{
-		for (int i=0; i<k; i++)
-		{
-      entry.second = i;
-      it = m_htable.find(entry);
-      if(it != m_htable.end())
-      {
-        hashPtr = it->second;
-        delete hashPtr;
-        m_htable.erase(it);
-      }
-		}
-	}
-
-  entry.second = pkNum;
-  hashPtr = GetHash(sAddr,pkNum);
-  //entryPtr = Tcl_CreateHashEntry(&m_htable, (char *)key, &newPtr);
-	if (hashPtr != NULL)
-	{
-		int m=hashPtr->number;
-		// printf("hash_table: this is not old item, there are %d item inside\n",m);
-		if (m<MAX_NEIGHBOR) {
-			hashPtr->number++;
-			hashPtr->neighbor[m].x=p.x;
-			hashPtr->neighbor[m].y=p.y;
-			hashPtr->neighbor[m].z=p.z;
-		}
-		return;
-	}
-	hashPtr=new vbf_neighborhood[1];
-	hashPtr[0].number=1;
-	hashPtr[0].neighbor[0].x=p.x;
-	hashPtr[0].neighbor[0].y=p.y;
-	hashPtr[0].neighbor[0].z=p.z;
-
-  std::pair<hash_entry,vbf_neighborhood*> newPair;
-  newPair.first=entry; newPair.second=hashPtr;
-  if (m_htable.insert(newPair).second == false)
-  {
-    delete newPair.second;
+  bool isNew;
+  vbf_neighborhood* hashPtr = m_htable.Insert(sAddr, pkNum, isNew);
+  if (hashPtr == NULL) {
+    //already behind the window of sAddr
+    return;
+  }
+  if (isNew) {
+    hashPtr->number=1;
+    hashPtr->neighbor[0]=p;
+    return;
+  }
+  int m=hashPtr->number;
+  if (m<MAX_NEIGHBOR) {
+    hashPtr->number++;
+    hashPtr->neighbor[m]=p;
   }
-	//Tcl_SetHashValue(entryPtr, hashPtr);
 }
 
 AquaSimDataHashTable::AquaSimDataHashTable() {
@@ -281,6 +160,13 @@ AquaSimVBF::AquaSimVBF()
 	//  printf("VB initialized\n");
 	m_pkCount = 0;
 	m_width=0;
+	m_adaptiveWidth=false;
+	m_minWidth=20;
+	m_maxWidth=400;
+	m_targetDensity=2;
+	m_densityWindow=Seconds(5);
+	m_density=0;
+	m_curWidth=-1;
 	m_counter=0;
 	m_priority=1.5;
 	//m_useOverhear = 0;
@@ -307,6 +193,26 @@ AquaSimVBF::GetTypeId(void)
       DoubleValue(100),
       MakeDoubleAccessor(&AquaSimVBF::m_width),
       MakeDoubleChecker<double>())
+    .AddAttribute ("AdaptiveWidth", "Adapt the pipe width to the observed forwarder density. Default false.",
+      BooleanValue(false),
+      MakeBooleanAccessor(&AquaSimVBF::m_adaptiveWidth),
+      MakeBooleanChecker())
+    .AddAttribute ("MinWidth", "Lower bound of the adaptive pipe width.",
+      DoubleValue(20),
+      MakeDoubleAccessor(&AquaSimVBF::m_minWidth),
+      MakeDoubleChecker<double>(0))
+    .AddAttribute ("MaxWidth", "Upper bound of the adaptive pipe width.",
+      DoubleValue(400),
+      MakeDoubleAccessor(&AquaSimVBF::m_maxWidth),
+      MakeDoubleChecker<double>(0))
+    .AddAttribute ("TargetDensity", "Number of copies of a packet the adaptive width aims to overhear per hop.",
+      DoubleValue(2),
+      MakeDoubleAccessor(&AquaSimVBF::m_targetDensity),
+      MakeDoubleChecker<double>(1))
+    .AddAttribute ("DensityWindow", "Time after the first copy of a packet at which its copies are counted.",
+      TimeValue(Seconds(5)),
+      MakeTimeAccessor(&AquaSimVBF::m_densityWindow),
+      MakeTimeChecker())
     .AddAttribute ("TargetPos", "Position of target sink (x,y,z).",
       Vector3DValue(),
       MakeVector3DAccessor(&AquaSimVBF::m_targetPos),
@@ -343,7 +249,7 @@ AquaSimVBF::Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumbe
     vbh.SetSenderAddr(AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()));
     vbh.SetForwardAddr(AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()));
     vbh.SetTargetAddr(AquaSimAddress::ConvertFrom(dest));
-    vbh.SetPkNum(packet->GetUid());
+    vbh.SetPkNum(m_pkCount++);
 
     Ptr<Object> sObject = GetNetDevice()->GetNode();
     Ptr<MobilityModel> sModel = sObject->GetObject<MobilityModel> ();
@@ -400,10 +306,8 @@ AquaSimVBF::Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumbe
 		return true;
 	}
 
-	vbf_neighborhood *hashPtr= PktTable.GetHash(vbh.GetSenderAddr(), vbh.GetPkNum());
 	// Received this packet before ?
-
-	if (hashPtr != NULL) {
+	if (PktTable.IsDuplicate(vbh.GetSenderAddr(), vbh.GetPkNum())) {
 		PktTable.PutInHash(vbh.GetSenderAddr(), vbh.GetPkNum(),vbh.GetExtraInfo().f);
 		packet=0;
     return false;
@@ -413,36 +317,46 @@ AquaSimVBF::Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumbe
 		// Never receive it before ? Put in hash table.
 		//printf("vectrobasedforward: this is new packet\n");
 		PktTable.PutInHash(vbh.GetSenderAddr(), vbh.GetPkNum(),vbh.GetExtraInfo().f);
+		if (m_adaptiveWidth && vbh.GetMessType() == AS_DATA)
+			Simulator::Schedule(m_densityWindow, &AquaSimVBF::SampleDensity, this,
+					    vbh.GetSenderAddr(), vbh.GetPkNum());
 
-    Ptr<Object> sObject = GetNetDevice()->GetNode();
-    Ptr<MobilityModel> sModel = sObject->GetObject<MobilityModel> ();
+    Vector myPos = GetNetDevice()->GetPosition();
     Vector forwarder = vbh.GetExtraInfo().f;
 
     packet->RemoveHeader(ash);
     packet->RemoveHeader(vbh);
-    Vector d = Vector(sModel->GetPosition().x - forwarder.x,
-                      sModel->GetPosition().y - forwarder.y,
-                      sModel->GetPosition().z - forwarder.z);
+    Vector d = Vector(myPos.x - forwarder.x,
+                      myPos.y - forwarder.y,
+                      myPos.z - forwarder.z);
     vbh.SetExtraInfo_d(d);
     packet->AddHeader(vbh);
     packet->AddHeader(ash);
 
-		ConsiderNew(packet);
+    vbf_pkt_info info;
+    info.messType = vbh.GetMessType();
+    info.pkNum = vbh.GetPkNum();
+    info.senderAddr = vbh.GetSenderAddr();
+    info.targetAddr = vbh.GetTargetAddr();
+    info.range = vbh.GetRange();
+    info.o = vbh.GetExtraInfo().o;
+    info.t = vbh.GetExtraInfo().t;
+    info.f = forwarder;
+    info.myPos = myPos;
+
+		ConsiderNew(packet, info);
 	}
 
   return true;
 }
 
 void
-AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
+AquaSimVBF::ConsiderNew(Ptr<Packet> pkt, vbf_pkt_info &info)
 {
   NS_LOG_FUNCTION(this);
   AquaSimHeader ash;
   VBHeader vbh;
-  pkt->RemoveHeader(ash);
-  pkt->PeekHeader(vbh);
-  pkt->AddHeader(ash);
-	unsigned char msg_type =vbh.GetMessType();
+	unsigned char msg_type =info.messType;
 	//unsigned int dtype = vbh.GetDataType();  //unused
 	double l;//,h;  //unused
 
@@ -459,12 +373,12 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
 	switch (msg_type) {
 	case INTEREST:
 		// printf("Vectorbasedforward:it is interest packet!\n");
-		hashPtr = PktTable.GetHash(vbh.GetSenderAddr(), vbh.GetPkNum());
+		hashPtr = PktTable.GetHash(info.senderAddr, info.pkNum);
     NS_LOG_INFO("ConsiderNew: INTEREST, hashptr #=" << hashPtr->number);
 		// Check if it comes from sink agent of this node
 		// If so we have to keep it in sink list
 
-		from_nodeAddr = vbh.GetSenderAddr();
+		from_nodeAddr = info.senderAddr;
 		//forward_nodeAddr = vbh.GetForwardAddr();
 		//  printf("Vectorbasedforward:it the from_nodeaddr is %d %d  and theb this node id is %d ,%d!\n", from_nodeAddr,from_nodeID.port_,THIS_NODE.addr_,THIS_NODE.port_ );
 
@@ -478,10 +392,10 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
 		{
 			//CalculatePosition(pkt); not necessary with mobilitymodel
 			//printf("vectorbasedforward: This packet is from different node\n");
-			if (IsTarget(pkt))
+			if (IsTarget(info))
 			{
 				// If this node is target?
-				l=Advance(pkt);
+				l=Advance(info);
 
 				//    if (!SendUp(p))
       	//	     NS_LOG_WARN("DataForSink: Something went wrong when passing packet up to dmux.");
@@ -491,15 +405,16 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
         vbh.SetMessType(SOURCE_DISCOVERY);
         pkt->AddHeader(vbh);
         pkt->AddHeader(ash);
-				SetDelayTimer(pkt,l*JITTER);
+        info.messType = SOURCE_DISCOVERY;
+				SetDelayTimer(pkt,info,l*JITTER);
 				// !!! need to re-think
 			}
 			else{
 				// CalculatePosition(pkt);
 				// No the target forwared
-				l=Advance(pkt);
+				l=Advance(info);
 				//h=Projection(pkt);  //never used...
-				if (IsCloseEnough(pkt)) {
+				if (IsCloseEnough(info)) {
 					// printf("vectorbasedforward:%d I am close enough for the interest\n",here_.addr_);
 					MACprepare(pkt);
 					MACsend(pkt,m_rand->GetValue()*JITTER);//!!!! need to re-think
@@ -521,7 +436,7 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
 		// to be the one hop away from the sink
 
 		// printf("Vectorbasedforward(%d,%d):it is target-discovery  packet(%d)! it target id is %d  coordinate is %f,%f,%f and range is %f\n",here_.addr_,here_.port_,vbh.GetPkNum(),vbh.GetTargetAddr(),vbh.GetExtraInfo().t.x, vbh.GetExtraInfo().t.y,vbh.GetExtraInfo().t.z,vbh.GetRange());
-		if (GetNetDevice()->GetAddress()==vbh.GetTargetAddr()) {
+		if (GetNetDevice()->GetAddress()==info.targetAddr) {
 			//printf("Vectorbasedforward(%d,??%d):it is target-discovery  packet(%d)! it target id is %d  coordinate is %f,%f,%f and range is %f\n",here_.addr_,here_.port_,vbh.GetPkNum(),vbh.GetTargetAddr(),vbh.GetExtraInfo().t.x, vbh.GetExtraInfo().t.y,vbh.GetExtraInfo().t.z,vbh.GetRange());
 			// AquaSimAddress *hashPtr= PktTable.GetHash(vbh.GetSenderAddr(), vbh.GetPkNum());
 			// Received this packet before ?
@@ -544,7 +459,7 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
 
 	case DATA_READY:
 		//  printf("Vectorbasedforward(%d,%d):it is data ready packet(%d)! it target id is %d \n",here_.addr_,here_.port_,vbh->pk_num,vbh->target_id.addr_);
-		from_nodeAddr = vbh.GetSenderAddr();
+		from_nodeAddr = info.senderAddr;
 		if (GetNetDevice()->GetAddress() == from_nodeAddr) {
 			// come from the same node, broadcast it
 			MACprepare(pkt);
@@ -552,7 +467,7 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
 			return;
 		}
 		//CalculatePosition(pkt); not necessary with mobilitymodel
-		if (GetNetDevice()->GetAddress()==vbh.GetTargetAddr())
+		if (GetNetDevice()->GetAddress()==info.targetAddr)
 		{
 		  NS_LOG_INFO("AquaSimVBF::ConsiderNew: target is " << GetNetDevice()->GetAddress());
 			DataForSink(pkt); // process it
@@ -589,7 +504,7 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
     NS_LOG_INFO("AquaSimVBF::ConsiderNew: data packet");
 		// printf("Vectorbasedforward(%d,%d):it is data packet(%d)! it target id is %d  coordinate is %f,%f,%f and range is %f\n",here_.addr_,here_.port_,vbh->pk_num,vbh->target_id.addr_,vbh->info.tx, vbh->info.ty,vbh->info.tz,vbh->range);
 		//  printf("Vectorbasedforward(%d):it is data packet(%d)\n",here_.addr_,vbh->pk_num);
-		from_nodeAddr = vbh.GetSenderAddr();
+		from_nodeAddr = info.senderAddr;
 
 		if (GetNetDevice()->GetAddress() == from_nodeAddr) {
 			// come from the same node, broadcast it
@@ -599,11 +514,11 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
 		}
 		//CalculatePosition(pkt); not necessary with mobilitymodel
 		//  printf("vectorbasedforward: after MACprepare(pkt)\n");
-		l=Advance(pkt);
+		l=Advance(info);
 		//h=Projection(pkt);  //never used...
 
 
-		if (GetNetDevice()->GetAddress()==vbh.GetTargetAddr())
+		if (GetNetDevice()->GetAddress()==info.targetAddr)
 		{
 			// printf("Vectorbasedforward: %d is the target\n", here_.addr_);
 			DataForSink(pkt); // process it
@@ -611,18 +526,12 @@ AquaSimVBF::ConsiderNew(Ptr<Packet> pkt)
 
 		else{
 			//  printf("Vectorbasedforward: %d is the not  target\n", here_.addr_);
-			if (IsCloseEnough(pkt)) {
-        Vector * p1;
-        p1=new Vector[1];
-        p1[0].x=vbh.GetExtraInfo().f.x;
-        p1[0].y=vbh.GetExtraInfo().f.y;
-        p1[0].z=vbh.GetExtraInfo().f.z;
-				double delay=CalculateDelay(pkt,p1);  //TODO should just pass the Vector for easier memory management here.
-        delete p1;
-				double d2=(Distance(pkt)-m_device->GetPhy()->GetTransRange())/ns3::SOUND_SPEED_IN_WATER;
+			if (IsCloseEnough(info)) {
+				double delay=CalculateDelay(info,info.f);
+				double d2=(Distance(info)-m_device->GetPhy()->GetTransRange())/ns3::SOUND_SPEED_IN_WATER;
 				//printf("Vectorbasedforward: I am  not  target delay is %f d2=%f distance=%f\n",(sqrt(delay)*DELAY+d2*2),d2,Distance(pkt));
         //std::cout << "DElay is " << (sqrt(delay)*DELAY+d2*2) << " d2 is " << d2 << " distance is " << Distance(pkt) << "\n";
-        SetDelayTimer(pkt,(sqrt(delay)*DELAY+d2*2));
+        SetDelayTimer(pkt,info,(sqrt(delay)*DELAY+d2*2));
 			}
 			else { pkt=0; }
 		}
@@ -814,29 +723,26 @@ AquaSimVBF::DataForSink(Ptr<Packet> pkt)
 
 
 void
-AquaSimVBF::SetDelayTimer(Ptr<Packet> pkt, double c)
+AquaSimVBF::SetDelayTimer(Ptr<Packet> pkt, const vbf_pkt_info &info, double c)
 {
   NS_LOG_FUNCTION(this << c);
   if(c<0)c=0;
-  Simulator::Schedule(Seconds(c),&AquaSimVBF::Timeout,this,pkt);
+  Simulator::Schedule(Seconds(c),&AquaSimVBF::Timeout,this,pkt,info);
 }
 
 void
-AquaSimVBF::Timeout(Ptr<Packet> pkt)
+AquaSimVBF::Timeout(Ptr<Packet> pkt, vbf_pkt_info info)
 {
-  VBHeader vbh;
-  AquaSimHeader ash;
-  pkt->RemoveHeader(ash);
-  pkt->PeekHeader(vbh);
-  pkt->AddHeader(ash);
-	unsigned char msg_type =vbh.GetMessType();
 	vbf_neighborhood  *hashPtr;
 	//Ptr<Packet> p1;
 
-	switch (msg_type) {
+	//we may have moved while waiting
+	info.myPos = GetNetDevice()->GetPosition();
+
+	switch (info.messType) {
 
 	case AS_DATA:
-		hashPtr= PktTable.GetHash(vbh.GetSenderAddr(), vbh.GetPkNum());
+		hashPtr= PktTable.GetHash(info.senderAddr, info.pkNum);
 		if (hashPtr != NULL) {
 			int num_neighbor=hashPtr->number;
 			// printf("vectorbasedforward: node %d have received %d when wake up at %f\n",here_.addr_,num_neighbor,NOW);
@@ -859,29 +765,16 @@ AquaSimVBF::Timeout(Ptr<Packet> pkt)
 				}
 				else //I need to calculate my delay time again
 				{
-					int i=0;
-					Vector* tp;
-					tp=new Vector[1];
-
-					tp[0].x=hashPtr->neighbor[i].x;
-					tp[0].y=hashPtr->neighbor[i].y;
-					tp[0].z=hashPtr->neighbor[i].z;
-					double tdelay=CalculateDelay(pkt,tp);
+					double tdelay=CalculateDelay(info,hashPtr->neighbor[0]);
 					// double tdelay=5;
-					i++;
 					double c=1;
-					while (i<num_neighbor) {
+					for (int i=1; i<num_neighbor; i++) {
 						c=c*2;
-						tp[0].x=hashPtr->neighbor[i].x;
-						tp[0].y=hashPtr->neighbor[i].y;
-						tp[0].z=hashPtr->neighbor[i].z;
-						double t2delay=CalculateDelay(pkt,tp);
+						double t2delay=CalculateDelay(info,hashPtr->neighbor[i]);
 						if (t2delay<tdelay)
 							tdelay=t2delay;
-						i++;
 					}
 
-					delete tp;
 					if(tdelay<=(m_priority/c)) {
 						MACprepare(pkt);
 						MACsend(pkt,0);
@@ -892,14 +785,8 @@ AquaSimVBF::Timeout(Ptr<Packet> pkt)
 				}// end of calculate my new delay time
 			}
 			else{// I am the only neighbor
-				Vector* tp;
-				tp=new Vector[1];
-				tp[0].x=vbh.GetExtraInfo().f.x;
-				tp[0].y=vbh.GetExtraInfo().f.y;
-				tp[0].z=vbh.GetExtraInfo().f.z;
-				double delay=CalculateDelay(pkt,tp);
-
-				delete tp;
+				double delay=CalculateDelay(info,info.f);
+
 				if (delay<=m_priority) {
 					// printf("vectorbasedforward: !!%f\n",delay);
 					MACprepare(pkt);
@@ -941,128 +828,61 @@ AquaSimVBF::CalculatePosition(Ptr<Packet> pkt)
 }
 
 double
-AquaSimVBF::CalculateDelay(Ptr<Packet> pkt,Vector* p1)
+AquaSimVBF::CalculateDelay(const vbf_pkt_info &info, const Vector &p1)
 {
-  VBHeader vbh;
-  AquaSimHeader ash;
-  pkt->RemoveHeader(ash);
-  pkt->PeekHeader(vbh);
-  pkt->AddHeader(ash);
-	double fx=p1->x;
-	double fy=p1->y;
-	double fz=p1->z;
+	double dx=info.myPos.x-p1.x;
+	double dy=info.myPos.y-p1.y;
+	double dz=info.myPos.z-p1.z;
 
-  Vector pos = GetNetDevice()->GetPosition();
-	double dx=pos.x-fx;
-	double dy=pos.y-fy;
-	double dz=pos.z-fz;
-
-	double tx=vbh.GetExtraInfo().t.x;
-	double ty=vbh.GetExtraInfo().t.y;
-	double tz=vbh.GetExtraInfo().t.z;
-
-	double dtx=tx-fx;
-	double dty=ty-fy;
-	double dtz=tz-fz;
+	double dtx=info.t.x-p1.x;
+	double dty=info.t.y-p1.y;
+	double dtz=info.t.z-p1.z;
 
 	double dp=dx*dtx+dy*dty+dz*dtz;
 
 	// double a=Advance(pkt);
-	double p=Projection(pkt);
+	double p=Projection(info);
 	double d=sqrt((dx*dx)+(dy*dy)+ (dz*dz));
 	double l=sqrt((dtx*dtx)+(dty*dty)+ (dtz*dtz));
   double cos_theta;
   if (d ==0 || l==0) cos_theta=0;
   else cos_theta=dp/(d*l);
+  double range=m_device->GetPhy()->GetTransRange();
 	// double delay=(TRANSMISSION_DISTANCE-d*cos_theta)/TRANSMISSION_DISTANCE;
-	double delay=(p/m_width) +((m_device->GetPhy()->GetTransRange()-d*cos_theta)/m_device->GetPhy()->GetTransRange());
+	double delay=(p/Width()) +((range-d*cos_theta)/range);
 	// double delay=(p/m_width) +((TRANSMISSION_DISTANCE-d)/TRANSMISSION_DISTANCE)+(1-cos_theta);
-	//printf("vectorbased: node(%d) projection is %f, and cos is %f, and d is %f)\n",here_.addr_,p, cos_theta, d);
   NS_LOG_DEBUG("CalculateDelay(" << GetNetDevice()->GetAddress() << ") projection is "
       << p << ", cos is " << cos_theta << " and d is " << d << " and total delay is " << delay);
   return delay;
 }
 
 double
-AquaSimVBF::Distance(Ptr<Packet> pkt)
+AquaSimVBF::Distance(const vbf_pkt_info &info)
 {
-  VBHeader vbh;
-  AquaSimHeader ash;
-  pkt->RemoveHeader(ash);
-  pkt->PeekHeader(vbh);
-  pkt->AddHeader(ash);
-  double tx=vbh.GetExtraInfo().f.x;
-	double ty=vbh.GetExtraInfo().f.y;
-	double tz=vbh.GetExtraInfo().f.z;
-	// printf("vectorbased: the target is %lf,%lf,%lf \n",tx,ty,tz);
-  Vector pos = GetNetDevice()->GetPosition();
-	//double x=GetNetDevice()->CX(); //change later
-	//double y=GetNetDevice()->CY();// printf(" Vectorbasedforward: I am in advanced\n");
-	//double z=GetNetDevice()->CZ();
-	// printf("the target is %lf,%lf,%lf and my coordinates are %lf,%lf,%lf\n",tx,ty,tz,x,y,z);
-	return sqrt((tx-pos.x)*(tx-pos.x)+(ty-pos.y)*(ty-pos.y)+ (tz-pos.z)*(tz-pos.z));
+  const Vector &f = info.f;
+  const Vector &pos = info.myPos;
+	return sqrt((f.x-pos.x)*(f.x-pos.x)+(f.y-pos.y)*(f.y-pos.y)+ (f.z-pos.z)*(f.z-pos.z));
 }
 
 double
-AquaSimVBF::Advance(Ptr<Packet> pkt)
+AquaSimVBF::Advance(const vbf_pkt_info &info)
 {
-  VBHeader vbh;
-  AquaSimHeader ash;
-  pkt->RemoveHeader(ash);
-  pkt->PeekHeader(vbh);
-  pkt->AddHeader(ash);
-	double tx=vbh.GetExtraInfo().t.x;
-	double ty=vbh.GetExtraInfo().t.y;
-	double tz=vbh.GetExtraInfo().t.z;
-	// printf("vectorbased: the target is %lf,%lf,%lf \n",tx,ty,tz);
-  Vector pos = GetNetDevice()->GetPosition();
-	//double x=GetNetDevice()->CX(); //change later
-	//double y=GetNetDevice()->CY();// printf(" Vectorbasedforward: I am in advanced\n");
-	//double z=GetNetDevice()->CZ();
-	// printf("the target is %lf,%lf,%lf and my coordinates are %lf,%lf,%lf\n",tx,ty,tz,x,y,z);
-	return sqrt((tx-pos.x)*(tx-pos.x)+(ty-pos.y)*(ty-pos.y)+ (tz-pos.z)*(tz-pos.z));
+  const Vector &t = info.t;
+  const Vector &pos = info.myPos;
+	return sqrt((t.x-pos.x)*(t.x-pos.x)+(t.y-pos.y)*(t.y-pos.y)+ (t.z-pos.z)*(t.z-pos.z));
 }
 
 double
-AquaSimVBF::Projection(Ptr<Packet> pkt)
+AquaSimVBF::Projection(const vbf_pkt_info &info)
 {
-  VBHeader vbh;
-  AquaSimHeader ash;
-  pkt->RemoveHeader(ash);
-  pkt->PeekHeader(vbh);
-  pkt->AddHeader(ash);
-
-	double tx=vbh.GetExtraInfo().t.x;
-	double ty=vbh.GetExtraInfo().t.y;
-	double tz=vbh.GetExtraInfo().t.z;
+  const Vector &t = info.t;
+  //hop by hop VBF measures the pipe from the last forwarder
+  const Vector &o = m_hopByHop ? info.f : info.o;
+  const Vector &myPos = info.myPos;
 
-  Vector o;
-	//double ox, oy, oz;
-
-	if( !m_hopByHop )
-	{
-		//printf("vbf is used\n");
-		o.x=vbh.GetExtraInfo().o.x;
-		o.y=vbh.GetExtraInfo().o.y;
-		o.z=vbh.GetExtraInfo().o.z;
-	}
-	else{
-		//printf("m_hopByHop vbf is used\n");
-		o.x=vbh.GetExtraInfo().f.x;
-		o.y=vbh.GetExtraInfo().f.y;
-		o.z=vbh.GetExtraInfo().f.z;
-	}
-
-  //NOTE below may not work if the nodes are mobile.
-	/*double x=GetNetDevice()->CX();
-	double y=GetNetDevice()->CY();
-	double z=GetNetDevice()->CZ();
-  */
-  Vector myPos = GetNetDevice()->GetPosition();
-
-	double wx=tx-o.x;
-	double wy=ty-o.y;
-	double wz=tz-o.z;
+	double wx=t.x-o.x;
+	double wy=t.y-o.y;
+	double wz=t.z-o.z;
 
 	double vx=myPos.x-o.x;
 	double vy=myPos.y-o.y;
@@ -1074,76 +894,61 @@ AquaSimVBF::Projection(Ptr<Packet> pkt)
 
 	double area=sqrt(cross_product_x*cross_product_x+
 	                 cross_product_y*cross_product_y+cross_product_z*cross_product_z);
-	double length=sqrt((tx-o.x)*(tx-o.x)+(ty-o.y)*(ty-o.y)+ (tz-o.z)*(tz-o.z));
-	// printf("vectorbasedforward: the area is %f and length is %f\n",area,length);
+	double length=sqrt(wx*wx+wy*wy+wz*wz);
   NS_LOG_DEBUG("Projection: area is " << area << " length is " << length);
   if (length==0) return 0;
 	return area/length;
 }
 
 bool
-AquaSimVBF::IsTarget(Ptr<Packet> pkt)
+AquaSimVBF::IsTarget(const vbf_pkt_info &info)
 {
-  VBHeader vbh;
-  AquaSimHeader ash;
-  pkt->RemoveHeader(ash);
-  pkt->PeekHeader(vbh);
-  pkt->AddHeader(ash);
-	if (vbh.GetTargetAddr().GetAsInt()==0) {
-
-		//  printf("vectorbased: advanced is %lf and my range is %f\n",Advance(pkt),vbh.GetRange());
-		return (Advance(pkt)<vbh.GetRange());
+	if (info.targetAddr.GetAsInt()==0) {
+		return (Advance(info)<info.range);
 	}
-	else return(GetNetDevice()->GetAddress()==vbh.GetTargetAddr());
+	else return(GetNetDevice()->GetAddress()==info.targetAddr);
 }
 
 
 bool
-AquaSimVBF::IsCloseEnough(Ptr<Packet> pkt)
+AquaSimVBF::IsCloseEnough(const vbf_pkt_info &info)
 {
-  //VBHeader vbh;
-  //AquaSimHeader ash;
-  //pkt->RemoveHeader(ash);
-  //pkt->PeekHeader(vbh);
-  //pkt->AddHeader(ash);
-
-  //double range=vbh.GetRange();  //unused
-	//double range=m_width;
-
-	//  printf("underwatersensor: The m_width is %f\n",range);
-	//double ox=vbh.GetExtraInfo().o.x;  //unused
-	//double oy=vbh.GetExtraInfo().o.y;  //unused
-	//double oz=vbh.GetExtraInfo().o.z;  //unused
-
-	/*
-  double tx=vbh.GetExtraInfo().t.x;
-	double ty=vbh.GetExtraInfo().t.y;
-	double tz=vbh.GetExtraInfo().t.z;
-
-	double fx=vbh.GetExtraInfo().f.x;
-	double fy=vbh.GetExtraInfo().f.y;
-	double fz=vbh.GetExtraInfo().f.z;
-  */  //currently unused...
-
-	//double x=GetNetDevice()->CX();  //unused  //change later
-	//double y=GetNetDevice()->CY();  //unused
-	//double z=GetNetDevice()->CZ();  //unused
-
-	//double d=sqrt((tx-fx)*(tx-fx)+(ty-fy)*(ty-fy)+(tz-fz)*(tz-fz));  //unused
-	//double l=sqrt((tx-ox)*(tx-ox)+(ty-oy)*(ty-oy)+ (tz-oz)*(tz-oz));
-	//double l=Advance(pkt);  //unused
-	// if (l<range)
-	// {
-	// printf("vectorbasedforward: IsClose?too close! it should be target!\n");
-	// return true;
-	// }
-	// else {
-	//double c=d/l;
 	double c=1;
 	// if ((d<=range)&&((z-oz)<0.01))  return true;
-	if ((Projection(pkt)<=(c*m_width)))  return true;
+	if ((Projection(info)<=(c*Width())))  return true;
 	return false;
+}
+
+double
+AquaSimVBF::Width()
+{
+  if (!m_adaptiveWidth)
+    return m_width;
+  if (m_curWidth < 0)
+    m_curWidth = std::min(std::max(m_width, m_minWidth), m_maxWidth);
+  return m_curWidth;
+}
+
+/*
+ * Count the copies of a packet heard within the density window and steer the
+ * width towards m_targetDensity. The number of forwarders grows with the pipe
+ * cross section, i.e. with the square of the width, hence the square root.
+ */
+void
+AquaSimVBF::SampleDensity(AquaSimAddress senderAddr, uint32_t pkNum)
+{
+  vbf_neighborhood *hashPtr = PktTable.GetHash(senderAddr, pkNum);
+  if (hashPtr == NULL)
+    return;
+
+  double copies = hashPtr->number;
+  m_density = (m_density == 0) ? copies : 0.875*m_density + 0.125*copies;
 
+  double width = Width();
+  double desired = width * sqrt(m_targetDensity / std::max(m_density, 1.0));
+  m_curWidth = std::min(std::max(0.875*width + 0.125*desired, m_minWidth), m_maxWidth);
+  NS_LOG_DEBUG("SampleDensity: copies=" << copies << " density=" << m_density <<
+               " width=" << m_curWidth);
 }
 
 void AquaSimVBF::DoDispose()
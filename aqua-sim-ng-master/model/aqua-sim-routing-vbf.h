@@ -25,7 +25,9 @@
 #include "aqua-sim-address.h"
 #include "aqua-sim-datastructure.h"
 #include "aqua-sim-channel.h"
+#include "aqua-sim-dup-table.h"
 #include "ns3/vector.h"
+#include "ns3/nstime.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/packet.h"
 
@@ -40,28 +42,42 @@ struct vbf_neighborhood{
   Vector neighbor[MAX_NEIGHBOR];
 };
 
-typedef std::pair<AquaSimAddress, unsigned int> hash_entry;
+/*
+ * VBHeader fields used by the forwarding decisions, decoded once per
+ * received packet together with this node's position at that time.
+ */
+struct vbf_pkt_info{
+  uint8_t messType;
+  uint32_t pkNum;
+  AquaSimAddress senderAddr;
+  AquaSimAddress targetAddr;
+  double range;
+  Vector o;   //original source
+  Vector t;   //target
+  Vector f;   //last forwarder
+  Vector myPos;
+};
 
 /**
  * \ingroup aqua-sim-ng
  *
  * \brief Packet Hash table for VBF to assist in specialized tables.
+ *
+ * Neighbourhood records are stored inline in an AquaSimDupTable, the last
+ * WINDOW_SIZE packets of every source are remembered.
  */
 class AquaSimPktHashTable {
 public:
-  std::map<hash_entry,vbf_neighborhood*> m_htable;
-  //std::map<hash_t, hash_entry> m_htable;
-
   AquaSimPktHashTable();
   ~AquaSimPktHashTable();
 
-  int  m_windowSize;
   void Reset();
   void PutInHash(AquaSimAddress sAddr, unsigned int pkNum);
   void PutInHash(AquaSimAddress sAddr, unsigned int pkNum, Vector p);
   vbf_neighborhood* GetHash(AquaSimAddress senderAddr, unsigned int pkt_num);
-//private:
-//int lower_counter;
+  bool IsDuplicate(AquaSimAddress senderAddr, unsigned int pkt_num);
+private:
+  AquaSimDupTable<vbf_neighborhood> m_htable;
 };  // class AquaSimPktHashTable
 
 /**
@@ -111,23 +127,32 @@ protected:
 
   double m_width;
   // the width is used to test if the node is close enough to the path specified by the packet
+  bool m_adaptiveWidth;
+  double m_minWidth;
+  double m_maxWidth;
+  double m_targetDensity;   //forwarders per hop we aim to overhear
+  Time m_densityWindow;
+  double m_density;         //smoothed number of copies heard per packet
+  double m_curWidth;        //pipe width used when m_adaptiveWidth is set
   Vector m_targetPos;
   Ptr<UniformRandomVariable> m_rand;
 
   void Terminate();
   void Reset();
-  void ConsiderNew(Ptr<Packet> pkt);
-  void SetDelayTimer(Ptr<Packet>,double);
-  void Timeout(Ptr<Packet>);
-  double Advance(Ptr<Packet> );
-  double Distance(Ptr<Packet> );
-  double Projection(Ptr<Packet>);
-  double CalculateDelay(Ptr<Packet>, Vector*);
+  void ConsiderNew(Ptr<Packet> pkt, vbf_pkt_info &info);
+  void SetDelayTimer(Ptr<Packet>, const vbf_pkt_info &info, double);
+  void Timeout(Ptr<Packet>, vbf_pkt_info info);
+  double Advance(const vbf_pkt_info &info);
+  double Distance(const vbf_pkt_info &info);
+  double Projection(const vbf_pkt_info &info);
+  double CalculateDelay(const vbf_pkt_info &info, const Vector &p1);
   //double RecoveryDelay(Ptr<Packet>, Vector*);
   void CalculatePosition(Ptr<Packet>);
   void SetMeasureTimer(Ptr<Packet>,double);
-  bool IsTarget(Ptr<Packet>);
-  bool IsCloseEnough(Ptr<Packet>);
+  bool IsTarget(const vbf_pkt_info &info);
+  bool IsCloseEnough(const vbf_pkt_info &info);
+  double Width();
+  void SampleDensity(AquaSimAddress senderAddr, uint32_t pkNum);
 
 
   Ptr<Packet> CreatePacket();
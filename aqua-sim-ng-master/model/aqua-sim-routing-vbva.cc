@@ -36,91 +36,30 @@ NS_LOG_COMPONENT_DEFINE("AquaSimVBVA");
 
 AquaSimVBVAPktHashTable::~AquaSimVBVAPktHashTable()
 {
-  for (std::map<hash_entry,neighborhood*>::iterator it=m_htable.begin(); it!=m_htable.end(); ++it)
-    delete it->second;
-  m_htable.clear();
 }
 
 void AquaSimVBVAPktHashTable::Reset()
 {
-  m_htable.clear();
-  /*
-  neighborhood *hashPtr;
-  Tcl_HashEntry *entryPtr;
-  Tcl_HashSearch searchPtr;
-
-  entryPtr = Tcl_FirstHashEntry(&htable, &searchPtr);
-  while (entryPtr != NULL) {
-    hashPtr = (neighborhood *)Tcl_GetHashValue(entryPtr);
-     delete hashPtr;
-    Tcl_DeleteHashEntry(entryPtr);
-    entryPtr = Tcl_NextHashEntry(&searchPtr);
-  }
-  */
+  m_htable.Reset();
 }
 
 
 neighborhood*
 AquaSimVBVAPktHashTable::GetHash(AquaSimAddress senderAddr,unsigned int pk_num)
 {
-  hash_entry entry = std::make_pair (senderAddr,pk_num);
-  std::map<hash_entry,neighborhood*>::iterator it;
-
-  it = m_htable.find(entry);
-
-  if (it == m_htable.end())
-    return NULL;
-
-  return it->second;
-  /*
-  unsigned int key[3];
-
-  key[0] = sender_id.addr_;
-  key[1] = sender_id.port_;
-  key[2] = pk_num;
-
-  Tcl_HashEntry *entryPtr = Tcl_FindHashEntry(&htable, (char *)key);
-
-  if (entryPtr == NULL )
-     return NULL;
-
-  return (neighborhood *)Tcl_GetHashValue(entryPtr);
-  */
+  return m_htable.Get(senderAddr, pk_num);
 }
 
 
 void AquaSimVBVAPktHashTable::DeleteHash(VBHeader * vbh)
 {
-	//Tcl_HashEntry *entryPtr;
-	//neighborhood* hashPtr;
-
-  hash_entry entry = std::make_pair (vbh->GetSenderAddr(),vbh->GetPkNum());
-  std::map<hash_entry,neighborhood*>::iterator it;
-
-	//entryPtr=Tcl_FindHashEntry(&m_htable, (char *)key);
-  if(m_htable.count(entry)>0)
-	{
-    it = m_htable.find(entry);
-    m_htable.erase(it);
-	}
-	return;
+  m_htable.Erase(vbh->GetSenderAddr(), vbh->GetPkNum());
 }
 
 
 void AquaSimVBVAPktHashTable::DeleteHash(AquaSimAddress source, unsigned int pkt_num)
 {
-	//Tcl_HashEntry *entryPtr;
-	//neighborhood* hashPtr;
-  hash_entry entry = std::make_pair (source,pkt_num);
-  std::map<hash_entry,neighborhood*>::iterator it;
-
-	//entryPtr=Tcl_FindHashEntry(&m_htable, (char *)key);
-  if(m_htable.count(entry)>0)
-	{
-    it = m_htable.find(entry);
-    m_htable.erase(it);
-	}
-	return;
+  m_htable.Erase(source, pkt_num);
 }
 
 void AquaSimVBVAPktHashTable::MarkNextHopStatus(AquaSimAddress senderAddr,
@@ -128,250 +67,72 @@ void AquaSimVBVAPktHashTable::MarkNextHopStatus(AquaSimAddress senderAddr,
                                              unsigned int forwarder_id,
                                              unsigned int status)
 {
-	//Tcl_HashEntry *entryPtr;
-
-	neighborhood* hashPtr = new neighborhood();
-	//unsigned int key[3];
-	//int newPtr;
-	// unsigned int forwarder_id=forwarder_id;
-
-  hash_entry entry = std::make_pair (senderAddr,pk_num);
-
-	//entryPtr = Tcl_CreateHashEntry(&m_htable, (char *)key, &newPtr);
-  if(m_htable.count(entry)>0)
-  {
-		hashPtr=GetHash(senderAddr,pk_num);
-		int m=hashPtr->number;
-
-		for (int i=0; i<m; i++) {
-			if ((hashPtr->neighbor[i].forwarder_id==forwarder_id)&&
-			    (hashPtr->neighbor[i].status==FRESHED))
-				hashPtr->neighbor[i].status=status;
-		}
+	neighborhood* hashPtr = GetHash(senderAddr,pk_num);
+	if (hashPtr == NULL) {
+		NS_LOG_WARN("hashtable, the packet record doesn't exist");
+		return;
 	}
-	else
-    NS_LOG_WARN("hashtable, the packet record doesn't exist");
 
-	return;
+	int m=hashPtr->number;
+	for (int i=0; i<m; i++) {
+		if ((hashPtr->neighbor[i].forwarder_id==forwarder_id)&&
+		    (hashPtr->neighbor[i].status==FRESHED))
+			hashPtr->neighbor[i].status=status;
+	}
 }
 
 
+/*
+ * Update the entry of forwarder_id, or append one. A full list drops its
+ * oldest entry.
+ */
 void
-AquaSimVBVAPktHashTable::PutInHash(VBHeader * vbh)
+AquaSimVBVAPktHashTable::SetNeighbor(neighborhood *hashPtr, unsigned int forwarder_id,
+                                     Vector3D sp, Vector3D tp, Vector3D fp, unsigned int status)
 {
-	//Tcl_HashEntry *entryPtr;
-	neighborhood* hashPtr = new neighborhood();
-  AquaSimAddress addr;
-  unsigned int addrAsInt;
-  unsigned int pkNum;
-	//unsigned int key[3];
-	bool newPtr = true;
-
-  addr=vbh->GetForwardAddr();
-  addrAsInt=addr.GetAsInt();
-  pkNum=vbh->GetPkNum();
-  hash_entry entry = std::make_pair (addr,pkNum);
-  std::map<hash_entry,neighborhood*>::iterator it;
-	//key[0]=(vbh->sender_id).addr_;
-	//key[1]=(vbh->sender_id).port_;
-	//key[2]=vbh->pk_num;
-
-	int k=pkNum-m_windowSize;
-	if(k>0)
-	{
-		for (int i=0; i<k; i++)
-		{
-			pkNum=i;
-      if(m_htable.count(entry)>0)
-      {
-        it = m_htable.find(entry);
-        hashPtr = it->second;
-        newPtr = false;
-        m_htable.erase(it);
-      }
-		}
+	int m=hashPtr->number;
+	int k=0;
+	while((k<m)&&(hashPtr->neighbor[k].forwarder_id!=forwarder_id)) k++;
+
+	if (k==MAX_NEIGHBOR) {
+		for(int i=1; i<MAX_NEIGHBOR; i++)
+			hashPtr->neighbor[i-1]=hashPtr->neighbor[i];
+		k=MAX_NEIGHBOR-1;
+		status=FRESHED;
 	}
-
-  pkNum=vbh->GetPkNum();
-	//entryPtr = Tcl_CreateHashEntry(&htable, (char *)key, &newPtr);
-	if (!newPtr) {// the record already exist
-    //hashPtr=GetHash(vbh->GetSenderAddr(),vbh->GetPkNum());
-		int m=hashPtr->number;
-
-		int k=0;
-		while((hashPtr->neighbor[k].forwarder_id!=addrAsInt)&&(k<m)) k++;
-
-		if(k==m) hashPtr->number++;
-		if (k<MAX_NEIGHBOR) {
-			hashPtr->neighbor[k].vec.start.x=0;
-			hashPtr->neighbor[k].vec.start.y=0;
-			hashPtr->neighbor[k].vec.start.z=0;
-
-			hashPtr->neighbor[k].vec.end.x=0;
-			hashPtr->neighbor[k].vec.end.y=0;
-			hashPtr->neighbor[k].vec.end.z=0;
-
-			hashPtr->neighbor[k].node.x=0;
-			hashPtr->neighbor[k].node.y=0;
-			hashPtr->neighbor[k].node.z=0;
-
-			hashPtr->neighbor[k].forwarder_id=addrAsInt;
-			hashPtr->neighbor[k].status=FRESHED;
-		}
-		else {
-			for(int i=1; i<MAX_NEIGHBOR; i++)
-			{
-				hashPtr->neighbor[i-1].vec=hashPtr->neighbor[i].vec;
-				hashPtr->neighbor[i-1].node=hashPtr->neighbor[i].node;
-
-				hashPtr->neighbor[i-1].forwarder_id=hashPtr->neighbor[i].forwarder_id;
-				hashPtr->neighbor[i-1].status= hashPtr->neighbor[i].status;
-			}
-
-			hashPtr->neighbor[MAX_NEIGHBOR-1].vec.start.x=0;
-			hashPtr->neighbor[MAX_NEIGHBOR-1].vec.start.y=0;
-			hashPtr->neighbor[MAX_NEIGHBOR-1].vec.start.z=0;
-
-			hashPtr->neighbor[MAX_NEIGHBOR-1].vec.end.x=0;
-			hashPtr->neighbor[MAX_NEIGHBOR-1].vec.end.y=0;
-			hashPtr->neighbor[MAX_NEIGHBOR-1].vec.end.z=0;
-
-			hashPtr->neighbor[MAX_NEIGHBOR-1].node.x=0;
-			hashPtr->neighbor[MAX_NEIGHBOR-1].node.y=0;
-			hashPtr->neighbor[MAX_NEIGHBOR-1].node.z=0;
-
-
-			hashPtr->neighbor[MAX_NEIGHBOR-1].forwarder_id=addrAsInt;
-			hashPtr->neighbor[MAX_NEIGHBOR-1].status=FRESHED;
-		}
-		return;
+	else if (k==m) {
+		hashPtr->number++;
 	}
 
-	// the record does not exist
-
-	hashPtr=new neighborhood;
-	hashPtr->number=1;
-
-
-	hashPtr->neighbor[0].vec.start.x=0;
-	hashPtr->neighbor[0].vec.start.y=0;
-	hashPtr->neighbor[0].vec.start.z=0;
-
-	hashPtr->neighbor[0].vec.end.x=0;
-	hashPtr->neighbor[0].vec.end.y=0;
-	hashPtr->neighbor[0].vec.end.z=0;
-
-	hashPtr->neighbor[0].node.x=0;
-	hashPtr->neighbor[0].node.y=0;
-	hashPtr->neighbor[0].node.z=0;
+	hashPtr->neighbor[k].vec.start=sp;
+	hashPtr->neighbor[k].vec.end=tp;
+	hashPtr->neighbor[k].node=fp;
+	hashPtr->neighbor[k].forwarder_id=forwarder_id;
+	hashPtr->neighbor[k].status=status;
+}
 
-	hashPtr->neighbor[0].forwarder_id=addrAsInt;
-	hashPtr->neighbor[0].status=FRESHED;
 
-  m_htable.insert(std::pair<hash_entry,neighborhood*>(entry,hashPtr));
-  //Tcl_SetHashValue(entryPtr, hashPtr);
+void
+AquaSimVBVAPktHashTable::PutInHash(VBHeader * vbh)
+{
+	Vector3D zero;
+	zero.x=0; zero.y=0; zero.z=0;
+	PutInHash(vbh, &zero, &zero, &zero, FRESHED);
 }
 
 
 void AquaSimVBVAPktHashTable::PutInHash(VBHeader * vbh, Vector3D* sp, Vector3D* tp, Vector3D* fp, unsigned int status)
 {
-	//Tcl_HashEntry *entryPtr;
-	neighborhood* hashPtr = new neighborhood();
-	//unsigned int key[3];
-  unsigned int pkNum;
-  AquaSimAddress addr;
-  unsigned int addrAsInt;
-	int newPtr;
-
-  addr=vbh->GetForwardAddr();
-  addrAsInt=addr.GetAsInt();
-  pkNum=vbh->GetPkNum();
-  hash_entry entry = std::make_pair (addr,pkNum);
-  std::map<hash_entry,neighborhood*>::iterator it;
-	//key[0]=vbh->sender_id.addr_;
-	//key[1]=vbh->sender_id.port_;
-	//key[2]=vbh->pk_num;
-
-	int k=pkNum-m_windowSize;
-	if(k>0)
-	{
-		for (int i=0; i<k; i++) {
-      pkNum=i;
-      if(m_htable.count(entry)>0)
-      {
-        it = m_htable.find(entry);
-        hashPtr = it->second;
-        newPtr = false;
-        m_htable.erase(it);
-      }
-		}
-	}
-
-  pkNum=vbh->GetPkNum();
-	//entryPtr = Tcl_CreateHashEntry(&htable, (char *)key, &newPtr);
-	if (!newPtr)// record already exists
-	{
-    //hashPtr=GetHash(vbh->GetSenderAddr(),vbh->GetPkNum());
-		int m=hashPtr->number;
-
-		int k=0;
-		while((hashPtr->neighbor[k].forwarder_id!=addrAsInt)&&(k<m)) k++;
-		if(k==m) hashPtr->number++;
-
-
-		// printf("hash_table: this is not old item, there are %d item inside\n",m);
-		if (k<MAX_NEIGHBOR) {
-			hashPtr->neighbor[k].vec.start.x=sp->x;
-			hashPtr->neighbor[k].vec.start.y=sp->y;
-			hashPtr->neighbor[k].vec.start.z=sp->z;
-
-			hashPtr->neighbor[k].vec.end.x=tp->x;
-			hashPtr->neighbor[k].vec.end.y=tp->y;
-			hashPtr->neighbor[k].vec.end.z=tp->z;
-
-			hashPtr->neighbor[k].node.x=fp->x;
-			hashPtr->neighbor[k].node.y=fp->y;
-			hashPtr->neighbor[k].node.z=fp->z;
-
-
-			hashPtr->neighbor[k].forwarder_id=addrAsInt;
-			hashPtr->neighbor[k].status=status;
-		}
-		else {
-			for(int i=1; i<MAX_NEIGHBOR; i++)
-			{
-				hashPtr->neighbor[i-1].vec=hashPtr->neighbor[i].vec;
-				hashPtr->neighbor[i-1].node=hashPtr->neighbor[i].node;
-
-				hashPtr->neighbor[i-1].forwarder_id=hashPtr->neighbor[i].forwarder_id;
-				hashPtr->neighbor[i-1].status= hashPtr->neighbor[i].status;
-			}
-
-			hashPtr->neighbor[MAX_NEIGHBOR-1].vec.start=(*sp);
-			hashPtr->neighbor[MAX_NEIGHBOR-1].vec.end=(*tp);
-			hashPtr->neighbor[MAX_NEIGHBOR-1].node=(*fp);
-
-			hashPtr->neighbor[MAX_NEIGHBOR-1].forwarder_id=addrAsInt;
-			hashPtr->neighbor[MAX_NEIGHBOR-1].status=FRESHED;
-		}
-
+	bool isNew;
+	neighborhood* hashPtr = m_htable.Insert(vbh->GetSenderAddr(), vbh->GetPkNum(), isNew);
+	if (hashPtr == NULL) {
+		//already behind the window of this source
 		return;
 	}
-	// record does not exist
-	hashPtr=new neighborhood;
-	hashPtr->number=1;
-
-	hashPtr->neighbor[0].vec.start=(*sp);
-	hashPtr->neighbor[0].vec.end=(*tp);
-	hashPtr->neighbor[0].node=(*fp);
+	if (isNew)
+		hashPtr->number=0;
 
-
-	hashPtr->neighbor[0].forwarder_id=addrAsInt;
-	hashPtr->neighbor[0].status=status;
-
-  m_htable.insert(std::pair<hash_entry,neighborhood*>(entry,hashPtr));
-	//Tcl_SetHashValue(entryPtr, hashPtr);
-	return;
+	SetNeighbor(hashPtr, vbh->GetForwardAddr().GetAsInt(), *sp, *tp, *fp, status);
 }
 
 AquaSimVBVADataHashTable::~AquaSimVBVADataHashTable()
@@ -512,7 +273,7 @@ bool AquaSimVBVA::Recv(Ptr<Packet> packet, const Address &dest, uint16_t protoco
     ash.SetErrorFlag(false);
     ash.SetUId(packet->GetUid());
     vbh.SetMessType(AS_DATA);
-    vbh.SetPkNum(packet->GetUid());
+    vbh.SetPkNum(m_pkCount++);
     vbh.SetTargetAddr(AquaSimAddress::ConvertFrom(dest));
     vbh.SetSenderAddr(myAddr);
     vbh.SetForwardAddr(myAddr);
@@ -997,7 +758,6 @@ void AquaSimVBVA::ConsiderNew(Ptr<Packet> pkt)
 
 // printf("Vectorbasedvoidavoidance(%d,%d):it is target-discovery  packet(%d)! it target id is %d  coordinate is %f,%f,%f and range is %f\n",here_.addr_,here_.port_,vbh->pk_num,vbh->target_id.addr_,vbh->info.tx, vbh->info.ty,vbh->info.tz,vbh->range);
   if (GetNetDevice()->GetAddress()==vbh.GetTargetAddr()) {
-			m_pkCount = 0;
 			// AquaSimAddress *hashPtr= PktTable.GetHash(vbh->sender_id, vbh->pk_num);
 			// Received this packet before ?
 			// if (hashPtr == NULL) {
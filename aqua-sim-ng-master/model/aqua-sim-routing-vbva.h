@@ -29,6 +29,8 @@
 #include "ns3/random-variable-stream.h"
 #include "ns3/packet.h"
 
+#include "aqua-sim-dup-table.h"
+
 #include <math.h>
 #include <map>
 
@@ -56,18 +58,16 @@ class VBHeader;
  * \ingroup aqua-sim-ng
  *
  * \brief Packet Hash table for VBVA to assist in specialized tables.
+ *
+ * Keyed by (source, packet number); records are stored inline in an
+ * AquaSimDupTable holding the last WINDOW_SIZE packets of every source.
  */
 class AquaSimVBVAPktHashTable {
 public:
-  std::map<hash_entry,neighborhood*> m_htable;
-
   AquaSimVBVAPktHashTable() {
-    m_windowSize=WINDOW_SIZE;
-    //Tcl_InitHashTable(&htable, 3);
   }
   ~AquaSimVBVAPktHashTable();
 
-  int  m_windowSize;
   void Reset();
   void DeleteHash(VBHeader*); //delete the enrty that has the same key as the new packet
   void DeleteHash(AquaSimAddress, unsigned);
@@ -77,6 +77,11 @@ public:
   void PutInHash(VBHeader *);
   void PutInHash(VBHeader *, Vector3D *, Vector3D*, Vector3D*, unsigned int=FRESHED);
   neighborhood* GetHash(AquaSimAddress senderAddr, unsigned int pkt_num);
+private:
+  void SetNeighbor(neighborhood *hashPtr, unsigned int forwarder_id, Vector3D sp,
+                   Vector3D tp, Vector3D fp, unsigned int status);
+
+  AquaSimDupTable<neighborhood> m_htable;
 };  // class AquaSimVBVAPktHashTable
 
 /**
@@ -230,6 +230,22 @@ AquaSimRouting::AmISrc(const Ptr<Packet> p)
   return (asHeader.GetSAddr()==AquaSimAddress::ConvertFrom(m_device->GetAddress())) && (asHeader.GetNumForwards() == 0);
 }
 
+/**
+  * check if packet p comes from the upper layer. The net device hands
+  * packets down marked DOWN, the channel marks every copy it delivers UP.
+  *
+  * @param p		a packet
+  * @return		true for yes, false for no
+  * */
+bool
+AquaSimRouting::FromUpperLayer(const Ptr<Packet> p)
+{
+  NS_LOG_FUNCTION(this);
+  AquaSimHeader asHeader;
+  p->PeekHeader(asHeader);
+  return asHeader.GetDirection() == AquaSimHeader::DOWN;
+}
+
 /**
   * check if this node is the destination of packet p, i.e. p is destined to this node
   *
@@ -83,6 +83,9 @@ protected:
   /*check if this node is the source node,
           * i.e., whose app layer generates this packet.*/
   virtual bool AmISrc(const Ptr<Packet> p);
+  /*check if p was handed down by the net device, i.e. carries the device's
+          * AquaSimHeader only and has not been on the channel yet.*/
+  virtual bool FromUpperLayer(const Ptr<Packet> p);
   virtual void SendPacket(Ptr<Packet> p);
 
   virtual Ptr<AquaSimNetDevice> GetNetDevice();
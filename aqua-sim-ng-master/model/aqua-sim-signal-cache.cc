@@ -137,13 +137,12 @@ AquaSimSignalCache::AddNewPacket(Ptr<Packet> p){
   * as noise to other packets only.
   */
   // TODO is packet collision even really tested or dealt with in this class???
-  AquaSimHeader asHeader;
-  p->PeekHeader(asHeader);
+  bool error = AquaSimHeader::PeekErrorFlag(p);
 
   Ptr<IncomingPacket> inPkt = CreateObject<IncomingPacket>(p,
-		  asHeader.GetErrorFlag() ? AquaSimPacketStamp::INVALID : AquaSimPacketStamp::RECEPTION);
+		  error ? AquaSimPacketStamp::INVALID : AquaSimPacketStamp::RECEPTION);
 
-  NS_LOG_DEBUG("AddNewPacket:" << p << " w/ Error flag:" << asHeader.GetErrorFlag() << " and incomingpkt:" << inPkt);
+  NS_LOG_DEBUG("AddNewPacket:" << p << " w/ Error flag:" << error << " and incomingpkt:" << inPkt);
 
 
   m_pktSubTimer->AddNewSubmission(inPkt);
@@ -23,11 +23,18 @@
 
 #include "ns3/log.h"
 #include "ns3/integer.h"
+#include "ns3/boolean.h"
+#include "ns3/double.h"
 #include "ns3/nstime.h"
 #include "ns3/packet.h"
 #include "ns3/simulator.h"
+#include "ns3/node-list.h"
+#include "ns3/mobility-model.h"
 #include "aqua-sim-header.h"
 #include "aqua-sim-header-mac.h"
+#include "aqua-sim-phy.h"
+
+#include <cmath>
 
 using namespace ns3;
 
@@ -35,8 +42,11 @@ NS_LOG_COMPONENT_DEFINE("AquaSimSync");
 NS_OBJECT_ENSURE_REGISTERED(AquaSimSync);
 
 AquaSimSync::AquaSimSync() :
-m_clockSkew(Seconds(0)),
-m_beaconRecvCount(0)
+m_reference(false),
+m_skew(0), m_offset(Seconds(0)),
+m_soundSpeed(1500),
+m_synced(false), m_estSkew(0), m_estOffset(Seconds(0)),
+m_residual(0), m_skewError(0), m_lastSync(Seconds(0))
 {
 }
 
@@ -62,18 +72,146 @@ AquaSimSync::GetTypeId(void)
     TimeValue (Hours(5)),
     MakeTimeAccessor (&AquaSimSync::m_clockSkewInterval),
     MakeTimeChecker ())
+  .AddAttribute ("Reference", "Node keeps the reference time and sends beacons.",
+    BooleanValue (false),
+    MakeBooleanAccessor (&AquaSimSync::m_reference),
+    MakeBooleanChecker ())
+  .AddAttribute ("Skew", "Drift of the local clock (ppm).",
+    DoubleValue (0),
+    MakeDoubleAccessor (&AquaSimSync::m_skew),
+    MakeDoubleChecker<double> ())
+  .AddAttribute ("Offset", "Local clock reading at simulation start.",
+    TimeValue (Seconds(0)),
+    MakeTimeAccessor (&AquaSimSync::m_offset),
+    MakeTimeChecker ())
+  .AddAttribute ("SoundSpeed", "Speed of sound used to remove propagation delay (m/s).",
+    DoubleValue (1500),
+    MakeDoubleAccessor (&AquaSimSync::m_soundSpeed),
+    MakeDoubleChecker<double> (0))
   ;
   return tid;
 }
 
+void
+AquaSimSync::Start()
+{
+  Simulator::Cancel(m_startEvent);
+  if (!m_reference)
+    return;
+  SendBeacons();
+  Simulator::Schedule(Seconds(m_beaconSendInterval.GetSeconds() * m_numBeacons), &AquaSimSync::SendSync, this);
+}
+
+Time
+AquaSimSync::GetLocalTime()
+{
+  double t = Simulator::Now().GetSeconds();
+  return Seconds(t * (1 + m_skew * 1e-6)) + m_offset;
+}
+
+Time
+AquaSimSync::LocalToGlobal(Time local)
+{
+  if (m_reference)
+    return local;
+  return Seconds((local - m_estOffset).GetSeconds() / (1 + m_estSkew));
+}
+
+Time
+AquaSimSync::GlobalToLocal(Time global)
+{
+  if (m_reference)
+    return global;
+  return m_estOffset + Seconds(global.GetSeconds() * (1 + m_estSkew));
+}
+
+Time
+AquaSimSync::GetSyncedTime()
+{
+  return LocalToGlobal(GetLocalTime());
+}
+
+double
+AquaSimSync::GetEstimatedSkew()
+{
+  return m_estSkew;
+}
+
+Time
+AquaSimSync::GetEstimatedOffset()
+{
+  return m_estOffset;
+}
+
+Time
+AquaSimSync::GetGuardTime(Time horizon)
+{
+  if (m_reference)
+    return Seconds(0);
+  if (!m_synced)
+    return Time::Max();
+  double elapsed = (Simulator::Now() - m_lastSync + horizon).GetSeconds();
+  return Seconds(3 * (m_residual + m_skewError * elapsed));
+}
+
+/*
+ * One way delay of a packet from src, from the node positions. Peers are
+ * looked up once.
+ */
+Time
+AquaSimSync::PropagationDelay(AquaSimAddress src)
+{
+  Ptr<MobilityModel> local = m_device->GetNode()->GetObject<MobilityModel>();
+  std::map<uint16_t, Ptr<MobilityModel> >::iterator it = m_peers.find(src.GetAsInt());
+  if (it == m_peers.end())
+    {
+      Ptr<MobilityModel> peer = 0;
+      for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End() && peer == 0; ++n)
+        for (uint32_t i = 0; i < (*n)->GetNDevices(); i++)
+          {
+            Ptr<AquaSimNetDevice> dev = DynamicCast<AquaSimNetDevice>((*n)->GetDevice(i));
+            if (dev != 0 && AquaSimAddress::ConvertFrom(dev->GetAddress()) == src)
+              {
+                peer = (*n)->GetObject<MobilityModel>();
+                break;
+              }
+          }
+      it = m_peers.insert(std::make_pair(src.GetAsInt(), peer)).first;
+    }
+  if (local == 0 || it->second == 0 || m_soundSpeed <= 0)
+    return Seconds(0);
+  return Seconds(local->GetDistanceFrom(it->second) / m_soundSpeed);
+}
+
+/*
+ * Time the sender spent putting size bytes on air. The header's TxTime is
+ * reused by the channel and signal cache, so ask our own PHY instead.
+ */
+Time
+AquaSimSync::TransmissionDelay(uint32_t size)
+{
+  Ptr<AquaSimPhy> phy = m_device->GetPhy();
+  if (phy == 0)
+    return Seconds(0);
+  return phy->CalcTxTime(size);
+}
+
+/*
+ * Periodic sync: keep the skew, move the offset onto the new sample.
+ */
 void
 AquaSimSync::RecvSync(Ptr<Packet> p)
 {
   NS_LOG_FUNCTION(this << p);
+  if (m_reference)
+    return;
   AquaSimHeader ash;
   p->PeekHeader(ash);
 
-  m_localClock = ash.GetTimeStamp() + m_clockSkew;
+  double ref = (ash.GetTimeStamp() + TransmissionDelay(ash.GetSize()) + PropagationDelay(ash.GetSAddr())).GetSeconds();
+  m_estOffset = GetLocalTime() - Seconds(ref * (1 + m_estSkew));
+  m_lastSync = Simulator::Now();
+  m_synced = true;
   //NOTE can and SHOULD be overloaded
 }
 
@@ -81,20 +219,71 @@ void
 AquaSimSync::RecvSyncBeacon(Ptr<Packet> p)
 {
   NS_LOG_FUNCTION(this << p);
+  if (m_reference)
+    return;
   AquaSimHeader ash;
   p->PeekHeader(ash);
 
-  m_beaconRecvCount++;
-  m_beaconClockSkew += Simulator::Now() - ash.GetTimeStamp();
+  double ref = (ash.GetTimeStamp() + TransmissionDelay(ash.GetSize()) + PropagationDelay(ash.GetSAddr())).GetSeconds();
+  m_beacons.push_back(std::make_pair(ref, GetLocalTime().GetSeconds()));
 
-  if (m_beaconRecvCount >= m_numBeacons){
-    m_clockSkew = m_beaconClockSkew / m_beaconRecvCount;
-    m_beaconRecvCount = 0;
-    m_beaconClockSkew = Seconds(0);
+  if (m_beacons.size() >= (unsigned)m_numBeacons){
+    EstimateClock();
   }
   //NOTE can and SHOULD be overloaded
 }
 
+/*
+ * Least squares fit of local = offset + (1 + skew) * reference over the
+ * collected beacons, centred on the first sample for precision.
+ */
+void
+AquaSimSync::EstimateClock()
+{
+  uint32_t n = m_beacons.size();
+  if (n == 0)
+    return;
+  double x0 = m_beacons[0].first;
+  double y0 = m_beacons[0].second;
+  double mx = 0, my = 0;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      mx += m_beacons[i].first - x0;
+      my += m_beacons[i].second - y0;
+    }
+  mx /= n;
+  my /= n;
+
+  double sxx = 0, sxy = 0;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      double dx = m_beacons[i].first - x0 - mx;
+      double dy = m_beacons[i].second - y0 - my;
+      sxx += dx * dx;
+      sxy += dx * dy;
+    }
+  double slope = (sxx > 0) ? sxy / sxx : 1 + m_estSkew;
+  double intercept = (y0 + my) - slope * (x0 + mx);
+
+  double sse = 0;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      double r = m_beacons[i].second - intercept - slope * m_beacons[i].first;
+      sse += r * r;
+    }
+  m_residual = (n > 2) ? std::sqrt(sse / (n - 2)) : 0;
+  m_skewError = (sxx > 0) ? m_residual / std::sqrt(sxx) : 0;
+
+  m_estSkew = slope - 1;
+  m_estOffset = Seconds(intercept);
+  m_lastSync = Simulator::Now();
+  m_synced = true;
+  m_beacons.clear();
+
+  NS_LOG_DEBUG("Clock estimate: skew " << m_estSkew * 1e6 << "ppm (true " << m_skew <<
+               ") offset " << m_estOffset << " (true " << m_offset << ") residual " << m_residual << "s");
+}
+
 void
 AquaSimSync::SendBeacons()
 {
@@ -129,6 +318,8 @@ void
 AquaSimSync::SetDevice(Ptr<AquaSimNetDevice> device)
 {
   m_device = device;
+  Simulator::Cancel(m_startEvent);
+  m_startEvent = Simulator::ScheduleNow(&AquaSimSync::Start, this);
 }
 
 Ptr<Packet>
@@ -144,7 +335,7 @@ AquaSimSync::CreateSyncPacket(bool isBeacon)
   ash.SetDAddr(AquaSimAddress::GetBroadcast());
   ash.SetErrorFlag(false);
   ash.SetUId(p->GetUid());
-  ash.SetTimeStamp(Simulator::Now());
+  ash.SetTimeStamp(GetSyncedTime());	//restamped by the PHY on air
 
   if(isBeacon){
     mach.SetDemuxPType(MacHeader::UWPTYPE_SYNC_BEACON);
@@ -161,5 +352,7 @@ AquaSimSync::CreateSyncPacket(bool isBeacon)
 void AquaSimSync::DoDispose()
 {
   NS_LOG_FUNCTION(this);
+  Simulator::Cancel(m_startEvent);
   m_device=0;
+  m_peers.clear();
 }
@@ -23,50 +23,96 @@
 
 #include "ns3/object.h"
 #include "ns3/nstime.h"
+#include "ns3/event-id.h"
 #include "aqua-sim-net-device.h"
 
+#include <map>
+#include <vector>
+
 namespace ns3 {
 
 class Packet;
+class MobilityModel;
 
 /**
  * \ingroup aqua-sim-ng
  *
  * \brief Syncronization class for underwater.
  *
- * Currently is strictly applying synchronization techniques without simulating the need for them (i.e. no internal clocks
- *  are handled since we rely on the simulator clock).
+ * Every node runs a drifting clock, local = t * (1 + Skew) + Offset with t
+ * the simulator (reference) time. Reference nodes send a burst of beacons
+ * and then periodic sync packets, time stamped by the PHY as they go on
+ * air. Receivers correct each stamp for transmission time and acoustic
+ * propagation delay, fit local against reference time by linear regression
+ * over the beacons (skew and offset, as in TSHL) and refresh the offset
+ * from every sync packet.
+ *
+ * Syed, A. A. and Heidemann, J., "Time Synchronization for High Latency
+ *  Acoustic Networks," in Proc. IEEE INFOCOM 2006.
  */
 class AquaSimSync : public Object {
 public:
   AquaSimSync();
   static TypeId GetTypeId(void);
   void SetDevice(Ptr<AquaSimNetDevice>);
+  /*
+   * Reference nodes start beaconing. SetDevice schedules it for the start
+   * of the simulation, call it directly only to start at another time.
+   */
+  void Start();
 
   //Should be overloaded for protocol needs
   virtual void RecvSync(Ptr<Packet>);
   virtual void RecvSyncBeacon(Ptr<Packet>);
 
+  Time GetLocalTime();	// reading of the local clock now
+  Time LocalToGlobal(Time local);	// using the current estimate
+  Time GlobalToLocal(Time global);
+  Time GetSyncedTime();	// best estimate of reference time now
+  double GetEstimatedSkew();
+  Time GetEstimatedOffset();
+  /*
+   * Margin covering the sync error horizon after now, for schedule based
+   * MACs. Time::Max() while not synchronized.
+   */
+  Time GetGuardTime(Time horizon);
+
 protected:
   void SendBeacons();
   virtual void SendSync();
   void SyncSend(bool isBeacon);
 
   Ptr<Packet> CreateSyncPacket(bool isBeacon);
+  Time PropagationDelay(AquaSimAddress src);
+  Time TransmissionDelay(uint32_t size);
+  void EstimateClock();
   void DoDispose();
 
   int m_numBeacons;
-  Time m_clockSkew;  //local clock skew
-  Time m_localClock;  //currently not implemented.
+  bool m_reference;
+
+  //local clock
+  double m_skew;	//ppm
+  Time m_offset;
 
   Time m_beaconSendInterval;
   Time m_periodicSyncInterval;
   Time m_clockSkewInterval;   // re-estimation of clock skew
+  double m_soundSpeed;
   Ptr<AquaSimNetDevice> m_device;
+  EventId m_startEvent;
+
+  //estimate, local = m_estOffset + (1 + m_estSkew) * reference
+  bool m_synced;
+  double m_estSkew;
+  Time m_estOffset;
+  double m_residual;	//s, std deviation of the last fit
+  double m_skewError;	//standard error of the fitted skew
+  Time m_lastSync;
 
-  //clockskew values:
-  int m_beaconRecvCount;
-  Time m_beaconClockSkew;
+  //clockskew values: (reference, local) in seconds
+  std::vector<std::pair<double, double> > m_beacons;
+  std::map<uint16_t, Ptr<MobilityModel> > m_peers;
 
 }; //class AquaSimSync
 
@@ -21,19 +21,24 @@
 #include "aqua-sim-trace-reader.h"
 #include "ns3/simulator.h"
 #include "ns3/log.h"
-#include <fstream>
+
+#include <algorithm>
+#include <cstring>
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE ("AquaSimTraceReader");
 NS_OBJECT_ENSURE_REGISTERED (AquaSimTraceReader);
 
-AquaSimTraceReader::AquaSimTraceReader()
+AquaSimTraceReader::AquaSimTraceReader() :
+  m_binary(false), m_window(Hours(1)), m_bufferSize(4096), m_background(true),
+  m_hasPending(false), m_eof(true), m_stop(false)
 {
 }
 
 AquaSimTraceReader::~AquaSimTraceReader()
 {
+  Stop();
   m_channel=0;
 }
 
@@ -54,19 +59,35 @@ AquaSimTraceReader::ReadFile (const std::string& fileName)
     return false;
   }
 
-  std::ifstream reader;
-  reader.open(fileName.c_str());
-  if(!reader) {
+  Stop();
+  m_reader.open(fileName.c_str(), std::ios::in | std::ios::binary);
+  if(!m_reader) {
     NS_LOG_DEBUG("Trace file(" << fileName << ") does exist.");
     return false;
   }
 
-  TraceEntry entry;
-  entry.Reset();
-  while (reader >> entry.time >> entry.temp >> entry.salinity >> entry.noise) {
-    ScheduleComponents(entry);
-    entry.Reset();
+  uint32_t hdr[2] = {0, 0};
+  m_reader.read((char*)hdr, sizeof(hdr));
+  m_binary = (m_reader.gcount() == sizeof(hdr) && hdr[0] == TR_FILE_MAGIC);
+  if (m_binary && hdr[1] != TR_FILE_VERSION) {
+    NS_LOG_DEBUG("Trace file(" << fileName << ") has unknown version " << hdr[1]);
+    m_reader.close();
+    return false;
+  }
+  if (!m_binary) {
+    m_reader.clear();
+    m_reader.seekg(0);
+  }
+
+  m_eof = false;
+  m_stop = false;
+  m_hasPending = false;
+  m_buffer.clear();
+  if (m_background) {
+    m_parser = Create<SystemThread> (MakeCallback (&AquaSimTraceReader::Parse, this));
+    m_parser->Start();
   }
+  Refill();
   return true;
 }
 
@@ -76,6 +97,52 @@ AquaSimTraceReader::SetChannel(Ptr<AquaSimChannel> channel)
   m_channel = channel;
 }
 
+void
+AquaSimTraceReader::SetWindow(Time window)
+{
+  NS_ASSERT(window.IsStrictlyPositive());
+  m_window = window;
+}
+
+void
+AquaSimTraceReader::SetBufferSize(uint32_t entries)
+{
+  m_bufferSize = std::max(entries, (uint32_t)1);
+}
+
+/* only takes effect on the next ReadFile */
+void
+AquaSimTraceReader::SetBackground(bool background)
+{
+  m_background = background;
+}
+
+bool
+AquaSimTraceReader::Compile(const std::string& textFile, const std::string& binFile)
+{
+  std::ifstream reader(textFile.c_str());
+  if (!reader)
+    return false;
+  std::ofstream writer(binFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!writer)
+    return false;
+
+  uint32_t hdr[2] = {TR_FILE_MAGIC, TR_FILE_VERSION};
+  writer.write((const char*)hdr, sizeof(hdr));
+  TraceEntry entry;
+  entry.Reset();
+  while (reader >> entry.time >> entry.temp >> entry.salinity >> entry.noise) {
+    char rec[TR_RECORD_LEN];
+    float v[3] = {(float)entry.temp, (float)entry.salinity, (float)entry.noise};
+    memcpy(rec, &entry.time, sizeof(double));
+    memcpy(rec + sizeof(double), v, sizeof(v));
+    writer.write(rec, TR_RECORD_LEN);
+    entry.Reset();
+  }
+  writer.close();
+  return !writer.fail();
+}
+
 void
 AquaSimTraceReader::Initialize()
 {
@@ -84,10 +151,136 @@ AquaSimTraceReader::Initialize()
   m_channel->m_noiseGen->Initialize();
 }
 
+/*
+ * Schedule every entry up to one window ahead, then come back half a
+ * window before the first entry left out.
+ */
+void
+AquaSimTraceReader::Refill()
+{
+  Time horizon = Simulator::Now() + m_window;
+  while (m_hasPending || NextEntry(m_pending)) {
+    m_hasPending = true;
+    if (Seconds(m_pending.time) > horizon) {
+      m_refill = Simulator::Schedule(Seconds(m_pending.time) - Simulator::Now() - m_window / 2,
+                                     &AquaSimTraceReader::Refill, this);
+      return;
+    }
+    ScheduleComponents(m_pending);
+    m_hasPending = false;
+  }
+  NS_LOG_DEBUG("Trace fully scheduled.");
+}
+
+/* next entry in file order, waiting for the parser if it is behind */
+bool
+AquaSimTraceReader::NextEntry(TraceEntry &entry)
+{
+  if (!m_background) {
+    if (m_eof)
+      return false;
+    m_eof = !ReadEntry(entry);
+    return !m_eof;
+  }
+
+  while (true) {
+    {
+      CriticalSection cs(m_mutex);
+      if (!m_buffer.empty()) {
+        entry = m_buffer.front();
+        m_buffer.pop_front();
+        break;
+      }
+      if (m_eof)
+        return false;
+      m_notEmpty.SetCondition(false);  //set again by the parser once it adds an entry
+    }
+    m_notEmpty.TimedWait(1000000);
+  }
+  m_notFull.SetCondition(true);
+  m_notFull.Signal();
+  return true;
+}
+
+bool
+AquaSimTraceReader::ReadEntry(TraceEntry &entry)
+{
+  entry.Reset();
+  if (!m_binary)
+    return (bool)(m_reader >> entry.time >> entry.temp >> entry.salinity >> entry.noise);
+
+  char rec[TR_RECORD_LEN];
+  if (!m_reader.read(rec, TR_RECORD_LEN))
+    return false;
+  float v[3];
+  memcpy(&entry.time, rec, sizeof(double));
+  memcpy(v, rec + sizeof(double), sizeof(v));
+  entry.temp = v[0];
+  entry.salinity = v[1];
+  entry.noise = v[2];
+  return true;
+}
+
+/*
+ * Parser thread: keeps the buffer topped up. Never touches the simulator.
+ */
+void
+AquaSimTraceReader::Parse()
+{
+  TraceEntry entry;
+  while (ReadEntry(entry)) {
+    while (true) {
+      {
+        CriticalSection cs(m_mutex);
+        if (m_stop)
+          return;
+        if (m_buffer.size() < m_bufferSize) {
+          m_buffer.push_back(entry);
+          break;
+        }
+        m_notFull.SetCondition(false);  //set again by NextEntry/Stop
+      }
+      m_notFull.TimedWait(1000000);
+    }
+    m_notEmpty.SetCondition(true);
+    m_notEmpty.Signal();
+  }
+  {
+    CriticalSection cs(m_mutex);
+    m_eof = true;
+  }
+  m_notEmpty.SetCondition(true);
+  m_notEmpty.Signal();
+}
+
+void
+AquaSimTraceReader::Stop()
+{
+  Simulator::Cancel(m_refill);
+  if (m_parser) {
+    {
+      CriticalSection cs(m_mutex);
+      m_stop = true;
+    }
+    m_notFull.SetCondition(true);
+    m_notFull.Signal();
+    m_parser->Join();
+    m_parser = 0;
+  }
+  if (m_reader.is_open())
+    m_reader.close();
+  m_buffer.clear();
+  m_hasPending = false;
+  m_eof = true;
+}
+
 void
 AquaSimTraceReader::ScheduleComponents(TraceEntry entry)
 {
-  Simulator::Schedule(Seconds(entry.time), &AquaSimTraceReader::SetComponents, this, entry);
+  Time delay = Seconds(entry.time) - Simulator::Now();
+  if (delay.IsNegative())
+    delay = Seconds(0);
+  Simulator::Schedule(delay, &AquaSimTraceReader::SetComponents, this, entry);
 }
 
 void
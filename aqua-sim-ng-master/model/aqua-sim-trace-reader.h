@@ -22,7 +22,20 @@
 #define AQUA_SIM_TRACE_READER_H
 
 #include "aqua-sim-channel.h"
+
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/system-thread.h"
+#include "ns3/system-mutex.h"
+#include "ns3/system-condition.h"
+
 #include <string>
+#include <fstream>
+#include <deque>
+
+#define TR_FILE_MAGIC 0x52545341	// "ASTR"
+#define TR_FILE_VERSION 1
+#define TR_RECORD_LEN (sizeof(double)+3*sizeof(float))
 
 namespace ns3 {
 
@@ -44,7 +57,12 @@ struct TraceEntry {
  *      -Line layout: <Timestamp Temperature Salinity Noise>
  *      -Note: Delimiter is a space ' '
  *      -Expected metrics: <Seconds Celsius PPT dB>, respectivitly
+ *    or a binary trace written by Compile(): a magic/version header followed
+ *    by one record (double time, float temperature, salinity, noise) per entry.
  *
+ *    Entries must be in time order. The file is streamed: only entries within
+ *    the lookahead window are scheduled, the rest wait in a bounded buffer
+ *    that a background thread keeps parsing ahead.
  */
 class AquaSimTraceReader
 {
@@ -54,15 +72,43 @@ public:
   static TypeId GetTypeId (void);
   bool ReadFile (const std::string& fileName);
   void SetChannel(Ptr<AquaSimChannel> channel);
+  void SetWindow(Time window);
+  void SetBufferSize(uint32_t entries);
+  void SetBackground(bool background);
+
+  static bool Compile(const std::string& textFile, const std::string& binFile);
 
 protected:
   void Initialize();
   void ScheduleComponents(TraceEntry entry);
   void SetComponents(TraceEntry entry);
+  void Refill();
+  bool NextEntry(TraceEntry &entry);
+  bool ReadEntry(TraceEntry &entry);
+  void Parse();
+  void Stop();
 
 private:
   Ptr<AquaSimChannel> m_channel;
 
+  std::ifstream m_reader;
+  bool m_binary;
+  Time m_window;
+  uint32_t m_bufferSize;
+  bool m_background;
+  EventId m_refill;
+  TraceEntry m_pending;   // first entry past the window
+  bool m_hasPending;
+
+  // shared with the parser thread
+  std::deque<TraceEntry> m_buffer;
+  bool m_eof;
+  bool m_stop;
+  SystemMutex m_mutex;
+  SystemCondition m_notEmpty;
+  SystemCondition m_notFull;
+  Ptr<SystemThread> m_parser;
+
 };  //class AquaSimTraceReader
 
 } // namespace ns3
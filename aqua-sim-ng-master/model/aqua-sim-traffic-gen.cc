@@ -28,6 +28,13 @@
 #include "ns3/packet.h"
 #include "ns3/address.h"
 #include "ns3/log.h"
+#include "ns3/enum.h"
+#include "ns3/string.h"
+#include "ns3/random-variable-stream.h"
+
+#include <cstdio>
+#include <cmath>
+#include <limits>
 
 namespace ns3 {
 
@@ -40,6 +47,14 @@ AquaSimTrafficGen::GetTypeId()
   static TypeId tid = TypeId("ns3::AquaSimTrafficGen")
     .SetParent<Application>()
     .AddConstructor<AquaSimTrafficGen>()
+    .AddAttribute ("Arrival", "Arrival process of the packets.",
+                    EnumValue (FIXED),
+                    MakeEnumAccessor (&AquaSimTrafficGen::m_arrival),
+                    MakeEnumChecker (FIXED, "Fixed",
+                                     POISSON, "Poisson",
+                                     MMPP, "Mmpp",
+                                     ONOFF, "OnOff",
+                                     TRACE, "Trace"))
     .AddAttribute ("Delay", "The delay interval between sending packets (seconds)",
                     DoubleValue (10),
                     MakeDoubleAccessor (&AquaSimTrafficGen::m_delayInt),
@@ -48,6 +63,43 @@ AquaSimTrafficGen::GetTypeId()
                     UintegerValue (300),
                     MakeUintegerAccessor (&AquaSimTrafficGen::m_pktSize),
                     MakeUintegerChecker<uint32_t>())
+    .AddAttribute ("Rate", "Packets per second (Poisson, MMPP normal state, on periods).",
+                    DoubleValue (0.1),
+                    MakeDoubleAccessor (&AquaSimTrafficGen::m_rate),
+                    MakeDoubleChecker<double>(0))
+    .AddAttribute ("BurstRate", "Packets per second in the MMPP burst state.",
+                    DoubleValue (1),
+                    MakeDoubleAccessor (&AquaSimTrafficGen::m_burstRate),
+                    MakeDoubleChecker<double>(0))
+    .AddAttribute ("MeanNormal", "Mean time spent in the MMPP normal state (seconds).",
+                    DoubleValue (100),
+                    MakeDoubleAccessor (&AquaSimTrafficGen::m_meanNormal),
+                    MakeDoubleChecker<double>(1e-3))
+    .AddAttribute ("MeanBurst", "Mean time spent in the MMPP burst state (seconds).",
+                    DoubleValue (10),
+                    MakeDoubleAccessor (&AquaSimTrafficGen::m_meanBurst),
+                    MakeDoubleChecker<double>(1e-3))
+    .AddAttribute ("MeanOn", "Mean length of an on period (seconds).",
+                    DoubleValue (10),
+                    MakeDoubleAccessor (&AquaSimTrafficGen::m_meanOn),
+                    MakeDoubleChecker<double>(1e-3))
+    .AddAttribute ("MeanOff", "Mean length of an off period (seconds).",
+                    DoubleValue (90),
+                    MakeDoubleAccessor (&AquaSimTrafficGen::m_meanOff),
+                    MakeDoubleChecker<double>(1e-3))
+    .AddAttribute ("Shape", "Pareto shape of on/off periods, above 1, heavy tailed below 2.",
+                    DoubleValue (1.5),
+                    MakeDoubleAccessor (&AquaSimTrafficGen::m_shape),
+                    MakeDoubleChecker<double>(1.01))
+    .AddAttribute ("BatchSize", "Arrivals drawn at once into the arrival ring.",
+                    UintegerValue (1024),
+                    MakeUintegerAccessor (&AquaSimTrafficGen::m_batchSize),
+                    MakeUintegerChecker<uint32_t>(1))
+    .AddAttribute ("TraceFile", "Arrivals to replay, \"time [size]\" per line, time relative to the start.",
+                    StringValue (""),
+                    MakeStringAccessor (&AquaSimTrafficGen::SetTraceFile,
+                                        &AquaSimTrafficGen::GetTraceFile),
+                    MakeStringChecker ())
     .AddAttribute ("Protocol", "The type of protocol to use.",
                     TypeIdValue (UdpSocketFactory::GetTypeId ()),
                     MakeTypeIdAccessor (&AquaSimTrafficGen::m_tid),
@@ -61,9 +113,13 @@ AquaSimTrafficGen::GetTypeId()
 }
 
 AquaSimTrafficGen::AquaSimTrafficGen ()
- : m_socket(0)
+ : m_arrival(FIXED), m_batchSize(1024), m_ringHead(0), m_ringCount(0),
+   m_start(0), m_last(0), m_traceIdx(0), m_burst(false), m_on(false),
+   m_stateEnd(0), m_sent(0), m_socket(0)
 {
   NS_LOG_FUNCTION(this);
+  m_uniform = CreateObject<UniformRandomVariable> ();
+  m_exp = CreateObject<ExponentialRandomVariable> ();
 }
 AquaSimTrafficGen::~AquaSimTrafficGen()
 {
@@ -82,9 +138,51 @@ AquaSimTrafficGen::SetSize (uint32_t size)
 }
 
 void
-AquaSimTrafficGen::DoDipsose()
+AquaSimTrafficGen::SetTraceFile (std::string filename)
+{
+  m_traceFile = filename;
+  m_trace.clear();
+  if (filename.empty())
+    return;
+
+  FILE* stream = fopen(filename.c_str(), "r");
+  if (stream == NULL)
+    NS_FATAL_ERROR("Cannot read traffic trace " << filename);
+  char line[256];
+  while (fgets(line, sizeof(line), stream) != NULL)
+    {
+      Arrival a;
+      unsigned size = 0;
+      int n = sscanf(line, "%lf %u", &a.time, &size);
+      if (n < 1)
+        continue;
+      a.size = size;
+      m_trace.push_back(a);
+    }
+  fclose(stream);
+  NS_LOG_INFO("Traffic trace " << filename << ": " << m_trace.size() << " arrivals");
+}
+
+std::string
+AquaSimTrafficGen::GetTraceFile () const
+{
+  return m_traceFile;
+}
+
+int64_t
+AquaSimTrafficGen::AssignStreams (int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  m_uniform->SetStream(stream);
+  m_exp->SetStream(stream + 1);
+  return 2;
+}
+
+void
+AquaSimTrafficGen::DoDispose()
 {
   NS_LOG_FUNCTION(this);
+  CancelEvents();
   m_socket=0;
   Application::DoDispose();
 }
@@ -113,13 +211,24 @@ AquaSimTrafficGen::StartApplication()
     m_socket->ShutdownRecv ();
   }
   CancelEvents();
-  m_sendEvent = Simulator::Schedule(Seconds(m_delayInt),&AquaSimTrafficGen::DoGenerate, this);
+
+  m_start = m_last = Simulator::Now().GetSeconds();
+  m_ring.resize(m_batchSize);
+  m_ringHead = m_ringCount = 0;
+  m_traceIdx = 0;
+  m_burst = false;
+  m_on = false;
+  m_stateEnd = m_start;
+  if (m_arrival == MMPP)
+    m_stateEnd += m_exp->GetValue(m_meanNormal, 0);
+  m_sendEvent = Simulator::ScheduleNow(&AquaSimTrafficGen::DoGenerate, this);
 }
 
 void
 AquaSimTrafficGen::StopApplication()
 {
   NS_LOG_FUNCTION(this);
+  CancelEvents();
   if (m_socket != 0) {
     m_socket->Close();
   }
@@ -128,19 +237,132 @@ AquaSimTrafficGen::StopApplication()
   }
 }
 
+/*
+ * Pareto variate of the given mean, shape > 1.
+ */
+double
+AquaSimTrafficGen::Pareto(double mean, double shape)
+{
+  double scale = mean * (shape - 1) / shape;
+  return scale / std::pow(1 - m_uniform->GetValue(0, 1), 1 / shape);
+}
+
+/*
+ * Next arrival after m_last, infinite if there is none.
+ */
+double
+AquaSimTrafficGen::NextArrival()
+{
+  double inf = std::numeric_limits<double>::infinity();
+  switch (m_arrival) {
+    case POISSON:
+      return (m_rate > 0) ? m_last + m_exp->GetValue(1 / m_rate, 0) : inf;
+    case MMPP:
+      {
+        if (m_rate <= 0 && m_burstRate <= 0)
+          return inf;
+        //exponential gaps are memoryless, redraw after a state switch
+        double t = m_last;
+        while (true)
+          {
+            double rate = m_burst ? m_burstRate : m_rate;
+            double next = (rate > 0) ? t + m_exp->GetValue(1 / rate, 0) : inf;
+            if (next <= m_stateEnd)
+              return next;
+            t = m_stateEnd;
+            m_burst = !m_burst;
+            m_stateEnd = t + m_exp->GetValue(m_burst ? m_meanBurst : m_meanNormal, 0);
+          }
+      }
+    case ONOFF:
+      {
+        if (m_rate <= 0)
+          return inf;
+        double next = m_last + 1 / m_rate;
+        while (!m_on || next > m_stateEnd)
+          {
+            if (m_on)
+              m_stateEnd += Pareto(m_meanOff, m_shape);
+            else
+              {
+                next = m_stateEnd;
+                m_stateEnd += Pareto(m_meanOn, m_shape);
+              }
+            m_on = !m_on;
+          }
+        return next;
+      }
+    default:
+      return (m_delayInt > 0) ? m_last + m_delayInt : inf;
+  }
+}
+
+/*
+ * Draw the next batch of arrivals into the ring.
+ */
+void
+AquaSimTrafficGen::Refill()
+{
+  m_ringHead = m_ringCount = 0;
+  while (m_ringCount < m_ring.size())
+    {
+      Arrival a;
+      if (m_arrival == TRACE)
+        {
+          if (m_traceIdx >= m_trace.size())
+            break;
+          a = m_trace[m_traceIdx++];
+          a.time += m_start;
+          if (a.size == 0)
+            a.size = m_pktSize;
+        }
+      else
+        {
+          a.time = NextArrival();
+          a.size = m_pktSize;
+          if (a.time == std::numeric_limits<double>::infinity())
+            break;
+        }
+      m_last = a.time;
+      m_ring[m_ringCount++] = a;
+    }
+  NS_LOG_DEBUG("Refilled " << m_ringCount << " arrivals up to " << m_last);
+}
+
+/*
+ * Send everything due now, then sleep until the next arrival.
+ */
 void
 AquaSimTrafficGen::DoGenerate()
 {
   NS_LOG_FUNCTION(this);
-  m_sendEvent = Simulator::Schedule(Seconds(m_delayInt),&AquaSimTrafficGen::DoGenerate,this);
-  SendPacket();
+  double now = Simulator::Now().GetSeconds();
+  while (true)
+    {
+      if (m_ringCount == 0)
+        {
+          Refill();
+          if (m_ringCount == 0)
+            return;
+        }
+      const Arrival &a = m_ring[m_ringHead];
+      if (a.time > now + 1e-9)
+        {
+          m_sendEvent = Simulator::Schedule(Seconds(a.time - now), &AquaSimTrafficGen::DoGenerate, this);
+          return;
+        }
+      SendPacket(a.size);
+      m_ringHead++;
+      m_ringCount--;
+    }
 }
 
 void
-AquaSimTrafficGen::SendPacket()
+AquaSimTrafficGen::SendPacket(uint32_t size)
 {
-  Ptr<Packet> packet = Create<Packet> (m_pktSize);
-  m_socket->Send(packet);
+  //copies of one packet would share its uid, routing tells duplicates by it
+  m_socket->Send(Create<Packet> (size));
+  m_sent++;
 }
 
 void
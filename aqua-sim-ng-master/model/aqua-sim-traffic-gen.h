@@ -27,35 +27,93 @@
 #include "ns3/ptr.h"
 #include "ns3/socket.h"
 
+#include <string>
+#include <vector>
+
 namespace ns3 {
 
+class UniformRandomVariable;
+class ExponentialRandomVariable;
+
   /**
    * \ingroup aqua-sim-ng
    *
    * \brief Specialized traffic generator for underwater simulation.
    *
+   * Arrivals are fixed interval (Delay), Poisson, two state MMPP, on/off
+   * with Pareto (heavy tailed) on and off periods, or replayed from a
+   * trace. Arrival times are drawn BatchSize at a time into a ring that is
+   * allocated once, and every arrival due at the same instant is sent by
+   * one event. Every packet is created fresh, so it gets its own uid;
+   * payloads are zero filled and stored as a virtual zero area.
+   *
    * TODO: this should be expanded to better incorporate application layer packet integration
    */
 
 class AquaSimTrafficGen : public Application
 {
 public:
+  enum ArrivalProcess {
+    FIXED,
+    POISSON,
+    MMPP,
+    ONOFF,
+    TRACE
+  };
+
   static TypeId GetTypeId();
   AquaSimTrafficGen ();
   ~AquaSimTrafficGen ();
   void SetDelay (double delay);
   void SetSize (uint32_t size);
+  void SetTraceFile (std::string filename);
+  std::string GetTraceFile () const;
+  uint64_t GetSent () const { return m_sent; }
+  int64_t AssignStreams (int64_t stream);
 protected:
-  virtual void DoDipsose();
+  virtual void DoDispose();
 private:
+  struct Arrival {
+    double time;	// absolute, seconds
+    uint32_t size;
+  };
+
   virtual void StartApplication();
   virtual void StopApplication();
   void DoGenerate();
   void CancelEvents();
-  void SendPacket();
+  void SendPacket(uint32_t size);
+  void Refill();
+  double NextArrival();
+  double Pareto(double mean, double shape);
 
+  ArrivalProcess m_arrival;
   double m_delayInt;
   uint32_t m_pktSize;
+  double m_rate;	// packets/s, Poisson/MMPP normal state/on period
+  double m_burstRate;	// MMPP burst state
+  double m_meanNormal;	// MMPP mean sojourn times
+  double m_meanBurst;
+  double m_meanOn;	// on/off mean period lengths
+  double m_meanOff;
+  double m_shape;	// Pareto shape of on/off periods
+  uint32_t m_batchSize;
+  std::string m_traceFile;
+  std::vector<Arrival> m_trace;
+
+  std::vector<Arrival> m_ring;
+  uint32_t m_ringHead;
+  uint32_t m_ringCount;
+  double m_start;
+  double m_last;	// last arrival put in the ring
+  uint32_t m_traceIdx;
+  bool m_burst;		// MMPP state
+  bool m_on;		// on/off state
+  double m_stateEnd;	// end of the current MMPP/on/off period
+  uint64_t m_sent;
+
+  Ptr<UniformRandomVariable> m_uniform;
+  Ptr<ExponentialRandomVariable> m_exp;
   Ptr<Socket> m_socket;
   Address m_peer;
   EventId m_sendEvent;
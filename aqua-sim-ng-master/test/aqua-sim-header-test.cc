@@ -0,0 +1,135 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 University of Connecticut
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/aqua-sim-header.h"
+#include "ns3/aqua-sim-address.h"
+#include "ns3/packet.h"
+#include "ns3/nstime.h"
+#include "ns3/test.h"
+
+using namespace ns3;
+
+// Serialize/Deserialize round trip of the varint encoded AquaSimHeader
+class AquaSimHeaderRoundTripTestCase : public TestCase
+{
+public:
+  AquaSimHeaderRoundTripTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AquaSimHeaderRoundTripTestCase::AquaSimHeaderRoundTripTestCase ()
+  : TestCase ("AquaSimHeader serialization round trip")
+{
+}
+
+void
+AquaSimHeaderRoundTripTestCase::DoRun (void)
+{
+  // every field but the flags byte needs a multi byte varint
+  AquaSimHeader ash;
+  ash.SetDirection (AquaSimHeader::UP);
+  ash.SetErrorFlag (true);
+  ash.SetSize (60000);			// 3 bytes
+  ash.SetNumForwards (300);		// 2 bytes
+  ash.SetNextHop (AquaSimAddress (200));	// 2 bytes
+  ash.SetSAddr (AquaSimAddress (0x4000));	// 3 bytes
+  ash.SetDAddr (AquaSimAddress (0xffff));	// 3 bytes
+  ash.SetUId (0xffff);			// 3 bytes
+  ash.SetTxTime (MilliSeconds (1500));		// 2 bytes
+  ash.SetTimeStamp (MilliSeconds (20000125));	// 4 bytes, exact in binary seconds
+  NS_TEST_ASSERT_MSG_EQ (ash.GetSerializedSize (), 23u, "Unexpected encoded size");
+
+  Ptr<Packet> p = Create<Packet> (10);
+  p->AddHeader (ash);
+  NS_TEST_ASSERT_MSG_EQ (p->GetSize (), 10 + ash.GetSerializedSize (), "Header size differs from the bytes written");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) AquaSimHeader::PeekDirection (p), (uint32_t) AquaSimHeader::UP, "Peeked direction");
+  NS_TEST_ASSERT_MSG_EQ (AquaSimHeader::PeekErrorFlag (p), true, "Peeked error flag");
+
+  AquaSimHeader out;
+  uint32_t read = p->RemoveHeader (out);
+  NS_TEST_ASSERT_MSG_EQ (read, ash.GetSerializedSize (), "Bytes read differ from bytes written");
+  NS_TEST_ASSERT_MSG_EQ (p->GetSize (), 10u, "Payload left behind");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) out.GetDirection (), (uint32_t) AquaSimHeader::UP, "Direction");
+  NS_TEST_ASSERT_MSG_EQ (out.GetErrorFlag (), true, "Error flag");
+  NS_TEST_ASSERT_MSG_EQ (out.GetSize (), 60000u, "Size");
+  NS_TEST_ASSERT_MSG_EQ (out.GetNumForwards (), 300, "NumForwards");
+  NS_TEST_ASSERT_MSG_EQ (out.GetNextHop ().GetAsInt (), 200, "NextHop");
+  NS_TEST_ASSERT_MSG_EQ (out.GetSAddr ().GetAsInt (), 0x4000, "SAddr");
+  NS_TEST_ASSERT_MSG_EQ (out.GetDAddr ().GetAsInt (), 0xffff, "DAddr");
+  NS_TEST_ASSERT_MSG_EQ (out.GetUId (), 0xffff, "UId");
+  NS_TEST_ASSERT_MSG_EQ (out.GetTxTime (), MilliSeconds (1500), "TxTime");
+  NS_TEST_ASSERT_MSG_EQ (out.GetTimeStamp ().GetMilliSeconds (), 20000125, "TimeStamp");
+}
+
+// In place peek of the flags byte behind other headers and past the end
+class AquaSimHeaderPeekTestCase : public TestCase
+{
+public:
+  AquaSimHeaderPeekTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AquaSimHeaderPeekTestCase::AquaSimHeaderPeekTestCase ()
+  : TestCase ("AquaSimHeader flags peek")
+{
+}
+
+void
+AquaSimHeaderPeekTestCase::DoRun (void)
+{
+  AquaSimHeader inner;
+  inner.SetDirection (AquaSimHeader::UP);
+  inner.SetErrorFlag (false);
+  AquaSimHeader outer;
+  outer.SetDirection (AquaSimHeader::DOWN);
+  outer.SetErrorFlag (true);
+  outer.SetUId (0xffff);
+
+  Ptr<Packet> p = Create<Packet> ();
+  p->AddHeader (inner);
+  p->AddHeader (outer);
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) AquaSimHeader::PeekDirection (p), (uint32_t) AquaSimHeader::DOWN, "Outer direction");
+  NS_TEST_ASSERT_MSG_EQ (AquaSimHeader::PeekErrorFlag (p), true, "Outer error flag");
+  uint32_t offset = outer.GetSerializedSize ();
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) AquaSimHeader::PeekDirection (p, offset), (uint32_t) AquaSimHeader::UP, "Inner direction");
+  NS_TEST_ASSERT_MSG_EQ (AquaSimHeader::PeekErrorFlag (p, offset), false, "Inner error flag");
+
+  // out of range reads no flags instead of overrunning
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) AquaSimHeader::PeekDirection (p, p->GetSize ()), (uint32_t) AquaSimHeader::NONE, "Past the end");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) AquaSimHeader::PeekDirection (Create<Packet> (), 0), (uint32_t) AquaSimHeader::NONE, "Empty packet");
+  NS_TEST_ASSERT_MSG_EQ (AquaSimHeader::PeekErrorFlag (Create<Packet> (200), 100), false, "Offset beyond the peek window");
+}
+
+class AquaSimHeaderTestSuite : public TestSuite
+{
+public:
+  AquaSimHeaderTestSuite ();
+};
+
+AquaSimHeaderTestSuite::AquaSimHeaderTestSuite ()
+  : TestSuite ("aqua-sim-header", UNIT)
+{
+  AddTestCase (new AquaSimHeaderRoundTripTestCase, TestCase::QUICK);
+  AddTestCase (new AquaSimHeaderPeekTestCase, TestCase::QUICK);
+}
+
+static AquaSimHeaderTestSuite aquaSimHeaderTestSuite;